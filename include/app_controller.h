@@ -22,8 +22,6 @@
 #include "ui_screens.h"
 #include <Arduino.h>
 
-#include <vector>
-
 class AppController {
 public:
   static AppController &instance() {
@@ -51,9 +49,9 @@ public:
     storageOk_ = StorageManager::instance().init();
     if (storageOk_) {
       // Load calibration if available
-      CalibrationData cal;
+      CalibrationTable cal;
       if (StorageManager::instance().loadCalibration(cal)) {
-        SensorManager::instance().setCalibration(cal);
+        SensorManager::instance().setCalibrationTable(cal);
         Screens::drawBoot(disp, 0.8f, "Calibration loaded from SD");
       }
     } else {
@@ -61,6 +59,9 @@ public:
       vTaskDelay(pdMS_TO_TICKS(2000));
     }
 
+    // Reference palette is optional; lookups are skipped without it
+    PaletteDb::instance().begin();
+
     Screens::drawBoot(disp, 0.9f, "Initializing input...");
     InputHandler::instance().init();
 
@@ -84,12 +85,28 @@ public:
     while (true) {
       // Process events (blocking with timeout for power efficiency)
       if (EventQueue::receive(evt, 50)) {
+        // Frames that arrive from here on queue the next wake
+        if (evt.type == EventType::SENSOR_DATA_READY &&
+            evt.data == SensorManager::LIVE_TAG)
+          SensorManager::instance().liveWakeHandled();
         processEvent(evt);
+        lastEventMs_ = millis();
       }
 
-      // Push live data to connectivity manager for broadcasting
-      if (currentMeasurement_.valid) {
-        ConnectivityManager::instance().setLiveData(currentMeasurement_);
+      // Reclaim deleted records once idle (queued to the storage
+      // task). Compaction renumbers them, so not while a list of
+      // them is on screen.
+      if (millis() - lastEventMs_ > Config::Storage::COMPACT_IDLE_MS &&
+          !showingSavedRecords() &&
+          StorageManager::instance().needsCompaction()) {
+        StorageManager::instance().compact();
+      }
+
+      // Newest live-preview frame (WebSocket/BLE read the same
+      // SeqLock on their own)
+      if (stateMachine_.current() == AppState::PICK_COLOR &&
+          SensorManager::instance().live().readIfNewer(liveFrame_, liveGen_)) {
+        needsRefresh_ = true;
       }
 
       // Periodic screen refresh for animations
@@ -104,6 +121,18 @@ public:
 private:
   AppController() = default;
 
+  bool showingSavedRecords() const {
+    switch (stateMachine_.current()) {
+    case AppState::SAVED_COLORS_LIST:
+    case AppState::SAVED_COLOR_DETAIL:
+    case AppState::MEASUREMENTS_LIST:
+    case AppState::MEASUREMENT_DETAIL:
+      return true;
+    default:
+      return false;
+    }
+  }
+
   // ── Event Processing ────────────────────────────────────
   void processEvent(const Event &evt) {
     AppState state = stateMachine_.current();
@@ -171,38 +200,69 @@ private:
   // ── Remote Event Handler ──────────────────────────────────
   void handleRemoteEvents(const Event &evt) {
     switch (evt.type) {
-    case EventType::REMOTE_MEASURE: {
-      auto &sensor = SensorManager::instance();
-      SpectralData data;
-      if (sensor.measure(data)) {
-        currentMeasurement_ = data;
-        if (StorageManager::instance().saveColor(data)) {
-          Serial.println("[Remote] Color measured and saved");
+    case EventType::REMOTE_MEASURE:
+      SensorManager::instance().requestMeasurement(TAG_REMOTE_MEASURE);
+      break;
+    case EventType::SENSOR_DATA_READY:
+      if (evt.data == TAG_REMOTE_MEASURE) {
+        SpectralData data;
+        if (SensorManager::instance().getResult(TAG_REMOTE_MEASURE, data)) {
+          currentMeasurement_ = data;
+          remoteSavePending_ = StorageManager::instance().saveColor(data);
         }
       }
-    } break;
+      break;
+    case EventType::COLOR_SAVED:
+      if (remoteSavePending_) {
+        remoteSavePending_ = false;
+        Serial.printf("[Remote] Color measured and saved (#%ld)\n",
+                      (long)evt.data);
+      }
+      break;
+    case EventType::SAVE_ERROR:
+      // Saves are queued, so the screen that made them is gone. A
+      // pick or calibration in flight is abandoned with the screen:
+      // its late result must not act on ERROR_SCREEN.
+      remoteSavePending_ = false;
+      measuring_ = false;
+      calibrating_ = false;
+      stateMachine_.transitionTo(AppState::ERROR_SCREEN);
+      Screens::drawError(DisplayManager::instance(), "Save Error",
+                         "Could not write to SD card.");
+      break;
     case EventType::REMOTE_SET_GAIN: {
       auto &sensor = SensorManager::instance();
       sensor.setGainIndex(evt.data);
     } break;
-    case EventType::REMOTE_CALIBRATE: {
-      auto &sensor = SensorManager::instance();
-      bool ok = false;
-      switch (evt.data) {
-      case 0:
-        ok = sensor.captureDarkReference();
-        break;
-      case 1:
-        ok = sensor.captureGrayReference();
-        break;
-      case 2:
-        ok = sensor.captureWhiteReference();
-        break;
+    case EventType::REMOTE_CALIBRATE:
+      if (SensorManager::instance().requestCalibration(evt.data,
+                                                       TAG_REMOTE_CALIB)) {
+        remoteCalibStep_ = evt.data;
+      }
+      break;
+    case EventType::CALIBRATION_COMPLETE:
+      if (evt.data == TAG_REMOTE_CALIB) {
+        StorageManager::instance().saveCalibration(
+            SensorManager::instance().getCalibrationTable());
+        Serial.printf("[Remote] Calibration step %d complete\n",
+                      remoteCalibStep_);
+        remoteCalibStep_ = -1;
       }
-      if (ok) {
-        StorageManager::instance().saveCalibration(sensor.getCalibration());
-        Serial.printf("[Remote] Calibration step %d complete\n", evt.data);
+      break;
+    case EventType::SENSOR_ERROR:
+      // Local picks and calibration handle their own tags
+      if (evt.data == TAG_REMOTE_CALIB) {
+        Serial.printf("[Remote] Calibration step %d failed\n",
+                      remoteCalibStep_);
+        remoteCalibStep_ = -1;
+      } else if (evt.data == TAG_REMOTE_MEASURE) {
+        Serial.println("[Remote] Measurement failed");
       }
+      break;
+    case EventType::REMOTE_SET_RECON: {
+      auto &sensor = SensorManager::instance();
+      sensor.setReconSet(evt.data);
+      StorageManager::instance().saveCalibration(sensor.getCalibrationTable());
     } break;
     case EventType::REMOTE_SET_ROTATION: {
       auto &disp = DisplayManager::instance();
@@ -211,9 +271,8 @@ private:
     } break;
     case EventType::REMOTE_DELETE_COLOR: {
       StorageManager::instance().deleteColor(evt.data);
-      // Reload if currently viewing colors list
+      // The list cursor re-reads on its own; back to the top
       if (stateMachine_.current() == AppState::SAVED_COLORS_LIST) {
-        StorageManager::instance().loadColors(savedColors_);
         colorListIndex_ = 0;
         colorListScroll_ = 0;
       }
@@ -221,7 +280,6 @@ private:
     case EventType::REMOTE_DELETE_MEASUREMENT: {
       StorageManager::instance().deleteMeasurement(evt.data);
       if (stateMachine_.current() == AppState::MEASUREMENTS_LIST) {
-        StorageManager::instance().loadMeasurements(savedMeasurements_);
         measureListIndex_ = 0;
         measureListScroll_ = 0;
       }
@@ -278,7 +336,6 @@ private:
         stateMachine_.transitionTo(AppState::PICK_COLOR);
         break;
       case 1:
-        StorageManager::instance().loadColors(savedColors_);
         colorListIndex_ = 0;
         colorListScroll_ = 0;
         stateMachine_.transitionTo(AppState::SAVED_COLORS_LIST);
@@ -314,7 +371,6 @@ private:
         stateMachine_.transitionTo(AppState::MEASURE);
         break;
       case 1:
-        StorageManager::instance().loadMeasurements(savedMeasurements_);
         measureListIndex_ = 0;
         measureListScroll_ = 0;
         stateMachine_.transitionTo(AppState::MEASUREMENTS_LIST);
@@ -335,25 +391,63 @@ private:
   // ── Pick Color Handler ──────────────────────────────────
   void handlePickColor(const Event &evt) {
     switch (evt.type) {
+    case EventType::ENCODER_CW:
+    case EventType::ENCODER_CCW:
+      // Toggle live preview illumination: LED ↔ ambient
+      liveLed_ = !liveLed_;
+      liveFrame_.valid = false;
+      liveGen_ = SensorManager::instance().live().generation();
+      SensorManager::instance().startStream(liveLed_);
+      break;
     case EventType::BUTTON_PRESS:
-      if (!measuring_) {
+      // Measurement runs on the sensor task; result arrives as an event
+      if (!measuring_ &&
+          SensorManager::instance().requestMeasurement(TAG_PICK)) {
         measuring_ = true;
         needsRefresh_ = true;
-
-        // Perform measurement
-        bool ok = SensorManager::instance().measure(currentMeasurement_);
+      }
+      break;
+    case EventType::SENSOR_DATA_READY:
+      if (measuring_ && evt.data == TAG_PICK) {
+        SpectralData previous = currentMeasurement_;
         measuring_ = false;
-
-        if (ok) {
+        if (SensorManager::instance().getResult(TAG_PICK,
+                                                currentMeasurement_)) {
+          pickDeltaE_ =
+              previous.valid
+                  ? ColorLab::deltaE2000(
+                        ColorLab::fromFloat(previous.L, previous.a_star,
+                                            previous.b_star),
+                        ColorLab::fromFloat(currentMeasurement_.L,
+                                            currentMeasurement_.a_star,
+                                            currentMeasurement_.b_star)) *
+                        0.01f
+                  : -1.0f;
+          paletteMatched_ = PaletteDb::instance().nearest(
+              ColorLab::fromFloat(currentMeasurement_.L,
+                                  currentMeasurement_.a_star,
+                                  currentMeasurement_.b_star),
+              paletteMatch_);
+          savedMatched_ =
+              StorageManager::instance().colorIndex().nearest(
+                  ColorLab::fromFloat(currentMeasurement_.L,
+                                      currentMeasurement_.a_star,
+                                      currentMeasurement_.b_star),
+                  &savedMatch_, 1) > 0;
           actionIndex_ = 0;
           stateMachine_.transitionTo(AppState::PICK_RESULT);
-        } else {
-          Screens::drawError(DisplayManager::instance(), "Sensor Error",
-                             "Failed to read AS7343. Check connection.");
         }
       }
       break;
+    case EventType::SENSOR_ERROR:
+      if (measuring_ && evt.data == TAG_PICK) {
+        measuring_ = false;
+        Screens::drawError(DisplayManager::instance(), "Sensor Error",
+                           "Failed to read AS7343. Check connection.");
+      }
+      break;
     case EventType::BUTTON_LONG_PRESS:
+      measuring_ = false; // a late result is ignored
       stateMachine_.goBack();
       break;
     default:
@@ -483,33 +577,28 @@ private:
     }
   }
 
+  // Moves the selection one row, wrapping around, and keeps it
+  // within the LIST_ROWS rows shown from `scroll`
+  static void scrollList(int dir, int count, int &index, int &scroll) {
+    if (count == 0)
+      return;
+    index = (index + dir + count) % count;
+    if (index >= scroll + Config::UI::LIST_ROWS)
+      scroll = index - (Config::UI::LIST_ROWS - 1);
+    if (index < scroll)
+      scroll = index;
+  }
+
   // ── Measurements List Handler ──────────────────────────
   void handleMeasurementsList(const Event &evt) {
     switch (evt.type) {
     case EventType::ENCODER_CW:
-      if (!savedMeasurements_.empty()) {
-        measureListIndex_ =
-            (measureListIndex_ + 1) % savedMeasurements_.size();
-        if (measureListIndex_ >= measureListScroll_ + 6)
-          measureListScroll_ = measureListIndex_ - 5;
-        if (measureListIndex_ < measureListScroll_)
-          measureListScroll_ = measureListIndex_;
-      }
-      break;
     case EventType::ENCODER_CCW:
-      if (!savedMeasurements_.empty()) {
-        measureListIndex_ = (measureListIndex_ == 0)
-                                ? savedMeasurements_.size() - 1
-                                : measureListIndex_ - 1;
-        if (measureListIndex_ < measureListScroll_)
-          measureListScroll_ = measureListIndex_;
-        if (measureListIndex_ >= measureListScroll_ + 6)
-          measureListScroll_ = measureListIndex_ - 5;
-      }
+      scrollList(evt.type == EventType::ENCODER_CW ? 1 : -1,
+                 measureCursor_.size(), measureListIndex_, measureListScroll_);
       break;
     case EventType::BUTTON_PRESS:
-      if (!savedMeasurements_.empty()) {
-        selectedMeasurement_ = savedMeasurements_[measureListIndex_];
+      if (measureCursor_.get(measureListIndex_, selectedMeasurement_)) {
         measureDetailActionIndex_ = 0;
         stateMachine_.transitionTo(AppState::MEASUREMENT_DETAIL);
       }
@@ -537,7 +626,6 @@ private:
         // Delete
         StorageManager::instance().deleteMeasurement(
             selectedMeasurement_.index);
-        StorageManager::instance().loadMeasurements(savedMeasurements_);
         measureListIndex_ = 0;
         measureListScroll_ = 0;
         stateMachine_.transitionTo(AppState::MEASUREMENTS_LIST);
@@ -555,32 +643,12 @@ private:
   void handleSavedColorsList(const Event &evt) {
     switch (evt.type) {
     case EventType::ENCODER_CW:
-      if (!savedColors_.empty()) {
-        colorListIndex_ = (colorListIndex_ + 1) % savedColors_.size();
-        // Adjust scroll
-        if (colorListIndex_ >= colorListScroll_ + 6) {
-          colorListScroll_ = colorListIndex_ - 5;
-        }
-        if (colorListIndex_ < colorListScroll_) {
-          colorListScroll_ = colorListIndex_;
-        }
-      }
-      break;
     case EventType::ENCODER_CCW:
-      if (!savedColors_.empty()) {
-        colorListIndex_ = (colorListIndex_ == 0) ? savedColors_.size() - 1
-                                                 : colorListIndex_ - 1;
-        if (colorListIndex_ < colorListScroll_) {
-          colorListScroll_ = colorListIndex_;
-        }
-        if (colorListIndex_ >= colorListScroll_ + 6) {
-          colorListScroll_ = colorListIndex_ - 5;
-        }
-      }
+      scrollList(evt.type == EventType::ENCODER_CW ? 1 : -1,
+                 colorCursor_.size(), colorListIndex_, colorListScroll_);
       break;
     case EventType::BUTTON_PRESS:
-      if (!savedColors_.empty()) {
-        selectedColor_ = savedColors_[colorListIndex_];
+      if (colorCursor_.get(colorListIndex_, selectedColor_)) {
         detailActionIndex_ = 0;
         stateMachine_.transitionTo(AppState::SAVED_COLOR_DETAIL);
       }
@@ -607,7 +675,6 @@ private:
       } else {
         // Delete
         StorageManager::instance().deleteColor(selectedColor_.index);
-        StorageManager::instance().loadColors(savedColors_);
         colorListIndex_ = 0;
         colorListScroll_ = 0;
         stateMachine_.transitionTo(AppState::SAVED_COLORS_LIST);
@@ -643,8 +710,8 @@ private:
         stateMachine_.transitionTo(AppState::CALIB_DARK);
         break;
       case 1:
-        // Cycle sensor gain to next value
-        sensor.setGainIndex(sensor.getGainIndex() + 1);
+        // Cycle sensor gain to next value (… 2048x → Auto → 0.5x …)
+        sensor.setGainIndex(sensor.getGainSetting() + 1);
         needsRefresh_ = true;
         break;
       case 2:
@@ -684,54 +751,50 @@ private:
     switch (evt.type) {
     case EventType::BUTTON_PRESS:
       if (!calibrating_) {
-        calibrating_ = true;
-        needsRefresh_ = true;
+        int step = state == AppState::CALIB_DARK   ? 0
+                   : state == AppState::CALIB_GRAY ? 1
+                                                   : 2;
+        // Capture runs on the sensor task; completion arrives as an event
+        if (SensorManager::instance().requestCalibration(step, TAG_CALIB)) {
+          calibrating_ = true;
+          needsRefresh_ = true;
+        }
+      }
+      break;
+    case EventType::CALIBRATION_COMPLETE:
+      if (calibrating_ && evt.data == TAG_CALIB) {
+        calibrating_ = false;
 
-        auto &sensor = SensorManager::instance();
-        bool ok = false;
+        // Queue the calibration write after each step
+        StorageManager::instance().saveCalibration(
+            SensorManager::instance().getCalibrationTable());
 
+        // Advance to next wizard step
         switch (state) {
         case AppState::CALIB_DARK:
-          ok = sensor.captureDarkReference();
+          stateMachine_.transitionTo(AppState::CALIB_GRAY);
           break;
         case AppState::CALIB_GRAY:
-          ok = sensor.captureGrayReference();
+          stateMachine_.transitionTo(AppState::CALIB_WHITE);
           break;
         case AppState::CALIB_WHITE:
-          ok = sensor.captureWhiteReference();
+          stateMachine_.transitionTo(AppState::CALIB_COMPLETE);
           break;
         default:
           break;
         }
-
+      }
+      break;
+    case EventType::SENSOR_ERROR:
+      if (calibrating_ && evt.data == TAG_CALIB) {
         calibrating_ = false;
-
-        if (ok) {
-          // Save calibration to SD after each step
-          StorageManager::instance().saveCalibration(sensor.getCalibration());
-
-          // Advance to next wizard step
-          switch (state) {
-          case AppState::CALIB_DARK:
-            stateMachine_.transitionTo(AppState::CALIB_GRAY);
-            break;
-          case AppState::CALIB_GRAY:
-            stateMachine_.transitionTo(AppState::CALIB_WHITE);
-            break;
-          case AppState::CALIB_WHITE:
-            stateMachine_.transitionTo(AppState::CALIB_COMPLETE);
-            break;
-          default:
-            break;
-          }
-        } else {
-          Screens::drawError(DisplayManager::instance(), "Calibration Error",
-                             "Failed to capture reference.");
-        }
+        Screens::drawError(DisplayManager::instance(), "Calibration Error",
+                           "Failed to capture reference.");
       }
       break;
     case EventType::BUTTON_LONG_PRESS:
       // Cancel entire wizard
+      calibrating_ = false;
       stateMachine_.transitionTo(AppState::SETTINGS_MENU);
       break;
     default:
@@ -750,6 +813,16 @@ private:
   // ── State Transition Callback ───────────────────────────
   void onStateTransition(AppState oldState, AppState newState) {
     Serial.printf("[State] %d -> %d\n", (int)oldState, (int)newState);
+
+    // Live preview runs only while PICK_COLOR is on screen
+    if (newState == AppState::PICK_COLOR && oldState != AppState::PICK_COLOR) {
+      liveFrame_.valid = false;
+      liveGen_ = SensorManager::instance().live().generation();
+      SensorManager::instance().startStream(liveLed_);
+    } else if (oldState == AppState::PICK_COLOR &&
+               newState != AppState::PICK_COLOR) {
+      SensorManager::instance().stopStream();
+    }
     needsRefresh_ = true;
   }
 
@@ -772,11 +845,17 @@ private:
       break;
 
     case AppState::PICK_COLOR:
-      Screens::drawPickColor(disp, currentMeasurement_, measuring_);
+      Screens::drawPickColor(
+          disp, liveFrame_.valid ? liveFrame_ : currentMeasurement_,
+          measuring_, liveLed_ ? "LIVE LED" : "LIVE AMBIENT");
       break;
 
     case AppState::PICK_RESULT:
-      Screens::drawPickResult(disp, currentMeasurement_, actionIndex_);
+      Screens::drawPickResult(disp, currentMeasurement_, actionIndex_,
+                              pickDeltaE_,
+                              paletteMatched_ ? &paletteMatch_ : nullptr,
+                              savedMatched_ ? &savedMatch_ : nullptr,
+                              StorageManager::instance().unindexedColors());
       break;
 
     case AppState::MEASURE:
@@ -788,19 +867,25 @@ private:
                                  measureActionIndex_);
       break;
 
-    case AppState::SAVED_COLORS_LIST:
-      Screens::drawSavedColorsList(disp, savedColors_, colorListIndex_,
-                                   colorListScroll_);
-      break;
+    case AppState::SAVED_COLORS_LIST: {
+      SavedColor rows[Config::UI::LIST_ROWS];
+      int n =
+          colorCursor_.window(colorListScroll_, rows, Config::UI::LIST_ROWS);
+      Screens::drawSavedColorsList(disp, rows, n, colorCursor_.size(),
+                                   colorListIndex_, colorListScroll_);
+    } break;
 
     case AppState::SAVED_COLOR_DETAIL:
       Screens::drawSavedColorDetail(disp, selectedColor_, detailActionIndex_);
       break;
 
-    case AppState::MEASUREMENTS_LIST:
-      Screens::drawMeasurementsList(disp, savedMeasurements_, measureListIndex_,
-                                    measureListScroll_);
-      break;
+    case AppState::MEASUREMENTS_LIST: {
+      SavedMeasurement rows[Config::UI::LIST_ROWS];
+      int n = measureCursor_.window(measureListScroll_, rows,
+                                    Config::UI::LIST_ROWS);
+      Screens::drawMeasurementsList(disp, rows, n, measureCursor_.size(),
+                                    measureListIndex_, measureListScroll_);
+    } break;
 
     case AppState::MEASUREMENT_DETAIL:
       Screens::drawMeasurementDetail(disp, selectedMeasurement_,
@@ -864,12 +949,30 @@ private:
   int menuIndex_ = 0;
   int actionIndex_ = 0;
 
+  // Sensor request tags (echoed back in the completion event data)
+  enum SensorTag : int32_t {
+    TAG_PICK = 1,
+    TAG_REMOTE_MEASURE,
+    TAG_CALIB,
+    TAG_REMOTE_CALIB,
+  };
+  int remoteCalibStep_ = -1; // in progress, -1 = none
+  bool remoteSavePending_ = false; // logged on its COLOR_SAVED
+
   // Measurement state
   SpectralData currentMeasurement_;
+  SpectralData liveFrame_ = {}; // newest PICK_COLOR stream frame
+  uint32_t liveGen_ = 0;        // SeqLock generation of liveFrame_
+  bool liveLed_ = true;         // stream with LED (false = ambient)
+  float pickDeltaE_ = -1.0f; // ΔE2000 to the previous pick
+  PaletteDb::Match paletteMatch_ = {}; // closest reference color
+  bool paletteMatched_ = false;
+  ColorIndex::Hit savedMatch_ = {}; // closest saved color
+  bool savedMatched_ = false;
   bool measuring_ = false;
 
   // Saved colors state
-  std::vector<SavedColor> savedColors_;
+  ColorCursor colorCursor_; // list window, paged from the color log
   int colorListIndex_ = 0;
   int colorListScroll_ = 0;
   SavedColor selectedColor_;
@@ -884,7 +987,7 @@ private:
   int measureActionIndex_ = 0;        // result screen action
 
   // Measurements history state
-  std::vector<SavedMeasurement> savedMeasurements_;
+  MeasurementCursor measureCursor_;
   int measureListIndex_ = 0;
   int measureListScroll_ = 0;
   SavedMeasurement selectedMeasurement_;
@@ -904,4 +1007,5 @@ private:
   bool storageOk_ = false;
   bool needsRefresh_ = true;
   uint32_t lastRefresh_ = 0;
+  uint32_t lastEventMs_ = 0; // idle time gates storage compaction
 };
@@ -0,0 +1,378 @@
+#pragma once
+// ============================================================
+// as7343_source.h – AS7343 on I²C as a SpectralSource
+//
+// Uses the SparkFun AS7343 library for setup; integration
+// start/stop, the data-ready interrupt and the channel readout are
+// driven directly through the AS7343 registers:
+//   - The INT pin ISR gives a binary semaphore, so waitFrame()
+//     sleeps instead of polling.
+//   - A frame is one I²C transaction: ASTATUS + DATA_0…DATA_17
+//     (37 bytes, reading ASTATUS latches the block) into a fixed
+//     buffer, scattered into raw[] by a compile-time channel map.
+//   - Preview profile: 6-channel auto-SMUX, one phase per frame,
+//     read as ASTATUS + DATA_0…DATA_5 (13 bytes).
+//   - The bus runs at Fast-mode Plus when a register write/readback
+//     probe passes at that clock; every read is timed against a
+//     budget of twice the nominal transfer time, and repeated
+//     overruns or a bus error drop back to Fast mode.
+// ============================================================
+
+#include "config.h"
+#include "spectral_source.h"
+#include <Arduino.h>
+#include <SparkFun_AS7343.h>
+#include <Wire.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+// ── AS7343 registers used directly ──────────────────────────
+namespace AS7343Reg {
+constexpr uint8_t ENABLE = 0x80;   // PON bit0, SP_EN bit1
+constexpr uint8_t ATIME = 0x81;
+constexpr uint8_t STATUS2 = 0x90;  // AVALID bit6
+constexpr uint8_t STATUS = 0x93;   // write 1s to clear
+constexpr uint8_t ASTATUS = 0x94;  // followed by DATA_0_L … DATA_17_H
+constexpr uint8_t PERS = 0xCF;     // 0 = interrupt every cycle
+constexpr uint8_t ASTEP_L = 0xD4;
+constexpr uint8_t ASTEP_H = 0xD5;
+constexpr uint8_t INTENAB = 0xF9;  // SP_IEN bit3
+
+constexpr uint8_t ENABLE_SP_EN = 0x02;
+constexpr uint8_t STATUS2_AVALID = 0x40;
+constexpr uint8_t INTENAB_SP_IEN = 0x08;
+} // namespace AS7343Reg
+
+// ── Channel map ─────────────────────────────────────────────
+// Data register (DATA_n) holding each raw[] channel in the
+// 18-channel auto-SMUX block (datasheet order):
+//   0 FZ   1 FY   2 FXL   3 NIR   4 VIS   5 FD    (SMUX cycle 1)
+//   6 F2   7 F3   8 F4    9 F6   10 VIS  11 FD    (SMUX cycle 2)
+//  12 F1  13 F7  14 F8   15 F5   16 VIS  17 FD    (SMUX cycle 3)
+namespace AS7343Map {
+constexpr int DATA_CHANNELS = 18;
+constexpr int BLOCK_LEN = 1 + 2 * DATA_CHANNELS; // ASTATUS + 18 × 16 bit
+constexpr int PREVIEW_BLOCK_LEN = 1 + 2 * PREVIEW_CHANNELS; // SMUX cycle 1
+
+constexpr uint8_t kChannelMap[Config::Sensor::NUM_CHANNELS] = {
+    12, // F1  (405-425 nm, violet)
+    6,  // F2  (435-455 nm, blue)
+    0,  // FZ  (CIE Z approximation)
+    7,  // F3  (470-490 nm, cyan-blue)
+    8,  // F4  (505-525 nm, green)
+    1,  // FY  (CIE Y approximation)
+    15, // F5  (545-565 nm, yellow-green)
+    2,  // FXL (CIE X low approximation)
+    9,  // F6  (580-600 nm, orange)
+    13, // F7  (620-640 nm, red)
+    14, // F8  (670-690 nm, deep red)
+    3,  // NIR (near infrared)
+    4,  // Clear/VIS (first SMUX cycle)
+    5,  // FD  (flicker detect)
+};
+
+// Same indices as the SparkFun library's channel enum
+static_assert(kChannelMap[0] == CH_PURPLE_F1_405NM &&
+                  kChannelMap[1] == CH_DARK_BLUE_F2_425NM &&
+                  kChannelMap[2] == CH_BLUE_FZ_450NM &&
+                  kChannelMap[3] == CH_LIGHT_BLUE_F3_475NM &&
+                  kChannelMap[4] == CH_BLUE_F4_515NM &&
+                  kChannelMap[5] == CH_GREEN_FY_555NM &&
+                  kChannelMap[6] == CH_GREEN_F5_550NM &&
+                  kChannelMap[7] == CH_ORANGE_FXL_600NM &&
+                  kChannelMap[8] == CH_BROWN_F6_640NM &&
+                  kChannelMap[9] == CH_RED_F7_690NM &&
+                  kChannelMap[10] == CH_DARK_RED_F8_745NM &&
+                  kChannelMap[11] == CH_NIR_855NM &&
+                  kChannelMap[12] == CH_VIS_1 && kChannelMap[13] == CH_FD_1,
+              "AS7343 channel map out of sync with the data registers");
+
+// The 6-channel auto-SMUX fills DATA_0…5 the same way as the first
+// phase of the 18-channel cycle
+constexpr bool previewInFirstPhase() {
+  for (int i = 0; i < PREVIEW_CHANNELS; i++)
+    if (kChannelMap[kPreviewChannels[i]] >= PREVIEW_CHANNELS)
+      return false;
+  return true;
+}
+static_assert(previewInFirstPhase(),
+              "preview channels must come from SMUX cycle 1");
+
+// Nominal time of one block read of `len` bytes at `hz`: register
+// write + repeated start + len bytes, 9 clocks per byte
+constexpr uint32_t readTimeUs(uint32_t hz, int len = BLOCK_LEN) {
+  return (uint32_t)((uint64_t)9 * (len + 3) * 1000000 / hz);
+}
+} // namespace AS7343Map
+
+// ── AS7343 Source ───────────────────────────────────────────
+class As7343Source : public SpectralSource {
+public:
+  static constexpr int GAIN_COUNT = 13;
+  static constexpr sfe_as7343_again_t kGainTable[GAIN_COUNT] = {
+      AGAIN_0_5, AGAIN_1,   AGAIN_2,   AGAIN_4,  AGAIN_8,   AGAIN_16, AGAIN_32,
+      AGAIN_64,  AGAIN_128, AGAIN_256, AGAIN_512, AGAIN_1024, AGAIN_2048};
+
+  static constexpr int PROBE_READS = 8;     // readbacks to accept FM+
+  static constexpr int OVERRUN_LIMIT = 3;   // consecutive slow reads
+
+  As7343Source()
+      : drdy_(nullptr), exposure_(kDefaultExposure),
+        profile_(SmuxProfile::FULL), i2cFreq_(Config::Sensor::I2C_FREQ),
+        readBudgetUs_(0), lastReadUs_(0), maxReadUs_(0), overruns_(0) {}
+
+  bool begin() override {
+    Wire.begin(Config::Sensor::SDA, Config::Sensor::SCL,
+               Config::Sensor::I2C_FREQ);
+
+    drdy_ = xSemaphoreCreateBinary();
+    if (!drdy_)
+      return false;
+
+    // Initialize sensor using SparkFun library
+    if (!sensor_.begin(Config::Sensor::I2C_ADDR, Wire)) {
+      Serial.println("[Sensor] AS7343 not found at 0x39");
+      return false;
+    }
+
+    sensor_.powerOn();
+
+    // Set AutoSmux to 18 channels (to read all channels)
+    sensor_.setAutoSmux(AUTOSMUX_18_CHANNELS);
+
+    // Spectral interrupt on every completed cycle (INT is open-drain,
+    // active low). Measurement stays idle until armed.
+    writeReg(AS7343Reg::PERS, 0);
+    writeReg(AS7343Reg::INTENAB, AS7343Reg::INTENAB_SP_IEN);
+    setSpectralEnable(false);
+    clearStatus();
+
+    active_ = this;
+    pinMode(Config::Sensor::INT_PIN, INPUT_PULLUP);
+    attachInterrupt(digitalPinToInterrupt(Config::Sensor::INT_PIN),
+                    onDataReadyISR, FALLING);
+
+    // Configure LED drive current but keep it OFF by default.
+    // LED is turned on/off only during active measurements.
+    sensor_.setLedDrive(0); // 4 mA (Minimum)
+    sensor_.ledOff();
+
+    selectBusClock();
+    return true;
+  }
+
+  // Bus clock in use and measured block-read times
+  uint32_t i2cFreq() const { return i2cFreq_; }
+  uint32_t readBudgetUs() const { return readBudgetUs_; }
+  uint32_t lastReadUs() const { return lastReadUs_; }
+  uint32_t maxReadUs() const { return maxReadUs_; }
+
+  const char *name() const override { return "AS7343"; }
+
+  // Writes only the registers that change
+  void setExposure(const Exposure &e, bool force) override {
+    if (force || e.gainIndex != exposure_.gainIndex)
+      sensor_.setAgain(kGainTable[e.gainIndex]);
+    if (force || e.atime != exposure_.atime)
+      writeReg(AS7343Reg::ATIME, e.atime);
+    if (force || e.astep != exposure_.astep) {
+      writeReg(AS7343Reg::ASTEP_L, e.astep & 0xFF);
+      writeReg(AS7343Reg::ASTEP_H, e.astep >> 8);
+    }
+    exposure_ = e;
+  }
+
+  void setProfile(SmuxProfile p) override {
+    if (p == profile_)
+      return;
+    sensor_.setAutoSmux(p == SmuxProfile::PREVIEW ? AUTOSMUX_6_CHANNELS
+                                                  : AUTOSMUX_18_CHANNELS);
+    profile_ = p;
+    readBudgetUs_ = 2 * AS7343Map::readTimeUs(i2cFreq_, blockLen());
+  }
+
+  // Full 18-channel cycle = 3 SMUX phases; preview = 1
+  uint32_t cycleTimeUs(const Exposure &e) const override {
+    return (profile_ == SmuxProfile::PREVIEW ? 1 : 3) * e.integrationUs();
+  }
+
+  void setLed(bool on) override {
+    if (on)
+      sensor_.ledOn();
+    else
+      sensor_.ledOff();
+  }
+
+  bool setMeasuring(bool on) override {
+    if (on) {
+      xSemaphoreTake(drdy_, 0); // drop a stale edge
+      clearStatus();
+      return setSpectralEnable(true);
+    }
+    bool ok = setSpectralEnable(false);
+    clearStatus();
+    return ok;
+  }
+
+  // Sleeps until the data-ready interrupt fires. If INT never
+  // arrives (pin not wired) falls back to polling AVALID.
+  bool waitFrame(uint32_t timeoutMs) override {
+    if (xSemaphoreTake(drdy_, pdMS_TO_TICKS(timeoutMs)) == pdTRUE)
+      return true;
+
+    uint8_t st2 = 0;
+    uint32_t start = millis();
+    while (millis() - start < timeoutMs) {
+      if (readReg(AS7343Reg::STATUS2, st2) && (st2 & AS7343Reg::STATUS2_AVALID))
+        return true;
+      vTaskDelay(pdMS_TO_TICKS(5));
+    }
+    return false;
+  }
+
+  bool readFrame(uint16_t *raw) override {
+    bool ok = readChannels(raw);
+    clearStatus(); // re-arm INT for the next cycle
+    return ok;
+  }
+
+  void sleepMs(uint32_t ms) override { vTaskDelay(pdMS_TO_TICKS(ms)); }
+  uint32_t nowMs() override { return millis(); }
+  uint32_t nowUs() override { return micros(); }
+
+private:
+  static void IRAM_ATTR onDataReadyISR() {
+    BaseType_t woken = pdFALSE;
+    xSemaphoreGiveFromISR(active_->drdy_, &woken);
+    if (woken) {
+      portYIELD_FROM_ISR();
+    }
+  }
+
+  // ── Register access ───────────────────────────────────────
+  bool writeReg(uint8_t reg, uint8_t val) {
+    Wire.beginTransmission(Config::Sensor::I2C_ADDR);
+    Wire.write(reg);
+    Wire.write(val);
+    return Wire.endTransmission() == 0;
+  }
+
+  bool readReg(uint8_t reg, uint8_t &val) {
+    Wire.beginTransmission(Config::Sensor::I2C_ADDR);
+    Wire.write(reg);
+    if (Wire.endTransmission(false) != 0)
+      return false;
+    if (Wire.requestFrom(Config::Sensor::I2C_ADDR, (uint8_t)1) != 1)
+      return false;
+    val = Wire.read();
+    return true;
+  }
+
+  bool setSpectralEnable(bool on) {
+    uint8_t en;
+    if (!readReg(AS7343Reg::ENABLE, en))
+      return false;
+    en = on ? (en | AS7343Reg::ENABLE_SP_EN) : (en & ~AS7343Reg::ENABLE_SP_EN);
+    return writeReg(AS7343Reg::ENABLE, en);
+  }
+
+  void clearStatus() { writeReg(AS7343Reg::STATUS, 0xFF); }
+
+  // ── Bus clock ─────────────────────────────────────────────
+  // FM+ only if the sensor answers reliably at that clock (pull-ups
+  // and wire length decide); otherwise stay at Fast mode. Probes by
+  // writing and reading back ATIME (bank 0, rewritten afterwards).
+  void selectBusClock() {
+    setBusClock(Config::Sensor::I2C_FREQ_FAST);
+    for (int i = 0; i < PROBE_READS; i++) {
+      uint8_t pattern = static_cast<uint8_t>(0x5A ^ (i * 0x3B)), back = 0;
+      if (!writeReg(AS7343Reg::ATIME, pattern) ||
+          !readReg(AS7343Reg::ATIME, back) || back != pattern) {
+        setBusClock(Config::Sensor::I2C_FREQ);
+        break;
+      }
+    }
+    writeReg(AS7343Reg::ATIME, exposure_.atime);
+    Serial.printf("[Sensor] I2C at %lu kHz, block read budget %lu us\n",
+                  (unsigned long)(i2cFreq_ / 1000),
+                  (unsigned long)readBudgetUs_);
+  }
+
+  void setBusClock(uint32_t hz) {
+    Wire.setClock(hz);
+    i2cFreq_ = hz;
+    readBudgetUs_ = 2 * AS7343Map::readTimeUs(hz, blockLen());
+    overruns_ = 0;
+  }
+
+  // Bus error or repeated overruns at FM+: back to Fast mode
+  void fallBack(const char *why) {
+    if (i2cFreq_ == Config::Sensor::I2C_FREQ)
+      return;
+    setBusClock(Config::Sensor::I2C_FREQ);
+    Serial.printf("[Sensor] I2C %s, falling back to %lu kHz\n", why,
+                  (unsigned long)(i2cFreq_ / 1000));
+  }
+
+  int blockLen() const {
+    return profile_ == SmuxProfile::PREVIEW ? AS7343Map::PREVIEW_BLOCK_LEN
+                                            : AS7343Map::BLOCK_LEN;
+  }
+
+  // Raw counts of the completed cycle: one burst from ASTATUS
+  bool readChannels(uint16_t *raw) {
+    const int len = blockLen();
+    uint32_t start = micros();
+    Wire.beginTransmission(Config::Sensor::I2C_ADDR);
+    Wire.write(AS7343Reg::ASTATUS);
+    bool ok = Wire.endTransmission(false) == 0 &&
+              Wire.requestFrom(Config::Sensor::I2C_ADDR, (uint8_t)len) == len;
+    if (!ok) {
+      fallBack("bus error");
+      return false;
+    }
+    for (int i = 0; i < len; i++)
+      block_[i] = static_cast<uint8_t>(Wire.read());
+
+    lastReadUs_ = micros() - start;
+    if (lastReadUs_ > maxReadUs_)
+      maxReadUs_ = lastReadUs_;
+    if (lastReadUs_ > readBudgetUs_) {
+      if (++overruns_ >= OVERRUN_LIMIT)
+        fallBack("reads over budget");
+    } else {
+      overruns_ = 0;
+    }
+
+    // DATA_n is little-endian, right after ASTATUS
+    if (profile_ == SmuxProfile::PREVIEW) {
+      memset(raw, 0, Config::Sensor::NUM_CHANNELS * sizeof(uint16_t));
+      for (int i = 0; i < PREVIEW_CHANNELS; i++) {
+        int ch = kPreviewChannels[i];
+        const uint8_t *d = &block_[1 + 2 * AS7343Map::kChannelMap[ch]];
+        raw[ch] = static_cast<uint16_t>(d[0] | (d[1] << 8));
+      }
+      return true;
+    }
+    for (int ch = 0; ch < Config::Sensor::NUM_CHANNELS; ch++) {
+      const uint8_t *d = &block_[1 + 2 * AS7343Map::kChannelMap[ch]];
+      raw[ch] = static_cast<uint16_t>(d[0] | (d[1] << 8));
+    }
+    return true;
+  }
+
+  static inline As7343Source *active_ = nullptr; // for the ISR
+
+  SfeAS7343ArdI2C sensor_;
+  SemaphoreHandle_t drdy_; // given by the INT pin ISR
+  Exposure exposure_;      // currently programmed in the sensor
+  SmuxProfile profile_;    // auto-SMUX channel set in use
+
+  // Bulk readout
+  uint8_t block_[AS7343Map::BLOCK_LEN];
+  uint32_t i2cFreq_;
+  uint32_t readBudgetUs_;
+  uint32_t lastReadUs_;
+  uint32_t maxReadUs_;
+  int overruns_;
+};
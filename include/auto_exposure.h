@@ -0,0 +1,100 @@
+#pragma once
+// ============================================================
+// auto_exposure.h – Gain / integration time controller
+//
+// Picks the next exposure from the previous frame's peak counts.
+// The peak as a fraction of full scale depends only on gain
+// (counts and full scale both grow with integration time), so:
+//   - gain is stepped by powers of two to bring the peak to
+//     AE_TARGET_PCT (rounded down, so it lands in 25–50 %);
+//   - integration time is stretched beyond the default only when
+//     gain is already at maximum, to raise the absolute counts;
+//   - a frame above AE_HIGH_PCT steps gain down the same way;
+//   - a saturated frame carries no level information, so it
+//     drops straight to minimum gain and the next frame is exact.
+// Any frame therefore converges in at most two iterations.
+// ============================================================
+
+#include "config.h"
+#include "spectral_types.h"
+#include <cstdint>
+
+namespace AutoExposure {
+
+constexpr int MAX_GAIN_INDEX = 12;
+constexpr int PEAK_CHANNELS = 13; // F1…NIR + Clear, FD excluded
+
+inline uint16_t peakCounts(const uint16_t *raw) {
+  uint16_t peak = 0;
+  for (int ch = 0; ch < PEAK_CHANNELS; ch++) {
+    if (raw[ch] > peak)
+      peak = raw[ch];
+  }
+  return peak;
+}
+
+inline bool isSaturated(const Exposure &e, uint16_t peak) {
+  return (uint32_t)peak * 100 >=
+         (uint32_t)e.fullScale() * Config::Sensor::AE_SAT_PCT;
+}
+
+// floor(log2(num / den)) for num, den > 0 (negative when num < den)
+inline int log2Ratio(uint32_t num, uint32_t den) {
+  int steps = 0;
+  while (num >= den * 2) {
+    den *= 2;
+    steps++;
+  }
+  while (num < den) {
+    num *= 2;
+    steps--;
+  }
+  return steps;
+}
+
+// Computes the exposure for the next frame. Returns true if the
+// frame taken at `cur` is usable as is (no retake needed).
+inline bool evaluate(const Exposure &cur, uint16_t peak, Exposure &next) {
+  using namespace Config::Sensor;
+  next = cur;
+  const uint32_t fs = cur.fullScale();
+  const uint32_t target = fs * AE_TARGET_PCT / 100;
+  const bool gainMaxed = cur.gainIndex >= MAX_GAIN_INDEX;
+
+  if (isSaturated(cur, peak)) {
+    if (cur.gainIndex == 0)
+      return true; // nothing left to reduce
+    next.gainIndex = 0;
+    next.astep = DEFAULT_ASTEP;
+    return false;
+  }
+
+  if ((uint32_t)peak * 100 > fs * AE_HIGH_PCT) {
+    // Close to clipping: step gain down towards the target
+    int gain = cur.gainIndex + log2Ratio(target, peak);
+    next.gainIndex = static_cast<uint8_t>(gain < 0 ? 0 : gain);
+    next.astep = DEFAULT_ASTEP;
+    return next == cur;
+  }
+
+  bool under = (uint32_t)peak * 100 < fs * AE_LOW_PCT;
+  if (!under) {
+    next.astep = DEFAULT_ASTEP; // stretched integration no longer needed
+    return true;
+  }
+
+  if (gainMaxed) {
+    // Gain at its limit: longest integration for more absolute counts
+    next.astep = AE_ASTEP_MAX;
+    return next == cur;
+  }
+
+  int gain = cur.gainIndex + log2Ratio(target, peak > 0 ? peak : 1);
+  next.gainIndex =
+      static_cast<uint8_t>(gain > MAX_GAIN_INDEX ? MAX_GAIN_INDEX : gain);
+  if (next.gainIndex == MAX_GAIN_INDEX && gain > MAX_GAIN_INDEX)
+    next.astep = AE_ASTEP_MAX; // still short of target at max gain
+  return false;
+}
+
+} // namespace AutoExposure
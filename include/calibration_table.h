@@ -0,0 +1,159 @@
+#pragma once
+// ============================================================
+// calibration_table.h – Calibration references per exposure
+//
+// Holds up to MAX_ENTRIES measured CalibrationData records, each
+// keyed by the exposure (gain index, ATIME, ASTEP) it was taken
+// at. resolve() returns references for any exposure:
+//   - each reference (dark / gray / white) comes from the entry
+//     measured at exactly that exposure when it has one;
+//   - otherwise it is derived from the measured entry closest in
+//     sensitivity, scaled by the gain × integration ratio.
+// So a gain change, manual or by auto-exposure, needs no new
+// calibration; capturing at more exposures only adds accuracy.
+// The LED warm-up time and the spectral reconstruction matrix set
+// (both independent of exposure) are kept alongside.
+// Each store() stamps its entry with the next value of a sequence
+// saved with the table, so the entry dropped when it is full is the
+// one calibrated longest ago, across restarts (calibTimestamp is
+// millis() since boot and only set by a gray capture).
+// ============================================================
+
+#include "config.h"
+#include "spectral_types.h"
+#include <cstdint>
+#include <cstring>
+
+class CalibrationTable {
+public:
+  static constexpr int MAX_ENTRIES = 8;
+  static constexpr int N = Config::Sensor::NUM_CHANNELS;
+
+  CalibrationTable() { clear(); }
+
+  void clear() {
+    memset(entries_, 0, sizeof(entries_));
+    memset(seq_, 0, sizeof(seq_));
+    count_ = 0;
+    lastSeq_ = 0;
+    ledSettleMs_ = -1;
+    reconSet_ = 0;
+  }
+
+  // LED turn-on to stable output, from the measured warm-up curve
+  // (SpectralPipeline::characterizeLed); -1 = not characterized
+  int32_t ledSettleMs() const { return ledSettleMs_; }
+  void setLedSettleMs(int32_t ms) { ledSettleMs_ = ms; }
+
+  // SpectralRecon::kSets index for the target calibrated against
+  uint8_t reconSet() const { return reconSet_; }
+  void setReconSet(uint8_t set) { reconSet_ = set; }
+
+  int count() const { return count_; }
+  const CalibrationData &entry(int i) const { return entries_[i]; }
+  // Store order of entry i, higher = more recent
+  uint32_t sequence(int i) const { return seq_[i]; }
+
+  // Measured entry for exactly this exposure, or nullptr
+  const CalibrationData *find(const Exposure &e) const {
+    for (int i = 0; i < count_; i++) {
+      if (entries_[i].exposure == e)
+        return &entries_[i];
+    }
+    return nullptr;
+  }
+
+  // Inserts or replaces the entry for cal.exposure. When the table
+  // is full the least recently stored entry is dropped.
+  void store(const CalibrationData &cal) { restore(cal, lastSeq_ + 1); }
+
+  // As store(), keeping the sequence the entry was saved with
+  // (loading a saved table)
+  void restore(const CalibrationData &cal, uint32_t seq) {
+    if (seq > lastSeq_)
+      lastSeq_ = seq;
+    int slot = 0;
+    while (slot < count_ && !(entries_[slot].exposure == cal.exposure))
+      slot++;
+    if (slot == count_) {
+      if (count_ < MAX_ENTRIES) {
+        count_++;
+      } else {
+        slot = 0;
+        for (int i = 1; i < count_; i++) {
+          if (seq_[i] < seq_[slot])
+            slot = i;
+        }
+      }
+    }
+    entries_[slot] = cal;
+    seq_[slot] = seq;
+  }
+
+  // References for `e`, measured or derived. Flags tell which
+  // references are available at all.
+  CalibrationData resolve(const Exposure &e) const {
+    CalibrationData out;
+    memset(&out, 0, sizeof(out));
+    out.exposure = e;
+    out.reconSet = reconSet_;
+
+    const CalibrationData *src;
+    if ((src = nearest(e, &CalibrationData::hasDark))) {
+      scaleInto(*src, e, src->darkRef, out.darkRef);
+      out.hasDark = true;
+    }
+    if ((src = nearest(e, &CalibrationData::hasGray))) {
+      scaleInto(*src, e, src->grayRef, out.grayRef);
+      out.hasGray = true;
+      out.calibTimestamp = src->calibTimestamp;
+    }
+    if ((src = nearest(e, &CalibrationData::hasWhite))) {
+      scaleInto(*src, e, src->whiteRef, out.whiteRef);
+      out.hasWhite = true;
+    }
+    return out;
+  }
+
+private:
+  // Sensitivity ratio between two exposures, always >= 1
+  static float distance(const Exposure &a, const Exposure &b) {
+    float sa = static_cast<float>(a.sensitivity());
+    float sb = static_cast<float>(b.sensitivity());
+    return sa > sb ? sa / sb : sb / sa;
+  }
+
+  // Exact match first, else smallest sensitivity ratio
+  const CalibrationData *nearest(const Exposure &e,
+                                 bool CalibrationData::*flag) const {
+    const CalibrationData *best = nullptr;
+    float bestDist = 0;
+    for (int i = 0; i < count_; i++) {
+      if (!(entries_[i].*flag))
+        continue;
+      if (entries_[i].exposure == e)
+        return &entries_[i];
+      float d = distance(entries_[i].exposure, e);
+      if (!best || d < bestDist) {
+        best = &entries_[i];
+        bestDist = d;
+      }
+    }
+    return best;
+  }
+
+  static void scaleInto(const CalibrationData &src, const Exposure &e,
+                        const float *in, float *out) {
+    float ratio = static_cast<float>(e.sensitivity()) /
+                  static_cast<float>(src.exposure.sensitivity());
+    for (int ch = 0; ch < N; ch++)
+      out[ch] = in[ch] * ratio;
+  }
+
+  CalibrationData entries_[MAX_ENTRIES];
+  uint32_t seq_[MAX_ENTRIES];
+  int count_;
+  uint32_t lastSeq_; // highest sequence stored
+  int32_t ledSettleMs_;
+  uint8_t reconSet_;
+};
@@ -0,0 +1,495 @@
+#pragma once
+// ============================================================
+// color_engine.h – Calibration + color conversion pipeline
+//
+//   raw counts → calibrated reflectance → CIE XYZ → RGB
+//                         │                        → Lab / LCh
+//                         └→ 31-band reflectance spectrum
+//   (XYZ uses all 14 channels, see cie_observer.h; the spectrum
+//    spectral_recon.h; Lab and ΔE live in color_lab.h)
+// XYZ comes out under D65; the selected viewing illuminant
+// (illuminant.h) and output space (output_space.h) supply one fused
+// XYZ → RGB matrix and the adaptation + white point for XYZ / Lab,
+// all precomputed. RGB outside the space is clamped or gamut-mapped
+// (gamut_map.h) and flagged in SpectralData::inGamut.
+//
+// The ESP32-C6 has no FPU, so every float op is a soft-float
+// library call. Two implementations share the same interface:
+//   Float – reference path (original soft-float math + powf)
+//   Fixed – integer path: Q8 dark subtraction, Q16 reflectance,
+//           Q16 observer matrix, Q14 XYZ→RGB matrix,
+//           threshold-LUT RGB encoding
+// The active one is chosen at compile time via COLOR_FIXED_POINT
+// (see Config::Color). Both are always compiled so they can be
+// cross-checked with ColorEngine::selfTest() and timed against each
+// other with ColorEngine::benchmark().
+// ============================================================
+
+#include "cie_observer.h"
+#include "color_lab.h"
+#include "config.h"
+#include "gamut_map.h"
+#include "illuminant.h"
+#include "output_space.h"
+#include "spectral_recon.h"
+#include "spectral_types.h"
+#include <cmath>
+#include <cstdint>
+
+namespace ColorEngine {
+
+constexpr int N = Config::Sensor::NUM_CHANNELS;
+
+// ── Per-channel coefficients ────────────────────────────────
+// Derived once from CalibrationData (prepare()), so the
+// per-measurement path contains no divisions.
+struct Coefficients {
+  // Float path
+  float dark[N];  // counts
+  float scale[N]; // GRAY_REFLECTANCE / grayNet, or 1 if uncalibrated
+
+  // Fixed path
+  int32_t darkQ8[N];     // dark reference, Q8 counts
+  uint32_t scaleMant[N]; // scale mantissa in [2^31, 2^32) …
+  uint8_t scaleShift[N]; // … so that Q8 * mant >> shift = Q16
+
+  // true  → calibrated values are reflectance (Q16 in fixed path)
+  // false → calibrated values are net counts (Q8), normalized to max
+  bool relative;
+
+  // Exposure the references were taken at; frames at any other
+  // exposure are rescaled to it before dark subtraction
+  Exposure exposure;
+
+  // SpectralRecon matrix set (spectrum only when relative)
+  uint8_t reconSet;
+
+  // Viewing illuminant for XYZ, Lab and RGB, the RGB space and
+  // what happens outside it (set by the pipeline)
+  Illuminant::Id illuminant;
+  OutputSpace::Id space;
+  bool gamutMap;
+};
+
+inline void prepare(const CalibrationData &cal, Coefficients &k) {
+  k.relative = cal.hasGray;
+  k.exposure = cal.exposure;
+  k.reconSet = cal.reconSet < SpectralRecon::SET_COUNT ? cal.reconSet : 0;
+  k.illuminant = Illuminant::Id::D65;
+  k.space = OutputSpace::Id::SRGB;
+  k.gamutMap = Config::Color::GAMUT_MAP;
+  for (int ch = 0; ch < N; ch++) {
+    float dark = cal.hasDark ? cal.darkRef[ch] : 0.0f;
+    float scale = 1.0f;
+    if (cal.hasGray) {
+      float grayNet = cal.grayRef[ch] - cal.darkRef[ch];
+      if (grayNet > 0)
+        scale = CalibrationData::GRAY_REFLECTANCE / grayNet;
+    }
+    k.dark[ch] = dark;
+    k.scale[ch] = scale;
+
+    k.darkQ8[ch] = static_cast<int32_t>(dark * 256.0f + 0.5f);
+
+    // Block-float scale keeps ~24 significant bits whether grayNet is
+    // 10 counts or 60000 (a plain Q24 factor loses 0.1% at high counts).
+    int e;
+    float f = frexpf(scale, &e); // scale = f * 2^e, f in [0.5, 1)
+    if (e > 23)
+      e = 23; // degenerate gray reference, saturate
+    k.scaleMant[ch] = static_cast<uint32_t>(ldexpf(f, 32));
+    k.scaleShift[ch] = static_cast<uint8_t>(24 - e);
+  }
+}
+
+// ============================================================
+// Float path (reference)
+// ============================================================
+namespace Float {
+
+inline void calibrate(const Coefficients &k, SpectralData &data) {
+  float ratio = static_cast<float>(k.exposure.sensitivity()) /
+                static_cast<float>(data.exposure.sensitivity());
+  for (int ch = 0; ch < N; ch++) {
+    float val = static_cast<float>(data.raw[ch]) * ratio - k.dark[ch];
+    if (val < 0)
+      val = 0;
+    data.calibrated[ch] = val * k.scale[ch];
+  }
+}
+
+// One multiply-accumulate pass over all channels
+inline void toXYZ(const Coefficients &k, SpectralData &data) {
+  const auto &m = data.profile == SmuxProfile::PREVIEW
+                      ? CieObserver::kPreviewToXYZ
+                      : CieObserver::kChannelToXYZ;
+  float x = 0, y = 0, z = 0;
+  for (int ch = 0; ch < N; ch++) {
+    float v = data.calibrated[ch];
+    x += m[0][ch] * v;
+    y += m[1][ch] * v;
+    z += m[2][ch] * v;
+  }
+  // Negative weights can push near-black samples slightly below zero
+  data.cie_X = x > 0 ? x : 0;
+  data.cie_Y = y > 0 ? y : 0;
+  data.cie_Z = z > 0 ? z : 0;
+
+  // If calibrated with gray card, values are already relative.
+  // Without calibration, normalize to max for visualization.
+  if (!k.relative) {
+    float maxVal = fmax(fmax(data.cie_X, data.cie_Y), data.cie_Z);
+    if (maxVal > 0) {
+      data.cie_X /= maxVal;
+      data.cie_Y /= maxVal;
+      data.cie_Z /= maxVal;
+    }
+  }
+}
+
+// D65 XYZ → linear RGB under the illuminant (one fused matrix)
+inline void toLinearRGB(const OutputSpace::Render &r, const SpectralData &data,
+                        float *lin) {
+  const float xyz[3] = {data.cie_X, data.cie_Y, data.cie_Z};
+  GamutMap::mul(r.toRGB, xyz, lin);
+}
+
+// D65 XYZ → XYZ under the illuminant
+inline void adapt(const Illuminant::View &v, SpectralData &data) {
+  const float xyz[3] = {data.cie_X, data.cie_Y, data.cie_Z};
+  float adapted[3];
+  GamutMap::mul(v.toXYZ, xyz, adapted);
+  data.cie_X = adapted[0];
+  data.cie_Y = adapted[1];
+  data.cie_Z = adapted[2];
+}
+
+// Linear RGB → 8-bit codes, outside the space clamped or mapped
+// onto its boundary (needs the Lab)
+inline void toRGB(const Coefficients &k, float *lin, SpectralData &data) {
+  const OutputSpace::Space &sp = OutputSpace::space(k.space);
+  data.inGamut = GamutMap::inGamut(lin);
+  if (!data.inGamut && k.gamutMap)
+    GamutMap::compress(data.L, data.a_star, data.b_star,
+                       Illuminant::kWhites[static_cast<int>(k.illuminant)],
+                       sp.fromXYZ, lin);
+  data.r = OutputSpace::encodeFloat(sp.transfer, lin[0]);
+  data.g = OutputSpace::encodeFloat(sp.transfer, lin[1]);
+  data.b = OutputSpace::encodeFloat(sp.transfer, lin[2]);
+}
+
+inline void toLab(const Illuminant::White &w, SpectralData &data) {
+  ColorLab::fromXYZ(data.cie_X, data.cie_Y, data.cie_Z, data.L, data.a_star,
+                    data.b_star, w.X, w.Z);
+  data.C_star = sqrtf(data.a_star * data.a_star + data.b_star * data.b_star);
+  float h = atan2f(data.b_star, data.a_star) * (180.0f / (float)M_PI);
+  data.h_ab = h < 0.0f ? h + 360.0f : h;
+}
+
+// Reflectance needs the gray reference and all channels
+inline void toSpectrum(const Coefficients &k, SpectralData &data) {
+  data.hasSpectrum = k.relative && data.profile == SmuxProfile::FULL;
+  if (data.hasSpectrum)
+    SpectralRecon::reconstruct(SpectralRecon::kSets[k.reconSet],
+                               data.calibrated, data.reflectance);
+}
+
+inline void process(const Coefficients &k, SpectralData &data) {
+  float lin[3];
+  calibrate(k, data);
+  toXYZ(k, data);
+  toLinearRGB(OutputSpace::render(k.illuminant, k.space), data, lin);
+  adapt(Illuminant::view(k.illuminant), data);
+  toLab(Illuminant::kWhites[static_cast<int>(k.illuminant)], data);
+  toRGB(k, lin, data);
+  toSpectrum(k, data);
+}
+
+} // namespace Float
+
+// ============================================================
+// Fixed path (Q16)
+// ============================================================
+namespace Fixed {
+
+constexpr int32_t ONE_Q16 = 1 << 16;
+
+// Q16 factor taking counts at `frame` exposure to `ref` exposure
+inline uint64_t exposureRatioQ16(const Exposure &ref, const Exposure &frame) {
+  if (ref == frame)
+    return ONE_Q16;
+  return (ref.sensitivity() << 16) / frame.sensitivity();
+}
+
+// Exposure rescale + dark subtraction + gray normalization.
+// Output is Q16 reflectance (relative) or Q8 net counts.
+inline void calibrate(const Coefficients &k, const uint16_t *raw,
+                      uint64_t ratioQ16, int32_t *cal) {
+  for (int ch = 0; ch < N; ch++) {
+    int64_t scaled = ratioQ16 == ONE_Q16
+                         ? static_cast<int64_t>(raw[ch]) << 8
+                         : static_cast<int64_t>((raw[ch] * ratioQ16) >> 8);
+    int64_t net64 = scaled - k.darkQ8[ch];
+    int32_t net = net64 < 0           ? 0
+                  : net64 > INT32_MAX ? INT32_MAX
+                                      : static_cast<int32_t>(net64);
+    if (k.relative) {
+      uint64_t v = (static_cast<uint64_t>(net) * k.scaleMant[ch]) >>
+                   k.scaleShift[ch];
+      cal[ch] = v > INT32_MAX ? INT32_MAX : static_cast<int32_t>(v);
+    } else {
+      cal[ch] = net;
+    }
+  }
+}
+
+// Q16 weights × calibrated values, one MAC pass, format-preserving
+inline void toXYZ(const Coefficients &k, const CieObserver::MatrixQ16 &obs,
+                  const int32_t *cal, int32_t *xyz) {
+  const auto &m = obs.m;
+  int64_t x = 0, y = 0, z = 0;
+  for (int ch = 0; ch < N; ch++) {
+    int64_t v = cal[ch];
+    x += m[0][ch] * v;
+    y += m[1][ch] * v;
+    z += m[2][ch] * v;
+  }
+  xyz[0] = x > 0 ? static_cast<int32_t>((x + (1 << 15)) >> 16) : 0;
+  xyz[1] = y > 0 ? static_cast<int32_t>((y + (1 << 15)) >> 16) : 0;
+  xyz[2] = z > 0 ? static_cast<int32_t>((z + (1 << 15)) >> 16) : 0;
+
+  if (!k.relative) {
+    int32_t maxVal = xyz[0];
+    if (xyz[1] > maxVal)
+      maxVal = xyz[1];
+    if (xyz[2] > maxVal)
+      maxVal = xyz[2];
+    if (maxVal > 0) {
+      // One division for all three components. Q47 / maxVal keeps
+      // 16 significant bits however large the net counts are, and
+      // xyz[i] <= maxVal keeps the product within 2^47.
+      uint64_t recip = (1ULL << 47) / static_cast<uint32_t>(maxVal);
+      for (int i = 0; i < 3; i++) {
+        xyz[i] = static_cast<int32_t>(
+            (static_cast<uint64_t>(xyz[i]) * recip + (1u << 30)) >> 31);
+      }
+    }
+  }
+}
+
+// Q14 matrix × Q16 XYZ, rounded to Q16
+inline int64_t mulQ14(const int32_t (&m)[3][3], const int32_t *xyz, int i) {
+  int64_t acc = static_cast<int64_t>(xyz[0]) * m[i][0] +
+                static_cast<int64_t>(xyz[1]) * m[i][1] +
+                static_cast<int64_t>(xyz[2]) * m[i][2];
+  return (acc + (1 << 13)) >> 14;
+}
+
+// D65 XYZ → Q16 linear RGB under the illuminant (one fused matrix)
+inline void toLinearRGB(const OutputSpace::Render &r, const int32_t *xyz,
+                        int32_t *lin) {
+  for (int i = 0; i < 3; i++) {
+    int64_t v = mulQ14(r.toRGBQ14, xyz, i);
+    lin[i] = v < INT32_MIN ? INT32_MIN
+             : v > INT32_MAX ? INT32_MAX
+                             : static_cast<int32_t>(v);
+  }
+}
+
+// Q16 linear RGB → 8-bit codes, outside the space clamped or
+// mapped onto its boundary; returns whether it was inside
+inline bool toRGB(const Coefficients &k, const ColorLab::LabQ &lab,
+                  int32_t *lin, uint8_t *rgb) {
+  bool inGamut = GamutMap::inGamutQ16(lin);
+  if (!inGamut && k.gamutMap)
+    GamutMap::compressQ16(lab, Illuminant::view(k.illuminant),
+                          OutputSpace::matrices(k.space).fromXYZQ14, lin);
+  const OutputSpace::Transfer t = OutputSpace::space(k.space).transfer;
+  for (int i = 0; i < 3; i++)
+    rgb[i] = OutputSpace::encode(t, lin[i] > ONE_Q16 ? ONE_Q16 : lin[i]);
+  return inGamut;
+}
+
+inline void process(const Coefficients &k, SpectralData &data) {
+  int32_t cal[N];
+  int32_t xyz[3];
+  int32_t lin[3];
+  uint8_t rgb[3];
+
+  calibrate(k, data.raw, exposureRatioQ16(k.exposure, data.exposure), cal);
+  toXYZ(k,
+        data.profile == SmuxProfile::PREVIEW ? CieObserver::kPreviewToXYZQ16
+                                             : CieObserver::kChannelToXYZQ16,
+        cal, xyz);
+  const Illuminant::View &view = Illuminant::view(k.illuminant);
+  toLinearRGB(OutputSpace::render(k.illuminant, k.space), xyz, lin);
+  if (k.illuminant != Illuminant::Id::D65) {
+    int32_t d65[3] = {xyz[0], xyz[1], xyz[2]};
+    for (int i = 0; i < 3; i++) {
+      int64_t v = mulQ14(view.toXYZQ14, d65, i);
+      xyz[i] = v < 0 ? 0 : v > INT32_MAX ? INT32_MAX : static_cast<int32_t>(v);
+    }
+  }
+  ColorLab::LabQ lab = ColorLab::fromXYZQ16(xyz[0], xyz[1], xyz[2],
+                                            view.invXnQ16, view.invZnQ16);
+  data.inGamut = toRGB(k, lab, lin, rgb);
+  data.hasSpectrum = k.relative && data.profile == SmuxProfile::FULL;
+  if (data.hasSpectrum)
+    SpectralRecon::reconstruct(SpectralRecon::kSetsQ16[k.reconSet], cal,
+                               data.reflectance);
+
+  // Publish float views for display / storage / connectivity
+  const float calUnit = k.relative ? 1.0f / ONE_Q16 : 1.0f / 256.0f;
+  for (int ch = 0; ch < N; ch++)
+    data.calibrated[ch] = cal[ch] * calUnit;
+  data.cie_X = xyz[0] * (1.0f / ONE_Q16);
+  data.cie_Y = xyz[1] * (1.0f / ONE_Q16);
+  data.cie_Z = xyz[2] * (1.0f / ONE_Q16);
+  data.r = rgb[0];
+  data.g = rgb[1];
+  data.b = rgb[2];
+  data.L = lab.L * 0.01f;
+  data.a_star = lab.a * 0.01f;
+  data.b_star = lab.b * 0.01f;
+  data.C_star = ColorLab::chroma(lab.a, lab.b) * 0.01f;
+  data.h_ab = ColorLab::hueCdeg(lab.a, lab.b) * 0.01f;
+}
+
+} // namespace Fixed
+
+// ── Active pipeline ─────────────────────────────────────────
+inline void process(const Coefficients &k, SpectralData &data) {
+  if (Config::Color::FIXED_POINT)
+    Fixed::process(k, data);
+  else
+    Float::process(k, data);
+}
+
+// ── Synthetic frames ────────────────────────────────────────
+// Deterministic raw frame at the reference exposure (LCG `seed`)
+inline void syntheticFrame(const Coefficients &k, uint32_t &seed,
+                           SpectralData &data) {
+  data = {};
+  data.exposure = k.exposure;
+  for (int ch = 0; ch < N; ch++) {
+    seed = seed * 1664525u + 1013904223u;
+    data.raw[ch] = static_cast<uint16_t>(seed >> 16);
+  }
+}
+
+// ── Self-test ───────────────────────────────────────────────
+// 1. Sweeps every Q16 linear value through the LUT and float
+//    encoders of each transfer curve, and every 8-bit code they
+//    produce through decode + encode, and counts mismatches
+//    (expected: 0).
+// 2. Runs a deterministic set of synthetic raw frames through both
+//    full pipelines and reports the largest 8-bit RGB difference
+//    (non-zero where Q16 rounding moves a value across a code
+//    boundary), the largest ΔE2000 between the two Lab outputs and
+//    the largest reflectance difference of the two spectra.
+// passed() holds both to Config::Color::SELFTEST_MAX_*.
+struct SelfTestResult {
+  uint32_t encodeMismatches;
+  uint32_t frames;
+  uint32_t frameMismatches;
+  int maxRgbDelta;
+  uint16_t maxDeltaE00;  // centi-ΔE2000
+  uint16_t maxReflDelta; // SpectralRecon::REFL_SCALE units
+
+  bool passed() const {
+    return encodeMismatches == 0 &&
+           maxRgbDelta <= Config::Color::SELFTEST_MAX_DRGB &&
+           maxDeltaE00 <= Config::Color::SELFTEST_MAX_DE00;
+  }
+};
+
+inline SelfTestResult selfTest(const Coefficients &k, uint32_t frames = 256) {
+  SelfTestResult res = {0, frames, 0, 0, 0, 0};
+
+  using OutputSpace::Transfer;
+  const Transfer transfers[] = {Transfer::SRGB, Transfer::GAMMA_563};
+  for (Transfer t : transfers) {
+    bool produced[256] = {};
+    for (int32_t v = 0; v <= Fixed::ONE_Q16; v++) {
+      uint8_t code = OutputSpace::encode(t, v);
+      produced[code] = true;
+      if (code != OutputSpace::encodeFloat(t, v * (1.0f / Fixed::ONE_Q16)))
+        res.encodeMismatches++;
+    }
+    for (int c = 0; c < 256; c++) {
+      uint8_t code = static_cast<uint8_t>(c);
+      if (produced[c] &&
+          OutputSpace::encode(t, OutputSpace::decode(t, code)) != code)
+        res.encodeMismatches++;
+    }
+  }
+
+  uint32_t seed = 0x12345678;
+  for (uint32_t f = 0; f < frames; f++) {
+    SpectralData a;
+    syntheticFrame(k, seed, a);
+    SpectralData b = a;
+    Float::process(k, a);
+    Fixed::process(k, b);
+
+    int d = abs(a.r - b.r);
+    d = d > abs(a.g - b.g) ? d : abs(a.g - b.g);
+    d = d > abs(a.b - b.b) ? d : abs(a.b - b.b);
+    if (d > 0)
+      res.frameMismatches++;
+    if (d > res.maxRgbDelta)
+      res.maxRgbDelta = d;
+
+    uint16_t de = ColorLab::deltaE2000(
+        ColorLab::fromFloat(a.L, a.a_star, a.b_star),
+        ColorLab::fromFloat(b.L, b.a_star, b.b_star));
+    if (de > res.maxDeltaE00)
+      res.maxDeltaE00 = de;
+
+    for (int i = 0; a.hasSpectrum && i < Config::Sensor::SPECTRUM_BANDS;
+         i++) {
+      int dr = abs(a.reflectance[i] - b.reflectance[i]);
+      if (dr > res.maxReflDelta)
+        res.maxReflDelta = static_cast<uint16_t>(dr);
+    }
+  }
+  return res;
+}
+
+// ── Benchmark ───────────────────────────────────────────────
+// Cost of one process() call on each path, averaged over `frames`
+// synthetic frames, in the units of `now()`: CPU cycles on the
+// device (COLOR_ENGINE_SELFTEST), ns on the host (engine_bench).
+// Frame generation is timed with both paths alike.
+struct BenchResult {
+  uint32_t frames;
+  uint32_t floatPerFrame;
+  uint32_t fixedPerFrame;
+};
+
+template <typename Now>
+inline BenchResult benchmark(const Coefficients &k, Now now,
+                             uint32_t frames = 256) {
+  BenchResult res = {frames, 0, 0};
+  if (frames == 0)
+    return res;
+  SpectralData d;
+  uint32_t seed = 0x12345678;
+  uint32_t start = now();
+  for (uint32_t f = 0; f < frames; f++) {
+    syntheticFrame(k, seed, d);
+    Float::process(k, d);
+  }
+  res.floatPerFrame = (now() - start) / frames;
+
+  seed = 0x12345678;
+  start = now();
+  for (uint32_t f = 0; f < frames; f++) {
+    syntheticFrame(k, seed, d);
+    Fixed::process(k, d);
+  }
+  res.fixedPerFrame = (now() - start) / frames;
+  return res;
+}
+
+} // namespace ColorEngine
@@ -0,0 +1,337 @@
+#pragma once
+// ============================================================
+// color_index.h – ΔE nearest-neighbour index over saved colors
+//
+// Lab of every saved color (20 bytes each) on a uniform grid of
+// INDEX_CELL-sized cubes (L 0..100, a/b -128..128, outer cells
+// open-ended), each cell a linked chain through the entries. Saves
+// insert in O(1), deletes unlink; compacting the log rebuilds it.
+//   - within(): every color within a ΔE00 radius. ΔE00 compresses
+//     chroma differences, so the ΔE*ab box searched grows with the
+//     query's chroma (scan()).
+//   - nearest(): grid shells around the query's cell, outward until
+//     the k closest by ΔE*ab are certain; the largest ΔE00 among them
+//     is the radius for a within() pass that returns the k closest by
+//     ΔE00.
+// Ids are record positions in the color log, as SavedColor::index.
+// Entries live in fixed chunks of Config::Storage::INDEX_CHUNK,
+// allocated as the index grows (never moved, so no reallocation
+// spike) while the heap keeps INDEX_HEAP_RESERVE free; insert()
+// fails past that.
+// Thread-safe: saves run on the storage task, queries on the app
+// and web server tasks.
+// ============================================================
+
+#include "color_lab.h"
+#include "config.h"
+#include <Arduino.h>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <vector>
+
+#ifdef ARDUINO
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#else
+#include <mutex>
+#endif
+
+class ColorIndex {
+public:
+  static constexpr int32_t CELL = Config::Storage::INDEX_CELL;
+  static constexpr uint32_t NONE = 0xFFFFFFFF; // chain end
+  static constexpr size_t CHUNK = Config::Storage::INDEX_CHUNK;
+
+  struct Hit {
+    uint32_t id;     // record in the color log
+    uint16_t deltaE; // centi-ΔE00 to the query
+    ColorLab::LabQ lab;
+    uint8_t r, g, b;
+  };
+
+  ColorIndex() { heads_.assign(CELLS, NONE); }
+
+  // Frees the entry storage as well
+  void clear() {
+    Lock lock(mutex_);
+    chunks_.clear();
+    size_ = 0;
+    heads_.assign(CELLS, NONE);
+  }
+
+  size_t size() const {
+    Lock lock(mutex_);
+    return size_;
+  }
+
+  // Adds a color saved as record `id`; false when no chunk can be
+  // allocated for it
+  bool insert(const ColorLab::LabQ &lab, uint8_t r, uint8_t g, uint8_t b,
+              uint32_t id) {
+    Lock lock(mutex_);
+    if (size_ == chunks_.size() * CHUNK && !grow())
+      return false;
+    int cell = cellOf(lab);
+    uint32_t i = static_cast<uint32_t>(size_++);
+    entry(i) = {lab, {r, g, b}, heads_[cell], id};
+    heads_[cell] = i;
+    return true;
+  }
+
+  // Drops record `id`; deleted records keep their place in the color
+  // log, so other ids are unchanged. False if it was not indexed.
+  bool remove(uint32_t id) {
+    Lock lock(mutex_);
+    for (uint32_t i = 0; i < size_; i++) {
+      if (entry(i).id != id)
+        continue;
+      // Unlink i, then move the last entry into its slot
+      unlink(i);
+      uint32_t last = static_cast<uint32_t>(size_ - 1);
+      if (i != last) {
+        *linkTo(last) = i;
+        entry(i) = entry(last);
+      }
+      size_--;
+      // Keep one spare chunk so a delete + save does not thrash
+      if (chunks_.size() * CHUNK >= size_ + 2 * CHUNK)
+        chunks_.pop_back();
+      return true;
+    }
+    return false;
+  }
+
+  // Up to k closest colors, ascending ΔE00; returns the count
+  int nearest(const ColorLab::LabQ &q, Hit *out, int k) const {
+    if (k <= 0)
+      return 0;
+    std::vector<uint32_t> bestD(k);
+    std::vector<uint32_t> bestI(k);
+    int found = 0;
+
+    Lock lock(mutex_);
+    int c[3];
+    cellCoords(q, c);
+    for (int r = 0;; r++) {
+      // Cells at Chebyshev distance r from the query's cell
+      for (int l = c[0] - r; l <= c[0] + r; l++) {
+        for (int a = c[1] - r; a <= c[1] + r; a++) {
+          for (int b = c[2] - r; b <= c[2] + r; b++) {
+            if (abs(l - c[0]) != r && abs(a - c[1]) != r &&
+                abs(b - c[2]) != r)
+              continue;
+            if (l < 0 || l >= NL || a < 0 || a >= NAB || b < 0 || b >= NAB)
+              continue;
+            for (uint32_t i = heads_[(l * NAB + a) * NAB + b]; i != NONE;
+                 i = entry(i).next)
+              keep(distance2(q, entry(i).lab), i, bestD.data(), bestI.data(),
+                   found, k);
+          }
+        }
+      }
+      // Anything unvisited is at least `gap` away
+      int32_t gap;
+      if (!remainingGap(q, c, r, gap))
+        break;
+      if (found == k && bestD[k - 1] <= static_cast<uint32_t>(gap) *
+                                            static_cast<uint32_t>(gap))
+        break;
+    }
+    if (found == 0)
+      return 0;
+
+    // The k closest by ΔE*ab bound the k-th ΔE00; the true k closest
+    // by ΔE00 are within that radius
+    uint16_t radius = 0;
+    for (int i = 0; i < found; i++) {
+      uint16_t de = ColorLab::deltaE2000(q, entry(bestI[i]).lab);
+      radius = de > radius ? de : radius;
+    }
+    return scan(q, radius, out, k);
+  }
+
+  // Colors within `radius` centi-ΔE00, ascending; at most maxOut
+  // written, returns that count
+  int within(const ColorLab::LabQ &q, uint16_t radius, Hit *out,
+             int maxOut) const {
+    Lock lock(mutex_);
+    return scan(q, radius, out, maxOut);
+  }
+
+private:
+  // Grid: L* 0..100 and a*/b* -128..128 in CELL steps
+  static constexpr int32_t AB_MIN = -12800;
+  static constexpr int NL = (10000 + CELL - 1) / CELL;
+  static constexpr int NAB = (25600 + CELL - 1) / CELL;
+  static constexpr int CELLS = NL * NAB * NAB;
+
+  struct Entry {
+    ColorLab::LabQ lab;
+    uint8_t rgb[3];
+    uint32_t next; // next entry in the same cell
+    uint32_t id;
+  };
+
+#ifdef ARDUINO
+  struct Mutex {
+    SemaphoreHandle_t h = xSemaphoreCreateMutex();
+  };
+  struct Lock {
+    explicit Lock(Mutex &m) : m_(m) { xSemaphoreTake(m_.h, portMAX_DELAY); }
+    ~Lock() { xSemaphoreGive(m_.h); }
+    Mutex &m_;
+  };
+#else
+  using Mutex = std::mutex;
+  using Lock = std::lock_guard<std::mutex>;
+#endif
+
+  // ΔE00 radius search over the ΔE*ab box that can hold it
+  // (ColorLab::deltaE2000Box)
+  int scan(const ColorLab::LabQ &q, uint16_t radius, Hit *out,
+           int maxOut) const {
+    const ColorLab::DeltaEBox box = ColorLab::deltaE2000Box(q, radius);
+    const int32_t boxL = box.L, boxAB = box.ab;
+    int lo[3], hi[3];
+    cellCoords(clampLab(q.L - boxL, q.a - boxAB, q.b - boxAB), lo);
+    cellCoords(clampLab(q.L + boxL, q.a + boxAB, q.b + boxAB), hi);
+
+    int n = 0;
+    for (int l = lo[0]; l <= hi[0]; l++)
+      for (int a = lo[1]; a <= hi[1]; a++)
+        for (int b = lo[2]; b <= hi[2]; b++)
+          for (uint32_t i = heads_[(l * NAB + a) * NAB + b]; i != NONE;
+               i = entry(i).next) {
+            const ColorLab::LabQ &p = entry(i).lab;
+            if (abs(p.L - q.L) > boxL || abs(p.a - q.a) > boxAB ||
+                abs(p.b - q.b) > boxAB)
+              continue;
+            Hit h = hitOf(i, q);
+            if (h.deltaE <= radius)
+              n = insertSorted(h, out, n, maxOut);
+          }
+    return n;
+  }
+
+  static int axisCell(int32_t v, int32_t origin, int n) {
+    int32_t c = (v - origin) / CELL;
+    if (v < origin)
+      c = 0;
+    return c >= n ? n - 1 : static_cast<int>(c);
+  }
+
+  static void cellCoords(const ColorLab::LabQ &q, int *c) {
+    c[0] = axisCell(q.L, 0, NL);
+    c[1] = axisCell(q.a, AB_MIN, NAB);
+    c[2] = axisCell(q.b, AB_MIN, NAB);
+  }
+
+  static int cellOf(const ColorLab::LabQ &q) {
+    int c[3];
+    cellCoords(q, c);
+    return (c[0] * NAB + c[1]) * NAB + c[2];
+  }
+
+  static ColorLab::LabQ clampLab(int32_t L, int32_t a, int32_t b) {
+    return {ColorLab::clamp16(L), ColorLab::clamp16(a), ColorLab::clamp16(b)};
+  }
+
+  // Smallest distance from q to a cell outside the (2r+1)³ block
+  // around c; false once the block covers the whole grid
+  static bool remainingGap(const ColorLab::LabQ &q, const int *c, int r,
+                           int32_t &gap) {
+    const int32_t v[3] = {q.L, q.a, q.b};
+    const int32_t origin[3] = {0, AB_MIN, AB_MIN};
+    const int n[3] = {NL, NAB, NAB};
+    bool any = false;
+    gap = INT32_MAX;
+    for (int ax = 0; ax < 3; ax++) {
+      if (c[ax] - r > 0) {
+        int32_t g = v[ax] - (origin[ax] + (c[ax] - r) * CELL);
+        gap = g < gap ? g : gap;
+        any = true;
+      }
+      if (c[ax] + r < n[ax] - 1) {
+        int32_t g = origin[ax] + (c[ax] + r + 1) * CELL - v[ax];
+        gap = g < gap ? g : gap;
+        any = true;
+      }
+    }
+    if (gap < 0)
+      gap = 0;
+    return any;
+  }
+
+  static uint32_t distance2(const ColorLab::LabQ &q, const ColorLab::LabQ &p) {
+    int32_t dL = q.L - p.L, da = q.a - p.a, db = q.b - p.b;
+    return static_cast<uint32_t>(dL * dL) + static_cast<uint32_t>(da * da) +
+           static_cast<uint32_t>(db * db);
+  }
+
+  // Keeps the `want` smallest distances, ascending
+  static void keep(uint32_t d, uint32_t idx, uint32_t *bestD, uint32_t *bestI,
+                   int &found, int want) {
+    if (found == want && d >= bestD[want - 1])
+      return;
+    int i = found < want ? found++ : want - 1;
+    for (; i > 0 && bestD[i - 1] > d; i--) {
+      bestD[i] = bestD[i - 1];
+      bestI[i] = bestI[i - 1];
+    }
+    bestD[i] = d;
+    bestI[i] = idx;
+  }
+
+  // Inserts h into out[0..n) by ΔE, capped at cap; returns the new n
+  static int insertSorted(const Hit &h, Hit *out, int n, int cap) {
+    if (n == cap && (cap == 0 || h.deltaE >= out[n - 1].deltaE))
+      return n;
+    int i = n < cap ? n++ : cap - 1;
+    for (; i > 0 && out[i - 1].deltaE > h.deltaE; i--)
+      out[i] = out[i - 1];
+    out[i] = h;
+    return n;
+  }
+
+  Hit hitOf(uint32_t i, const ColorLab::LabQ &q) const {
+    const Entry &e = entry(i);
+    return {e.id, ColorLab::deltaE2000(q, e.lab), e.lab,
+            e.rgb[0], e.rgb[1], e.rgb[2]};
+  }
+
+  // The link (cell head or predecessor's next) that points at i
+  uint32_t *linkTo(uint32_t i) {
+    uint32_t *link = &heads_[cellOf(entry(i).lab)];
+    while (*link != i)
+      link = &entry(*link).next;
+    return link;
+  }
+
+  void unlink(uint32_t i) { *linkTo(i) = entry(i).next; }
+
+  Entry &entry(uint32_t i) { return chunks_[i / CHUNK][i % CHUNK]; }
+  const Entry &entry(uint32_t i) const {
+    return chunks_[i / CHUNK][i % CHUNK];
+  }
+
+  // One more chunk, unless that would eat into the heap reserve
+  bool grow() {
+#ifdef ARDUINO
+    if (ESP.getFreeHeap() <
+        sizeof(Entry) * CHUNK + Config::Storage::INDEX_HEAP_RESERVE)
+      return false;
+#endif
+    Entry *chunk = new (std::nothrow) Entry[CHUNK];
+    if (!chunk)
+      return false;
+    chunks_.emplace_back(chunk);
+    return true;
+  }
+
+  std::vector<std::unique_ptr<Entry[]>> chunks_;
+  size_t size_ = 0;
+  std::vector<uint32_t> heads_;
+  mutable Mutex mutex_;
+};
@@ -0,0 +1,459 @@
+#pragma once
+// ============================================================
+// color_lab.h – CIE L*a*b* / LCh and color difference (ΔE)
+//
+// Integer implementation for the FPU-less ESP32-C6:
+//   - Lab from Q16 XYZ (D65 white) with a 225-entry cube-root LUT
+//   - LCh hue from an octant-reduced atan LUT
+//   - ΔE76, ΔE94 (graphic arts) and ΔE2000, all hue/lightness
+//     weighting terms read from per-degree / per-L* tables
+// Values are carried as LabQ in centi-units (L* 53.21 → 5321).
+// ΔE functions return centi-ΔE (1.00 → 100).
+//
+// Tables generated offline from the CIE formulas (Sharma et al.
+// 2005 for ΔE2000); with linear interpolation the results stay
+// within 0.06 ΔE of the double-precision formulas.
+// ============================================================
+
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+
+namespace ColorLab {
+
+// ── Lab in centi-units ──────────────────────────────────────
+struct LabQ {
+  int16_t L, a, b;
+};
+
+// D65 reference white, Q16 reciprocals (Yn = 1)
+constexpr uint32_t kInvXnQ16 = 68951; // 1 / 0.95047
+constexpr uint32_t kInvZnQ16 = 60190; // 1 / 1.08883
+
+// cbrt(i / 256) in Q16 for i = 32..256
+constexpr uint32_t kCbrtQ16[225] = {
+    32768, 33106, 33437, 33762, 34080, 34393, 34700, 35002, 35298, 35590,
+    35877, 36160, 36438, 36712, 36982, 37248, 37510, 37769, 38024, 38276,
+    38524, 38770, 39012, 39251, 39488, 39721, 39952, 40181, 40406, 40630,
+    40850, 41069, 41285, 41499, 41711, 41920, 42128, 42333, 42537, 42739,
+    42938, 43136, 43332, 43526, 43719, 43910, 44099, 44287, 44473, 44658,
+    44841, 45022, 45202, 45381, 45558, 45734, 45909, 46082, 46254, 46424,
+    46594, 46762, 46929, 47095, 47260, 47423, 47586, 47747, 47907, 48066,
+    48224, 48381, 48538, 48693, 48847, 49000, 49152, 49303, 49454, 49603,
+    49751, 49899, 50046, 50192, 50337, 50481, 50624, 50767, 50909, 51050,
+    51190, 51330, 51468, 51606, 51744, 51880, 52016, 52151, 52285, 52419,
+    52552, 52685, 52816, 52947, 53078, 53208, 53337, 53465, 53593, 53720,
+    53847, 53973, 54099, 54224, 54348, 54472, 54595, 54718, 54840, 54962,
+    55083, 55203, 55323, 55443, 55562, 55680, 55798, 55916, 56032, 56149,
+    56265, 56381, 56496, 56610, 56724, 56838, 56951, 57064, 57176, 57288,
+    57400, 57511, 57621, 57731, 57841, 57951, 58059, 58168, 58276, 58384,
+    58491, 58598, 58705, 58811, 58917, 59022, 59127, 59232, 59336, 59440,
+    59543, 59647, 59749, 59852, 59954, 60056, 60157, 60258, 60359, 60460,
+    60560, 60659, 60759, 60858, 60957, 61055, 61153, 61251, 61349, 61446,
+    61543, 61640, 61736, 61832, 61928, 62023, 62118, 62213, 62308, 62402,
+    62496, 62590, 62683, 62776, 62869, 62962, 63054, 63146, 63238, 63329,
+    63420, 63511, 63602, 63693, 63783, 63873, 63963, 64052, 64141, 64230,
+    64319, 64407, 64496, 64584, 64671, 64759, 64846, 64933, 65020, 65107,
+    65193, 65279, 65365, 65451, 65536,
+};
+
+// atan(i / 256) in centidegrees for i = 0..256
+constexpr uint16_t kAtanCdeg[257] = {
+    0,    22,   45,   67,   90,   112,  134,  157,  179,  201,
+    224,  246,  268,  291,  313,  335,  358,  380,  402,  424,
+    447,  469,  491,  513,  536,  558,  580,  602,  624,  646,
+    668,  690,  713,  735,  757,  779,  800,  822,  844,  866,
+    888,  910,  932,  953,  975,  997,  1019, 1040, 1062, 1084,
+    1105, 1127, 1148, 1170, 1191, 1213, 1234, 1255, 1277, 1298,
+    1319, 1340, 1361, 1383, 1404, 1425, 1446, 1467, 1488, 1508,
+    1529, 1550, 1571, 1592, 1612, 1633, 1653, 1674, 1695, 1715,
+    1735, 1756, 1776, 1796, 1817, 1837, 1857, 1877, 1897, 1917,
+    1937, 1957, 1977, 1997, 2016, 2036, 2056, 2075, 2095, 2114,
+    2134, 2153, 2172, 2192, 2211, 2230, 2249, 2268, 2287, 2306,
+    2325, 2344, 2363, 2382, 2400, 2419, 2438, 2456, 2475, 2493,
+    2511, 2530, 2548, 2566, 2584, 2603, 2621, 2639, 2657, 2674,
+    2692, 2710, 2728, 2745, 2763, 2780, 2798, 2815, 2833, 2850,
+    2867, 2885, 2902, 2919, 2936, 2953, 2970, 2987, 3003, 3020,
+    3037, 3053, 3070, 3086, 3103, 3119, 3136, 3152, 3168, 3184,
+    3201, 3217, 3233, 3249, 3264, 3280, 3296, 3312, 3327, 3343,
+    3359, 3374, 3390, 3405, 3420, 3436, 3451, 3466, 3481, 3496,
+    3511, 3526, 3541, 3556, 3571, 3585, 3600, 3615, 3629, 3644,
+    3658, 3673, 3687, 3701, 3716, 3730, 3744, 3758, 3772, 3786,
+    3800, 3814, 3828, 3841, 3855, 3869, 3882, 3896, 3909, 3923,
+    3936, 3950, 3963, 3976, 3989, 4003, 4016, 4029, 4042, 4055,
+    4067, 4080, 4093, 4106, 4119, 4131, 4144, 4156, 4169, 4181,
+    4194, 4206, 4218, 4231, 4243, 4255, 4267, 4279, 4291, 4303,
+    4315, 4327, 4339, 4351, 4363, 4374, 4386, 4397, 4409, 4421,
+    4432, 4443, 4455, 4466, 4478, 4489, 4500,
+};
+
+// sin(d°) in Q15 for d = 0..90
+constexpr int16_t kSinQ15[91] = {
+    0,     572,   1144,  1715,  2286,  2856,  3425,  3993,  4560,  5126,
+    5690,  6252,  6813,  7371,  7927,  8481,  9032,  9580,  10126, 10668,
+    11207, 11743, 12275, 12803, 13328, 13848, 14364, 14876, 15383, 15886,
+    16383, 16876, 17364, 17846, 18323, 18794, 19260, 19720, 20173, 20621,
+    21062, 21497, 21925, 22347, 22762, 23170, 23571, 23964, 24351, 24730,
+    25101, 25465, 25821, 26169, 26509, 26841, 27165, 27481, 27788, 28087,
+    28377, 28659, 28932, 29196, 29451, 29697, 29934, 30162, 30381, 30591,
+    30791, 30982, 31163, 31335, 31498, 31650, 31794, 31927, 32051, 32165,
+    32269, 32364, 32448, 32523, 32587, 32642, 32687, 32722, 32747, 32762,
+    32767,
+};
+
+// ΔE2000 hue weighting T(h') in Q14, h' = 0..360°
+constexpr int16_t kTQ14[361] = {
+    21631, 21368, 21096, 20815, 20526, 20230, 19929, 19623, 19313, 19001,
+    18687, 18373, 18058, 17745, 17434, 17126, 16822, 16521, 16226, 15936,
+    15652, 15375, 15105, 14842, 14587, 14340, 14101, 13871, 13649, 13436,
+    13232, 13036, 12849, 12671, 12500, 12338, 12184, 12038, 11898, 11767,
+    11642, 11523, 11411, 11304, 11203, 11107, 11015, 10929, 10846, 10767,
+    10691, 10618, 10548, 10481, 10416, 10353, 10292, 10232, 10175, 10119,
+    10064, 10011, 9959,  9909,  9861,  9814,  9769,  9726,  9686,  9648,
+    9614,  9582,  9554,  9530,  9510,  9494,  9484,  9480,  9481,  9489,
+    9503,  9525,  9555,  9593,  9639,  9694,  9759,  9834,  9919,  10014,
+    10120, 10236, 10364, 10504, 10654, 10817, 10991, 11176, 11373, 11582,
+    11802, 12033, 12274, 12526, 12788, 13060, 13341, 13630, 13928, 14233,
+    14544, 14862, 15184, 15511, 15842, 16175, 16510, 16846, 17181, 17515,
+    17847, 18176, 18501, 18820, 19134, 19439, 19737, 20025, 20304, 20571,
+    20826, 21068, 21296, 21510, 21709, 21892, 22058, 22208, 22339, 22453,
+    22548, 22625, 22683, 22722, 22742, 22742, 22724, 22687, 22632, 22558,
+    22467, 22358, 22233, 22092, 21935, 21764, 21579, 21381, 21172, 20952,
+    20722, 20483, 20238, 19986, 19729, 19469, 19206, 18943, 18680, 18419,
+    18160, 17906, 17658, 17417, 17184, 16960, 16748, 16547, 16359, 16185,
+    16026, 15884, 15758, 15650, 15560, 15490, 15439, 15408, 15397, 15407,
+    15438, 15491, 15564, 15658, 15773, 15908, 16063, 16238, 16432, 16644,
+    16873, 17119, 17381, 17657, 17947, 18249, 18562, 18885, 19217, 19555,
+    19899, 20246, 20597, 20947, 21298, 21645, 21989, 22327, 22658, 22980,
+    23291, 23590, 23876, 24146, 24400, 24636, 24853, 25050, 25225, 25376,
+    25505, 25608, 25686, 25737, 25761, 25758, 25727, 25667, 25579, 25462,
+    25317, 25142, 24940, 24709, 24451, 24166, 23855, 23518, 23157, 22772,
+    22364, 21935, 21486, 21018, 20533, 20032, 19517, 18990, 18451, 17904,
+    17349, 16789, 16225, 15659, 15093, 14530, 13970, 13417, 12871, 12334,
+    11809, 11297, 10799, 10319, 9856,  9413,  8992,  8593,  8217,  7867,
+    7544,  7247,  6979,  6740,  6531,  6353,  6205,  6089,  6005,  5953,
+    5932,  5944,  5987,  6062,  6168,  6304,  6470,  6666,  6890,  7141,
+    7419,  7722,  8050,  8400,  8772,  9165,  9576,  10004, 10447, 10905,
+    11375, 11856, 12346, 12843, 13345, 13851, 14359, 14868, 15375, 15879,
+    16378, 16871, 17356, 17831, 18296, 18748, 19186, 19610, 20017, 20406,
+    20778, 21130, 21461, 21772, 22060, 22326, 22570, 22789, 22985, 23157,
+    23305, 23428, 23527, 23601, 23652, 23679, 23683, 23663, 23621, 23557,
+    23472, 23366, 23241, 23096, 22934, 22754, 22558, 22346, 22121, 21882,
+    21631,
+};
+
+// ΔE2000 sin(2Δθ(h')) in Q15, h' = 180..360° (zero below 180°)
+constexpr int16_t kSin2DThetaQ15[181] = {
+    0,     0,     0,     0,     0,     0,     0,     0,     0,     0,
+    0,     0,     1,     1,     1,     1,     2,     2,     3,     3,
+    4,     5,     7,     9,     11,    14,    17,    21,    26,    32,
+    40,    49,    60,    73,    89,    108,   131,   158,   190,   227,
+    271,   323,   383,   453,   535,   628,   736,   860,   1001,  1162,
+    1343,  1549,  1780,  2039,  2328,  2650,  3006,  3399,  3830,  4302,
+    4816,  5373,  5975,  6621,  7312,  8047,  8824,  9643,  10500, 11391,
+    12313, 13261, 14229, 15211, 16199, 17188, 18169, 19134, 20077, 20990,
+    21866, 22700, 23485, 24217, 24894, 25511, 26068, 26563, 26996, 27369,
+    27681, 27934, 28129, 28267, 28350, 28377, 28350, 28267, 28129, 27934,
+    27681, 27369, 26996, 26563, 26068, 25511, 24894, 24217, 23485, 22700,
+    21866, 20990, 20077, 19134, 18169, 17188, 16199, 15211, 14229, 13261,
+    12313, 11391, 10500, 9643,  8824,  8047,  7312,  6621,  5975,  5373,
+    4816,  4302,  3830,  3399,  3006,  2650,  2328,  2039,  1780,  1549,
+    1343,  1162,  1001,  860,   736,   628,   535,   453,   383,   323,
+    271,   227,   190,   158,   131,   108,   89,    73,    60,    49,
+    40,    32,    26,    21,    17,    14,    11,    9,     7,     5,
+    4,     3,     3,     2,     2,     1,     1,     1,     1,     0,
+    0,
+};
+
+// ΔE2000 lightness weighting S_L(L̄') in Q16, L̄' = 0..100
+constexpr uint32_t kSLQ16[101] = {
+    114493, 113506, 112518, 111531, 110544, 109556, 108568, 107580, 106592, 105603,
+    104614, 103625, 102635, 101646, 100655, 99665,  98674,  97682,  96691,  95698,
+    94705,  93711,  92717,  91721,  90725,  89728,  88730,  87730,  86729,  85727,
+    84723,  83717,  82709,  81698,  80684,  79667,  78646,  77620,  76590,  75553,
+    74510,  73459,  72401,  71335,  70265,  69200,  68157,  67179,  66339,  65751,
+    65536,  65751,  66339,  67179,  68157,  69200,  70265,  71335,  72401,  73459,
+    74510,  75553,  76590,  77620,  78646,  79667,  80684,  81698,  82709,  83717,
+    84723,  85727,  86729,  87730,  88730,  89728,  90725,  91721,  92717,  93711,
+    94705,  95698,  96691,  97682,  98674,  99665,  100655, 101646, 102635, 103625,
+    104614, 105603, 106592, 107580, 108568, 109556, 110544, 111531, 112518, 113506,
+    114493,
+};
+
+// sqrt(C^7 / (C^7 + 25^7)) in Q16 for C = 0..128 (≈1 above)
+constexpr uint16_t kC7Q16[129] = {
+    0,     1,     9,     39,    107,   234,   444,   761,   1215,  1834,
+    2651,  3697,  5007,  6611,  8539,  10815, 13451, 16449, 19787, 23423,
+    27287, 31283, 35299, 39217, 42927, 46341, 49401, 52080, 54381, 56325,
+    57947, 59289, 60391, 61294, 62031, 62632, 63124, 63526, 63855, 64125,
+    64348, 64533, 64685, 64812, 64918, 65007, 65082, 65145, 65198, 65243,
+    65281, 65314, 65342, 65366, 65387, 65405, 65421, 65434, 65446, 65456,
+    65465, 65472, 65479, 65485, 65491, 65495, 65499, 65503, 65506, 65509,
+    65512, 65514, 65516, 65518, 65520, 65521, 65522, 65524, 65525, 65526,
+    65526, 65527, 65528, 65529, 65529, 65530, 65530, 65531, 65531, 65531,
+    65532, 65532, 65532, 65533, 65533, 65533, 65533, 65534, 65534, 65534,
+    65534, 65534, 65534, 65534, 65534, 65535, 65535, 65535, 65535, 65535,
+    65535, 65535, 65535, 65535, 65535, 65535, 65535, 65535, 65535, 65535,
+    65535, 65535, 65535, 65535, 65535, 65535, 65535, 65535, 65535,
+};
+
+// ── Integer helpers ─────────────────────────────────────────
+inline uint32_t isqrt(uint64_t v) {
+  uint64_t res = 0;
+  uint64_t bit = 1ULL << 62;
+  while (bit > v)
+    bit >>= 2;
+  while (bit != 0) {
+    if (v >= res + bit) {
+      v -= res + bit;
+      res = (res >> 1) + bit;
+    } else {
+      res >>= 1;
+    }
+    bit >>= 2;
+  }
+  return static_cast<uint32_t>(res);
+}
+
+// Cube root, Q16 in / Q16 out (t > 0)
+inline uint32_t cbrtQ16(uint32_t t) {
+  int msb = 31 - __builtin_clz(t);
+  // Scale by 2^(3m) into [2^22, 2^25) so the result scale is a shift
+  int m = (24 - msb + 30) / 3 - 10;
+  uint32_t u = m >= 0 ? t << (3 * m) : t >> (-3 * m);
+  uint32_t idx = (u >> 17) - 32;
+  uint32_t frac = u & 0x1FFFF;
+  uint32_t c = kCbrtQ16[idx] +
+               (((kCbrtQ16[idx + 1] - kCbrtQ16[idx]) * frac) >> 17);
+  int sh = 3 - m;
+  return sh >= 0 ? c << sh : c >> -sh;
+}
+
+// Lab companding f(t), Q16 in / Q16 out
+inline int32_t labF(uint32_t tQ16) {
+  if (tQ16 > 580) // ε = 216/24389
+    return static_cast<int32_t>(cbrtQ16(tQ16));
+  // (κ t + 16) / 116, κ = 24389/27
+  return static_cast<int32_t>(((uint64_t)tQ16 * 510338 >> 16) + 9039);
+}
+
+// atan2 in centidegrees, [0, 36000)
+inline int32_t atan2Cdeg(int32_t y, int32_t x) {
+  if (x == 0 && y == 0)
+    return 0;
+  uint32_t ax = abs(x), ay = abs(y);
+  bool swap = ay > ax;
+  uint32_t num = swap ? ax : ay;
+  uint32_t den = swap ? ay : ax;
+  uint32_t r = static_cast<uint32_t>(((uint64_t)num << 16) / den); // ≤ 1.0
+  uint32_t idx = r >> 8, frac = r & 0xFF;
+  int32_t a = kAtanCdeg[idx];
+  if (idx < 256)
+    a += ((kAtanCdeg[idx + 1] - a) * (int32_t)frac) >> 8;
+  if (swap)
+    a = 9000 - a;
+  if (x < 0)
+    a = 18000 - a;
+  if (y < 0)
+    a = 36000 - a;
+  return a >= 36000 ? a - 36000 : a;
+}
+
+// sin of centidegrees, Q15
+inline int32_t sinCdeg(int32_t a) {
+  a %= 36000;
+  if (a < 0)
+    a += 36000;
+  int32_t sign = 1;
+  if (a >= 18000) {
+    a -= 18000;
+    sign = -1;
+  }
+  if (a > 9000)
+    a = 18000 - a;
+  int32_t i = a / 100, f = a % 100;
+  int32_t v = kSinQ15[i];
+  if (i < 90)
+    v += ((kSinQ15[i + 1] - v) * f) / 100;
+  return sign * v;
+}
+
+// Per-degree table lookup with interpolation, centidegree input
+inline int32_t lookupDeg(const int16_t *table, int32_t cdeg) {
+  int32_t i = cdeg / 100, f = cdeg % 100;
+  int32_t v = table[i];
+  return v + ((table[i + 1] - v) * f) / 100;
+}
+
+// sqrt(C^7 / (C^7 + 25^7)), C in centi-units, Q16 out
+inline int32_t c7Ratio(int32_t cCenti) {
+  int32_t i = cCenti / 100;
+  if (i >= 128)
+    return 65536;
+  int32_t v = kC7Q16[i];
+  return v + ((kC7Q16[i + 1] - v) * (cCenti % 100)) / 100;
+}
+
+inline int16_t clamp16(int64_t v) {
+  return v > INT16_MAX ? INT16_MAX : (v < INT16_MIN ? INT16_MIN : (int16_t)v);
+}
+
+// ── XYZ → Lab / LCh ─────────────────────────────────────────
+// White point as Q16 reciprocals of Xn, Zn (Yn = 1); D65 by default
+inline LabQ fromXYZQ16(int32_t X, int32_t Y, int32_t Z,
+                       uint32_t invXnQ16 = kInvXnQ16,
+                       uint32_t invZnQ16 = kInvZnQ16) {
+  uint32_t tx = X > 0 ? (uint32_t)(((uint64_t)X * invXnQ16) >> 16) : 0;
+  uint32_t ty = Y > 0 ? (uint32_t)Y : 0;
+  uint32_t tz = Z > 0 ? (uint32_t)(((uint64_t)Z * invZnQ16) >> 16) : 0;
+  int64_t fx = labF(tx), fy = labF(ty), fz = labF(tz);
+
+  LabQ lab;
+  lab.L = clamp16(((fy * 11600 + (1 << 15)) >> 16) - 1600);
+  lab.a = clamp16(((fx - fy) * 50000 + (1 << 15)) >> 16);
+  lab.b = clamp16(((fy - fz) * 20000 + (1 << 15)) >> 16);
+  return lab;
+}
+
+inline int32_t chroma(int32_t a, int32_t b) {
+  return static_cast<int32_t>(isqrt((int64_t)a * a + (int64_t)b * b));
+}
+
+inline int32_t hueCdeg(int32_t a, int32_t b) { return atan2Cdeg(b, a); }
+
+inline LabQ fromFloat(float L, float a, float b) {
+  return {clamp16(lroundf(L * 100)), clamp16(lroundf(a * 100)),
+          clamp16(lroundf(b * 100))};
+}
+
+// Float reference (used by the float color engine)
+inline void fromXYZ(float X, float Y, float Z, float &L, float &a, float &b,
+                    float Xn = 0.95047f, float Zn = 1.08883f) {
+  auto f = [](float t) -> float {
+    return t > 216.0f / 24389.0f ? cbrtf(t)
+                                 : (24389.0f / 27.0f * t + 16.0f) / 116.0f;
+  };
+  float fx = f(X / Xn), fy = f(Y), fz = f(Z / Zn);
+  L = 116.0f * fy - 16.0f;
+  a = 500.0f * (fx - fy);
+  b = 200.0f * (fy - fz);
+}
+
+// ── Lab → XYZ ───────────────────────────────────────────────
+// Inverse companding f⁻¹(t), Q16 in / Q16 out (negative below 4/29)
+inline int32_t labFinv(int32_t fQ16) {
+  if (fQ16 > 13559) { // δ = 6/29
+    int64_t sq = ((int64_t)fQ16 * fQ16) >> 16;
+    return static_cast<int32_t>((sq * fQ16) >> 16);
+  }
+  // 3δ² (t − 4/29)
+  return static_cast<int32_t>(((int64_t)(fQ16 - 9039) * 8416) >> 16);
+}
+
+// Float reference
+inline float labFinv(float f) {
+  return f > 6.0f / 29.0f ? f * f * f : 108.0f / 841.0f * (f - 4.0f / 29.0f);
+}
+
+// ── Color differences (centi-ΔE) ────────────────────────────
+inline uint16_t saturate16(uint32_t v) { return v > 65535 ? 65535 : v; }
+
+inline uint16_t deltaE76(const LabQ &p, const LabQ &q) {
+  int64_t dL = q.L - p.L, da = q.a - p.a, db = q.b - p.b;
+  return saturate16(isqrt(dL * dL + da * da + db * db));
+}
+
+// CIE94, graphic arts weights (kL = 1, K1 = 0.045, K2 = 0.015);
+// p is the reference
+inline uint16_t deltaE94(const LabQ &p, const LabQ &q) {
+  int64_t C1 = chroma(p.a, p.b), C2 = chroma(q.a, q.b);
+  int64_t dL = q.L - p.L, dC = C2 - C1;
+  int64_t da = q.a - p.a, db = q.b - p.b;
+  int64_t dH2 = da * da + db * db - dC * dC;
+  if (dH2 < 0)
+    dH2 = 0;
+
+  int64_t SC = 65536 + ((C1 * 1932735) >> 16); // 1 + 0.045 C1
+  int64_t SH = 65536 + ((C1 * 644245) >> 16);  // 1 + 0.015 C1
+  int64_t tC = (dC << 16) / SC;
+  int64_t tH = ((int64_t)isqrt(dH2) << 16) / SH;
+  return saturate16(isqrt(dL * dL + tC * tC + tH * tH));
+}
+
+inline uint16_t deltaE2000(const LabQ &p, const LabQ &q) {
+  // a' correction
+  int32_t C1 = chroma(p.a, p.b), C2 = chroma(q.a, q.b);
+  int32_t onePlusG = 65536 + ((65536 - c7Ratio((C1 + C2) / 2)) >> 1);
+  int32_t a1 = (int32_t)(((int64_t)p.a * onePlusG) >> 16);
+  int32_t a2 = (int32_t)(((int64_t)q.a * onePlusG) >> 16);
+
+  int32_t C1p = chroma(a1, p.b), C2p = chroma(a2, q.b);
+  int32_t h1p = atan2Cdeg(p.b, a1), h2p = atan2Cdeg(q.b, a2);
+  bool achromatic = (C1p == 0 || C2p == 0);
+
+  // Differences
+  int64_t dL = q.L - p.L;
+  int64_t dC = C2p - C1p;
+  int32_t dh = 0;
+  if (!achromatic) {
+    dh = h2p - h1p;
+    if (dh > 18000)
+      dh -= 36000;
+    else if (dh < -18000)
+      dh += 36000;
+  }
+  int64_t dH = (2 * (int64_t)isqrt((int64_t)C1p * C2p) * sinCdeg(dh / 2)) >> 15;
+
+  // Means
+  int32_t Lbar = (p.L + q.L) / 2;
+  int32_t Cbar = (C1p + C2p) / 2;
+  int32_t hbar = h1p + h2p;
+  if (!achromatic) {
+    if (abs(h1p - h2p) <= 18000)
+      hbar /= 2;
+    else if (hbar < 36000)
+      hbar = (hbar + 36000) / 2;
+    else
+      hbar = (hbar - 36000) / 2;
+  }
+
+  // Weighting functions
+  int32_t li = Lbar < 0 ? 0 : (Lbar >= 10000 ? 9999 : Lbar);
+  int64_t SL = kSLQ16[li / 100] +
+               (((int64_t)kSLQ16[li / 100 + 1] - kSLQ16[li / 100]) *
+                (li % 100)) / 100;
+  int64_t T = lookupDeg(kTQ14, hbar);
+  int64_t SC = 65536 + (((int64_t)Cbar * 1932735) >> 16);   // 1 + 0.045 C̄'
+  int64_t SH = 65536 + (((int64_t)Cbar * T * 629) >> 20);   // 1 + 0.015 C̄' T
+  int64_t RC = 2 * (int64_t)c7Ratio(Cbar);                  // Q16
+  int64_t s2 = hbar >= 18000 ? lookupDeg(kSin2DThetaQ15, hbar - 18000) : 0;
+  int64_t RT = -(RC * s2) >> 15;                            // Q16
+
+  int64_t tL = (dL << 16) / SL;
+  int64_t tC = (dC << 16) / SC;
+  int64_t tH = (dH << 16) / SH;
+  int64_t sum = tL * tL + tC * tC + tH * tH + ((RT * tC * tH) >> 16);
+  return saturate16(isqrt(sum > 0 ? sum : 0));
+}
+
+// ΔE*ab box holding every color within `radius` centi-ΔE00 of q:
+// |ΔL*| ≤ L, |Δa*| and |Δb*| ≤ ab (centi-units). S_C, S_H and R_T
+// shrink chroma and hue differences by up to 4.5 + C̄*/10 (measured
+// over random Lab pairs within ΔE00 15), C̄* the mean chroma of the
+// pair, which is at most C*q + d/2 for a color d away: so
+// ΔL* ≤ 2·radius (S_L ≤ 1.75) and Δa*, Δb* ≤ d with
+// d = radius·(4.5 + C*q/10) / (1 - radius/20).
+struct DeltaEBox {
+  int32_t L, ab;
+};
+
+inline DeltaEBox deltaE2000Box(const LabQ &q, uint16_t radius) {
+  const int32_t c = chroma(q.a, q.b);
+  const int32_t denom = 1000 - radius / 2;
+  return {2 * static_cast<int32_t>(radius),
+          denom > 0 ? static_cast<int32_t>(static_cast<int64_t>(radius) *
+                                           (4500 + c) / denom)
+                    : INT16_MAX};
+}
+
+} // namespace ColorLab
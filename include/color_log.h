@@ -0,0 +1,231 @@
+#pragma once
+// ============================================================
+// color_log.h – Binary record log of saved colors
+//
+// The primary color store on SD (Config::Storage::COLORS_FILE):
+//   Header (32 bytes) | Record × count
+// Every record has the same size, so record i is at
+//   sizeof(Header) + i · sizeof(Record)
+// and is read with one seek. Appends write at the end of the last
+// whole record, so a record torn by power loss is overwritten by
+// the next save instead of misaligning the file.
+//
+// Each record carries its format version and a CRC-32 of its other
+// bytes; records that fail either check are skipped on load. A
+// delete rewrites the record in place with DELETED set – a tombstone
+// torn by power loss fails its CRC and is just as dead – and
+// StorageManager::compact() later drops dead records. Lab is
+// stored as ColorLab::LabQ and the spectrum in REFL_SCALE units, so
+// nothing is parsed on load.
+//
+// CSV is an export format only (formatCsv, on demand); a colors.csv
+// from before the log is imported once (StorageManager).
+// ============================================================
+
+#include "color_lab.h"
+#include "config.h"
+#include "crc32.h"
+#include "spectral_recon.h"
+#include "spectral_types.h"
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+// ── Saved Color Entry ───────────────────────────────────────
+struct SavedColor {
+  uint32_t timestamp; // epoch or millis
+  uint8_t r, g, b;
+  char hex[8]; // "#RRGGBB\0"
+  uint16_t raw[Config::Sensor::NUM_CHANNELS];
+  float L, a_star, b_star; // CIE Lab
+  bool hasLab;             // false for rows saved without Lab
+  uint16_t reflectance[Config::Sensor::SPECTRUM_BANDS]; // REFL_SCALE
+  bool hasSpectrum;
+  int index; // record position in the log (for deletion)
+};
+
+namespace ColorLog {
+
+constexpr uint32_t MAGIC = 0x31474C43; // "CLG1"
+constexpr uint16_t VERSION = 1;        // file layout
+constexpr uint8_t RECORD_VERSION = 1;  // record layout
+
+// Record flags
+constexpr uint8_t HAS_LAB = 0x01;
+constexpr uint8_t HAS_SPECTRUM = 0x02;
+constexpr uint8_t IN_GAMUT = 0x04;
+constexpr uint8_t DELETED = 0x08; // tombstone
+
+struct Header {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t recordSize; // sizeof(Record)
+  uint32_t reserved[5];
+  uint32_t crc; // CRC-32 of the bytes above
+};
+
+struct Record {
+  uint32_t timestamp;
+  uint8_t version; // RECORD_VERSION
+  uint8_t flags;
+  uint8_t rgb[3];
+  uint8_t reserved;
+  uint16_t raw[Config::Sensor::NUM_CHANNELS];
+  int16_t lab[3]; // ColorLab::LabQ
+  uint16_t reflectance[Config::Sensor::SPECTRUM_BANDS];
+  uint16_t reserved2;
+  uint32_t crc; // CRC-32 of the bytes above
+};
+
+static_assert(sizeof(Header) == 32, "color log header layout");
+static_assert(sizeof(Record) == 112, "color log record layout");
+
+constexpr size_t RECORD_CRC_BYTES = offsetof(Record, crc);
+
+inline size_t offset(uint32_t index) {
+  return sizeof(Header) + static_cast<size_t>(index) * sizeof(Record);
+}
+
+// Whole records in a log file of `size` bytes (a torn tail is not)
+inline uint32_t count(size_t size) {
+  return size < sizeof(Header)
+             ? 0
+             : static_cast<uint32_t>((size - sizeof(Header)) / sizeof(Record));
+}
+
+inline Header makeHeader() {
+  Header h = {};
+  h.magic = MAGIC;
+  h.version = VERSION;
+  h.recordSize = sizeof(Record);
+  h.crc = Crc32::update(0, &h, offsetof(Header, crc));
+  return h;
+}
+
+inline bool headerValid(const Header &h) {
+  return h.magic == MAGIC && h.version == VERSION &&
+         h.recordSize == sizeof(Record) &&
+         h.crc == Crc32::update(0, &h, offsetof(Header, crc));
+}
+
+inline void seal(Record &rec) {
+  rec.version = RECORD_VERSION;
+  rec.crc = Crc32::update(0, &rec, RECORD_CRC_BYTES);
+}
+
+inline bool recordValid(const Record &rec) {
+  return rec.version == RECORD_VERSION &&
+         rec.crc == Crc32::update(0, &rec, RECORD_CRC_BYTES);
+}
+
+// Valid and not deleted
+inline bool live(const Record &rec) {
+  return recordValid(rec) && !(rec.flags & DELETED);
+}
+
+inline void markDeleted(Record &rec) {
+  rec.flags |= DELETED;
+  seal(rec);
+}
+
+// ── SpectralData / SavedColor ↔ Record ──────────────────────
+inline void encode(const SpectralData &data, Record &rec) {
+  memset(&rec, 0, sizeof(rec));
+  rec.timestamp = data.timestamp;
+  rec.flags = HAS_LAB | (data.hasSpectrum ? HAS_SPECTRUM : 0) |
+              (data.inGamut ? IN_GAMUT : 0);
+  rec.rgb[0] = data.r;
+  rec.rgb[1] = data.g;
+  rec.rgb[2] = data.b;
+  memcpy(rec.raw, data.raw, sizeof(rec.raw));
+  ColorLab::LabQ lab = ColorLab::fromFloat(data.L, data.a_star, data.b_star);
+  rec.lab[0] = lab.L;
+  rec.lab[1] = lab.a;
+  rec.lab[2] = lab.b;
+  if (data.hasSpectrum)
+    memcpy(rec.reflectance, data.reflectance, sizeof(rec.reflectance));
+  seal(rec);
+}
+
+inline void encode(const SavedColor &color, Record &rec) {
+  memset(&rec, 0, sizeof(rec));
+  rec.timestamp = color.timestamp;
+  rec.flags = (color.hasLab ? HAS_LAB : 0) |
+              (color.hasSpectrum ? HAS_SPECTRUM : 0);
+  rec.rgb[0] = color.r;
+  rec.rgb[1] = color.g;
+  rec.rgb[2] = color.b;
+  memcpy(rec.raw, color.raw, sizeof(rec.raw));
+  ColorLab::LabQ lab = ColorLab::fromFloat(color.L, color.a_star, color.b_star);
+  rec.lab[0] = lab.L;
+  rec.lab[1] = lab.a;
+  rec.lab[2] = lab.b;
+  if (color.hasSpectrum)
+    memcpy(rec.reflectance, color.reflectance, sizeof(rec.reflectance));
+  seal(rec);
+}
+
+// False when the record fails its version / CRC check
+inline bool decode(const Record &rec, SavedColor &color) {
+  if (!recordValid(rec))
+    return false;
+  color.timestamp = rec.timestamp;
+  color.r = rec.rgb[0];
+  color.g = rec.rgb[1];
+  color.b = rec.rgb[2];
+  snprintf(color.hex, sizeof(color.hex), "#%02X%02X%02X", color.r, color.g,
+           color.b);
+  memcpy(color.raw, rec.raw, sizeof(color.raw));
+  color.hasLab = rec.flags & HAS_LAB;
+  color.L = rec.lab[0] * 0.01f;
+  color.a_star = rec.lab[1] * 0.01f;
+  color.b_star = rec.lab[2] * 0.01f;
+  color.hasSpectrum = rec.flags & HAS_SPECTRUM;
+  memcpy(color.reflectance, rec.reflectance, sizeof(color.reflectance));
+  return true;
+}
+
+inline ColorLab::LabQ labOf(const Record &rec) {
+  return {rec.lab[0], rec.lab[1], rec.lab[2]};
+}
+
+// ── CSV export ──────────────────────────────────────────────
+//   timestamp,r,g,b,hex,F1,F2,FZ,F3,F4,FY,F5,FXL,F6,F7,F8,NIR,
+//   Clear,FD,L,a,b,R400,R410,...,R700
+// (rows without Lab end after FD, rows without a spectrum after b)
+constexpr size_t CSV_LINE_MAX = 640;
+
+inline int formatCsvHeader(char *buf, size_t len) {
+  int n = snprintf(buf, len,
+                   "timestamp,r,g,b,hex,F1,F2,FZ,F3,F4,FY,F5,FXL,F6,F7,F8,"
+                   "NIR,Clear,FD,L,a,b");
+  for (int i = 0; i < Config::Sensor::SPECTRUM_BANDS && n < (int)len; i++)
+    n += snprintf(buf + n, len - n, ",R%d",
+                  Config::Sensor::SPECTRUM_START_NM +
+                      i * Config::Sensor::SPECTRUM_STEP_NM);
+  if (n < (int)len)
+    n += snprintf(buf + n, len - n, "\n");
+  return n;
+}
+
+// One line, '\n'-terminated; returns its length
+inline int formatCsv(const SavedColor &c, char *buf, size_t len) {
+  int n = snprintf(buf, len, "%lu,%d,%d,%d,%s", (unsigned long)c.timestamp,
+                   c.r, c.g, c.b, c.hex);
+  for (int i = 0; i < Config::Sensor::NUM_CHANNELS && n < (int)len; i++)
+    n += snprintf(buf + n, len - n, ",%u", c.raw[i]);
+  if (c.hasLab && n < (int)len)
+    n += snprintf(buf + n, len - n, ",%.2f,%.2f,%.2f", c.L, c.a_star,
+                  c.b_star);
+  for (int i = 0; c.hasLab && c.hasSpectrum &&
+                  i < Config::Sensor::SPECTRUM_BANDS && n < (int)len;
+       i++)
+    n += snprintf(buf + n, len - n, ",%.4f",
+                  c.reflectance[i] / (float)SpectralRecon::REFL_SCALE);
+  if (n < (int)len)
+    n += snprintf(buf + n, len - n, "\n");
+  return n;
+}
+
+} // namespace ColorLog
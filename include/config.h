@@ -7,6 +7,13 @@
 #include <Arduino.h>
 #include <cstdint>
 
+// Color engine implementation (see color_engine.h):
+//   1 = Q16 fixed-point (default, no soft-float in the hot path)
+//   0 = float reference path
+#ifndef COLOR_FIXED_POINT
+#define COLOR_FIXED_POINT 1
+#endif
+
 namespace Config {
 
 // ── Display (ST7789 172×320) ────────────────────────────────
@@ -35,6 +42,12 @@ constexpr int MISO = 5;
 constexpr int MOSI = 6; // shared with LCD
 constexpr int SCLK = 7; // shared with LCD
 constexpr int CS = 4;
+// 20 MHz = APB / 4, the fastest divider within the 25 MHz SPI-mode
+// limit of the card; SPI_FREQ_SAFE if it does not mount at that
+constexpr uint32_t SPI_FREQ = 20000000;
+constexpr uint32_t SPI_FREQ_SAFE = 4000000;
+// Longest SD work holds the bus while a frame waits (spi_bus.h)
+constexpr uint32_t BUS_SLICE_US = 20000;
 } // namespace SD
 
 // ── AS7343 Spectral Sensor (I²C) ───────────────────────────
@@ -44,17 +57,89 @@ constexpr int SCL = 19;
 constexpr int INT_PIN = 20;
 constexpr uint8_t I2C_ADDR = 0x39;
 
-constexpr uint32_t I2C_FREQ = 400000; // 400 kHz Fast Mode
+constexpr uint32_t I2C_FREQ = 400000;       // 400 kHz Fast Mode (fallback)
+constexpr uint32_t I2C_FREQ_FAST = 1000000; // 1 MHz Fast-mode Plus, if it probes OK
 
 // AS7343 has 14 channels across multiple SMUX configurations
 constexpr int NUM_CHANNELS = 14;
+// Reconstructed reflectance spectrum (spectral_recon.h)
+constexpr int SPECTRUM_BANDS = 31; // 400–700 nm
+constexpr int SPECTRUM_START_NM = 400;
+constexpr int SPECTRUM_STEP_NM = 10;
 
 // Integration time defaults (adjustable via calibration)
 constexpr uint8_t DEFAULT_ATIME = 29;   // (ATIME+1)*(ASTEP+1) = integration
-constexpr uint16_t DEFAULT_ASTEP = 599; // ~18ms integration time
+constexpr uint16_t DEFAULT_ASTEP = 599; // ~50 ms per SMUX phase (×3 for 18 ch)
 constexpr uint8_t DEFAULT_GAIN = 5;     // 16x gain (AS7343 gain index)
+
+// Auto-exposure: gain puts the peak channel near AE_TARGET_PCT of
+// full scale; integration is stretched only when gain is maxed out.
+constexpr bool AUTO_EXPOSURE = true;
+constexpr uint8_t AE_TARGET_PCT = 50;
+constexpr uint8_t AE_LOW_PCT = 20;      // below → underexposed
+constexpr uint8_t AE_HIGH_PCT = 85;     // above → step gain down
+constexpr uint8_t AE_SAT_PCT = 98;      // at or above → saturated
+constexpr uint16_t AE_ASTEP_MAX = 1799; // ~150 ms per SMUX phase
+constexpr int AE_MAX_RETAKES = 2;
+
+// Live stream on the 6-channel preview profile (FZ/FY/FXL/NIR/
+// Clear/FD, one SMUX phase: 3× the frame rate). Captures always
+// switch to the full 18-channel profile.
+constexpr bool PREVIEW_STREAM = true;
+
+// LED warm-up: the Clear-channel ramp after turn-on is recorded
+// with short preview-profile integrations (ATIME 0, LED_PROBE_ASTEP)
+// during gray calibration and the settle point stored with the
+// calibration. Without one, each turn-on is watched the same way
+// until consecutive probes agree within LED_SETTLE_TOL.
+constexpr uint16_t LED_PROBE_ASTEP = 999;   // ~2.8 ms per probe
+constexpr float LED_SETTLE_TOL = 0.005f;    // 0.5 % of the settled level
+constexpr uint32_t LED_SETTLE_MAX_MS = 150; // on-the-fly watch cap
+constexpr uint32_t LED_RAMP_MS = 250;       // characterization window
+constexpr uint32_t LED_COOL_MS = 500;       // LED off before the ramp
+
+// Flicker sync: before a measurement (at most every
+// FLICKER_RECHECK_MS) the FD channel is sampled with ~1 ms
+// integrations (ATIME 0, FLICKER_PROBE_ASTEP). 100 / 120 Hz ripple
+// of at least FLICKER_MIN_RIPPLE of the level snaps integration
+// times to whole ripple periods (flicker_sync.h).
+constexpr bool FLICKER_SYNC = true;
+constexpr uint16_t FLICKER_PROBE_ASTEP = 359; // 1.0 ms per probe
+constexpr uint32_t FLICKER_WINDOW_MS = 120;   // >= 2 / (120 - 100 Hz)
+constexpr float FLICKER_MIN_RIPPLE = 0.005f;  // 0.5 % of the FD level
+constexpr float FLICKER_SNR = 4.0f;           // vs. off-mains frequencies
+constexpr uint16_t FLICKER_MIN_COUNTS = 20;
+constexpr uint32_t FLICKER_RECHECK_MS = 30000;
+
+// Sequential sampling: frames are averaged until every channel's
+// standard error is within max(SE_TARGET_COUNTS, SE_TARGET_REL × mean)
+// or the sample cap is reached (bright targets stop after two).
+constexpr bool ADAPTIVE_SAMPLING = true;
+constexpr float SE_TARGET_COUNTS = 2.0f;
+constexpr float SE_TARGET_REL = 0.005f; // 0.5 % of the channel mean
+constexpr uint16_t MEASURE_MIN_SAMPLES = 2;
+constexpr uint16_t MEASURE_MAX_SAMPLES = 8;
+constexpr uint16_t CALIB_MIN_SAMPLES = 4;
+constexpr uint16_t CALIB_MAX_SAMPLES = 32;
 } // namespace Sensor
 
+// ── Color Engine ────────────────────────────────────────────
+namespace Color {
+constexpr bool FIXED_POINT = COLOR_FIXED_POINT != 0;
+// Chromatic adaptation for non-D65 illuminants (illuminant.h):
+// Bradford (ICC practice) or CAT02 (CIECAM02)
+constexpr bool CAT02 = false;
+// Out-of-gamut colors: true moves them onto the output space's
+// gamut boundary in LCh (gamut_map.h), false clamps each channel
+constexpr bool GAMUT_MAP = true;
+// Linear RGB overshoot still reported as in gamut (Q16, ~0.1 %)
+constexpr int32_t GAMUT_TOLERANCE_Q16 = 64;
+// Largest fixed vs float path difference ColorEngine::selfTest()
+// passes: 8-bit RGB codes, centi-ΔE2000
+constexpr int SELFTEST_MAX_DRGB = 1;
+constexpr uint16_t SELFTEST_MAX_DE00 = 5;
+} // namespace Color
+
 // ── Rotary Encoder ──────────────────────────────────────────
 namespace Encoder {
 constexpr int BTN_PIN = 2; // select / push button
@@ -70,23 +155,59 @@ constexpr uint32_t LONG_PRESS_MS = 800;
 
 // ── Storage ─────────────────────────────────────────────────
 namespace Storage {
-// CSV chosen over JSON for storage:
+// Binary record log for colors (color_log.h):
 // Justification:
-//   1. Lower memory footprint per record (no keys repeated)
-//   2. Easy append-only writes (no need to re-parse entire file)
-//   3. Human readable & trivially importable to spreadsheets
-//   4. ArduinoJson still used for calibration data (structured)
-constexpr const char *COLORS_FILE = "/colors.csv";
+//   1. Fixed-size records: record i is one seek away
+//   2. Append-only writes, CRC per record catches torn / bad sectors
+//   3. Loading copies records; no per-field String parsing
+//   4. CSV still available, generated on demand for spreadsheets
+//   5. ArduinoJson still used for calibration data (structured)
+constexpr const char *COLORS_FILE = "/colors.bin";
+constexpr const char *COLORS_TEMP = "/colors.tmp"; // rewrite target
+constexpr const char *COLORS_BAD = "/colors.bad";  // log with a bad header
+constexpr const char *COLORS_CSV = "/colors.csv";  // from before the log
+constexpr const char *COLORS_LEGACY = "/colors_v1.csv"; // imported CSV
 constexpr const char *CALIB_FILE = "/calibration.json";
-constexpr int MAX_SAVED_COLORS = 500;
+// Deletes only mark records dead; once COMPACT_DEAD_PCT of a file
+// (and at least COMPACT_MIN_DEAD records) is dead it is rewritten
+// without them, after COMPACT_IDLE_MS without input
+constexpr uint32_t COMPACT_MIN_DEAD = 16;
+constexpr uint32_t COMPACT_DEAD_PCT = 25;
+constexpr uint32_t COMPACT_IDLE_MS = 5000;
+// Write-behind (storage task): saves wait in a WRITE_QUEUE-deep queue
+// and are written BATCH_RECORDS per file in one SD transaction, at
+// most WRITE_BEHIND_MS after the first of them
+constexpr int WRITE_QUEUE = 16;
+constexpr int BATCH_RECORDS = 8;
+constexpr uint32_t WRITE_BEHIND_MS = 500;
+constexpr uint32_t FLUSH_TIMEOUT_MS = 2000; // flush() wait, e.g. at restart
+// List screens page through the files (record_cursor.h)
+constexpr int CURSOR_PAGE = 8;        // record positions per page
+constexpr int CURSOR_CACHE_PAGES = 4; // pages kept per list
+// Nearest saved color index (color_index.h)
+constexpr int32_t INDEX_CELL = 1600; // grid cell edge, centi-ΔE*ab
+// Index storage grows INDEX_CHUNK entries (20 B each, no PSRAM) at
+// a time while the heap keeps INDEX_HEAP_RESERVE free: the radio
+// stacks start after the index is built (BLE wants 70 KB, then
+// WiFi 80 KB). Colors past that are kept but not matched, and
+// reported as unindexed.
+constexpr size_t INDEX_CHUNK = 256;
+constexpr uint32_t INDEX_HEAP_RESERVE = 160 * 1024;
 } // namespace Storage
 
+// ── Reference palette (flash partition, palette_db.h) ───────
+namespace Palette {
+constexpr const char *PARTITION = "palette"; // label in partitions.csv
+constexpr uint8_t SUBTYPE = 0x40;            // custom data subtype
+} // namespace Palette
+
 // ── UI ──────────────────────────────────────────────────────
 namespace UI {
 constexpr uint32_t MENU_ANIMATION_MS = 100;
 constexpr int FONT_SIZE_TITLE = 2;
 constexpr int FONT_SIZE_BODY = 1;
 constexpr int MENU_ITEM_HEIGHT = 28;
+constexpr int LIST_ROWS = 6; // saved colors / measurements visible
 constexpr int HEADER_HEIGHT = 30;
 constexpr int PADDING = 8;
 
@@ -116,7 +237,7 @@ constexpr uint8_t STEP_MED = 3;          // ~0.3mm
 constexpr uint8_t STEP_FAST = 8;         // ~0.8mm
 
 constexpr const char *DATA_FILE = "/measurements.csv";
-constexpr int MAX_SAVED_MEASUREMENTS = 500;
+constexpr const char *DATA_TEMP = "/measurements.tmp";        // rewrite target
 } // namespace Measure
 
 // ── Connectivity (WiFi + BLE) ───────────────────────────────
@@ -129,7 +250,8 @@ constexpr const char *MDNS_HOSTNAME = "espc6";
 // Web server
 constexpr uint16_t HTTP_PORT = 80;
 constexpr int WS_MAX_CLIENTS = 3;
-constexpr uint32_t WS_INTERVAL_MS = 300; // Live stream push interval
+constexpr uint32_t WS_INTERVAL_MS = 150; // Live stream push interval (≈ one sensor cycle)
+constexpr int API_PAGE_SIZE = 50; // saved records per /api/colors, /api/measurements
 
 // Authentication
 constexpr const char *DEFAULT_PIN = "1234";
@@ -154,13 +276,19 @@ constexpr const char *CONFIG_FILE = "/connectivity.json";
 // ── System ──────────────────────────────────────────────────
 namespace System {
 constexpr uint32_t TASK_STACK_UI = 8192;
-constexpr uint32_t TASK_STACK_SENSOR = 4096;
+// Sensor: the deepest path (measure → refine → Q16 gamut map) is
+// ~1.4 KB of frames by -fstack-usage, plus newlib's float printf
+// (~1.5 KB); 6 KB keeps ~3 KB spare. SensorManager logs the
+// high-water mark whenever it drops.
+constexpr uint32_t TASK_STACK_SENSOR = 6144;
 constexpr uint32_t TASK_STACK_INPUT = 4096;
 constexpr uint32_t TASK_STACK_CONNECTIVITY = 8192;
+constexpr uint32_t TASK_STACK_STORAGE = 4096;
 constexpr int TASK_PRIORITY_UI = 2;
 constexpr int TASK_PRIORITY_SENSOR = 3;
 constexpr int TASK_PRIORITY_INPUT = 4;
 constexpr int TASK_PRIORITY_CONNECTIVITY = 1;
+constexpr int TASK_PRIORITY_STORAGE = 1; // below UI: saves never preempt it
 constexpr int CORE_UI = 0;
 constexpr int CORE_OTHER = 0; // ESP32-C6 is single-core RISC-V
 } // namespace System
@@ -12,13 +12,16 @@
 
 #include "config.h"
 #include "events.h"
+#include "palette_db.h"
 #include "sensor_manager.h"
+#include "spi_bus.h"
 #include "storage_manager.h"
 #include <Arduino.h>
 #include <ArduinoJson.h>
 #include <ESPmDNS.h>
 #include <LittleFS.h>
 #include <WiFi.h>
+#include <memory>
 
 #include <ESPAsyncWebServer.h>
 
@@ -178,12 +181,6 @@ public:
     }
   }
 
-  // Set latest measurement for broadcasting
-  void setLiveData(const SpectralData &data) {
-    liveData_ = data;
-    hasLiveData_ = true;
-  }
-
   // Getters for UI status display
   bool isWiFiConnected() const { return wifiConnected_; }
   bool isAPMode() const { return apMode_; }
@@ -331,27 +328,39 @@ private:
                  handleStatus(request);
                });
 
-    server_.on("/api/colors", HTTP_GET,
+    // Subpaths are registered before /api/colors, which also matches
+    // them. CSV export of the color log:
+    server_.on("/api/colors/csv", HTTP_GET,
                [this](AsyncWebServerRequest *request) {
                  if (!checkAuth(request))
                    return;
-                 handleGetColors(request);
+                 handleDownloadColorsCsv(request);
                });
 
-    server_.on("/api/colors/csv", HTTP_GET,
+    // Closest saved colors (?L=&a=&b=, else the live frame; ?k= / ?r=)
+    server_.on("/api/colors/nearest", HTTP_GET,
                [this](AsyncWebServerRequest *request) {
                  if (!checkAuth(request))
                    return;
-                 handleDownloadColorsCsv(request);
+                 handleColorsNearest(request);
                });
 
-    server_.on("/api/measurements", HTTP_GET,
+    server_.on("/api/colors", HTTP_GET,
                [this](AsyncWebServerRequest *request) {
                  if (!checkAuth(request))
                    return;
-                 handleGetMeasurements(request);
+                 handleGetColors(request);
                });
 
+    // Closest reference palette color (?L=&a=&b=, else the live frame)
+    server_.on("/api/palette/nearest", HTTP_GET,
+               [this](AsyncWebServerRequest *request) {
+                 if (!checkAuth(request))
+                   return;
+                 handlePaletteNearest(request);
+               });
+
+    // Before /api/measurements, which also matches its subpaths
     server_.on("/api/measurements/csv", HTTP_GET,
                [this](AsyncWebServerRequest *request) {
                  if (!checkAuth(request))
@@ -359,6 +368,13 @@ private:
                  handleDownloadMeasurementsCsv(request);
                });
 
+    server_.on("/api/measurements", HTTP_GET,
+               [this](AsyncWebServerRequest *request) {
+                 if (!checkAuth(request))
+                   return;
+                 handleGetMeasurements(request);
+               });
+
     server_.on("/api/measure", HTTP_POST,
                [this](AsyncWebServerRequest *request) {
                  if (!checkAuth(request))
@@ -572,41 +588,107 @@ private:
     JsonDocument doc;
     auto &sensor = SensorManager::instance();
     doc["gain"] = sensor.getGainLabel();
-    doc["gainIndex"] = sensor.getGainIndex();
-    auto &cal = sensor.getCalibration();
+    doc["gainIndex"] = sensor.getGainSetting(); // GAIN_AUTO = auto-exposure
+    const Exposure &exp = sensor.getExposure();
+    doc["gainApplied"] = SensorManager::kGainLabels[exp.gainIndex];
+    doc["integrationMs"] = exp.integrationUs() / 1000.0f;
+    doc["previewStream"] = sensor.previewStream();
+    doc["frameMs"] = sensor.cycleTimeUs() / 1000.0f;
+    doc["flickerHz"] = sensor.flickerHz();
+    const As7343Source &src = sensor.getSource();
+    doc["i2cKHz"] = src.i2cFreq() / 1000;
+    doc["readUs"] = src.lastReadUs();
+    doc["readMaxUs"] = src.maxReadUs();
+    doc["readBudgetUs"] = src.readBudgetUs();
+    CalibrationData cal = sensor.getCalibration();
     doc["calibDark"] = cal.hasDark;
     doc["calibGray"] = cal.hasGray;
     doc["calibWhite"] = cal.hasWhite;
+    doc["reconSet"] = SpectralRecon::name(cal.reconSet);
+    doc["illuminant"] = Illuminant::name(sensor.illuminant());
+    doc["outputSpace"] = OutputSpace::name(sensor.outputSpace());
+    doc["gamut"] = sensor.gamutMap() ? "map" : "clip";
+    doc["paletteColors"] = PaletteDb::instance().count();
     doc["wifiMode"] = apMode_ ? "AP" : "STA";
     doc["ip"] = getIPAddress();
     doc["bleConnected"] = bleServerCallbacks_.isConnected();
     doc["wsClients"] = ws_.count();
     doc["freeHeap"] = ESP.getFreeHeap();
 
+    // SPI bus shared by LCD and SD (spi_bus.h)
+    JsonObject spi = doc["spi"].to<JsonObject>();
+    const SpiBus::Stats bus = SpiBus::instance().stats();
+    for (int i = 0; i < SpiBus::DEVICES; i++) {
+      const auto dev = static_cast<SpiBus::Device>(i);
+      const SpiBus::DeviceStats &d = bus.device[i];
+      JsonObject obj = spi[SpiBus::name(dev)].to<JsonObject>();
+      obj["mhz"] = d.clockHz / 1000000;
+      obj["busyPct"] = SpiBus::occupancy(bus, dev);
+      obj["transactions"] = d.transactions;
+      obj["maxHoldUs"] = d.maxHoldUs;
+      obj["waitMs"] = d.waitUs / 1000;
+      obj["maxWaitUs"] = d.maxWaitUs;
+      obj["yields"] = d.yields;
+    }
+
     String response;
     serializeJson(doc, response);
     request->send(200, "application/json", response);
   }
 
-  void handleGetColors(AsyncWebServerRequest *request) {
-    std::vector<SavedColor> colors;
-    StorageManager::instance().loadColors(colors);
+  static void colorToJson(const SavedColor &c, JsonObject obj) {
+    obj["i"] = c.index;
+    obj["r"] = c.r;
+    obj["g"] = c.g;
+    obj["b"] = c.b;
+    obj["hex"] = c.hex;
+    obj["ts"] = c.timestamp;
+    JsonArray raw = obj["raw"].to<JsonArray>();
+    for (int j = 0; j < Config::Sensor::NUM_CHANNELS; j++) {
+      raw.add(c.raw[j]);
+    }
+    if (c.hasLab) {
+      JsonArray lab = obj["lab"].to<JsonArray>();
+      lab.add(c.L);
+      lab.add(c.a_star);
+      lab.add(c.b_star);
+    }
+  }
 
-    JsonDocument doc;
-    JsonArray arr = doc.to<JsonArray>();
+  // ?from=&limit= of a paged list: record position to start at and
+  // page size, capped at API_PAGE_SIZE
+  static void pageParams(AsyncWebServerRequest *request, uint32_t &from,
+                         int &limit) {
+    from = 0;
+    limit = Config::Connectivity::API_PAGE_SIZE;
+    if (request->hasParam("from"))
+      from = max(0L, request->getParam("from")->value().toInt());
+    if (request->hasParam("limit"))
+      limit = constrain(request->getParam("limit")->value().toInt(), 1L,
+                        (long)Config::Connectivity::API_PAGE_SIZE);
+  }
 
-    for (auto &c : colors) {
-      JsonObject obj = arr.add<JsonObject>();
-      obj["i"] = c.index;
-      obj["r"] = c.r;
-      obj["g"] = c.g;
-      obj["b"] = c.b;
-      obj["hex"] = c.hex;
-      obj["ts"] = c.timestamp;
-      JsonArray raw = obj["raw"].to<JsonArray>();
-      for (int j = 0; j < Config::Sensor::NUM_CHANNELS; j++) {
-        raw.add(c.raw[j]);
+  // A page of saved colors (?from=&limit=; a short page is the last),
+  // or ?i=N for the one record at that position
+  void handleGetColors(AsyncWebServerRequest *request) {
+    JsonDocument doc;
+    if (request->hasParam("i")) {
+      SavedColor c;
+      long i = request->getParam("i")->value().toInt();
+      if (i < 0 || !StorageManager::instance().readColor(i, c)) {
+        request->send(404, "application/json", "{\"error\":\"no such color\"}");
+        return;
       }
+      colorToJson(c, doc.to<JsonObject>());
+    } else {
+      uint32_t from;
+      int limit;
+      pageParams(request, from, limit);
+      std::vector<SavedColor> colors(limit);
+      int n = StorageManager::instance().readColors(from, colors.data(), limit);
+      JsonArray arr = doc.to<JsonArray>();
+      for (int i = 0; i < n; i++)
+        colorToJson(colors[i], arr.add<JsonObject>());
     }
 
     String response;
@@ -614,22 +696,134 @@ private:
     request->send(200, "application/json", response);
   }
 
+  // CSV streamed from the color log on each request
   void handleDownloadColorsCsv(AsyncWebServerRequest *request) {
-    if (SD.exists(Config::Storage::COLORS_FILE)) {
-      request->send(SD, Config::Storage::COLORS_FILE, "text/csv");
+    sendCsv<ColorsCsv>(request);
+  }
+
+  // Query color for the nearest-color endpoints: ?L=&a=&b=, or
+  // ?hex=RRGGBB in the current output space, else the newest live
+  // frame. Sends the error response on failure.
+  bool queryLab(AsyncWebServerRequest *request, ColorLab::LabQ &q) {
+    if (request->hasParam("L") && request->hasParam("a") &&
+        request->hasParam("b")) {
+      q = ColorLab::fromFloat(request->getParam("L")->value().toFloat(),
+                              request->getParam("a")->value().toFloat(),
+                              request->getParam("b")->value().toFloat());
+      return true;
+    }
+    if (request->hasParam("hex")) {
+      const char *hex = request->getParam("hex")->value().c_str();
+      if (*hex == '#')
+        hex++;
+      char *end;
+      unsigned long rgb = strtoul(hex, &end, 16);
+      if (end - hex != 6 || *end != '\0') {
+        request->send(400, "application/json", "{\"error\":\"bad hex\"}");
+        return false;
+      }
+      q = OutputSpace::toLab(SensorManager::instance().outputSpace(),
+                             (rgb >> 16) & 0xFF, (rgb >> 8) & 0xFF, rgb & 0xFF);
+      return true;
+    }
+    SpectralData live;
+    SensorManager::instance().live().read(live);
+    if (!live.valid) {
+      request->send(409, "application/json", "{\"error\":\"no live frame\"}");
+      return false;
+    }
+    q = ColorLab::fromFloat(live.L, live.a_star, live.b_star);
+    return true;
+  }
+
+  void handlePaletteNearest(AsyncWebServerRequest *request) {
+    auto &palette = PaletteDb::instance();
+    if (!palette.isReady()) {
+      request->send(404, "application/json", "{\"error\":\"no palette\"}");
+      return;
+    }
+    ColorLab::LabQ q;
+    if (!queryLab(request, q))
+      return;
+
+    PaletteDb::Match m;
+    palette.nearest(q, m);
+    JsonDocument doc;
+    doc["name"] = m.name;
+    doc["palette"] = palette.title();
+    doc["index"] = m.index;
+    char hex[8];
+    snprintf(hex, sizeof(hex), "#%02X%02X%02X", m.r, m.g, m.b);
+    doc["hex"] = hex;
+    JsonArray lab = doc["lab"].to<JsonArray>();
+    lab.add(m.lab.L * 0.01f);
+    lab.add(m.lab.a * 0.01f);
+    lab.add(m.lab.b * 0.01f);
+    doc["dE00"] = m.deltaE * 0.01f;
+
+    String response;
+    serializeJson(doc, response);
+    request->send(200, "application/json", response);
+  }
+
+  // ?k=N closest (default 1), or ?r=ΔE00 for all within a radius
+  void handleColorsNearest(AsyncWebServerRequest *request) {
+    constexpr int MAX_HITS = 32;
+    ColorLab::LabQ q;
+    if (!queryLab(request, q))
+      return;
+
+    ColorIndex::Hit hits[MAX_HITS];
+    const ColorIndex &index = StorageManager::instance().colorIndex();
+    int n;
+    if (request->hasParam("r")) {
+      float r = request->getParam("r")->value().toFloat();
+      r = constrain(r, 0.0f, 100.0f);
+      n = index.within(q, static_cast<uint16_t>(r * 100 + 0.5f), hits,
+                       MAX_HITS);
     } else {
-      request->send(404, "application/json", "{\"error\":\"file not found\"}");
+      int k = request->hasParam("k") ? request->getParam("k")->value().toInt()
+                                     : 1;
+      n = index.nearest(q, hits, constrain(k, 1, MAX_HITS));
+    }
+
+    JsonDocument doc;
+    JsonArray arr = doc["matches"].to<JsonArray>();
+    for (int i = 0; i < n; i++) {
+      JsonObject obj = arr.add<JsonObject>();
+      obj["index"] = hits[i].id;
+      char hex[8];
+      snprintf(hex, sizeof(hex), "#%02X%02X%02X", hits[i].r, hits[i].g,
+               hits[i].b);
+      obj["hex"] = hex;
+      JsonArray lab = obj["lab"].to<JsonArray>();
+      lab.add(hits[i].lab.L * 0.01f);
+      lab.add(hits[i].lab.a * 0.01f);
+      lab.add(hits[i].lab.b * 0.01f);
+      obj["dE00"] = hits[i].deltaE * 0.01f;
     }
+    // Saved colors the index had no memory for, so never matched
+    doc["unindexed"] = StorageManager::instance().unindexedColors();
+
+    String response;
+    serializeJson(doc, response);
+    request->send(200, "application/json", response);
   }
 
+  // A page of saved measurements (?from=&limit=, as /api/colors)
   void handleGetMeasurements(AsyncWebServerRequest *request) {
-    std::vector<SavedMeasurement> measurements;
-    StorageManager::instance().loadMeasurements(measurements);
+    uint32_t from;
+    int limit;
+    pageParams(request, from, limit);
+    std::vector<SavedMeasurement> measurements(limit);
+    int n = StorageManager::instance().readMeasurements(
+        from, measurements.data(), limit);
 
     JsonDocument doc;
     JsonArray arr = doc.to<JsonArray>();
 
-    for (auto &m : measurements) {
+    for (int i = 0; i < n; i++) {
+      const SavedMeasurement &m = measurements[i];
       JsonObject obj = arr.add<JsonObject>();
       obj["i"] = m.index;
       obj["mm"] = m.value_mm;
@@ -642,12 +836,20 @@ private:
     request->send(200, "application/json", response);
   }
 
+  // Live rows only; the file itself keeps deleted rows until compacted
   void handleDownloadMeasurementsCsv(AsyncWebServerRequest *request) {
-    if (SD.exists(Config::Measure::DATA_FILE)) {
-      request->send(SD, Config::Measure::DATA_FILE, "text/csv");
-    } else {
-      request->send(404, "application/json", "{\"error\":\"file not found\"}");
-    }
+    sendCsv<MeasurementsCsv>(request);
+  }
+
+  // Chunked response formatted from the records as the client reads
+  // it: no export file, and the card is taken one page per chunk
+  template <typename Csv>
+  static void sendCsv(AsyncWebServerRequest *request) {
+    auto csv = std::make_shared<Csv>();
+    request->send(request->beginChunkedResponse(
+        "text/csv", [csv](uint8_t *buf, size_t maxLen, size_t) -> size_t {
+          return csv->read(buf, maxLen);
+        }));
   }
 
   void handlePostSettings(AsyncWebServerRequest *request) {
@@ -659,6 +861,42 @@ private:
       int rot = request->getParam("rotation")->value().toInt();
       EventQueue::send(EventType::REMOTE_SET_ROTATION, rot);
     }
+    if (request->hasParam("preview")) {
+      SensorManager::instance().setPreviewStream(
+          request->getParam("preview")->value().toInt() != 0);
+    }
+    if (request->hasParam("recon")) {
+      int set = SpectralRecon::find(request->getParam("recon")->value().c_str());
+      if (set < 0) {
+        request->send(400, "application/json",
+                      "{\"error\":\"unknown recon set\"}");
+        return;
+      }
+      EventQueue::send(EventType::REMOTE_SET_RECON, set);
+    }
+    if (request->hasParam("illum")) {
+      Illuminant::Id id;
+      if (!Illuminant::find(request->getParam("illum")->value().c_str(), id)) {
+        request->send(400, "application/json",
+                      "{\"error\":\"unknown illuminant\"}");
+        return;
+      }
+      SensorManager::instance().setIlluminant(id);
+    }
+    if (request->hasParam("space")) {
+      OutputSpace::Id id;
+      if (!OutputSpace::find(request->getParam("space")->value().c_str(),
+                             id)) {
+        request->send(400, "application/json",
+                      "{\"error\":\"unknown output space\"}");
+        return;
+      }
+      SensorManager::instance().setOutputSpace(id);
+    }
+    if (request->hasParam("gamut")) {
+      SensorManager::instance().setGamutMap(
+          request->getParam("gamut")->value() == "map");
+    }
     request->send(200, "application/json", "{\"ok\":true}");
   }
 
@@ -708,6 +946,7 @@ private:
     switch (type) {
     case WS_EVT_CONNECT:
       Serial.printf("[WS] Client #%u connected\n", client->id());
+      wsGen_ = 0; // resend the current frame so the new client has one
       break;
     case WS_EVT_DISCONNECT:
       Serial.printf("[WS] Client #%u disconnected\n", client->id());
@@ -742,8 +981,11 @@ private:
     }
   }
 
+  // Live frames come from the sensor SeqLock; nothing is sent while
+  // its generation is unchanged.
   void pushWebSocketData() {
-    if (ws_.count() == 0 || !hasLiveData_)
+    if (ws_.count() == 0 ||
+        !SensorManager::instance().live().readIfNewer(liveData_, wsGen_))
       return;
 
     JsonDocument doc;
@@ -757,16 +999,34 @@ private:
     snprintf(hex, sizeof(hex), "#%02X%02X%02X", liveData_.r, liveData_.g,
              liveData_.b);
     doc["hex"] = hex;
+    doc["inGamut"] = liveData_.inGamut;
 
     JsonArray channels = doc["ch"].to<JsonArray>();
     for (int i = 0; i < Config::Sensor::NUM_CHANNELS; i++) {
       channels.add(liveData_.calibrated[i]);
     }
+    doc["preview"] = liveData_.profile == SmuxProfile::PREVIEW; // 6 ch only
 
     doc["x"] = liveData_.cie_X;
     doc["y"] = liveData_.cie_Y;
     doc["z"] = liveData_.cie_Z;
 
+    JsonArray lab = doc["lab"].to<JsonArray>();
+    lab.add(liveData_.L);
+    lab.add(liveData_.a_star);
+    lab.add(liveData_.b_star);
+    JsonArray lch = doc["lch"].to<JsonArray>();
+    lch.add(liveData_.L);
+    lch.add(liveData_.C_star);
+    lch.add(liveData_.h_ab);
+
+    // Reflectance ×REFL_SCALE, 400–700 nm in 10 nm steps
+    if (liveData_.hasSpectrum) {
+      JsonArray refl = doc["refl"].to<JsonArray>();
+      for (int i = 0; i < Config::Sensor::SPECTRUM_BANDS; i++)
+        refl.add(liveData_.reflectance[i]);
+    }
+
     String msg;
     serializeJson(doc, msg);
     ws_.textAll(msg);
@@ -774,7 +1034,8 @@ private:
 
   // ── BLE Data Push ──────────────────────────────────────────
   void pushBLEData() {
-    if (!hasLiveData_ || !bleLiveChar_)
+    if (!bleLiveChar_ ||
+        !SensorManager::instance().live().readIfNewer(liveData_, bleGen_))
       return;
 
     // Pack color data into compact JSON for Web Bluetooth
@@ -786,6 +1047,7 @@ private:
     snprintf(hex, sizeof(hex), "#%02X%02X%02X", liveData_.r, liveData_.g,
              liveData_.b);
     doc["hex"] = hex;
+    doc["ig"] = liveData_.inGamut;
 
     JsonArray ch = doc["ch"].to<JsonArray>();
     for (int i = 0; i < Config::Sensor::NUM_CHANNELS; i++) {
@@ -803,18 +1065,9 @@ private:
     if (!StorageManager::instance().isInitialized())
       return;
 
-    if (!SD.exists(Config::Connectivity::CONFIG_FILE))
-      return;
-
-    File f = SD.open(Config::Connectivity::CONFIG_FILE, FILE_READ);
-    if (!f)
-      return;
-
     JsonDocument doc;
-    DeserializationError err = deserializeJson(doc, f);
-    f.close();
-
-    if (err)
+    if (!StorageManager::instance().loadJson(Config::Connectivity::CONFIG_FILE,
+                                             doc))
       return;
 
     config_.wifiEnabled = doc["wifiEnabled"] | true;
@@ -850,11 +1103,11 @@ private:
     doc["wifiPassword"] = config_.wifiPassword;
     doc["pin"] = config_.pin;
 
-    File f = SD.open(Config::Connectivity::CONFIG_FILE, FILE_WRITE);
-    if (!f)
+    if (!StorageManager::instance().saveJson(Config::Connectivity::CONFIG_FILE,
+                                             doc)) {
+      Serial.println("[Conn] Config could not be written");
       return;
-    serializeJsonPretty(doc, f);
-    f.close();
+    }
     Serial.println("[Conn] Config saved to SD");
   }
 
@@ -873,8 +1126,9 @@ private:
   ConnectivityConfig config_;
   String sessionToken_;
 
-  SpectralData liveData_;
-  bool hasLiveData_ = false;
+  SpectralData liveData_; // scratch copy of the sensor SeqLock
+  uint32_t wsGen_ = 0;    // last generation pushed, per channel
+  uint32_t bleGen_ = 0;
 
   bool initialized_ = false;
   bool wifiConnected_ = false;
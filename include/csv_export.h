@@ -0,0 +1,76 @@
+#pragma once
+// ============================================================
+// csv_export.h – Saved records as a streamed CSV download
+//
+// Produces the CSV a buffer at a time, for a chunked HTTP response
+// (AsyncWebServer calls read() from its TCP task). Nothing is
+// written to the card, and it is held only while one page of
+// CURSOR_PAGE records is read, so a large library neither stalls
+// the network stack nor keeps saves and frames off the bus.
+// Records committed after the download started may or may not be
+// included; saves still queued to the storage task are not.
+//
+// Source (StorageManager, SavedColors / SavedMeasurements) supplies
+//   Item, next(pos, out, max) – live Items from pos on, pos advanced,
+//   csvHeader(buf, len), csvRow(item, buf, len) – line lengths
+// ============================================================
+
+#include "config.h"
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+template <typename Source, size_t LINE_MAX,
+          int PAGE = Config::Storage::CURSOR_PAGE>
+class CsvExport {
+public:
+  using Item = typename Source::Item;
+
+  // Copies up to len bytes of CSV to buf; 0 once all was copied
+  size_t read(uint8_t *buf, size_t len) {
+    size_t n = 0;
+    while (n < len) {
+      if (lineAt_ == lineLen_ && !nextLine())
+        break;
+      size_t k = lineLen_ - lineAt_;
+      if (k > len - n)
+        k = len - n;
+      memcpy(buf + n, line_ + lineAt_, k);
+      n += k;
+      lineAt_ += k;
+    }
+    return n;
+  }
+
+private:
+  bool nextLine() {
+    int len;
+    if (!headerDone_) {
+      headerDone_ = true;
+      len = Source::csvHeader(line_, sizeof(line_));
+    } else {
+      if (next_ == got_) {
+        got_ = Source::next(pos_, items_, PAGE);
+        next_ = 0;
+        if (got_ == 0)
+          return false;
+      }
+      len = Source::csvRow(items_[next_++], line_, sizeof(line_));
+    }
+    // snprintf reports the untruncated length
+    lineLen_ = len < 0 ? 0 : len < static_cast<int>(sizeof(line_))
+                                 ? static_cast<size_t>(len)
+                                 : sizeof(line_) - 1;
+    lineAt_ = 0;
+    return true;
+  }
+
+  Item items_[PAGE];
+  int got_ = 0;
+  int next_ = 0;
+  uint32_t pos_ = 0;
+  bool headerDone_ = false;
+  char line_[LINE_MAX];
+  size_t lineLen_ = 0;
+  size_t lineAt_ = 0;
+};
@@ -9,10 +9,15 @@
 //   3. Sprite (off-screen buffer) support for smooth UI
 //   4. Cleaner C++ API
 //   5. Active maintenance with ESP32-C6 compatibility
+//
+// The SPI bus is shared with the SD card: everything that talks to
+// the panel holds a SpiBus lease (spi_bus.h), so a frame flush is
+// never interleaved with SD I/O.
 // ============================================================
 
 #define LGFX_USE_V1
 #include "config.h"
+#include "spi_bus.h"
 #include <Arduino.h>
 #include <LovyanGFX.hpp>
 
@@ -82,10 +87,14 @@ public:
   }
 
   bool init() {
-    lcd_.init();
-    lcd_.setRotation(Config::LCD::ROTATION);
-    lcd_.setBrightness(Config::LCD::BL_DEFAULT);
-    lcd_.fillScreen(TFT_BLACK);
+    SpiBus::instance().setClock(SpiBus::Device::LCD, Config::LCD::SPI_FREQ);
+    {
+      SpiBus::Lease lease(SpiBus::Device::LCD);
+      lcd_.init();
+      lcd_.setRotation(Config::LCD::ROTATION);
+      lcd_.setBrightness(Config::LCD::BL_DEFAULT);
+      lcd_.fillScreen(TFT_BLACK);
+    }
 
     // Create sprite (full-screen back buffer) for flicker-free rendering
     sprite_.createSprite(Config::LCD::WIDTH, Config::LCD::HEIGHT);
@@ -100,15 +109,21 @@ public:
   LGFX_Sprite &canvas() { return sprite_; }
 
   // Push sprite to display (call after drawing a complete frame)
-  void flush() { sprite_.pushSprite(&lcd_, 0, 0); }
+  void flush() {
+    SpiBus::Lease lease(SpiBus::Device::LCD);
+    sprite_.pushSprite(&lcd_, 0, 0);
+  }
 
-  // Direct LCD access (for special cases)
+  // Direct LCD access (for special cases; hold a SpiBus lease)
   LGFX_ColorPicker &lcd() { return lcd_; }
 
   void setBrightness(uint8_t level) { lcd_.setBrightness(level); }
 
   void setRotation(uint8_t rotation) {
-    lcd_.setRotation(rotation);
+    {
+      SpiBus::Lease lease(SpiBus::Device::LCD);
+      lcd_.setRotation(rotation);
+    }
     // Recreate sprite to match new dimensions
     sprite_.deleteSprite();
     int w = lcd_.width();
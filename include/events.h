@@ -37,6 +37,7 @@ enum class EventType : uint8_t {
   REMOTE_SET_ROTATION,  // Change screen rotation (data = 0-3)
   REMOTE_DELETE_COLOR,  // Delete color (data = index)
   REMOTE_DELETE_MEASUREMENT, // Delete measurement (data = index)
+  REMOTE_SET_RECON,     // Spectral reconstruction set (data = set index)
 
   // Connectivity events
   WIFI_CONNECTED,
@@ -0,0 +1,103 @@
+#pragma once
+// ============================================================
+// flicker_sync.h – Mains ripple detection and exposure snapping
+//
+// Fluorescent and most LED shop lighting ripples at twice the mains
+// frequency (100 Hz on 50 Hz grids, 120 Hz on 60 Hz). An
+// integration that is not a whole number of ripple periods catches
+// a varying part of a cycle, which shows up as frame-to-frame noise
+// that sequential sampling then has to average away.
+//   - detect(): ripple amplitude of the FD (flicker detect) channel
+//     at 100 and 120 Hz from a burst of ~1 ms integrations – a
+//     Hann-windowed DFT at the actual sample times – checked
+//     against the level and against off-mains frequencies.
+//   - snap(): nearest ASTEP giving a whole number of ripple periods
+//     (at least one) at the programmed ATIME.
+// ============================================================
+
+#include "config.h"
+#include "spectral_types.h"
+#include <cmath>
+#include <cstdint>
+
+namespace FlickerSync {
+
+constexpr int FD_CHANNEL = 13; // raw[] index of FD
+
+// Off-mains reference frequencies: a null of the Hann window away
+// from 100 / 120 Hz for windows of FLICKER_WINDOW_MS or longer
+constexpr float FLOOR_HZ_LOW = 80.0f;
+constexpr float FLOOR_HZ_HIGH = 150.0f;
+
+inline float mean(const uint16_t *v, int n) {
+  float sum = 0;
+  for (int i = 0; i < n; i++)
+    sum += v[i];
+  return sum / n;
+}
+
+// Amplitude (counts) of the component of v at hz; tUs are the
+// sample times in µs, ascending
+inline float amplitude(const uint16_t *v, const uint32_t *tUs, int n,
+                       float hz) {
+  const float avg = mean(v, n);
+  const float span = static_cast<float>(tUs[n - 1] - tUs[0]);
+  const float twoPi = 2.0f * (float)M_PI;
+  float re = 0, im = 0, wsum = 0;
+  for (int i = 0; i < n; i++) {
+    float t = static_cast<float>(tUs[i] - tUs[0]);
+    float w = 0.5f - 0.5f * cosf(twoPi * t / span);
+    float phase = twoPi * hz * t * 1e-6f;
+    float x = w * (v[i] - avg);
+    re += x * cosf(phase);
+    im -= x * sinf(phase);
+    wsum += w;
+  }
+  return wsum > 0 ? 2.0f * sqrtf(re * re + im * im) / wsum : 0.0f;
+}
+
+// Ripple frequency in the FD samples: 100, 120 or 0 (none)
+inline uint16_t detect(const uint16_t *fd, const uint32_t *tUs, int n,
+                       float *ripple = nullptr) {
+  using namespace Config::Sensor;
+  if (ripple)
+    *ripple = 0;
+  if (n < 16)
+    return 0;
+  const float level = mean(fd, n);
+  if (level < FLICKER_MIN_COUNTS)
+    return 0;
+
+  float a100 = amplitude(fd, tUs, n, 100.0f);
+  float a120 = amplitude(fd, tUs, n, 120.0f);
+  float floor = fmaxf(amplitude(fd, tUs, n, FLOOR_HZ_LOW),
+                      amplitude(fd, tUs, n, FLOOR_HZ_HIGH));
+  float best = fmaxf(a100, a120);
+  if (ripple)
+    *ripple = best / level;
+  if (best < FLICKER_MIN_RIPPLE * level || best < FLICKER_SNR * floor)
+    return 0;
+  return a100 >= a120 ? 100 : 120;
+}
+
+// Integration stretched or shortened to whole ripple periods;
+// unchanged when hz is 0
+inline Exposure snap(const Exposure &e, uint16_t hz) {
+  if (hz == 0)
+    return e;
+  const float periodUs = 1e6f / hz;
+  const float stepUs = 2.78f * (e.atime + 1);
+  float periods = roundf(e.integrationUs() / periodUs);
+  if (periods < 1)
+    periods = 1;
+  long steps = lroundf(periods * periodUs / stepUs);
+  if (steps < 1)
+    steps = 1;
+  if (steps > 65536)
+    steps = 65536;
+  Exposure out = e;
+  out.astep = static_cast<uint16_t>(steps - 1);
+  return out;
+}
+
+} // namespace FlickerSync
@@ -0,0 +1,220 @@
+#pragma once
+// ============================================================
+// gamut_map.h – Perceptual gamut mapping for the output spaces
+//
+// A color whose linear RGB falls outside [0, 1] is moved onto the
+// gamut boundary in LCh instead of clamping each channel (which
+// shifts hue and lightness of saturated samples):
+//   - the anchor is the neutral of the same L*, or when even that
+//     is out of range (white under A on a D65 display, L* > 100)
+//     the neutral ANCHOR_HEADROOM below the lightest one that fits
+//     (an anchor on the boundary leaves lines that run along it)
+//   - the color moves along the line to the anchor – hue kept, C*
+//     scaled down (and L* towards the anchor's) – to the first point
+//     inside: MARCH coarse steps from the color (the line can graze
+//     the boundary, so plain bisection could stop at a far crossing),
+//     then bisection down to 1/RESOLUTION of the line, and within
+//     that last step linearly onto the channel bound it crosses
+//     (else the limiting channel sits anywhere up to a step inside
+//     it – several 8-bit codes near black – and the two paths,
+//     whose bisections can stop a step apart, disagree there)
+// The Lab is the one already computed against the illuminant's
+// white; the space matrix takes that adapted XYZ to linear RGB.
+// Integer and float versions mirror each other so the two color
+// engine paths agree.
+// ============================================================
+
+#include "color_lab.h"
+#include "config.h"
+#include "illuminant.h"
+#include <cmath>
+#include <cstdint>
+
+namespace GamutMap {
+
+constexpr int32_t RESOLUTION = 1024; // line parameter t, Q10
+constexpr int32_t MARCH = 16;
+constexpr float ANCHOR_HEADROOM = 0.95f; // of the brightest neutral's Y
+constexpr int32_t ONE_Q16 = 1 << 16;
+
+// ── Integer (Q16 linear RGB) ────────────────────────────────
+inline bool inGamutQ16(const int32_t *lin,
+                       int32_t tol = Config::Color::GAMUT_TOLERANCE_Q16) {
+  for (int i = 0; i < 3; i++)
+    if (lin[i] < -tol || lin[i] > ONE_Q16 + tol)
+      return false;
+  return true;
+}
+
+// Q14 matrix × Q16 XYZ → Q16 RGB
+inline void mulQ14(const int32_t (&m)[3][3], const int64_t *xyz,
+                   int32_t *rgb) {
+  for (int i = 0; i < 3; i++) {
+    int64_t acc = xyz[0] * m[i][0] + xyz[1] * m[i][1] + xyz[2] * m[i][2];
+    rgb[i] = static_cast<int32_t>((acc + (1 << 13)) >> 14);
+  }
+}
+
+// lab against white w, space matrix m (XYZ → linear RGB, Q14);
+// writes in-gamut Q16 linear RGB
+inline void compressQ16(const ColorLab::LabQ &lab, const Illuminant::View &w,
+                        const int32_t (&m)[3][3], int32_t *lin) {
+  // Linear RGB of the illuminant's white; a neutral of luminance Y
+  // is Y times this
+  const int64_t white[3] = {w.xnQ16, ONE_Q16, w.znQ16};
+  int32_t wRgb[3];
+  mulQ14(m, white, wRgb);
+  int32_t wMax = wRgb[0] > wRgb[1] ? wRgb[0] : wRgb[1];
+  wMax = wMax > wRgb[2] ? wMax : wRgb[2];
+
+  const int32_t fy = static_cast<int32_t>(
+      ((static_cast<int64_t>(lab.L) + 1600) * ONE_Q16 + 5800) / 11600);
+  int64_t Y = ColorLab::labFinv(fy);
+  if (Y <= 0 || wMax <= 0) {
+    lin[0] = lin[1] = lin[2] = 0;
+    return;
+  }
+  int32_t fy0 = fy; // anchor
+  constexpr int64_t yMax = static_cast<int64_t>(ANCHOR_HEADROOM * (1LL << 32));
+  if (Y * wMax > yMax)
+    fy0 = ColorLab::labF(static_cast<uint32_t>(yMax / wMax));
+
+  // f(X/Xn) − f(Y) and f(Y) − f(Z/Zn) of the color, Q16
+  const int64_t da = static_cast<int64_t>(lab.a) * ONE_Q16 / 50000;
+  const int64_t db = static_cast<int64_t>(lab.b) * ONE_Q16 / 20000;
+  const int64_t dfy = fy - fy0;
+  auto rgbAt = [&](int32_t t, int32_t *rgb) { // 0 anchor .. 1 color, Q10
+    int32_t fyt = fy0 + static_cast<int32_t>((dfy * t) >> 10);
+    int32_t fx = fyt + static_cast<int32_t>((da * t) >> 10);
+    int32_t fz = fyt - static_cast<int32_t>((db * t) >> 10);
+    const int64_t xyz[3] = {(w.xnQ16 * (int64_t)ColorLab::labFinv(fx)) >> 16,
+                            ColorLab::labFinv(fyt),
+                            (w.znQ16 * (int64_t)ColorLab::labFinv(fz)) >> 16};
+    mulQ14(m, xyz, rgb);
+  };
+
+  // Coarse march from the color towards the anchor (t = 0 is inside)
+  const int32_t step = RESOLUTION / MARCH;
+  int32_t lo = RESOLUTION - step;
+  for (; lo > 0; lo -= step) {
+    rgbAt(lo, lin);
+    if (inGamutQ16(lin, 0))
+      break;
+  }
+  if (lo <= 0) {
+    lo = 0;
+    rgbAt(0, lin);
+  }
+  for (int32_t hi = lo + step; hi - lo > 1;) {
+    int32_t mid = (lo + hi) / 2;
+    int32_t rgb[3];
+    rgbAt(mid, rgb);
+    if (inGamutQ16(rgb, 0)) {
+      lo = mid;
+      lin[0] = rgb[0];
+      lin[1] = rgb[1];
+      lin[2] = rgb[2];
+    } else {
+      hi = mid;
+    }
+  }
+  int32_t out[3];
+  rgbAt(lo + 1, out);
+  int64_t s = ONE_Q16; // fraction of the step to the first bound, Q16
+  for (int i = 0; i < 3; i++) {
+    const int32_t bound = out[i] < 0 ? 0 : ONE_Q16;
+    if ((out[i] < 0 || out[i] > ONE_Q16) && out[i] != lin[i]) {
+      int64_t si = (static_cast<int64_t>(bound - lin[i]) << 16) /
+                   (out[i] - lin[i]);
+      s = si < s ? si : s;
+    }
+  }
+  s = s < 0 ? 0 : s;
+  for (int i = 0; i < 3; i++) {
+    int32_t v = lin[i] + static_cast<int32_t>(
+                             (static_cast<int64_t>(out[i] - lin[i]) * s) >> 16);
+    lin[i] = v < 0 ? 0 : v > ONE_Q16 ? ONE_Q16 : v;
+  }
+}
+
+// ── Float reference ─────────────────────────────────────────
+inline bool inGamut(const float *lin,
+                    float tol = Config::Color::GAMUT_TOLERANCE_Q16 /
+                                static_cast<float>(ONE_Q16)) {
+  for (int i = 0; i < 3; i++)
+    if (lin[i] < -tol || lin[i] > 1.0f + tol)
+      return false;
+  return true;
+}
+
+inline void mul(const Illuminant::Mat3 &m, const float *xyz, float *rgb) {
+  for (int i = 0; i < 3; i++)
+    rgb[i] = m.m[i][0] * xyz[0] + m.m[i][1] * xyz[1] + m.m[i][2] * xyz[2];
+}
+
+inline void compress(float L, float a, float b, const Illuminant::White &w,
+                     const Illuminant::Mat3 &m, float *lin) {
+  const float white[3] = {w.X, 1.0f, w.Z};
+  float wRgb[3];
+  mul(m, white, wRgb);
+  float wMax = fmax(fmax(wRgb[0], wRgb[1]), wRgb[2]);
+
+  const float fy = (L + 16.0f) / 116.0f;
+  float Y = ColorLab::labFinv(fy);
+  if (Y <= 0 || wMax <= 0) {
+    lin[0] = lin[1] = lin[2] = 0;
+    return;
+  }
+  float fy0 = fy; // anchor
+  if (Y * wMax > ANCHOR_HEADROOM) {
+    float Y0 = ANCHOR_HEADROOM / wMax;
+    fy0 = Y0 > 216.0f / 24389.0f ? cbrtf(Y0)
+                                 : (24389.0f / 27.0f * Y0 + 16.0f) / 116.0f;
+  }
+
+  auto rgbAt = [&](float t, float *rgb) { // 0 anchor .. 1 color
+    float fyt = fy0 + t * (fy - fy0);
+    const float xyz[3] = {w.X * ColorLab::labFinv(fyt + t * a / 500.0f),
+                          ColorLab::labFinv(fyt),
+                          w.Z * ColorLab::labFinv(fyt - t * b / 200.0f)};
+    mul(m, xyz, rgb);
+  };
+
+  const int32_t step = RESOLUTION / MARCH;
+  int32_t lo = RESOLUTION - step;
+  for (; lo > 0; lo -= step) {
+    rgbAt(lo / static_cast<float>(RESOLUTION), lin);
+    if (inGamut(lin, 0))
+      break;
+  }
+  if (lo <= 0) {
+    lo = 0;
+    rgbAt(0, lin);
+  }
+  for (int32_t hi = lo + step; hi - lo > 1;) {
+    int32_t mid = (lo + hi) / 2;
+    float rgb[3];
+    rgbAt(mid / static_cast<float>(RESOLUTION), rgb);
+    if (inGamut(rgb, 0)) {
+      lo = mid;
+      lin[0] = rgb[0];
+      lin[1] = rgb[1];
+      lin[2] = rgb[2];
+    } else {
+      hi = mid;
+    }
+  }
+  float out[3];
+  rgbAt((lo + 1) / static_cast<float>(RESOLUTION), out);
+  float s = 1.0f; // fraction of the step to the first bound
+  for (int i = 0; i < 3; i++) {
+    const float bound = out[i] < 0 ? 0.0f : 1.0f;
+    if ((out[i] < 0 || out[i] > 1.0f) && out[i] != lin[i])
+      s = fmin(s, (bound - lin[i]) / (out[i] - lin[i]));
+  }
+  s = fmax(s, 0.0f);
+  for (int i = 0; i < 3; i++)
+    lin[i] = fmax(0.0f, fmin(1.0f, lin[i] + s * (out[i] - lin[i])));
+}
+
+} // namespace GamutMap
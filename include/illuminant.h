@@ -0,0 +1,160 @@
+#pragma once
+// ============================================================
+// illuminant.h – Viewing illuminants and chromatic adaptation
+//
+// The observer matrix (cie_observer.h) yields XYZ under D65. A
+// sample is rendered under another illuminant by carrying that XYZ
+// to its corresponding color under the target white with a von
+// Kries transform in a sharpened cone space – Bradford (as ICC
+// profiles do for D50) or CAT02 (Config::Color::CAT02):
+//   M = Cone⁻¹ · diag(cone(W_target) / cone(W_D65)) · Cone
+// Everything per illuminant is computed at compile time: the
+// adaptation (D65 XYZ → XYZ under the illuminant, Lab against its
+// white) in float and Q14, and the white point in Q16. The output
+// spaces fuse it with their RGB matrix (output_space.h), so the
+// rendered color shows the illuminant's cast on a D65 display.
+// Selecting an illuminant only swaps which View is used.
+// ============================================================
+
+#include "config.h"
+#include <cstdint>
+#include <cstring>
+#include <strings.h>
+
+namespace Illuminant {
+
+enum class Id : uint8_t { D65, D50, A, F11, COUNT };
+constexpr int COUNT = static_cast<int>(Id::COUNT);
+
+enum class Cat : uint8_t { BRADFORD, CAT02 };
+
+struct Mat3 {
+  float m[3][3];
+};
+
+struct White {
+  float X, Y, Z; // Y = 1, CIE 1931 2°
+};
+
+// ── Compile-time 3×3 helpers ────────────────────────────────
+constexpr Mat3 mul(const Mat3 &a, const Mat3 &b) {
+  Mat3 r = {};
+  for (int i = 0; i < 3; i++)
+    for (int j = 0; j < 3; j++)
+      for (int k = 0; k < 3; k++)
+        r.m[i][j] += a.m[i][k] * b.m[k][j];
+  return r;
+}
+
+constexpr Mat3 inverse(const Mat3 &a) {
+  const auto &m = a.m;
+  float det = m[0][0] * (m[1][1] * m[2][2] - m[1][2] * m[2][1]) -
+              m[0][1] * (m[1][0] * m[2][2] - m[1][2] * m[2][0]) +
+              m[0][2] * (m[1][0] * m[2][1] - m[1][1] * m[2][0]);
+  Mat3 r = {};
+  r.m[0][0] = (m[1][1] * m[2][2] - m[1][2] * m[2][1]) / det;
+  r.m[0][1] = (m[0][2] * m[2][1] - m[0][1] * m[2][2]) / det;
+  r.m[0][2] = (m[0][1] * m[1][2] - m[0][2] * m[1][1]) / det;
+  r.m[1][0] = (m[1][2] * m[2][0] - m[1][0] * m[2][2]) / det;
+  r.m[1][1] = (m[0][0] * m[2][2] - m[0][2] * m[2][0]) / det;
+  r.m[1][2] = (m[0][2] * m[1][0] - m[0][0] * m[1][2]) / det;
+  r.m[2][0] = (m[1][0] * m[2][1] - m[1][1] * m[2][0]) / det;
+  r.m[2][1] = (m[0][1] * m[2][0] - m[0][0] * m[2][1]) / det;
+  r.m[2][2] = (m[0][0] * m[1][1] - m[0][1] * m[1][0]) / det;
+  return r;
+}
+
+// ── Reference data ──────────────────────────────────────────
+constexpr const char *kNames[COUNT] = {"D65", "D50", "A", "F11"};
+
+constexpr White kWhites[COUNT] = {
+    {0.95047f, 1.0f, 1.08883f}, // D65 daylight
+    {0.96422f, 1.0f, 0.82521f}, // D50 horizon light, print viewing
+    {1.09850f, 1.0f, 0.35585f}, // A   incandescent, 2856 K
+    {1.00962f, 1.0f, 0.64350f}, // F11 narrow-band tri-phosphor, 4000 K
+};
+
+constexpr Mat3 kBradford = {{
+    {0.8951f, 0.2664f, -0.1614f},
+    {-0.7502f, 1.7135f, 0.0367f},
+    {0.0389f, -0.0685f, 1.0296f},
+}};
+
+constexpr Mat3 kCat02 = {{
+    {0.7328f, 0.4296f, -0.1624f},
+    {-0.7036f, 1.6975f, 0.0061f},
+    {0.0030f, 0.0136f, 0.9834f},
+}};
+
+constexpr Mat3 adaptation(const Mat3 &cone, const White &from,
+                          const White &to) {
+  float src[3] = {}, dst[3] = {};
+  for (int i = 0; i < 3; i++) {
+    src[i] = cone.m[i][0] * from.X + cone.m[i][1] * from.Y +
+             cone.m[i][2] * from.Z;
+    dst[i] = cone.m[i][0] * to.X + cone.m[i][1] * to.Y + cone.m[i][2] * to.Z;
+  }
+  Mat3 gain = {};
+  for (int i = 0; i < 3; i++)
+    gain.m[i][i] = dst[i] / src[i];
+  return mul(inverse(cone), mul(gain, cone));
+}
+
+// ── Per-illuminant views ────────────────────────────────────
+struct View {
+  Mat3 toXYZ; // D65 XYZ → XYZ under the illuminant
+  int32_t toXYZQ14[3][3];
+  uint32_t xnQ16, znQ16;       // Lab white (Yn = 1)
+  uint32_t invXnQ16, invZnQ16; // and its reciprocals
+};
+
+constexpr int32_t toQ14(float v) {
+  return static_cast<int32_t>(v * 16384.0f + (v < 0 ? -0.5f : 0.5f));
+}
+
+constexpr View makeView(Id id, Cat cat) {
+  View v = {};
+  const White &w = kWhites[static_cast<int>(id)];
+  v.toXYZ = adaptation(cat == Cat::CAT02 ? kCat02 : kBradford,
+                       kWhites[static_cast<int>(Id::D65)], w);
+  for (int i = 0; i < 3; i++)
+    for (int j = 0; j < 3; j++)
+      v.toXYZQ14[i][j] = toQ14(v.toXYZ.m[i][j]);
+  v.xnQ16 = static_cast<uint32_t>(w.X * 65536.0f + 0.5f);
+  v.znQ16 = static_cast<uint32_t>(w.Z * 65536.0f + 0.5f);
+  v.invXnQ16 = static_cast<uint32_t>(65536.0f / w.X + 0.5f);
+  v.invZnQ16 = static_cast<uint32_t>(65536.0f / w.Z + 0.5f);
+  return v;
+}
+
+constexpr Cat CAT = Config::Color::CAT02 ? Cat::CAT02 : Cat::BRADFORD;
+
+constexpr View kViews[COUNT] = {
+    makeView(Id::D65, CAT),
+    makeView(Id::D50, CAT),
+    makeView(Id::A, CAT),
+    makeView(Id::F11, CAT),
+};
+
+inline const View &view(Id id) {
+  int i = static_cast<int>(id);
+  return kViews[i < COUNT ? i : 0];
+}
+
+inline const char *name(Id id) {
+  int i = static_cast<int>(id);
+  return kNames[i < COUNT ? i : 0];
+}
+
+// Id by name ("D50", "a", …), false if unknown
+inline bool find(const char *name, Id &out) {
+  for (int i = 0; name && i < COUNT; i++) {
+    if (strcasecmp(kNames[i], name) == 0) {
+      out = static_cast<Id>(i);
+      return true;
+    }
+  }
+  return false;
+}
+
+} // namespace Illuminant
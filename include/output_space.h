@@ -0,0 +1,303 @@
+#pragma once
+// ============================================================
+// output_space.h – RGB output spaces and their encodings
+//
+// Rendered colors can be reported in sRGB, Display P3 or Adobe RGB
+// (1998). All three have a D65 white, so each is one XYZ → linear
+// RGB matrix plus a transfer curve:
+//   sRGB, Display P3 – the sRGB piecewise curve
+//   Adobe RGB        – a pure 563/256 (≈ 2.2) power law
+// At compile time every matrix is fused with every illuminant's
+// adaptation (illuminant.h): D65 XYZ → linear RGB stays a single
+// 3×3 multiply whatever the selection.
+//
+// Encoding and decoding are table lookups for the fixed path:
+//   - encode: threshold tables of the smallest Q16 linear value
+//     that the float encoder (encodeFloat) maps to each 8-bit code,
+//     searched in 8 steps – exact for every Q16 input
+//   - decode: 8-bit code → Q16 linear
+// Tables generated offline by sweeping all 65537 Q16 inputs
+// through the float encoders (encode) and from the transfer
+// formulas in double precision (decode).
+// ============================================================
+
+#include "color_lab.h"
+#include "illuminant.h"
+#include <cmath>
+#include <cstdint>
+#include <strings.h>
+
+namespace OutputSpace {
+
+enum class Id : uint8_t { SRGB, DISPLAY_P3, ADOBE_RGB, COUNT };
+constexpr int COUNT = static_cast<int>(Id::COUNT);
+
+enum class Transfer : uint8_t { SRGB, GAMMA_563 };
+
+struct Space {
+  const char *name;
+  Illuminant::Mat3 fromXYZ; // XYZ (D65) → linear RGB
+  Transfer transfer;
+};
+
+constexpr Space kSpaces[COUNT] = {
+    {"sRGB",
+     {{{3.2406f, -1.5372f, -0.4986f},
+       {-0.9689f, 1.8758f, 0.0415f},
+       {0.0557f, -0.2040f, 1.0570f}}},
+     Transfer::SRGB},
+    {"P3",
+     {{{2.4935f, -0.9314f, -0.4027f},
+       {-0.8295f, 1.7627f, 0.0236f},
+       {0.0358f, -0.0762f, 0.9569f}}},
+     Transfer::SRGB},
+    {"AdobeRGB",
+     {{{2.0414f, -0.5649f, -0.3447f},
+       {-0.9693f, 1.8760f, 0.0416f},
+       {0.0134f, -0.1184f, 1.0154f}}},
+     Transfer::GAMMA_563},
+};
+
+// ── Encode / decode tables ──────────────────────────────────
+constexpr uint16_t kSrgbEncodeQ16[256] = {
+    0,     10,    30,    50,    70,    90,    110,   130,   150,   170,
+    189,   209,   230,   253,   276,   301,   327,   354,   382,   412,
+    443,   475,   509,   544,   580,   618,   657,   698,   740,   783,
+    828,   875,   923,   972,   1023,  1075,  1129,  1185,  1242,  1300,
+    1360,  1422,  1486,  1551,  1617,  1685,  1755,  1827,  1900,  1975,
+    2052,  2130,  2210,  2292,  2376,  2461,  2548,  2637,  2727,  2820,
+    2914,  3010,  3108,  3208,  3309,  3412,  3518,  3625,  3734,  3844,
+    3957,  4072,  4188,  4307,  4427,  4550,  4674,  4800,  4929,  5059,
+    5191,  5325,  5461,  5600,  5740,  5882,  6026,  6173,  6321,  6471,
+    6624,  6779,  6935,  7094,  7255,  7418,  7583,  7750,  7920,  8091,
+    8265,  8440,  8618,  8798,  8981,  9165,  9352,  9541,  9732,  9925,
+    10121, 10318, 10518, 10721, 10925, 11132, 11341, 11552, 11766, 11981,
+    12200, 12420, 12643, 12868, 13095, 13325, 13557, 13791, 14028, 14267,
+    14508, 14752, 14998, 15247, 15498, 15751, 16007, 16265, 16525, 16788,
+    17054, 17322, 17592, 17864, 18140, 18417, 18697, 18980, 19265, 19552,
+    19842, 20135, 20430, 20727, 21027, 21330, 21635, 21942, 22252, 22565,
+    22880, 23198, 23518, 23841, 24166, 24494, 24825, 25158, 25494, 25832,
+    26173, 26517, 26863, 27212, 27563, 27917, 28274, 28633, 28995, 29360,
+    29727, 30097, 30470, 30845, 31223, 31604, 31987, 32373, 32762, 33154,
+    33548, 33945, 34345, 34747, 35152, 35560, 35971, 36384, 36800, 37219,
+    37641, 38065, 38493, 38923, 39355, 39791, 40229, 40671, 41115, 41562,
+    42011, 42464, 42919, 43377, 43838, 44302, 44769, 45238, 45711, 46186,
+    46664, 47145, 47629, 48116, 48605, 49098, 49593, 50092, 50593, 51097,
+    51604, 52114, 52627, 53143, 53662, 54184, 54709, 55236, 55767, 56300,
+    56837, 57377, 57919, 58465, 59013, 59564, 60119, 60676, 61237, 61800,
+    62367, 62936, 63509, 64084, 64663, 65245,
+};
+
+constexpr uint16_t kAdobeEncodeQ16[256] = {
+    0,     1,     1,     3,     6,     10,    15,    21,    29,    37,
+    48,    59,    72,    87,    103,   120,   139,   160,   182,   205,
+    230,   257,   285,   315,   347,   380,   415,   451,   490,   530,
+    571,   615,   660,   707,   755,   806,   858,   912,   968,   1026,
+    1085,  1146,  1209,  1274,  1341,  1410,  1481,  1553,  1628,  1704,
+    1782,  1862,  1944,  2028,  2114,  2202,  2292,  2383,  2477,  2573,
+    2671,  2770,  2872,  2976,  3081,  3189,  3299,  3411,  3524,  3640,
+    3758,  3878,  4000,  4124,  4250,  4378,  4509,  4641,  4775,  4912,
+    5051,  5191,  5334,  5479,  5626,  5775,  5927,  6080,  6236,  6394,
+    6554,  6716,  6880,  7047,  7215,  7386,  7559,  7734,  7911,  8091,
+    8273,  8457,  8643,  8831,  9022,  9215,  9410,  9607,  9806,  10008,
+    10212, 10418, 10627, 10837, 11050, 11266, 11483, 11703, 11925, 12149,
+    12376, 12605, 12836, 13069, 13305, 13543, 13784, 14026, 14271, 14519,
+    14768, 15020, 15275, 15531, 15790, 16051, 16315, 16581, 16849, 17120,
+    17393, 17668, 17946, 18226, 18509, 18793, 19081, 19370, 19662, 19956,
+    20253, 20552, 20854, 21158, 21464, 21773, 22084, 22397, 22713, 23032,
+    23353, 23676, 24001, 24329, 24660, 24993, 25328, 25666, 26006, 26349,
+    26694, 27041, 27391, 27744, 28099, 28456, 28816, 29178, 29543, 29911,
+    30280, 30652, 31027, 31404, 31784, 32166, 32551, 32938, 33328, 33720,
+    34114, 34512, 34911, 35313, 35718, 36125, 36535, 36947, 37362, 37779,
+    38199, 38622, 39046, 39474, 39904, 40336, 40771, 41209, 41649, 42092,
+    42537, 42985, 43435, 43888, 44344, 44802, 45262, 45726, 46191, 46660,
+    47131, 47604, 48080, 48559, 49040, 49524, 50010, 50499, 50991, 51485,
+    51982, 52481, 52983, 53488, 53995, 54505, 55018, 55533, 56050, 56571,
+    57094, 57619, 58148, 58678, 59212, 59748, 60287, 60828, 61372, 61919,
+    62468, 63020, 63575, 64132, 64692, 65254,
+};
+
+constexpr uint32_t kSrgbDecodeQ16[256] = {
+    0,     20,    40,    60,    80,    99,    119,   139,   159,   179,
+    199,   219,   241,   264,   288,   313,   340,   367,   396,   427,
+    458,   491,   526,   562,   599,   637,   677,   718,   761,   805,
+    851,   898,   947,   997,   1048,  1101,  1156,  1212,  1270,  1330,
+    1391,  1453,  1517,  1583,  1651,  1720,  1791,  1863,  1937,  2013,
+    2090,  2170,  2250,  2333,  2418,  2504,  2592,  2681,  2773,  2866,
+    2961,  3058,  3157,  3258,  3360,  3464,  3570,  3678,  3788,  3900,
+    4014,  4129,  4247,  4366,  4488,  4611,  4736,  4864,  4993,  5124,
+    5257,  5392,  5530,  5669,  5810,  5953,  6099,  6246,  6395,  6547,
+    6701,  6856,  7014,  7174,  7336,  7500,  7666,  7834,  8004,  8177,
+    8352,  8529,  8708,  8889,  9072,  9258,  9446,  9636,  9828,  10022,
+    10219, 10418, 10619, 10822, 11028, 11236, 11446, 11658, 11873, 12090,
+    12309, 12531, 12754, 12981, 13209, 13440, 13673, 13909, 14147, 14387,
+    14629, 14874, 15122, 15372, 15624, 15878, 16135, 16394, 16656, 16920,
+    17187, 17456, 17727, 18001, 18278, 18556, 18838, 19121, 19408, 19696,
+    19988, 20281, 20578, 20876, 21178, 21481, 21788, 22096, 22408, 22722,
+    23038, 23357, 23679, 24003, 24329, 24659, 24991, 25325, 25662, 26002,
+    26344, 26689, 27036, 27387, 27739, 28095, 28453, 28813, 29177, 29543,
+    29911, 30283, 30657, 31033, 31413, 31795, 32180, 32567, 32957, 33350,
+    33746, 34144, 34545, 34949, 35355, 35765, 36177, 36591, 37009, 37429,
+    37852, 38278, 38707, 39138, 39572, 40009, 40449, 40892, 41337, 41786,
+    42237, 42691, 43147, 43607, 44069, 44534, 45003, 45474, 45947, 46424,
+    46904, 47386, 47871, 48360, 48851, 49345, 49842, 50342, 50844, 51350,
+    51859, 52370, 52884, 53402, 53922, 54445, 54972, 55501, 56033, 56568,
+    57106, 57647, 58191, 58738, 59288, 59841, 60397, 60956, 61518, 62083,
+    62651, 63222, 63796, 64373, 64953, 65536,
+};
+
+constexpr uint32_t kAdobeDecodeQ16[256] = {
+    0,     0,     2,     4,     7,     12,    17,    24,    32,    42,
+    53,    65,    79,    94,    111,   129,   149,   170,   193,   217,
+    243,   270,   299,   330,   363,   397,   432,   470,   509,   550,
+    592,   637,   683,   730,   780,   831,   884,   939,   996,   1055,
+    1115,  1177,  1241,  1307,  1375,  1445,  1516,  1590,  1665,  1742,
+    1821,  1902,  1985,  2070,  2157,  2246,  2337,  2430,  2524,  2621,
+    2720,  2820,  2923,  3028,  3134,  3243,  3354,  3467,  3581,  3698,
+    3817,  3938,  4061,  4186,  4313,  4443,  4574,  4707,  4843,  4980,
+    5120,  5262,  5406,  5552,  5700,  5850,  6003,  6157,  6314,  6473,
+    6634,  6797,  6963,  7130,  7300,  7472,  7646,  7822,  8000,  8181,
+    8364,  8549,  8736,  8926,  9117,  9311,  9507,  9706,  9906,  10109,
+    10314, 10522, 10731, 10943, 11157, 11374, 11592, 11813, 12036, 12262,
+    12490, 12720, 12952, 13187, 13423, 13663, 13904, 14148, 14394, 14643,
+    14893, 15147, 15402, 15660, 15920, 16182, 16447, 16714, 16984, 17256,
+    17530, 17806, 18085, 18367, 18650, 18936, 19225, 19515, 19809, 20104,
+    20402, 20702, 21005, 21310, 21618, 21928, 22240, 22555, 22872, 23191,
+    23513, 23838, 24165, 24494, 24825, 25160, 25496, 25835, 26177, 26521,
+    26867, 27216, 27567, 27921, 28277, 28635, 28996, 29360, 29726, 30095,
+    30466, 30839, 31215, 31593, 31974, 32358, 32744, 33132, 33523, 33916,
+    34312, 34711, 35112, 35515, 35921, 36329, 36740, 37154, 37570, 37989,
+    38410, 38833, 39259, 39688, 40119, 40553, 40989, 41428, 41870, 42314,
+    42760, 43209, 43661, 44115, 44572, 45031, 45493, 45958, 46425, 46894,
+    47367, 47841, 48319, 48799, 49281, 49766, 50254, 50744, 51237, 51733,
+    52231, 52732, 53235, 53741, 54249, 54761, 55274, 55791, 56310, 56831,
+    57356, 57883, 58412, 58944, 59479, 60016, 60557, 61099, 61645, 62193,
+    62743, 63296, 63852, 64411, 64972, 65536,
+};
+
+// Q16 linear → 8-bit code (clamped to [0, 1])
+inline uint8_t encode(Transfer t, int32_t linQ16) {
+  if (linQ16 <= 0)
+    return 0;
+  const uint16_t *table =
+      t == Transfer::SRGB ? kSrgbEncodeQ16 : kAdobeEncodeQ16;
+  uint32_t code = 0;
+  for (uint32_t step = 128; step > 0; step >>= 1) {
+    if (linQ16 >= table[code + step])
+      code += step;
+  }
+  return static_cast<uint8_t>(code);
+}
+
+// 8-bit code → Q16 linear
+inline uint32_t decode(Transfer t, uint8_t code) {
+  return t == Transfer::SRGB ? kSrgbDecodeQ16[code] : kAdobeDecodeQ16[code];
+}
+
+// Float reference (used by the float color engine)
+inline uint8_t encodeFloat(Transfer t, float c) {
+  c = fmax(0.0f, fmin(1.0f, c));
+  float g;
+  if (t == Transfer::SRGB)
+    g = (c <= 0.0031308f) ? 12.92f * c
+                          : 1.055f * powf(c, 1.0f / 2.4f) - 0.055f;
+  else
+    g = powf(c, 256.0f / 563.0f);
+  return static_cast<uint8_t>(g * 255.0f + 0.5f);
+}
+
+// ── Per illuminant × space matrices ─────────────────────────
+struct Render {
+  Illuminant::Mat3 toRGB;  // D65 XYZ → linear RGB under the illuminant
+  int32_t toRGBQ14[3][3];
+};
+
+// Per space, for colors already in adapted XYZ / Lab
+struct Matrices {
+  int32_t fromXYZQ14[3][3]; // XYZ → linear RGB
+  int32_t toXYZQ14[3][3];   // linear RGB → XYZ
+};
+
+constexpr Render makeRender(Illuminant::Id ill, Id space) {
+  Render r = {};
+  r.toRGB = Illuminant::mul(kSpaces[static_cast<int>(space)].fromXYZ,
+                            Illuminant::kViews[static_cast<int>(ill)].toXYZ);
+  for (int i = 0; i < 3; i++)
+    for (int j = 0; j < 3; j++)
+      r.toRGBQ14[i][j] = Illuminant::toQ14(r.toRGB.m[i][j]);
+  return r;
+}
+
+constexpr Matrices makeMatrices(Id space) {
+  Matrices m = {};
+  const Illuminant::Mat3 &fwd = kSpaces[static_cast<int>(space)].fromXYZ;
+  const Illuminant::Mat3 inv = Illuminant::inverse(fwd);
+  for (int i = 0; i < 3; i++) {
+    for (int j = 0; j < 3; j++) {
+      m.fromXYZQ14[i][j] = Illuminant::toQ14(fwd.m[i][j]);
+      m.toXYZQ14[i][j] = Illuminant::toQ14(inv.m[i][j]);
+    }
+  }
+  return m;
+}
+
+struct RenderTable {
+  Render r[Illuminant::COUNT][COUNT];
+};
+
+constexpr RenderTable makeRenders() {
+  RenderTable t = {};
+  for (int i = 0; i < Illuminant::COUNT; i++)
+    for (int s = 0; s < COUNT; s++)
+      t.r[i][s] =
+          makeRender(static_cast<Illuminant::Id>(i), static_cast<Id>(s));
+  return t;
+}
+
+constexpr RenderTable kRenders = makeRenders();
+
+constexpr Matrices kMatrices[COUNT] = {
+    makeMatrices(Id::SRGB),
+    makeMatrices(Id::DISPLAY_P3),
+    makeMatrices(Id::ADOBE_RGB),
+};
+
+inline int index(Id id) {
+  int i = static_cast<int>(id);
+  return i < COUNT ? i : 0;
+}
+
+inline const Space &space(Id id) { return kSpaces[index(id)]; }
+inline const Matrices &matrices(Id id) { return kMatrices[index(id)]; }
+inline const char *name(Id id) { return kSpaces[index(id)].name; }
+
+inline const Render &render(Illuminant::Id ill, Id id) {
+  int i = static_cast<int>(ill);
+  return kRenders.r[i < Illuminant::COUNT ? i : 0][index(id)];
+}
+
+// Id by name ("sRGB", "p3", …), false if unknown
+inline bool find(const char *name, Id &out) {
+  for (int i = 0; name && i < COUNT; i++) {
+    if (strcasecmp(kSpaces[i].name, name) == 0) {
+      out = static_cast<Id>(i);
+      return true;
+    }
+  }
+  return false;
+}
+
+// 8-bit RGB in `id` → Lab (D65), e.g. to look up a typed-in color
+inline ColorLab::LabQ toLab(Id id, uint8_t r, uint8_t g, uint8_t b) {
+  const Transfer t = space(id).transfer;
+  const int64_t lin[3] = {decode(t, r), decode(t, g), decode(t, b)};
+  const auto &m = matrices(id).toXYZQ14;
+  int32_t xyz[3];
+  for (int i = 0; i < 3; i++) {
+    int64_t acc = lin[0] * m[i][0] + lin[1] * m[i][1] + lin[2] * m[i][2];
+    xyz[i] = static_cast<int32_t>((acc + (1 << 13)) >> 14);
+  }
+  return ColorLab::fromXYZQ16(xyz[0], xyz[1], xyz[2]);
+}
+
+} // namespace OutputSpace
@@ -0,0 +1,290 @@
+#pragma once
+// ============================================================
+// palette_db.h – Read-only reference palette in flash
+//
+// Named reference colors (paint / RAL / fan-deck libraries,
+// thousands of entries) live in their own flash partition
+// ("palette" in partitions.csv) as one binary image, built on the
+// host from CSV by src/tools/palette_build.cpp and flashed with
+//   esptool.py write_flash 0x400000 palette.bin
+// The partition is memory-mapped at boot and searched in place:
+// a lookup needs no heap, no copy and no SD I/O.
+//
+// Image layout (little-endian, PaletteFormat below):
+//   Header (48 bytes) | Record × count | names (NUL-terminated)
+// The records are the nodes of a balanced k-d tree over Lab, stored
+// implicitly: the node of range [lo, hi) is record lo + (hi-lo)/2,
+// its subtrees are [lo, mid) and [mid + 1, hi), and each record
+// holds its split axis.
+//
+// nearest() is exact for ΔE00 in two tree passes: the closest record
+// by ΔE*ab (Euclidean, so the pruning is exact) gives a ΔE00 radius,
+// then every record in the ΔE*ab box that can hold that radius
+// (ColorLab::deltaE2000Box, as ColorIndex) is compared by ΔE00.
+// ============================================================
+
+#include "color_lab.h"
+#include "config.h"
+#include "crc32.h"
+#include <Arduino.h>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef ARDUINO
+#include <esp_partition.h>
+#endif
+
+// ── Image format ────────────────────────────────────────────
+namespace PaletteFormat {
+
+constexpr uint32_t MAGIC = 0x31544C50; // "PLT1"
+constexpr uint16_t VERSION = 1;
+
+struct Header {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t recordSize;  // sizeof(Record)
+  uint32_t count;       // records, right after the header
+  uint32_t namesOffset; // from the start of the image
+  uint32_t namesSize;
+  uint32_t crc;         // CRC-32 of everything after the header
+  char title[24];       // library name, NUL-padded
+};
+
+struct Record {
+  int16_t lab[3];      // L, a, b in centi-units (ColorLab::LabQ)
+  uint8_t rgb[3];      // sRGB for display
+  uint8_t axis;        // k-d split axis: 0 L, 1 a, 2 b
+  uint16_t reserved;
+  uint32_t nameOffset; // into the names block
+};
+
+static_assert(sizeof(Header) == 48, "palette header layout");
+static_assert(sizeof(Record) == 16, "palette record layout");
+
+} // namespace PaletteFormat
+
+// ── Palette Database ────────────────────────────────────────
+class PaletteDb {
+public:
+  static constexpr int MAX_DEPTH = 64; // k-d traversal stack
+
+  struct Match {
+    const char *name; // points into the mapped image
+    ColorLab::LabQ lab;
+    uint8_t r, g, b;
+    uint16_t deltaE; // centi-ΔE00 to the query
+    uint32_t index;
+
+    uint16_t toRGB565() const {
+      return ((r & 0xF8) << 8) | ((g & 0xFC) << 3) | (b >> 3);
+    }
+  };
+
+  static PaletteDb &instance() {
+    static PaletteDb inst;
+    return inst;
+  }
+
+#ifdef ARDUINO
+  // Maps the palette partition (read-only, stays mapped)
+  bool begin() {
+    const esp_partition_t *part = esp_partition_find_first(
+        ESP_PARTITION_TYPE_DATA,
+        static_cast<esp_partition_subtype_t>(Config::Palette::SUBTYPE),
+        Config::Palette::PARTITION);
+    if (!part) {
+      Serial.println("[Palette] No palette partition");
+      return false;
+    }
+    const void *image = nullptr;
+    if (esp_partition_mmap(part, 0, part->size, ESP_PARTITION_MMAP_DATA,
+                           &image, &mmap_) != ESP_OK) {
+      Serial.println("[Palette] Partition mmap failed");
+      return false;
+    }
+    if (!attach(image, part->size)) {
+      esp_partition_munmap(mmap_);
+      return false;
+    }
+    Serial.printf("[Palette] %lu colors (%s) mapped from flash\n",
+                  (unsigned long)count_, title());
+    return true;
+  }
+#endif
+
+  // Uses an image already in (mapped) memory after checking its
+  // header, bounds and CRC
+  bool attach(const void *image, size_t size) {
+    using namespace PaletteFormat;
+    header_ = nullptr;
+    records_ = nullptr;
+    count_ = 0;
+
+    const uint8_t *base = static_cast<const uint8_t *>(image);
+    const Header *h = reinterpret_cast<const Header *>(base);
+    if (size < sizeof(Header) || h->magic != MAGIC) {
+      Serial.println("[Palette] No palette image");
+      return false;
+    }
+    uint64_t recordsEnd = sizeof(Header) + (uint64_t)h->count * sizeof(Record);
+    uint64_t end = (uint64_t)h->namesOffset + h->namesSize;
+    if (h->version != VERSION || h->recordSize != sizeof(Record) ||
+        h->namesOffset < recordsEnd || end > size || h->namesSize == 0 ||
+        base[end - 1] != '\0') {
+      Serial.println("[Palette] Unsupported or truncated image");
+      return false;
+    }
+    if (Crc32::update(0, base + sizeof(Header), end - sizeof(Header)) !=
+        h->crc) {
+      Serial.println("[Palette] CRC mismatch");
+      return false;
+    }
+
+    header_ = h;
+    records_ = reinterpret_cast<const Record *>(base + sizeof(Header));
+    names_ = reinterpret_cast<const char *>(base + h->namesOffset);
+    count_ = h->count;
+    return true;
+  }
+
+  bool isReady() const { return header_ != nullptr; }
+  uint32_t count() const { return count_; }
+  const char *title() const { return header_ ? header_->title : ""; }
+
+  // Closest reference color to `q` by ΔE00 (see header). False when
+  // no palette is loaded.
+  bool nearest(const ColorLab::LabQ &q, Match &out) const {
+    if (count_ == 0)
+      return false;
+    const int16_t query[3] = {q.L, q.a, q.b};
+
+    uint32_t best = nearestAb(query);
+    uint16_t bestDe = ColorLab::deltaE2000(q, labOf(records_[best]));
+
+    // The ΔE00-closest is no farther than `best`, so inside its box;
+    // the box shrinks as closer records turn up
+    ColorLab::DeltaEBox box = ColorLab::deltaE2000Box(q, bestDe);
+    int32_t reach[3] = {box.L, box.ab, box.ab};
+    struct Range {
+      uint32_t lo, hi;
+      uint8_t axis;
+      int32_t gap; // |query - split| on axis if the far side, else 0
+    };
+    Range stack[MAX_DEPTH];
+    int sp = 0;
+    stack[sp++] = {0, count_, 0, 0};
+    while (sp > 0) {
+      Range r = stack[--sp];
+      if (r.lo >= r.hi || r.gap > reach[r.axis])
+        continue;
+      uint32_t mid = r.lo + (r.hi - r.lo) / 2;
+      const PaletteFormat::Record &n = records_[mid];
+
+      bool inBox = true;
+      for (int ax = 0; ax < 3; ax++)
+        inBox = inBox && abs(n.lab[ax] - query[ax]) <= reach[ax];
+      if (inBox && mid != best) {
+        uint16_t de = ColorLab::deltaE2000(q, labOf(n));
+        if (de < bestDe) {
+          bestDe = de;
+          best = mid;
+          box = ColorLab::deltaE2000Box(q, bestDe);
+          reach[0] = box.L;
+          reach[1] = reach[2] = box.ab;
+        }
+      }
+
+      // Far side first, so the near side is searched next
+      int32_t diff = query[n.axis] - n.lab[n.axis];
+      Range below = {r.lo, mid, n.axis, diff > 0 ? diff : 0};
+      Range above = {mid + 1, r.hi, n.axis, diff < 0 ? -diff : 0};
+      if (sp + 2 > MAX_DEPTH)
+        break; // degenerate image; keep what was found
+      stack[sp++] = diff < 0 ? above : below;
+      stack[sp++] = diff < 0 ? below : above;
+    }
+    fill(best, bestDe, out);
+    return true;
+  }
+
+private:
+  PaletteDb()
+      : header_(nullptr), records_(nullptr), names_(nullptr), count_(0) {}
+
+  // Closest record by ΔE*ab
+  uint32_t nearestAb(const int16_t *query) const {
+    uint32_t bestD = UINT32_MAX;
+    uint32_t best = 0;
+
+    struct Range {
+      uint32_t lo, hi;
+      uint32_t bound; // squared distance to the range's half-space
+    };
+    Range stack[MAX_DEPTH];
+    int sp = 0;
+    stack[sp++] = {0, count_, 0};
+
+    while (sp > 0) {
+      Range r = stack[--sp];
+      if (r.lo >= r.hi || r.bound >= bestD)
+        continue;
+      uint32_t mid = r.lo + (r.hi - r.lo) / 2;
+      const PaletteFormat::Record &n = records_[mid];
+
+      uint32_t d = distance2(query, n.lab);
+      if (d < bestD) {
+        bestD = d;
+        best = mid;
+      }
+
+      // Far side first, so the near side is searched next
+      int32_t diff = query[n.axis] - n.lab[n.axis];
+      uint32_t split = static_cast<uint32_t>(diff * diff);
+      Range below = {r.lo, mid, r.bound};
+      Range above = {mid + 1, r.hi, r.bound};
+      Range &farSide = diff < 0 ? above : below;
+      farSide.bound = split > r.bound ? split : r.bound;
+      if (sp + 2 > MAX_DEPTH)
+        break; // degenerate image; keep what was found
+      stack[sp++] = farSide;
+      stack[sp++] = diff < 0 ? below : above;
+    }
+    return best;
+  }
+
+  // Squared ΔE*ab in centi-units (< 2^32 for any LabQ pair)
+  static uint32_t distance2(const int16_t *q, const int16_t *p) {
+    uint32_t sum = 0;
+    for (int i = 0; i < 3; i++) {
+      int32_t d = q[i] - p[i];
+      sum += static_cast<uint32_t>(d * d);
+    }
+    return sum;
+  }
+
+  static ColorLab::LabQ labOf(const PaletteFormat::Record &rec) {
+    return {rec.lab[0], rec.lab[1], rec.lab[2]};
+  }
+
+  void fill(uint32_t index, uint16_t deltaE, Match &out) const {
+    const PaletteFormat::Record &rec = records_[index];
+    out.name = rec.nameOffset < header_->namesSize ? names_ + rec.nameOffset
+                                                   : "";
+    out.lab = labOf(rec);
+    out.r = rec.rgb[0];
+    out.g = rec.rgb[1];
+    out.b = rec.rgb[2];
+    out.deltaE = deltaE;
+    out.index = index;
+  }
+
+  const PaletteFormat::Header *header_;
+  const PaletteFormat::Record *records_;
+  const char *names_;
+  uint32_t count_;
+#ifdef ARDUINO
+  esp_partition_mmap_handle_t mmap_;
+#endif
+};
@@ -0,0 +1,187 @@
+#pragma once
+// ============================================================
+// record_cursor.h – Windowed access to saved records for lists
+//
+// The saved colors / measurements screens show LIST_ROWS rows of
+// files that may hold tens of thousands of records. Rather than
+// loading them all, a cursor maps list rows (ordinals among the
+// live records) to pages of PAGE record positions and keeps
+// CACHE_PAGES of them, least recently used evicted:
+//   - window(first, out, n): rows first .. first+n-1, walked from
+//     the nearest known row – the list's start, its end or the
+//     previous window – so scrolling (and wrapping around) reads
+//     O(1) pages
+//   - the page past the window in the scroll direction is read
+//     ahead, so the next step is served from the cache
+// Deleted records leave holes in pages; they are skipped.
+//
+// Source (StorageManager, SavedColors / SavedMeasurements) supplies
+//   Item, records(), live(), generation(),
+//   read(pos, out, max, end) – live Items in [pos, end), ≤ max
+// A changed generation (save, delete, compaction) drops the cache.
+// Not thread-safe: one cursor per task.
+// ============================================================
+
+#include "config.h"
+#include <cstdint>
+
+template <typename Source, int PAGE = Config::Storage::CURSOR_PAGE,
+          int CACHE_PAGES = Config::Storage::CURSOR_CACHE_PAGES>
+class RecordCursor {
+public:
+  using Item = typename Source::Item;
+
+  // Live records, i.e. list rows
+  int size() {
+    sync();
+    return static_cast<int>(Source::live());
+  }
+
+  // Copies up to n rows from row `first` to out; returns the count
+  int window(int first, Item *out, int n) {
+    sync();
+    Loc loc;
+    if (n <= 0 || !seek(first, loc))
+      return 0;
+    const Loc start = loc;
+    int got = 0;
+    while (true) {
+      out[got++] = page(loc.page).items[loc.slot];
+      if (got == n || !step(loc, 1))
+        break;
+    }
+    // Read ahead in the direction the list moved
+    const uint32_t pages = pageCount();
+    if (anchorValid_ && first < anchor_.row && start.page > 0)
+      page(start.page - 1);
+    else if (loc.page + 1 < pages)
+      page(loc.page + 1);
+    anchor_ = start;
+    anchorValid_ = true;
+    return got;
+  }
+
+  bool get(int row, Item &out) { return window(row, &out, 1) == 1; }
+
+  // Pages read from the source since construction
+  uint32_t misses() const { return misses_; }
+
+private:
+  struct Page {
+    bool valid = false;
+    uint32_t number = 0;
+    uint32_t used = 0; // LRU stamp
+    int n = 0;
+    Item items[PAGE];
+  };
+
+  struct Loc {
+    uint32_t page;
+    int slot;
+    int row;
+  };
+
+  static uint32_t pageCount() {
+    return (Source::records() + PAGE - 1) / PAGE;
+  }
+
+  void sync() {
+    uint32_t gen = Source::generation();
+    if (gen == generation_)
+      return;
+    generation_ = gen;
+    for (Page &p : pages_)
+      p.valid = false;
+    anchorValid_ = false;
+  }
+
+  const Page &page(uint32_t number) {
+    Page *victim = nullptr;
+    for (Page &p : pages_) {
+      if (p.valid && p.number == number) {
+        p.used = ++clock_;
+        return p;
+      }
+      if (!victim || (victim->valid && (!p.valid || p.used < victim->used)))
+        victim = &p;
+    }
+    const uint32_t pos = number * PAGE;
+    victim->n = Source::read(pos, victim->items, PAGE, pos + PAGE);
+    victim->number = number;
+    victim->valid = true;
+    victim->used = ++clock_;
+    misses_++;
+    return *victim;
+  }
+
+  // First live record at or after page `number`
+  bool firstFrom(uint32_t number, int row, Loc &loc) {
+    for (const uint32_t pages = pageCount(); number < pages; number++) {
+      if (page(number).n > 0) {
+        loc = {number, 0, row};
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Last live record at or before page `number`
+  bool lastFrom(uint32_t number, int row, Loc &loc) {
+    for (uint32_t k = number + 1; k > 0; k--) {
+      int n = page(k - 1).n;
+      if (n > 0) {
+        loc = {k - 1, n - 1, row};
+        return true;
+      }
+    }
+    return false;
+  }
+
+  bool step(Loc &loc, int dir) {
+    if (dir > 0) {
+      if (loc.slot + 1 < page(loc.page).n) {
+        loc.slot++;
+        loc.row++;
+        return true;
+      }
+      return firstFrom(loc.page + 1, loc.row + 1, loc);
+    }
+    if (loc.slot > 0) {
+      loc.slot--;
+      loc.row--;
+      return true;
+    }
+    return loc.page > 0 && lastFrom(loc.page - 1, loc.row - 1, loc);
+  }
+
+  // Walks to `row` from whichever known row is closest
+  bool seek(int row, Loc &loc) {
+    const int live = static_cast<int>(Source::live());
+    if (row < 0 || row >= live)
+      return false;
+    const int fromEnd = live - 1 - row;
+    const int fromAnchor =
+        anchorValid_ ? (row > anchor_.row ? row - anchor_.row
+                                          : anchor_.row - row)
+                     : live;
+    bool ok;
+    if (fromAnchor <= row && fromAnchor <= fromEnd) {
+      loc = anchor_;
+      ok = true;
+    } else if (row <= fromEnd) {
+      ok = firstFrom(0, 0, loc);
+    } else {
+      ok = pageCount() > 0 && lastFrom(pageCount() - 1, live - 1, loc);
+    }
+    while (ok && loc.row != row)
+      ok = step(loc, row > loc.row ? 1 : -1);
+    return ok;
+  }
+
+  Page pages_[CACHE_PAGES];
+  uint32_t clock_ = 0;
+  uint32_t generation_ = 0;
+  uint32_t misses_ = 0;
+  Loc anchor_ = {};
+  bool anchorValid_ = false;
+};
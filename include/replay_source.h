@@ -0,0 +1,199 @@
+#pragma once
+// ============================================================
+// replay_source.h – Recorded raw-channel traces as a SpectralSource
+//
+// Plays back the raw columns of a colors.csv export
+//   timestamp,r,g,b,hex,F1,…,FD[,L,a,b]
+// one row per frame, so the whole pipeline (auto-exposure,
+// sampling, calibration, color conversion, streaming) runs without
+// the sensor – e.g. in the native host build (src/native).
+//   - Timing: speed 1 waits out the recorded gaps between rows
+//     (at least one sensor cycle); speed 0 runs flat out.
+//   - Exposure: rows are taken as recorded at `recorded` and
+//     rescaled by the sensitivity ratio to the programmed exposure,
+//     clipping at full scale like the ADC.
+//   - LED off reads as a dark frame (all zero).
+//   - The preview profile keeps only the preview channels and
+//     runs one SMUX phase per frame, like the sensor.
+//   - hold(i) repeats row i, e.g. a gray card row for calibration.
+// Portable C++ (stdio, <chrono>, <thread>).
+// ============================================================
+
+#include "config.h"
+#include "spectral_source.h"
+#include "spectral_types.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+class ReplaySource : public SpectralSource {
+public:
+  static constexpr int N = Config::Sensor::NUM_CHANNELS;
+  static constexpr int FIRST_RAW = 5; // CSV column of F1
+
+  struct Frame {
+    uint32_t timestamp; // ms, as recorded
+    uint16_t raw[N];
+  };
+
+  explicit ReplaySource(float speed = 1.0f,
+                        const Exposure &recorded = kDefaultExposure)
+      : speed_(speed), recorded_(recorded), exposure_(recorded),
+        profile_(SmuxProfile::FULL), next_(0), hold_(-1), current_(-1),
+        led_(false), measuring_(false), dueMs_(0), start_(Clock::now()) {}
+
+  // Reads every data row of a colors.csv file. Returns rows loaded.
+  size_t load(const char *path) {
+    FILE *f = fopen(path, "r");
+    if (!f)
+      return 0;
+    char line[512];
+    while (fgets(line, sizeof(line), f)) {
+      Frame fr;
+      if (parseLine(line, fr))
+        frames_.push_back(fr);
+    }
+    fclose(f);
+    return frames_.size();
+  }
+
+  void add(const Frame &fr) { frames_.push_back(fr); }
+  const std::vector<Frame> &frames() const { return frames_; }
+
+  void rewind() {
+    next_ = 0;
+    current_ = -1;
+  }
+  bool exhausted() const { return hold_ < 0 && next_ >= frames_.size(); }
+
+  // Repeats row `index` for every frame; -1 resumes the trace
+  void hold(int index) { hold_ = index; }
+
+  // ── SpectralSource ───────────────────────────────────────
+  bool begin() override { return !frames_.empty(); }
+  const char *name() const override { return "replay"; }
+
+  void setExposure(const Exposure &e, bool) override { exposure_ = e; }
+
+  void setProfile(SmuxProfile p) override { profile_ = p; }
+
+  // Same cycle as the sensor: 3 SMUX phases, 1 for preview
+  uint32_t cycleTimeUs(const Exposure &e) const override {
+    return (profile_ == SmuxProfile::PREVIEW ? 1 : 3) * e.integrationUs();
+  }
+
+  void setLed(bool on) override { led_ = on; }
+
+  bool setMeasuring(bool on) override {
+    measuring_ = on;
+    dueMs_ = nowMs() + cycleMs();
+    return true;
+  }
+
+  // Picks the next row and, at speed > 0, waits until it is due
+  bool waitFrame(uint32_t) override {
+    if (!measuring_)
+      return false;
+    if (hold_ >= 0) {
+      current_ = hold_;
+    } else {
+      if (next_ >= frames_.size())
+        return false; // end of trace
+      if (current_ >= 0 && next_ > 0) {
+        uint32_t gap = frames_[next_].timestamp - frames_[next_ - 1].timestamp;
+        if (gap > cycleMs())
+          dueMs_ += gap - cycleMs();
+      }
+      current_ = static_cast<int>(next_++);
+    }
+    if (speed_ > 0) {
+      uint32_t now = nowMs();
+      if (dueMs_ > now)
+        sleepMs(dueMs_ - now);
+    }
+    dueMs_ += cycleMs();
+    return true;
+  }
+
+  bool readFrame(uint16_t *raw) override {
+    if (current_ < 0)
+      return false;
+    if (!led_) {
+      memset(raw, 0, N * sizeof(uint16_t));
+      return true;
+    }
+    const uint64_t num = exposure_.sensitivity();
+    const uint64_t den = recorded_.sensitivity();
+    const uint32_t fs = exposure_.fullScale();
+    for (int ch = 0; ch < N; ch++) {
+      uint64_t v = (frames_[current_].raw[ch] * num + den / 2) / den;
+      raw[ch] = static_cast<uint16_t>(v > fs ? fs : v);
+    }
+    if (profile_ == SmuxProfile::PREVIEW) {
+      uint16_t kept[PREVIEW_CHANNELS];
+      for (int i = 0; i < PREVIEW_CHANNELS; i++)
+        kept[i] = raw[kPreviewChannels[i]];
+      memset(raw, 0, N * sizeof(uint16_t));
+      for (int i = 0; i < PREVIEW_CHANNELS; i++)
+        raw[kPreviewChannels[i]] = kept[i];
+    }
+    return true;
+  }
+
+  void sleepMs(uint32_t ms) override {
+    if (speed_ > 0)
+      std::this_thread::sleep_for(
+          std::chrono::microseconds((uint64_t)(ms * 1000 / speed_)));
+  }
+
+  uint32_t nowMs() override { return nowUs() / 1000; }
+
+  uint32_t nowUs() override {
+    auto us = std::chrono::duration_cast<std::chrono::microseconds>(
+                  Clock::now() - start_)
+                  .count();
+    return static_cast<uint32_t>(speed_ > 0 ? us * speed_ : us);
+  }
+
+private:
+  using Clock = std::chrono::steady_clock;
+
+  uint32_t cycleMs() const { return cycleTimeUs(exposure_) / 1000; }
+
+  // timestamp,r,g,b,hex,F1,…,FD[,…]; header and short rows rejected
+  static bool parseLine(const char *line, Frame &fr) {
+    if (line[0] < '0' || line[0] > '9')
+      return false;
+    const char *p = line;
+    for (int field = 0; field < FIRST_RAW + N; field++) {
+      if (field == 0)
+        fr.timestamp = static_cast<uint32_t>(strtoul(p, nullptr, 10));
+      else if (field >= FIRST_RAW)
+        fr.raw[field - FIRST_RAW] =
+            static_cast<uint16_t>(strtoul(p, nullptr, 10));
+      if (field == FIRST_RAW + N - 1)
+        return true;
+      p = strchr(p, ',');
+      if (!p)
+        return false;
+      p++;
+    }
+    return false;
+  }
+
+  std::vector<Frame> frames_;
+  float speed_;
+  Exposure recorded_;
+  Exposure exposure_;
+  SmuxProfile profile_;
+  size_t next_;
+  int hold_;
+  int current_;
+  bool led_;
+  bool measuring_;
+  uint32_t dueMs_; // replay clock time the next frame completes
+  Clock::time_point start_;
+};
@@ -1,383 +1,362 @@
 #pragma once
 // ============================================================
-// sensor_manager.h – AS7343 spectral sensor abstraction
+// sensor_manager.h – AS7343 spectral sensor service
 //
-// Uses SparkFun AS7343 library for all register-level access.
-// This layer adds:
-//   - Calibration (dark/gray/white references)
-//   - Color space conversion (spectral → XYZ → sRGB)
-//   - Thread-safe measurement interface
+// Owns the sensor (as7343_source.h) and the acquisition pipeline
+// (spectral_pipeline.h: auto-exposure, sequential sampling,
+// per-exposure calibration, color conversion) and runs them in a
+// dedicated task:
+//   - Asynchronous acquisition: the sensor task owns the I²C bus,
+//     runs one queued job at a time, sleeps until the INT pin
+//     signals data ready and publishes the result through the
+//     EventQueue (SENSOR_DATA_READY / CALIBRATION_COMPLETE /
+//     SENSOR_ERROR). Callers never block on the sensor.
+//   - Live stream: between jobs the task can free-run the sensor.
+//     Every completed frame (stream or measurement) is published
+//     in a SeqLock; UI and connectivity read it independently and
+//     skip work while its generation is unchanged. The stream uses
+//     the fast 6-channel preview profile unless switched off;
+//     measurements always take all 18 channels.
 // ============================================================
 
+#include "as7343_source.h"
+#include "color_engine.h"
 #include "config.h"
 #include "events.h"
+#include "seqlock.h"
+#include "spectral_pipeline.h"
+#include "spectral_types.h"
 #include <Arduino.h>
-#include <SparkFun_AS7343.h>
-#include <Wire.h>
+#include <atomic>
 #include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
 #include <freertos/semphr.h>
 
-// ── Channel Data ────────────────────────────────────────────
-// AS7343 provides 14 spectral channels via two SMUX configurations
-// Channels: FZ, FY, FXL, NIR, 2xVIS, FD, F1..F8
-// We store all raw + calibrated values
-
-struct SpectralData {
-  // Raw ADC counts from sensor
-  uint16_t raw[Config::Sensor::NUM_CHANNELS];
-
-  // Calibrated (dark-subtracted, gain-normalized) values
-  float calibrated[Config::Sensor::NUM_CHANNELS];
-
-  // Derived color values
-  float cie_X, cie_Y, cie_Z; // CIE 1931 XYZ
-  uint8_t r, g, b;           // sRGB (0-255)
-  float L, a_star, b_star;   // CIE Lab (future)
-
-  // Metadata
-  uint32_t timestamp;
-  bool valid;
-
-  // Convenience
-  uint32_t toRGB888() const {
-    return ((uint32_t)r << 16) | ((uint32_t)g << 8) | b;
-  }
-
-  uint16_t toRGB565() const {
-    return ((r & 0xF8) << 8) | ((g & 0xFC) << 3) | (b >> 3);
-  }
-
-  void toHexString(char *buf, size_t len) const {
-    snprintf(buf, len, "#%02X%02X%02X", r, g, b);
-  }
+// ── Sensor jobs (queued to the sensor task) ─────────────────
+enum class SensorJob : uint8_t {
+  MEASURE,       // LED on, auto-exposure + sequential sampling
+  MEASURE_DARK,  // same with the LED off
+  CALIB_DARK,
+  CALIB_GRAY,
+  CALIB_WHITE,
+  SET_GAIN,      // arg = gain index
+  STREAM_START,  // arg = 1 LED on, 0 ambient
+  STREAM_STOP,
 };
 
-// ── Calibration Data ────────────────────────────────────────
-struct CalibrationData {
-  float darkRef[Config::Sensor::NUM_CHANNELS];  // Dark reference (sensor noise
-                                                // floor)
-  float grayRef[Config::Sensor::NUM_CHANNELS];  // 18% gray card reference
-  float whiteRef[Config::Sensor::NUM_CHANNELS]; // (Optional) white reference
-  bool hasDark;
-  bool hasGray;
-  bool hasWhite;
-  uint32_t calibTimestamp;
-
-  // Gray card reflectance factor (18% = 0.18)
-  static constexpr float GRAY_REFLECTANCE = 0.18f;
+struct SensorRequest {
+  SensorJob job;
+  int32_t tag; // echoed back as the completion event's data
+  int32_t arg;
 };
 
 // ── Sensor Manager ──────────────────────────────────────────
 class SensorManager {
 public:
+  static constexpr int JOB_QUEUE_SIZE = 4;
+  static constexpr int32_t LIVE_TAG = 0; // evt.data of stream frames
+
   static SensorManager &instance() {
     static SensorManager inst;
     return inst;
   }
 
   bool init() {
-    Wire.begin(Config::Sensor::SDA, Config::Sensor::SCL,
-               Config::Sensor::I2C_FREQ);
+    resultMutex_ = xSemaphoreCreateMutex();
+    jobs_ = xQueueCreate(JOB_QUEUE_SIZE, sizeof(SensorRequest));
+    if (!resultMutex_ || !jobs_)
+      return false;
 
-    mutex_ = xSemaphoreCreateMutex();
-    if (!mutex_)
+    // Sensor at the default gain (16x) + integration, idle, LED off
+    if (!pipeline_.begin())
       return false;
 
-    // Initialize sensor using SparkFun library
-    if (!sensor_.begin(Config::Sensor::I2C_ADDR, Wire)) {
-      Serial.println("[Sensor] AS7343 not found at 0x39");
+#ifdef COLOR_ENGINE_SELFTEST
+    auto st = ColorEngine::selfTest(pipeline_.coefficients());
+    Serial.printf("[Sensor] Color engine self-test: encode mismatches %lu, "
+                  "frames %lu/%lu differ (max dRGB %d, max dE00 %.2f, "
+                  "max dR %.4f)\n",
+                  (unsigned long)st.encodeMismatches,
+                  (unsigned long)st.frameMismatches, (unsigned long)st.frames,
+                  st.maxRgbDelta, st.maxDeltaE00 * 0.01f,
+                  st.maxReflDelta / (float)SpectralRecon::REFL_SCALE);
+    if (!st.passed()) {
+      Serial.println("[Sensor] Color engine self-test FAILED");
       return false;
     }
-
-    sensor_.powerOn();
-
-    // Set AutoSmux to 18 channels (to read all channels)
-    sensor_.setAutoSmux(AUTOSMUX_18_CHANNELS);
-
-    // Enable Spectral Measurement (Required to start valid readings)
-    sensor_.enableSpectralMeasurement();
-
-    // Configure gain (AGAIN_16 = 16x)
-    sensor_.setAgain(AGAIN_16);
-
-    // Configure LED drive current but keep it OFF by default.
-    // LED is turned on/off only during active measurements.
-    sensor_.setLedDrive(0); // 4 mA (Minimum)
-    sensor_.ledOff();
+    auto bench = ColorEngine::benchmark(pipeline_.coefficients(),
+                                        [] { return ESP.getCycleCount(); });
+    Serial.printf("[Sensor] Color engine: float %lu, fixed %lu cycles/frame "
+                  "(%.1fx)\n",
+                  (unsigned long)bench.floatPerFrame,
+                  (unsigned long)bench.fixedPerFrame,
+                  bench.fixedPerFrame
+                      ? (float)bench.floatPerFrame / bench.fixedPerFrame
+                      : 0.0f);
+#endif
 
     initialized_ = true;
-    Serial.println("[Sensor] AS7343 initialized (LED off)");
+    Serial.printf("[Sensor] AS7343 initialized (LED off, %s color engine, "
+                  "%lu ms cycle, auto-exposure %s)\n",
+                  Config::Color::FIXED_POINT ? "fixed-point" : "float",
+                  (unsigned long)(cycleTimeUs() / 1000),
+                  pipeline_.autoExposure() ? "on" : "off");
     return true;
   }
 
-  // ── Single measurement ──────────────────────────────────
-  // withLed: when true the on-board LED is turned on for the
-  //          duration of the sensor read and turned off afterwards.
-  //          Pass false for dark-reference capture (no illumination).
-  bool measure(SpectralData &data, bool withLed = true) {
-    if (!initialized_)
-      return false;
-
-    xSemaphoreTake(mutex_, portMAX_DELAY);
-
-    if (withLed) {
-      sensor_.ledOn();
-      // Wait for at least one full integration cycle with LED on.
-      // Integration = (ATIME+1)*(ASTEP+1)*2.78µs ≈ 50 ms per SMUX config,
-      // ×2 for AUTOSMUX_18_CHANNELS ≈ 100 ms. Add margin for settling.
-      vTaskDelay(pdMS_TO_TICKS(150));
-      // Flush stale data captured before LED was on
-      sensor_.readSpectraDataFromSensor();
+  // ── Sensor task (called from FreeRTOS task) ─────────────
+  // Sole owner of the I²C bus after init(). Runs one job at a time;
+  // while streaming, jobs are checked between frames.
+  void run() {
+    SensorRequest req;
+
+    while (true) {
+      TickType_t wait = streaming_ ? 0 : portMAX_DELAY;
+      if (xQueueReceive(jobs_, &req, wait) == pdTRUE) {
+        busy_ = true;
+        runJob(req);
+        busy_ = uxQueueMessagesWaiting(jobs_) > 0;
+      } else if (streaming_) {
+        streamFrame();
+      }
+      checkStack();
     }
+  }
 
-    // Read fresh measurement (captured with LED illumination if withLed)
-    bool ok = sensor_.readSpectraDataFromSensor();
-
-    if (withLed)
-      sensor_.ledOff();
-
-    if (ok) {
-      // Read all 14 channels
-      // AS7343 channel mapping (SparkFun library order):
-      // Index 0:  F1  (405-425 nm, violet)
-      // Index 1:  F2  (435-455 nm, blue)
-      // Index 2:  FZ  (CIE Z approximation)
-      // Index 3:  F3  (470-490 nm, cyan-blue)
-      // Index 4:  F4  (505-525 nm, green)
-      // Index 5:  FY  (CIE Y approximation)
-      // Index 6:  F5  (545-565 nm, yellow-green)
-      // Index 7:  FXL (CIE X low approximation)
-      // Index 8:  F6  (580-600 nm, orange)
-      // Index 9:  F7  (620-640 nm, red)
-      // Index 10: F8  (670-690 nm, deep red)
-      // Index 11: NIR (near infrared)
-      // Index 12: Clear/VIS
-      // Index 13: FD  (flicker detect)
-
-      data.raw[0] = sensor_.getChannelData(CH_PURPLE_F1_405NM);
-      data.raw[1] = sensor_.getChannelData(CH_DARK_BLUE_F2_425NM);
-      data.raw[2] = sensor_.getChannelData(CH_BLUE_FZ_450NM);
-      data.raw[3] = sensor_.getChannelData(CH_LIGHT_BLUE_F3_475NM);
-      data.raw[4] = sensor_.getChannelData(CH_BLUE_F4_515NM);
-      data.raw[5] = sensor_.getChannelData(CH_GREEN_FY_555NM);
-      data.raw[6] = sensor_.getChannelData(CH_GREEN_F5_550NM);
-      data.raw[7] = sensor_.getChannelData(CH_ORANGE_FXL_600NM);
-      data.raw[8] = sensor_.getChannelData(CH_BROWN_F6_640NM);
-      data.raw[9] = sensor_.getChannelData(CH_RED_F7_690NM);
-      data.raw[10] = sensor_.getChannelData(CH_DARK_RED_F8_745NM);
-      data.raw[11] = sensor_.getChannelData(CH_NIR_855NM);
-      data.raw[12] = sensor_.getChannelData(
-          CH_VIS_1); // Using VIS_1 as Clear approximation
-      data.raw[13] = sensor_.getChannelData(CH_FD_1);
-
-      // Apply calibration
-      applyCalibration(data);
-
-      // Convert to color
-      spectralToXYZ(data);
-      xyzToSRGB(data);
-
-      data.timestamp = millis();
-      data.valid = true;
-    } else {
-      data.valid = false;
-    }
+  // ── Asynchronous requests (any task, never block) ───────
+  // Completion is reported through the EventQueue with evt.data = tag.
+  bool requestMeasurement(int32_t tag, bool withLed = true) {
+    return post({withLed ? SensorJob::MEASURE : SensorJob::MEASURE_DARK, tag,
+                 0});
+  }
+
+  // step: 0 = dark, 1 = gray, 2 = white
+  bool requestCalibration(int step, int32_t tag) {
+    static constexpr SensorJob kSteps[3] = {
+        SensorJob::CALIB_DARK, SensorJob::CALIB_GRAY, SensorJob::CALIB_WHITE};
+    if (step < 0 || step > 2)
+      return false;
+    return post({kSteps[step], tag, 0});
+  }
 
-    xSemaphoreGive(mutex_);
+  // Copy of the last completed measurement. Returns false if the
+  // latest result belongs to a different request.
+  bool getResult(int32_t tag, SpectralData &data) {
+    xSemaphoreTake(resultMutex_, portMAX_DELAY);
+    bool ok = result_.valid && resultTag_ == tag;
+    if (ok)
+      data = result_;
+    xSemaphoreGive(resultMutex_);
     return ok;
   }
 
-  // ── Calibration routines ────────────────────────────────
+  bool isBusy() const { return busy_; }
 
-  // Step 1: Dark reference – sensor covered, no light
-  bool captureDarkReference() {
-    SpectralData temp;
-    constexpr int AVG_COUNT = 10;
+  // ── Live stream ───────────────────────────────────────────
+  // withLed: LED on for every frame, otherwise ambient light.
+  // Queued jobs still run; the stream resumes after them.
+  bool startStream(bool withLed) {
+    return post({SensorJob::STREAM_START, 0, withLed ? 1 : 0});
+  }
+  bool stopStream() { return post({SensorJob::STREAM_STOP, 0, 0}); }
+  bool isStreaming() const { return streaming_; }
 
-    // Average multiple readings for stability
-    float accum[Config::Sensor::NUM_CHANNELS] = {0};
+  // Stream profile: true = 6-channel preview (one SMUX phase per
+  // frame), false = full 18 channels. Takes effect on the next frame.
+  void setPreviewStream(bool on) { previewStream_ = on; }
+  bool previewStream() const { return previewStream_; }
 
-    for (int i = 0; i < AVG_COUNT; i++) {
-      if (!measure(temp, false)) // LED off – measuring dark noise floor
-        return false;
-      for (int ch = 0; ch < Config::Sensor::NUM_CHANNELS; ch++) {
-        accum[ch] += temp.raw[ch];
-      }
-      vTaskDelay(pdMS_TO_TICKS(50));
-    }
+  // Newest completed frame, for any number of reader tasks.
+  // Stream frames also wake the app task with SENSOR_DATA_READY /
+  // LIVE_TAG, coalesced: no further one is queued until the app
+  // calls liveWakeHandled(), so the stream never fills the event
+  // queue ahead of button and remote events.
+  const SeqLock<SpectralData> &live() const { return live_; }
 
-    for (int ch = 0; ch < Config::Sensor::NUM_CHANNELS; ch++) {
-      calib_.darkRef[ch] = accum[ch] / AVG_COUNT;
-    }
-    calib_.hasDark = true;
-    Serial.println("[Sensor] Dark reference captured");
-    return true;
-  }
+  // App task, on LIVE_TAG, before it reads live()
+  void liveWakeHandled() { liveWake_.store(false); }
 
-  // Step 2: Gray card reference (18% neutral gray, GC-3)
-  // This establishes the relationship between sensor counts
-  // and known reflectance, enabling absolute color measurement.
-  bool captureGrayReference() {
-    if (!calib_.hasDark) {
-      Serial.println("[Sensor] ERROR: Dark reference required first");
-      return false;
-    }
+  // Duration of one frame in the current profile (3 SMUX phases,
+  // 1 while the preview stream runs)
+  uint32_t cycleTimeUs() const { return pipeline_.cycleTimeUs(); }
 
-    SpectralData temp;
-    constexpr int AVG_COUNT = 10;
-    float accum[Config::Sensor::NUM_CHANNELS] = {0};
+  // Mains ripple integrations are snapped to (0 = none detected)
+  uint16_t flickerHz() const { return pipeline_.flickerHz(); }
 
-    for (int i = 0; i < AVG_COUNT; i++) {
-      if (!measure(temp))
-        return false;
-      for (int ch = 0; ch < Config::Sensor::NUM_CHANNELS; ch++) {
-        accum[ch] += temp.raw[ch];
-      }
-      vTaskDelay(pdMS_TO_TICKS(50));
-    }
+  // References in effect for the current exposure (flags for the UI)
+  CalibrationData getCalibration() { return pipeline_.getCalibration(); }
 
-    for (int ch = 0; ch < Config::Sensor::NUM_CHANNELS; ch++) {
-      calib_.grayRef[ch] = accum[ch] / AVG_COUNT;
-    }
-    calib_.hasGray = true;
-    calib_.calibTimestamp = millis();
-    Serial.println("[Sensor] Gray reference captured");
-    return true;
+  // Whole table, for persistence
+  CalibrationTable getCalibrationTable() {
+    return pipeline_.getCalibrationTable();
+  }
+  void setCalibrationTable(const CalibrationTable &table) {
+    pipeline_.setCalibrationTable(table);
   }
 
-  // Optional Step 3: White reference (e.g., barium sulfate plate)
-  bool captureWhiteReference() {
-    SpectralData temp;
-    constexpr int AVG_COUNT = 10;
-    float accum[Config::Sensor::NUM_CHANNELS] = {0};
-
-    for (int i = 0; i < AVG_COUNT; i++) {
-      if (!measure(temp))
-        return false;
-      for (int ch = 0; ch < Config::Sensor::NUM_CHANNELS; ch++) {
-        accum[ch] += temp.raw[ch];
-      }
-      vTaskDelay(pdMS_TO_TICKS(50));
-    }
+  // Spectral reconstruction matrix set (SpectralRecon::kSets index)
+  void setReconSet(int set) { pipeline_.setReconSet(set); }
 
-    for (int ch = 0; ch < Config::Sensor::NUM_CHANNELS; ch++) {
-      calib_.whiteRef[ch] = accum[ch] / AVG_COUNT;
-    }
-    calib_.hasWhite = true;
-    Serial.println("[Sensor] White reference captured");
-    return true;
-  }
+  // Viewing illuminant for XYZ / Lab / RGB (Illuminant::kViews)
+  void setIlluminant(Illuminant::Id id) { pipeline_.setIlluminant(id); }
+  Illuminant::Id illuminant() const { return pipeline_.illuminant(); }
 
-  const CalibrationData &getCalibration() const { return calib_; }
-  void setCalibration(const CalibrationData &cal) { calib_ = cal; }
+  // RGB output space and out-of-gamut handling (OutputSpace, GamutMap)
+  void setOutputSpace(OutputSpace::Id id) { pipeline_.setOutputSpace(id); }
+  OutputSpace::Id outputSpace() const { return pipeline_.outputSpace(); }
+  void setGamutMap(bool on) { pipeline_.setGamutMap(on); }
+  bool gamutMap() const { return pipeline_.gamutMap(); }
   bool isInitialized() const { return initialized_; }
 
   // ── Gain control ──────────────────────────────────────────
-  static constexpr int GAIN_COUNT = 13;
-  static constexpr sfe_as7343_again_t kGainTable[GAIN_COUNT] = {
-      AGAIN_0_5, AGAIN_1,   AGAIN_2,   AGAIN_4,  AGAIN_8,   AGAIN_16, AGAIN_32,
-      AGAIN_64,  AGAIN_128, AGAIN_256, AGAIN_512, AGAIN_1024, AGAIN_2048};
+  static constexpr int GAIN_COUNT = As7343Source::GAIN_COUNT;
   static constexpr const char *kGainLabels[GAIN_COUNT] = {
       "0.5x", "1x",   "2x",   "4x",   "8x",    "16x",  "32x",
       "64x",  "128x", "256x", "512x", "1024x", "2048x"};
 
-  int getGainIndex() const { return gainIndex_; }
-  const char *getGainLabel() const { return kGainLabels[gainIndex_]; }
+  // Gain setting GAIN_AUTO selects auto-exposure; 0…GAIN_COUNT-1
+  // fix the gain at the default integration time.
+  static constexpr int GAIN_AUTO = GAIN_COUNT;
+
+  // Gain currently applied (follows auto-exposure)
+  int getGainIndex() const { return pipeline_.exposure().gainIndex; }
+  int getGainSetting() const { return gainSetting_; }
+  const char *getGainLabel() const {
+    return gainSetting_ == GAIN_AUTO ? "Auto" : kGainLabels[gainSetting_];
+  }
+  const Exposure &getExposure() const { return pipeline_.exposure(); }
+  const As7343Source &getSource() const { return source_; } // bus stats
 
+  // Takes effect before the next queued measurement. Wraps around
+  // through GAIN_AUTO, so settings can cycle with idx + 1.
   void setGainIndex(int idx) {
-    gainIndex_ = idx % GAIN_COUNT;
-    if (gainIndex_ < 0)
-      gainIndex_ += GAIN_COUNT;
-    sensor_.setAgain(kGainTable[gainIndex_]);
-    Serial.printf("[Sensor] Gain set to %s\n", kGainLabels[gainIndex_]);
+    gainSetting_ = idx % (GAIN_COUNT + 1);
+    if (gainSetting_ < 0)
+      gainSetting_ += GAIN_COUNT + 1;
+    post({SensorJob::SET_GAIN, 0, gainSetting_});
   }
 
 private:
-  SensorManager() : initialized_(false), mutex_(nullptr), gainIndex_(5) {
-    memset(&calib_, 0, sizeof(calib_));
+  SensorManager()
+      : pipeline_(source_), jobs_(nullptr), resultMutex_(nullptr),
+        resultTag_(0), busy_(false), streaming_(false), streamLed_(false),
+        previewStream_(Config::Sensor::PREVIEW_STREAM), initialized_(false),
+        gainSetting_(Config::Sensor::AUTO_EXPOSURE
+                         ? GAIN_AUTO
+                         : Config::Sensor::DEFAULT_GAIN) {
+    memset(&result_, 0, sizeof(result_));
   }
 
-  // ── Apply calibration to raw data ───────────────────────
-  void applyCalibration(SpectralData &data) {
-    for (int ch = 0; ch < Config::Sensor::NUM_CHANNELS; ch++) {
-      float val = static_cast<float>(data.raw[ch]);
-
-      // Subtract dark reference
-      if (calib_.hasDark) {
-        val -= calib_.darkRef[ch];
-        if (val < 0)
-          val = 0;
-      }
-
-      // Normalize to gray reference (reflectance-relative)
-      if (calib_.hasGray) {
-        float grayNet = calib_.grayRef[ch] - calib_.darkRef[ch];
-        if (grayNet > 0) {
-          // Scale so that gray card = 0.18 reflectance
-          val = (val / grayNet) * CalibrationData::GRAY_REFLECTANCE;
-        }
-      }
-
-      data.calibrated[ch] = val;
+  bool post(const SensorRequest &req) {
+    if (!jobs_)
+      return false;
+    if (xQueueSend(jobs_, &req, 0) != pdTRUE) {
+      Serial.println("[Sensor] Job queue full");
+      return false;
     }
+    busy_ = true;
+    return true;
   }
 
-  // ── Spectral → CIE XYZ conversion ──────────────────────
-  // Using AS7343's CIE-like channels (FZ, FY, FXL) as approximations
-  // HYPOTHESIS: Direct use of FZ/FY/FXL as Z/Y/X is a first-order
-  // approximation. For higher accuracy, a full spectral integration
-  // with CIE 1931 observer functions applied to F1-F8 would be needed.
-  void spectralToXYZ(SpectralData &data) {
-    // Use the CIE-approximation channels
-    // FXL ≈ X, FY ≈ Y, FZ ≈ Z
-    data.cie_X = data.calibrated[7]; // FXL
-    data.cie_Y = data.calibrated[5]; // FY
-    data.cie_Z = data.calibrated[2]; // FZ
-
-    // Normalize (D65 white point)
-    // If calibrated with gray card, values are already relative
-    if (!calib_.hasGray) {
-      // Without calibration, normalize to max for visualization
-      float maxVal = fmax(fmax(data.cie_X, data.cie_Y), data.cie_Z);
-      if (maxVal > 0) {
-        data.cie_X /= maxVal;
-        data.cie_Y /= maxVal;
-        data.cie_Z /= maxVal;
+  void runJob(const SensorRequest &req) {
+    switch (req.job) {
+    case SensorJob::MEASURE:
+    case SensorJob::MEASURE_DARK: {
+      SpectralData data;
+      bool ok = pipeline_.measure(data, req.job == SensorJob::MEASURE);
+      if (ok) {
+        xSemaphoreTake(resultMutex_, portMAX_DELAY);
+        result_ = data;
+        resultTag_ = req.tag;
+        xSemaphoreGive(resultMutex_);
+        live_.write(data);
       }
+      EventQueue::send(ok ? EventType::SENSOR_DATA_READY
+                          : EventType::SENSOR_ERROR,
+                       req.tag);
+    } break;
+    case SensorJob::CALIB_DARK:
+    case SensorJob::CALIB_GRAY:
+    case SensorJob::CALIB_WHITE: {
+      bool ok = false;
+      if (req.job == SensorJob::CALIB_DARK)
+        ok = pipeline_.captureDarkReference();
+      else if (req.job == SensorJob::CALIB_GRAY)
+        ok = pipeline_.captureGrayReference();
+      else
+        ok = pipeline_.captureWhiteReference();
+      EventQueue::send(ok ? EventType::CALIBRATION_COMPLETE
+                          : EventType::SENSOR_ERROR,
+                       req.tag);
+    } break;
+    case SensorJob::SET_GAIN: {
+      bool autoExposure = req.arg == GAIN_AUTO;
+      pipeline_.setAutoExposure(autoExposure);
+      if (!autoExposure) {
+        Exposure e = kDefaultExposure;
+        e.gainIndex = static_cast<uint8_t>(req.arg);
+        pipeline_.applyExposure(e);
+      }
+      pipeline_.restartStream();
+      Serial.printf("[Sensor] Gain set to %s\n",
+                    autoExposure ? "auto" : kGainLabels[req.arg]);
+    } break;
+    case SensorJob::STREAM_START:
+      streaming_ = initialized_;
+      streamLed_ = req.arg != 0;
+      pipeline_.restartStream(); // re-arm with the new LED mode
+      break;
+    case SensorJob::STREAM_STOP:
+      if (streaming_)
+        pipeline_.stopStream();
+      streaming_ = false;
+      break;
     }
   }
 
-  // ── CIE XYZ → sRGB conversion ──────────────────────────
-  void xyzToSRGB(SpectralData &data) {
-    // XYZ to linear sRGB matrix (D65)
-    float r_lin =
-        data.cie_X * 3.2406f + data.cie_Y * -1.5372f + data.cie_Z * -0.4986f;
-    float g_lin =
-        data.cie_X * -0.9689f + data.cie_Y * 1.8758f + data.cie_Z * 0.0415f;
-    float b_lin =
-        data.cie_X * 0.0557f + data.cie_Y * -0.2040f + data.cie_Z * 1.0570f;
-
-    // Clamp to [0, 1]
-    r_lin = fmax(0.0f, fmin(1.0f, r_lin));
-    g_lin = fmax(0.0f, fmin(1.0f, g_lin));
-    b_lin = fmax(0.0f, fmin(1.0f, b_lin));
-
-    // sRGB gamma correction
-    auto gammaCorrect = [](float c) -> float {
-      if (c <= 0.0031308f)
-        return 12.92f * c;
-      else
-        return 1.055f * powf(c, 1.0f / 2.4f) - 0.055f;
-    };
+  // Logs the task's least free stack each time it shrinks, the
+  // margin Config::System::TASK_STACK_SENSOR is sized by
+  void checkStack() {
+    UBaseType_t free = uxTaskGetStackHighWaterMark(nullptr);
+    if (free >= stackFree_)
+      return;
+    stackFree_ = free;
+    Serial.printf("[Sensor] Stack high-water: %u of %lu bytes free\n",
+                  (unsigned)free,
+                  (unsigned long)Config::System::TASK_STACK_SENSOR);
+  }
 
-    data.r = static_cast<uint8_t>(gammaCorrect(r_lin) * 255.0f + 0.5f);
-    data.g = static_cast<uint8_t>(gammaCorrect(g_lin) * 255.0f + 0.5f);
-    data.b = static_cast<uint8_t>(gammaCorrect(b_lin) * 255.0f + 0.5f);
+  void streamFrame() {
+    SpectralData data;
+    if (pipeline_.streamFrame(data, streamLed_,
+                              previewStream_ ? SmuxProfile::PREVIEW
+                                             : SmuxProfile::FULL)) {
+      live_.write(data);
+      // Wake the UI unless a wake is still queued
+      if (!liveWake_.exchange(true) &&
+          !EventQueue::send(EventType::SENSOR_DATA_READY, LIVE_TAG))
+        liveWake_.store(false);
+    } else {
+      vTaskDelay(pdMS_TO_TICKS(100)); // bus error, retry later
+    }
   }
 
-  SfeAS7343ArdI2C sensor_;
-  CalibrationData calib_;
-  SemaphoreHandle_t mutex_;
+  As7343Source source_;
+  SpectralPipeline pipeline_; // driven by the sensor task only
+
+  // Task handoff
+  QueueHandle_t jobs_;          // SensorRequest, consumed by run()
+  SemaphoreHandle_t resultMutex_;
+  SpectralData result_;         // last completed measurement
+  int32_t resultTag_;
+  SeqLock<SpectralData> live_;  // newest frame, written by run() only
+  std::atomic<bool> liveWake_{false}; // LIVE_TAG event queued
+  volatile bool busy_;
+  volatile bool streaming_;
+  bool streamLed_;
+  volatile bool previewStream_;
+  UBaseType_t stackFree_ = Config::System::TASK_STACK_SENSOR; // checkStack()
+
   bool initialized_;
-  int gainIndex_; // Index into kGainTable (default 5 = AGAIN_16)
+  volatile int gainSetting_; // gain index or GAIN_AUTO (UI view)
 };
@@ -0,0 +1,103 @@
+#pragma once
+// ============================================================
+// seqlock.h – Single-producer / multi-consumer value handoff
+//
+// Sequence lock with a generation counter:
+//   - The producer never blocks: it bumps the sequence to odd,
+//     copies the value, bumps it back to even.
+//   - Consumers copy optimistically and retry if the sequence
+//     changed underneath them, so they never see a torn value.
+//   - generation() = completed writes; consumers keep the last
+//     generation they handled and skip work when it is unchanged.
+// The payload is stored as relaxed atomic words, so concurrent
+// copies are well-defined. T must be trivially copyable.
+//
+// Single-core note: a reader that preempts the writer mid-write
+// cannot make progress by spinning, so after a few retries it
+// sleeps one tick to let the writer finish.
+// ============================================================
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+#ifdef ARDUINO
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#else
+#include <thread>
+#endif
+
+template <typename T> class SeqLock {
+  static_assert(std::is_trivially_copyable<T>::value,
+                "SeqLock payload must be trivially copyable");
+
+public:
+  static constexpr int SPIN_RETRIES = 4;
+
+  SeqLock() : seq_(0) {
+    for (auto &w : words_)
+      w.store(0, std::memory_order_relaxed);
+  }
+
+  // Producer side (one task only)
+  void write(const T &value) {
+    uint32_t buf[WORDS] = {};
+    memcpy(buf, &value, sizeof(T));
+
+    uint32_t s = seq_.load(std::memory_order_relaxed);
+    seq_.store(s + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for (int i = 0; i < WORDS; i++)
+      words_[i].store(buf[i], std::memory_order_relaxed);
+    seq_.store(s + 2, std::memory_order_release);
+  }
+
+  // Number of completed writes (0 = nothing published yet)
+  uint32_t generation() const {
+    return seq_.load(std::memory_order_acquire) >> 1;
+  }
+
+  // Consistent snapshot; returns its generation
+  uint32_t read(T &out) const {
+    uint32_t buf[WORDS];
+    for (int attempt = 0;; attempt++) {
+      uint32_t s1 = seq_.load(std::memory_order_acquire);
+      if ((s1 & 1) == 0) {
+        for (int i = 0; i < WORDS; i++)
+          buf[i] = words_[i].load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (seq_.load(std::memory_order_relaxed) == s1) {
+          memcpy(&out, buf, sizeof(T));
+          return s1 >> 1;
+        }
+      }
+      if (attempt >= SPIN_RETRIES)
+        backoff();
+    }
+  }
+
+  // Copies only if a write completed since `lastGen`, then updates
+  // `lastGen`. Returns false (and leaves `out` alone) otherwise.
+  bool readIfNewer(T &out, uint32_t &lastGen) const {
+    if (generation() == lastGen)
+      return false;
+    lastGen = read(out);
+    return true;
+  }
+
+private:
+  static constexpr int WORDS = (sizeof(T) + 3) / 4;
+
+  static void backoff() {
+#ifdef ARDUINO
+    vTaskDelay(1);
+#else
+    std::this_thread::yield();
+#endif
+  }
+
+  std::atomic<uint32_t> seq_;
+  std::atomic<uint32_t> words_[WORDS];
+};
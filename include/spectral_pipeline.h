@@ -0,0 +1,747 @@
+#pragma once
+// ============================================================
+// spectral_pipeline.h – Acquisition and calibration logic
+//
+// Everything between a SpectralSource and finished SpectralData,
+// with no RTOS or driver dependency (runs on the device and in the
+// native host build):
+//   - Auto-exposure: gain and ASTEP follow the previous frame's
+//     peak (auto_exposure.h); every frame records its exposure
+//   - Sequential sampling: measurements and calibration references
+//     average frames until the per-channel standard error meets a
+//     target (Welford statistics, spectral_types.h)
+//   - Calibration (dark/gray/white references) per exposure,
+//     derived for exposures never calibrated (calibration_table.h)
+//   - Color space conversion (spectral → XYZ → sRGB, color_engine.h)
+//   - Acquisition profiles: the live stream may run the fast
+//     6-channel preview profile; measurements and calibration
+//     always switch to the full 18-channel profile
+//   - LED warm-up: integration starts once the LED output is stable,
+//     after the settle time measured during calibration or, without
+//     one, when short Clear-channel probes stop changing
+//   - Flicker sync: mains ripple found on the FD channel snaps every
+//     integration to whole ripple periods (flicker_sync.h)
+// Acquisition methods must be called from one task only; the
+// calibration table accessors may be called from any task.
+// ============================================================
+
+#include "auto_exposure.h"
+#include "calibration_table.h"
+#include "color_engine.h"
+#include "config.h"
+#include "flicker_sync.h"
+#include "illuminant.h"
+#include "output_space.h"
+#include "spectral_source.h"
+#include "spectral_types.h"
+#include <Arduino.h>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef ARDUINO
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#else
+#include <mutex>
+#endif
+
+class SpectralPipeline {
+public:
+  // Sequential-sampling stopping rules (see Config::Sensor)
+  static constexpr SamplingTarget kMeasureTarget = {
+      Config::Sensor::MEASURE_MIN_SAMPLES, Config::Sensor::MEASURE_MAX_SAMPLES,
+      Config::Sensor::SE_TARGET_COUNTS, Config::Sensor::SE_TARGET_REL};
+  static constexpr SamplingTarget kCalibTarget = {
+      Config::Sensor::CALIB_MIN_SAMPLES, Config::Sensor::CALIB_MAX_SAMPLES,
+      Config::Sensor::SE_TARGET_COUNTS, Config::Sensor::SE_TARGET_REL};
+
+  static constexpr int RAMP_SAMPLES = 128;       // LED ramp probes kept
+  static constexpr uint16_t RAMP_MIN_COUNTS = 50; // Clear level needed
+  static constexpr int FLICKER_SAMPLES = 160;    // FD probes per window
+
+  explicit SpectralPipeline(SpectralSource &source)
+      : source_(source), ready_(false), coeffsDirty_(false),
+        calibExposure_(kDefaultExposure), ledSettleMs_(-1),
+        autoExposure_(Config::Sensor::AUTO_EXPOSURE), streamLed_(false),
+        streamArmed_(false), ledHeld_(false), exposure_(kDefaultExposure),
+        profile_(SmuxProfile::FULL), flickerHz_(0), flickerChecked_(false),
+        flickerCheckedMs_(0), illuminant_(Illuminant::Id::D65),
+        outputSpace_(OutputSpace::Id::SRGB),
+        gamutMap_(Config::Color::GAMUT_MAP) {
+    CalibrationData none = calib_.resolve(kDefaultExposure);
+    ColorEngine::prepare(none, coeffs_);
+  }
+
+  // Brings up the source at the default exposure, idle, LED off
+  bool begin() {
+    if (!source_.begin())
+      return false;
+    source_.setExposure(kDefaultExposure, true);
+    exposure_ = kDefaultExposure;
+    source_.setMeasuring(false);
+    source_.setProfile(SmuxProfile::FULL);
+    profile_ = SmuxProfile::FULL;
+    source_.setLed(false);
+    ready_ = true;
+    return true;
+  }
+
+  bool isReady() const { return ready_; }
+  SpectralSource &source() { return source_; }
+  const ColorEngine::Coefficients &coefficients() const { return coeffs_; }
+
+  // ── Exposure ──────────────────────────────────────────────
+  const Exposure &exposure() const { return exposure_; }
+  uint32_t cycleTimeUs() const { return source_.cycleTimeUs(exposure_); }
+  bool autoExposure() const { return autoExposure_; }
+  void setAutoExposure(bool on) { autoExposure_ = on; }
+
+  // Writes only the settings that change (measuring off or between
+  // frames). Under detected flicker the integration is snapped to
+  // whole ripple periods first.
+  void applyExposure(const Exposure &e, bool force = false) {
+    programExposure(FlickerSync::snap(e, flickerHz_), force);
+  }
+
+  // ── Flicker sync ──────────────────────────────────────────
+  // Ripple frequency integrations are snapped to (0 = none found)
+  uint16_t flickerHz() const { return flickerHz_; }
+
+  // Samples the FD channel with back-to-back ~1 ms preview-profile
+  // integrations for FLICKER_WINDOW_MS and looks for 100 / 120 Hz
+  // ripple. withLed: as the following measurement will be lit.
+  // The current exposure is re-snapped to the result.
+  bool detectFlicker(bool withLed) {
+    if (!ready_)
+      return false;
+    const Exposure saved = exposure_;
+    streamArmed_ = false;
+    source_.setMeasuring(false);
+    ledOn(withLed);
+    applyProfile(SmuxProfile::PREVIEW);
+    programExposure(
+        probeExposure(saved.gainIndex, Config::Sensor::FLICKER_PROBE_ASTEP));
+
+    uint16_t raw[Config::Sensor::NUM_CHANNELS];
+    int n = 0;
+    bool ok = source_.setMeasuring(true);
+    const uint32_t start = source_.nowUs();
+    while (ok && n < FLICKER_SAMPLES &&
+           source_.nowUs() - start < Config::Sensor::FLICKER_WINDOW_MS * 1000) {
+      ok = source_.waitFrame(frameTimeoutMs()) && source_.readFrame(raw);
+      if (ok) {
+        flickerTimeUs_[n] = source_.nowUs();
+        flickerFd_[n] = raw[FlickerSync::FD_CHANNEL];
+        n++;
+      }
+    }
+    source_.setMeasuring(false);
+    ledOff(withLed);
+    applyProfile(SmuxProfile::FULL);
+    if (!ok)
+      return false;
+
+    float ripple = 0;
+    uint16_t hz = FlickerSync::detect(flickerFd_, flickerTimeUs_, n, &ripple);
+    if (hz != flickerHz_) {
+      Serial.printf("[Sensor] Flicker: %s (ripple %.1f %%, %d probes)\n",
+                    hz == 100 ? "100 Hz" : hz == 120 ? "120 Hz" : "none",
+                    ripple * 100.0f, n);
+    }
+    flickerHz_ = hz;
+    flickerChecked_ = true;
+    flickerCheckedMs_ = source_.nowMs();
+    applyExposure(saved);
+    return true;
+  }
+
+  // ── Acquisition profile ───────────────────────────────────
+  SmuxProfile profile() const { return profile_; }
+
+  // Stops free-running frames if the channel set changes
+  void applyProfile(SmuxProfile p) {
+    if (p == profile_)
+      return;
+    source_.setMeasuring(false);
+    source_.setProfile(p);
+    profile_ = p;
+    streamArmed_ = false;
+  }
+
+  // ── Calibration table (any task) ──────────────────────────
+  // References in effect for the current exposure (flags for the UI)
+  CalibrationData getCalibration() {
+    Lock lock(mutex_);
+    return calib_.resolve(exposure_);
+  }
+
+  // Whole table, for persistence
+  CalibrationTable getCalibrationTable() {
+    Lock lock(mutex_);
+    return calib_;
+  }
+
+  void setCalibrationTable(const CalibrationTable &table) {
+    Lock lock(mutex_);
+    calib_ = table;
+    ledSettleMs_ = table.ledSettleMs();
+    coeffsDirty_ = true;
+  }
+
+  // Matrix set for the reflectance spectrum (SpectralRecon::kSets)
+  void setReconSet(int set) {
+    if (set < 0 || set >= SpectralRecon::SET_COUNT)
+      return;
+    Lock lock(mutex_);
+    calib_.setReconSet(static_cast<uint8_t>(set));
+    coeffsDirty_ = true;
+  }
+
+  // Illuminant XYZ / Lab / RGB are rendered under (not persisted)
+  void setIlluminant(Illuminant::Id id) {
+    if (static_cast<int>(id) >= Illuminant::COUNT)
+      return;
+    illuminant_ = id;
+    coeffsDirty_ = true;
+  }
+  Illuminant::Id illuminant() const { return illuminant_; }
+
+  // RGB output space, and whether colors outside it are gamut-mapped
+  // (else clamped); not persisted either
+  void setOutputSpace(OutputSpace::Id id) {
+    if (static_cast<int>(id) >= OutputSpace::COUNT)
+      return;
+    outputSpace_ = id;
+    coeffsDirty_ = true;
+  }
+  OutputSpace::Id outputSpace() const { return outputSpace_; }
+
+  void setGamutMap(bool on) {
+    gamutMap_ = on;
+    coeffsDirty_ = true;
+  }
+  bool gamutMap() const { return gamutMap_; }
+
+  // ── Single acquisition ────────────────────────────────────
+  // withLed: when true the on-board LED is turned on before the
+  //          integration is armed and turned off afterwards (left on
+  //          inside measure()).
+  //          Pass false for dark-reference capture (no illumination).
+  // Integration is started once the LED has settled, so the first
+  // completed cycle is already fully illuminated (no flush read).
+  // autoExposure: retake (up to AE_MAX_RETAKES) while the frame is
+  //               saturated or underexposed; the settled exposure is
+  //               kept for the next measurement.
+  bool acquire(SpectralData &data, bool withLed = true,
+               bool autoExposure = false) {
+    streamArmed_ = false; // a single acquisition stops free-running
+    for (int take = 0;; take++) {
+      if (!acquireOnce(data, withLed))
+        return false;
+      Exposure next;
+      if (!autoExposure ||
+          AutoExposure::evaluate(exposure_,
+                                 AutoExposure::peakCounts(data.raw), next) ||
+          take >= Config::Sensor::AE_MAX_RETAKES ||
+          FlickerSync::snap(next, flickerHz_) == exposure_)
+        return true;
+      applyExposure(next);
+    }
+  }
+
+  // One measurement: flicker check (when due), auto-exposure (if
+  // enabled), then sequential sampling when
+  // Config::Sensor::ADAPTIVE_SAMPLING is set. The LED is settled
+  // once and stays on through all of them.
+  bool measure(SpectralData &data, bool withLed) {
+    if (withLed && ready_) {
+      streamArmed_ = false;
+      source_.setMeasuring(false);
+      applyProfile(SmuxProfile::FULL);
+      ledOnSettled();
+      ledHeld_ = true;
+    }
+    if (Config::Sensor::FLICKER_SYNC &&
+        (!flickerChecked_ || source_.nowMs() - flickerCheckedMs_ >=
+                                 Config::Sensor::FLICKER_RECHECK_MS))
+      detectFlicker(withLed);
+    bool ok = acquire(data, withLed, autoExposure_);
+    if (ok && Config::Sensor::ADAPTIVE_SAMPLING)
+      ok = refine(data, withLed);
+    if (ledHeld_) {
+      ledHeld_ = false;
+      source_.setLed(false);
+    }
+    return ok;
+  }
+
+  // ── Burst acquisition ─────────────────────────────────────
+  // Settles the LED once (unless measure() has), then lets the
+  // sensor free-run back-to-back cycles at the current exposure,
+  // adding raw counts to `stats` without running the color
+  // pipeline, until `target` is met (sequential sampling) or
+  // maxSamples frames are in. One cycle per frame, no per-frame LED
+  // or SP_EN toggling. `stats` may already hold frames taken at the
+  // same exposure.
+  bool acquireBurst(ChannelStats &stats, const SamplingTarget &target,
+                    bool withLed) {
+    if (stats.count == 0)
+      stats.exposure = exposure_;
+    if (!ready_)
+      return false;
+    applyProfile(SmuxProfile::FULL);
+    streamArmed_ = false;
+
+    source_.setMeasuring(false);
+    ledOn(withLed);
+
+    bool ok = source_.setMeasuring(true);
+    uint16_t raw[Config::Sensor::NUM_CHANNELS];
+    while (ok && stats.count < target.maxSamples &&
+           !(stats.count >= target.minSamples &&
+             stats.converged(target.seCounts, target.seRel))) {
+      ok = source_.waitFrame(frameTimeoutMs()) && source_.readFrame(raw);
+      if (ok) {
+        stats.add(raw);
+        if (AutoExposure::isSaturated(exposure_,
+                                      AutoExposure::peakCounts(raw)))
+          stats.saturated = true;
+      }
+    }
+    source_.setMeasuring(false);
+
+    ledOff(withLed);
+    return ok;
+  }
+
+  // ── Live stream ───────────────────────────────────────────
+  // One free-running frame: measuring stays on between frames so
+  // the frame rate equals the integration rate (3× faster with the
+  // PREVIEW profile). Returns false on a bus error (the caller backs
+  // off) or a missed frame.
+  bool streamFrame(SpectralData &data, bool withLed,
+                   SmuxProfile profile = SmuxProfile::FULL) {
+    applyProfile(profile);
+    if (!streamArmed_ || withLed != streamLed_) {
+      source_.setLed(withLed);
+      streamLed_ = withLed;
+      streamArmed_ = source_.setMeasuring(true);
+      if (!streamArmed_)
+        return false;
+    }
+
+    bool ok = source_.waitFrame(frameTimeoutMs()) && readFrame(data);
+    if (!ok) {
+      source_.setMeasuring(false);
+      streamArmed_ = false;
+      return false;
+    }
+
+    // Next frame's exposure from this frame's peak; a new exposure
+    // restarts the cycle so no frame mixes two settings
+    if (autoExposure_) {
+      Exposure next;
+      AutoExposure::evaluate(exposure_, AutoExposure::peakCounts(data.raw),
+                             next);
+      next = FlickerSync::snap(next, flickerHz_);
+      if (next != exposure_) {
+        source_.setMeasuring(false);
+        applyExposure(next);
+        streamArmed_ = false;
+      }
+    }
+    return true;
+  }
+
+  void stopStream() {
+    if (ready_) {
+      source_.setMeasuring(false);
+      source_.setLed(false);
+    }
+    streamArmed_ = false;
+  }
+
+  // Forces the next streamFrame() to re-arm (e.g. after a gain change)
+  void restartStream() { streamArmed_ = false; }
+
+  // ── Calibration routines ──────────────────────────────────
+  // A calibration run takes all references at one exposure (the
+  // manual gain, or the default exposure under auto-exposure) and
+  // stores them as that exposure's table entry. Frames at other
+  // exposures use references derived from the table, so the
+  // coefficients are rebuilt whenever the frame exposure changes.
+
+  // Step 1: Dark reference – sensor covered, no light
+  bool captureDarkReference() {
+    calibExposure_ = FlickerSync::snap(
+        autoExposure_ ? kDefaultExposure : exposure_, flickerHz_);
+
+    // Average multiple readings for stability
+    CalibrationData cal = calibEntry();
+    if (!captureReference(cal.darkRef, false)) // LED off – dark noise floor
+      return false;
+    cal.hasDark = true;
+    storeEntry(cal);
+    Serial.printf("[Sensor] Dark reference captured (gain index %u, "
+                  "ASTEP %u)\n",
+                  (unsigned)calibExposure_.gainIndex,
+                  (unsigned)calibExposure_.astep);
+    return true;
+  }
+
+  // Step 2: Gray card reference (18% neutral gray, GC-3)
+  // This establishes the relationship between sensor counts
+  // and known reflectance, enabling absolute color measurement.
+  // The card is also the target for the LED warm-up curve.
+  bool captureGrayReference() {
+    CalibrationData cal = calibEntry();
+    if (!cal.hasDark) {
+      Serial.println("[Sensor] ERROR: Dark reference required first");
+      return false;
+    }
+    characterizeLed(); // keeps the previous settle time on failure
+
+    if (!captureReference(cal.grayRef, true))
+      return false;
+    cal.hasGray = true;
+    cal.calibTimestamp = source_.nowMs();
+    storeEntry(cal);
+    Serial.println("[Sensor] Gray reference captured");
+    return true;
+  }
+
+  // Optional Step 3: White reference (e.g., barium sulfate plate)
+  bool captureWhiteReference() {
+    CalibrationData cal = calibEntry();
+    if (!captureReference(cal.whiteRef, true))
+      return false;
+    cal.hasWhite = true;
+    storeEntry(cal);
+    Serial.println("[Sensor] White reference captured");
+    return true;
+  }
+
+  // ── LED warm-up ───────────────────────────────────────────
+  // Records the Clear-channel ramp after turn-on (LED off for
+  // LED_COOL_MS, then back-to-back probe integrations for
+  // LED_RAMP_MS) and stores the settle point – the start of the
+  // first probe from which every later one is within
+  // LED_SETTLE_TOL of the final level – in the calibration table.
+  // Needs a reflective target in front of the sensor.
+  bool characterizeLed() {
+    if (!ready_)
+      return false;
+    const Exposure saved = exposure_;
+    streamArmed_ = false;
+    source_.setMeasuring(false);
+    source_.setLed(false);
+    source_.sleepMs(Config::Sensor::LED_COOL_MS);
+
+    applyProfile(SmuxProfile::PREVIEW);
+    programExposure(probeExposure(calibExposure_.gainIndex));
+    const uint32_t probeMs = cycleTimeUs() / 1000;
+
+    uint16_t raw[Config::Sensor::NUM_CHANNELS];
+    int n = 0;
+    source_.setLed(true);
+    const uint32_t start = source_.nowMs();
+    bool ok = source_.setMeasuring(true);
+    while (ok && n < RAMP_SAMPLES &&
+           source_.nowMs() - start < Config::Sensor::LED_RAMP_MS) {
+      ok = source_.waitFrame(frameTimeoutMs()) && source_.readFrame(raw);
+      if (ok) {
+        uint32_t end = source_.nowMs() - start;
+        rampStartMs_[n] = static_cast<uint16_t>(end > probeMs ? end - probeMs
+                                                              : 0);
+        rampClear_[n] = raw[CLEAR_CHANNEL];
+        n++;
+      }
+    }
+    source_.setMeasuring(false);
+    source_.setLed(false);
+    applyProfile(SmuxProfile::FULL);
+    programExposure(saved);
+
+    // Final level from the last quarter of the window
+    const int tail = n / 4;
+    if (!ok || tail < 2) {
+      Serial.println("[Sensor] LED ramp: no probe frames");
+      return false;
+    }
+    float level = 0;
+    for (int i = n - tail; i < n; i++)
+      level += rampClear_[i];
+    level /= tail;
+    if (level < RAMP_MIN_COUNTS) {
+      Serial.printf("[Sensor] LED ramp: Clear %.0f counts, no target?\n",
+                    level);
+      return false;
+    }
+
+    int settled = n;
+    while (settled > 0 &&
+           fabsf(rampClear_[settled - 1] - level) <= settleTolerance(level))
+      settled--;
+    if (settled > n - tail) {
+      Serial.println("[Sensor] LED ramp: not settled within the window");
+      return false;
+    }
+
+    int32_t ms = settled < n ? rampStartMs_[settled] : 0;
+    {
+      Lock lock(mutex_);
+      calib_.setLedSettleMs(ms);
+    }
+    ledSettleMs_ = ms;
+    Serial.printf("[Sensor] LED settles in %ld ms (%d probes, Clear %u -> "
+                  "%.0f)\n",
+                  (long)ms, n, (unsigned)rampClear_[0], level);
+    return true;
+  }
+
+private:
+  // Mutex for the calibration table (FreeRTOS on the device)
+#ifdef ARDUINO
+  struct Mutex {
+    SemaphoreHandle_t h = xSemaphoreCreateMutex();
+  };
+  struct Lock {
+    explicit Lock(Mutex &m) : m_(m) { xSemaphoreTake(m_.h, portMAX_DELAY); }
+    ~Lock() { xSemaphoreGive(m_.h); }
+    Mutex &m_;
+  };
+#else
+  using Mutex = std::mutex;
+  using Lock = std::lock_guard<std::mutex>;
+#endif
+
+  uint32_t frameTimeoutMs() const { return cycleTimeUs() / 1000 + 50; }
+
+  // Exactly `e`, no flicker snapping (probes, calibration keys)
+  void programExposure(const Exposure &e, bool force = false) {
+    if (force || e != exposure_)
+      source_.setExposure(e, force);
+    exposure_ = e;
+  }
+
+  // Short integration at `gain` (one preview phase per probe)
+  static Exposure probeExposure(
+      uint8_t gain, uint16_t astep = Config::Sensor::LED_PROBE_ASTEP) {
+    return {gain, 0, astep};
+  }
+
+  // Clear-channel agreement for "settled": relative, with a floor of
+  // a couple of counts for dim targets
+  static float settleTolerance(float level) {
+    float tol = Config::Sensor::LED_SETTLE_TOL * level;
+    return tol > 2.0f ? tol : 2.0f;
+  }
+
+  // LED on, then wait for stable output: the characterized settle
+  // time, or else probe until two successive pairs of Clear readings
+  // agree (at most LED_SETTLE_MAX_MS). Leaves measuring off at the
+  // FULL profile and the previous exposure.
+  void ledOnSettled() {
+    source_.setLed(true);
+    if (ledSettleMs_ >= 0) {
+      if (ledSettleMs_ > 0)
+        source_.sleepMs(static_cast<uint32_t>(ledSettleMs_));
+      return;
+    }
+
+    const Exposure saved = exposure_;
+    applyProfile(SmuxProfile::PREVIEW);
+    programExposure(probeExposure(saved.gainIndex));
+    uint16_t raw[Config::Sensor::NUM_CHANNELS];
+    int prev = -1, stable = 0;
+    const uint32_t start = source_.nowMs();
+    bool ok = source_.setMeasuring(true);
+    while (ok && stable < 2 &&
+           source_.nowMs() - start < Config::Sensor::LED_SETTLE_MAX_MS) {
+      ok = source_.waitFrame(frameTimeoutMs()) && source_.readFrame(raw);
+      if (ok) {
+        int c = raw[CLEAR_CHANNEL];
+        stable = prev >= 0 && abs(c - prev) <= settleTolerance(c) ? stable + 1
+                                                                  : 0;
+        prev = c;
+      }
+    }
+    source_.setMeasuring(false);
+    applyProfile(SmuxProfile::FULL);
+    programExposure(saved);
+  }
+
+  // LED around one acquisition step: on and settled before, off
+  // after, unless measure() holds it on for the whole measurement
+  void ledOn(bool withLed) {
+    if (withLed && !ledHeld_)
+      ledOnSettled();
+  }
+  void ledOff(bool withLed) {
+    if (withLed && !ledHeld_)
+      source_.setLed(false);
+  }
+
+  bool acquireOnce(SpectralData &data, bool withLed) {
+    data.valid = false;
+    if (!ready_)
+      return false;
+
+    // Restart integration so no part of the cycle predates the LED
+    source_.setMeasuring(false);
+    applyProfile(SmuxProfile::FULL);
+    ledOn(withLed);
+
+    bool ok = source_.setMeasuring(true) &&
+              source_.waitFrame(frameTimeoutMs()) && readFrame(data);
+    source_.setMeasuring(false);
+
+    ledOff(withLed);
+    return ok;
+  }
+
+  // Averages more frames into an accepted measurement until the
+  // noise target is met; bright targets usually stop at two.
+  bool refine(SpectralData &data, bool withLed) {
+    ChannelStats stats;
+    stats.reset();
+    stats.exposure = data.exposure;
+    stats.saturated = data.saturated;
+    stats.add(data.raw);
+    if (!stats.converged(kMeasureTarget.seCounts, kMeasureTarget.seRel) &&
+        !acquireBurst(stats, kMeasureTarget, withLed))
+      return false;
+
+    for (int ch = 0; ch < Config::Sensor::NUM_CHANNELS; ch++) {
+      data.raw[ch] = static_cast<uint16_t>(stats.mean[ch] + 0.5f);
+      data.stdError[ch] = stats.stdError(ch);
+    }
+    data.samples = stats.count;
+    data.saturated = stats.saturated;
+    processFrame(data);
+    return true;
+  }
+
+  // Reads the completed cycle and runs the color pipeline
+  bool readFrame(SpectralData &data) {
+    data.valid = false;
+    bool ok = source_.readFrame(data.raw);
+    if (ok) {
+      data.exposure = exposure_;
+      data.profile = profile_;
+      data.saturated = AutoExposure::isSaturated(
+          exposure_, AutoExposure::peakCounts(data.raw));
+      memset(data.stdError, 0, sizeof(data.stdError));
+      data.samples = 1;
+      processFrame(data);
+    }
+    return ok;
+  }
+
+  // Calibrate + convert to color (fixed or float, see Config::Color)
+  void processFrame(SpectralData &data) {
+    updateCoefficients();
+    ColorEngine::process(coeffs_, data);
+    data.timestamp = source_.nowMs();
+    data.valid = true;
+  }
+
+  void updateCoefficients() {
+    if (!coeffsDirty_ && coeffs_.exposure == exposure_)
+      return;
+    CalibrationData cal;
+    {
+      Lock lock(mutex_);
+      cal = calib_.resolve(exposure_);
+      coeffsDirty_ = false;
+    }
+    ColorEngine::prepare(cal, coeffs_);
+    coeffs_.illuminant = illuminant_;
+    coeffs_.space = outputSpace_;
+    coeffs_.gamutMap = gamutMap_;
+  }
+
+  // Averages a burst at calibExposure_ into ref, sampling until
+  // kCalibTarget is met
+  bool captureReference(float *ref, bool withLed) {
+    ChannelStats stats;
+    stats.reset();
+    programExposure(calibExposure_); // exactly the table key
+
+    uint32_t start = source_.nowMs();
+    if (!acquireBurst(stats, kCalibTarget, withLed))
+      return false;
+
+    // Noisiest channel relative to its level, for the log
+    int worst = 0;
+    float worstRel = 0;
+    for (int ch = 0; ch < Config::Sensor::NUM_CHANNELS; ch++) {
+      ref[ch] = stats.mean[ch];
+      float rel = sqrtf(stats.variance(ch)) / (stats.mean[ch] + 1.0f);
+      if (rel > worstRel) {
+        worstRel = rel;
+        worst = ch;
+      }
+    }
+    Serial.printf("[Sensor] Burst %u frames in %lu ms, max noise ch%d: "
+                  "mean %.1f sd %.2f%s\n",
+                  (unsigned)stats.count,
+                  (unsigned long)(source_.nowMs() - start),
+                  worst, stats.mean[worst], sqrtf(stats.variance(worst)),
+                  stats.saturated ? " (SATURATED)" : "");
+    return true;
+  }
+
+  // Measured entry for calibExposure_, or an empty one
+  CalibrationData calibEntry() {
+    Lock lock(mutex_);
+    const CalibrationData *m = calib_.find(calibExposure_);
+    CalibrationData cal;
+    if (m) {
+      cal = *m;
+    } else {
+      memset(&cal, 0, sizeof(cal));
+      cal.exposure = calibExposure_;
+    }
+    return cal;
+  }
+
+  void storeEntry(const CalibrationData &cal) {
+    Lock lock(mutex_);
+    calib_.store(cal);
+    coeffsDirty_ = true;
+  }
+
+  SpectralSource &source_;
+  bool ready_;
+
+  Mutex mutex_;
+  CalibrationTable calib_;           // guarded by mutex_
+  ColorEngine::Coefficients coeffs_; // calib_ resolved at coeffs_.exposure
+  volatile bool coeffsDirty_;        // calib_ changed since last prepare
+  Exposure calibExposure_;           // exposure of the current calib run
+  volatile int32_t ledSettleMs_;     // calib_.ledSettleMs(), lock-free copy
+
+  // LED warm-up curve (characterizeLed)
+  uint16_t rampStartMs_[RAMP_SAMPLES];
+  uint16_t rampClear_[RAMP_SAMPLES];
+
+  volatile bool autoExposure_;
+  bool streamLed_;
+  bool streamArmed_; // measuring on and LED set for the stream
+  bool ledHeld_;     // measure() keeps the LED on and settled
+  Exposure exposure_; // currently programmed in the source
+  SmuxProfile profile_; // channel set programmed in the source
+
+  // Flicker sync
+  volatile uint16_t flickerHz_; // 0, 100 or 120
+  bool flickerChecked_;
+  uint32_t flickerCheckedMs_;
+  uint16_t flickerFd_[FLICKER_SAMPLES];
+  uint32_t flickerTimeUs_[FLICKER_SAMPLES];
+
+  volatile Illuminant::Id illuminant_;
+  volatile OutputSpace::Id outputSpace_;
+  volatile bool gamutMap_;
+};
@@ -0,0 +1,339 @@
+#pragma once
+// ============================================================
+// spectral_recon.h – 14 channels → 31-band reflectance spectrum
+//
+// Estimates the reflectance curve at 400, 410, … 700 nm from the
+// gray-calibrated channel values (band-averaged reflectances, see
+// cie_observer.h) with one precomputed linear map per matrix set:
+//   R(λ) = offset(λ) + Σ W(λ, ch) · cal(ch)
+// which is the Wiener estimate for the set's prior, folded with its
+// mean into offset. NIR, Clear and FD get zero weight.
+//
+// Derived offline with the same channel model as the XYZ matrix
+// (AS7343 Gaussians through the on-board white LED, 380–780 nm,
+// 5 nm), 0.5 % channel noise. Priors and simulated RMS reflectance
+// error (smooth broadband / steep single-edge test spectra):
+//   generic  first-order Markov, ρ 0.98   0.009 / 0.014
+//   smooth   sample covariance, smooth    0.006 / 0.018
+//   inks     sample covariance, edges     0.016 / 0.013
+// The set is chosen with the calibration (CalibrationTable::
+// reconSet), matching the kind of target being measured.
+//
+// Fixed path: Q16 weights × Q16 reflectance, 64-bit accumulate –
+// 31 × 14 MACs, a few µs per frame. Output in REFL_SCALE units.
+// ============================================================
+
+#include "config.h"
+#include <cstdint>
+#include <cstring>
+
+namespace SpectralRecon {
+
+constexpr int N = Config::Sensor::NUM_CHANNELS;
+constexpr int BANDS = Config::Sensor::SPECTRUM_BANDS;
+constexpr int REFL_SCALE = 10000; // reflectance 1.0 → 10000
+
+struct MatrixSet {
+  const char *name;
+  float offset[BANDS];
+  float w[BANDS][N]; // columns in SpectralData::raw[] order
+};
+
+constexpr MatrixSet kSets[] = {
+    // Markov prior (ρ 0.98 per 5 nm, mean 0.45): any surface
+    {"generic",
+     {
+         0.01089f, -0.00080f, -0.00513f, -0.00273f, 0.00152f, -0.00007f,
+         -0.00088f, -0.00005f, 0.00063f, 0.00087f, 0.00071f, 0.00030f,
+         -0.00015f, -0.00044f, -0.00045f, -0.00017f, 0.00028f, 0.00071f,
+         0.00087f, 0.00051f, -0.00039f, -0.00143f, -0.00188f, -0.00106f,
+         0.00098f, 0.00325f, 0.00418f, 0.00261f, -0.00137f, -0.00620f,
+         -0.00945f},
+     {
+         {2.90317f, -2.31923f, 0.63557f, -0.26103f, 0.02459f, 0.01835f,
+          -0.02244f, -0.00138f, -0.00257f, 0.00110f, -0.00032f, 0.0f, 0.0f,
+          0.0f},
+         {2.57044f, -1.80085f, 0.37147f, -0.14851f, 0.01305f, 0.01033f,
+          -0.01224f, -0.00099f, -0.00134f, 0.00059f, -0.00017f, 0.0f, 0.0f,
+          0.0f},
+         {1.69087f, -0.56028f, -0.20665f, 0.09542f, -0.01147f, -0.00692f,
+          0.00957f, -0.00004f, 0.00126f, -0.00051f, 0.00015f, 0.0f, 0.0f, 0.0f},
+         {0.42306f, 1.05996f, -0.77857f, 0.32376f, -0.03150f, -0.02275f,
+          0.02835f, 0.00145f, 0.00332f, -0.00141f, 0.00041f, 0.0f, 0.0f, 0.0f},
+         {-0.36872f, 1.35755f, 0.07167f, -0.07573f, 0.01712f, 0.00767f,
+          -0.01261f, 0.00106f, -0.00191f, 0.00074f, -0.00022f, 0.0f, 0.0f, 0.0f},
+         {0.04372f, -0.39258f, 1.96504f, -0.63205f, 0.02237f, 0.03228f,
+          -0.03020f, -0.00710f, -0.00212f, 0.00114f, -0.00034f, 0.0f, 0.0f,
+          0.0f},
+         {0.15486f, -0.55582f, 1.05803f, 0.47557f, -0.18250f, -0.08735f,
+          0.13126f, -0.00520f, 0.01826f, -0.00728f, 0.00212f, 0.0f, 0.0f, 0.0f},
+         {-0.00713f, 0.09149f, -0.56351f, 1.64385f, -0.23421f, -0.09473f,
+          0.16188f, -0.01566f, 0.02495f, -0.00962f, 0.00280f, 0.0f, 0.0f, 0.0f},
+         {-0.12110f, 0.51267f, -1.46440f, 2.09986f, -0.05051f, 0.04952f,
+          -0.00007f, -0.03464f, 0.00896f, -0.00237f, 0.00067f, 0.0f, 0.0f, 0.0f},
+         {-0.13308f, 0.54169f, -1.44130f, 1.76098f, 0.37552f, 0.22952f,
+          -0.30153f, -0.00760f, -0.03707f, 0.01546f, -0.00452f, 0.0f, 0.0f,
+          0.0f},
+         {-0.07234f, 0.29459f, -0.78316f, 0.90551f, 0.93696f, 0.26776f,
+          -0.58167f, 0.10623f, -0.10236f, 0.03791f, -0.01100f, 0.0f, 0.0f, 0.0f},
+         {-0.00531f, 0.02319f, -0.06948f, 0.05796f, 1.35452f, 0.23271f,
+          -0.66224f, 0.15977f, -0.12335f, 0.04445f, -0.01288f, 0.0f, 0.0f, 0.0f},
+         {0.03153f, -0.12865f, 0.34062f, -0.43022f, 1.36551f, 0.29865f,
+          -0.41427f, -0.04238f, -0.03016f, 0.01374f, -0.00403f, 0.0f, 0.0f,
+          0.0f},
+         {0.03359f, -0.13861f, 0.37508f, -0.46330f, 0.97332f, 0.13351f,
+          0.29074f, -0.30884f, 0.13761f, -0.04515f, 0.01302f, 0.0f, 0.0f, 0.0f},
+         {0.01390f, -0.05811f, 0.16559f, -0.18531f, 0.42599f, -0.52941f,
+          1.26479f, -0.26788f, 0.23151f, -0.08461f, 0.02454f, 0.0f, 0.0f, 0.0f},
+         {-0.00680f, 0.02760f, -0.06677f, 0.10439f, -0.09650f, -0.69680f,
+          1.70891f, -0.08664f, 0.15388f, -0.05753f, 0.01664f, 0.0f, 0.0f, 0.0f},
+         {-0.01419f, 0.05911f, -0.16814f, 0.18657f, -0.52495f, 0.60319f,
+          1.02243f, -0.11643f, -0.07586f, 0.03942f, -0.01176f, 0.0f, 0.0f, 0.0f},
+         {-0.00907f, 0.03885f, -0.13099f, 0.08936f, -0.69364f, 2.20798f,
+          -0.22749f, 0.00058f, -0.38916f, 0.15809f, -0.04609f, 0.0f, 0.0f, 0.0f},
+         {-0.00061f, 0.00379f, -0.03546f, -0.02868f, -0.47305f, 2.23860f,
+          -0.98103f, 0.77381f, -0.65545f, 0.21854f, -0.06239f, 0.0f, 0.0f, 0.0f},
+         {0.00465f, -0.01893f, 0.04433f, -0.07571f, -0.02121f, 0.66274f,
+          -0.89971f, 1.85654f, -0.66103f, 0.14659f, -0.03938f, 0.0f, 0.0f, 0.0f},
+         {0.00550f, -0.02339f, 0.07518f, -0.05988f, 0.33363f, -1.00274f,
+          -0.39170f, 2.35639f, -0.24477f, -0.07297f, 0.02560f, 0.0f, 0.0f, 0.0f},
+         {0.00343f, -0.01508f, 0.05819f, -0.02255f, 0.38513f, -1.51517f,
+          0.04462f, 1.78924f, 0.52407f, -0.35299f, 0.10429f, 0.0f, 0.0f, 0.0f},
+         {0.00048f, -0.00244f, 0.01587f, 0.00701f, 0.17520f, -0.82209f,
+          0.20125f, 0.48311f, 1.31901f, -0.51547f, 0.14224f, 0.0f, 0.0f, 0.0f},
+         {-0.00171f, 0.00725f, -0.02276f, 0.01948f, -0.09356f, 0.26196f,
+          0.14442f, -0.75285f, 1.73415f, -0.38318f, 0.08917f, 0.0f, 0.0f, 0.0f},
+         {-0.00237f, 0.01032f, -0.03828f, 0.01801f, -0.23583f, 0.89826f,
+          0.03264f, -1.26799f, 1.54998f, 0.09160f, -0.05852f, 0.0f, 0.0f, 0.0f},
+         {-0.00166f, 0.00736f, -0.02921f, 0.00966f, -0.20161f, 0.81201f,
+          -0.03203f, -0.97463f, 0.87608f, 0.76356f, -0.23677f, 0.0f, 0.0f, 0.0f},
+         {-0.00037f, 0.00169f, -0.00773f, 0.00050f, -0.06428f, 0.27870f,
+          -0.03729f, -0.26077f, 0.05808f, 1.36078f, -0.33860f, 0.0f, 0.0f, 0.0f},
+         {0.00073f, -0.00317f, 0.01159f, -0.00581f, 0.06950f, -0.26096f,
+          -0.01541f, 0.38648f, -0.55237f, 1.63549f, -0.27187f, 0.0f, 0.0f, 0.0f},
+         {0.00120f, -0.00529f, 0.02039f, -0.00797f, 0.13423f, -0.52901f,
+          0.00450f, 0.68281f, -0.77739f, 1.49062f, -0.01106f, 0.0f, 0.0f, 0.0f},
+         {0.00106f, -0.00466f, 0.01822f, -0.00655f, 0.12299f, -0.49047f,
+          0.01205f, 0.61089f, -0.64633f, 1.00628f, 0.39029f, 0.0f, 0.0f, 0.0f},
+         {0.00054f, -0.00238f, 0.00944f, -0.00315f, 0.06500f, -0.26162f,
+          0.00965f, 0.31676f, -0.31372f, 0.36973f, 0.83077f, 0.0f, 0.0f, 0.0f}}},
+    // trained on smooth broadband surfaces (paints, plastics, skin)
+    {"smooth",
+     {
+         0.00529f, 0.00238f, 0.00041f, -0.00053f, -0.00065f, -0.00029f,
+         0.00021f, 0.00053f, 0.00061f, 0.00052f, 0.00028f, 0.0f, -0.00018f,
+         -0.00019f, 0.00003f, 0.00030f, 0.00052f, 0.00044f, 0.00004f,
+         -0.00064f, -0.00124f, -0.00132f, -0.00067f, 0.00055f, 0.00194f,
+         0.00283f, 0.00247f, 0.00069f, -0.00214f, -0.00518f, -0.00707f},
+     {
+         {2.70724f, -1.34604f, -0.90922f, 0.52157f, -0.02726f, 0.01346f,
+          -0.02724f, 0.02612f, -0.02107f, 0.00776f, -0.00431f, 0.0f, 0.0f, 0.0f},
+         {1.97851f, -0.53770f, -0.69530f, 0.21456f, 0.06367f, 0.02177f,
+          -0.08444f, 0.04757f, -0.03111f, 0.01016f, -0.00411f, 0.0f, 0.0f, 0.0f},
+         {1.16969f, 0.18746f, -0.33995f, -0.06574f, 0.10293f, 0.01934f,
+          -0.09288f, 0.04492f, -0.02664f, 0.00799f, -0.00263f, 0.0f, 0.0f, 0.0f},
+         {0.46078f, 0.63640f, 0.07983f, -0.20645f, 0.06479f, 0.00582f,
+          -0.04137f, 0.01578f, -0.00763f, 0.00176f, -0.00038f, 0.0f, 0.0f, 0.0f},
+         {-0.00981f, 0.71349f, 0.44887f, -0.13155f, -0.03711f, -0.01159f,
+          0.04607f, -0.02570f, 0.01636f, -0.00521f, 0.00162f, 0.0f, 0.0f, 0.0f},
+         {-0.19307f, 0.46589f, 0.64294f, 0.16685f, -0.14887f, -0.02082f,
+          0.11667f, -0.05370f, 0.02985f, -0.00819f, 0.00221f, 0.0f, 0.0f, 0.0f},
+         {-0.14235f, 0.06263f, 0.59005f, 0.60214f, -0.18753f, -0.00988f,
+          0.10721f, -0.04167f, 0.01846f, -0.00345f, 0.00064f, 0.0f, 0.0f, 0.0f},
+         {0.01889f, -0.29834f, 0.34171f, 0.99826f, -0.07271f, 0.02574f,
+          -0.02383f, 0.02163f, -0.02139f, 0.00889f, -0.00274f, 0.0f, 0.0f, 0.0f},
+         {0.16801f, -0.48329f, 0.02732f, 1.18871f, 0.21494f, 0.07595f,
+          -0.24999f, 0.11330f, -0.07340f, 0.02287f, -0.00620f, 0.0f, 0.0f, 0.0f},
+         {0.22737f, -0.45989f, -0.21012f, 1.08812f, 0.61531f, 0.11954f,
+          -0.47678f, 0.18185f, -0.10676f, 0.02902f, -0.00727f, 0.0f, 0.0f, 0.0f},
+         {0.18745f, -0.28975f, -0.29175f, 0.74270f, 0.99787f, 0.13416f,
+          -0.57181f, 0.16800f, -0.09040f, 0.01954f, -0.00417f, 0.0f, 0.0f, 0.0f},
+         {0.08620f, -0.07734f, -0.21895f, 0.29024f, 1.22126f, 0.11422f,
+          -0.44008f, 0.04659f, -0.01810f, -0.00423f, 0.00225f, 0.0f, 0.0f, 0.0f},
+         {-0.01606f, 0.08094f, -0.06690f, -0.09747f, 1.18887f, 0.07799f,
+          -0.07525f, -0.15056f, 0.08150f, -0.03010f, 0.00833f, 0.0f, 0.0f, 0.0f},
+         {-0.07549f, 0.13974f, 0.07168f, -0.30087f, 0.89811f, 0.06201f,
+          0.41687f, -0.33319f, 0.15150f, -0.03970f, 0.00929f, 0.0f, 0.0f, 0.0f},
+         {-0.07692f, 0.10691f, 0.13043f, -0.29320f, 0.44262f, 0.10483f,
+          0.85280f, -0.38489f, 0.13241f, -0.01841f, 0.00189f, 0.0f, 0.0f, 0.0f},
+         {-0.03684f, 0.02868f, 0.09881f, -0.14072f, -0.02620f, 0.22173f,
+          1.05075f, -0.21806f, -0.00025f, 0.03151f, -0.01188f, 0.0f, 0.0f, 0.0f},
+         {0.01409f, -0.04494f, 0.01601f, 0.04533f, -0.36691f, 0.38873f,
+          0.92175f, 0.17012f, -0.20864f, 0.08619f, -0.02443f, 0.0f, 0.0f, 0.0f},
+         {0.04890f, -0.08063f, -0.06571f, 0.17040f, -0.50116f, 0.54735f,
+          0.51288f, 0.68085f, -0.39708f, 0.10828f, -0.02562f, 0.0f, 0.0f, 0.0f},
+         {0.05541f, -0.07267f, -0.10656f, 0.19300f, -0.43700f, 0.62676f,
+          -0.01164f, 1.14404f, -0.44587f, 0.06306f, -0.00764f, 0.0f, 0.0f, 0.0f},
+         {0.03724f, -0.03565f, -0.09582f, 0.12726f, -0.24824f, 0.58616f,
+          -0.45574f, 1.39250f, -0.27721f, -0.05329f, 0.02714f, 0.0f, 0.0f, 0.0f},
+         {0.00874f, 0.00596f, -0.04941f, 0.02491f, -0.03766f, 0.42763f,
+          -0.66600f, 1.32466f, 0.10875f, -0.20583f, 0.06544f, 0.0f, 0.0f, 0.0f},
+         {-0.01416f, 0.03165f, 0.00236f, -0.05625f, 0.10794f, 0.19821f,
+          -0.59298f, 0.95084f, 0.61880f, -0.32588f, 0.08688f, 0.0f, 0.0f, 0.0f},
+         {-0.02296f, 0.03408f, 0.03607f, -0.08547f, 0.15273f, -0.02901f,
+          -0.31066f, 0.39946f, 1.09082f, -0.33244f, 0.07126f, 0.0f, 0.0f, 0.0f},
+         {-0.01776f, 0.01825f, 0.04255f, -0.06331f, 0.11008f, -0.18866f,
+          0.03845f, -0.14389f, 1.36005f, -0.16958f, 0.01120f, 0.0f, 0.0f, 0.0f},
+         {-0.00563f, -0.00304f, 0.02798f, -0.01560f, 0.02737f, -0.24355f,
+          0.30202f, -0.50352f, 1.31679f, 0.16858f, -0.08175f, 0.0f, 0.0f, 0.0f},
+         {0.00542f, -0.01783f, 0.00522f, 0.02789f, -0.04562f, -0.19805f,
+          0.38866f, -0.58700f, 0.95874f, 0.62146f, -0.17465f, 0.0f, 0.0f, 0.0f},
+         {0.01013f, -0.01970f, -0.01308f, 0.04620f, -0.07567f, -0.08595f,
+          0.28597f, -0.40495f, 0.38665f, 1.07805f, -0.22227f, 0.0f, 0.0f, 0.0f},
+         {0.00785f, -0.00995f, -0.01978f, 0.03510f, -0.05744f, 0.04227f,
+          0.06055f, -0.06414f, -0.22597f, 1.40534f, -0.17932f, 0.0f, 0.0f, 0.0f},
+         {0.00196f, 0.00447f, -0.01503f, 0.00545f, -0.00907f, 0.14011f,
+          -0.18186f, 0.28528f, -0.69792f, 1.49444f, -0.01738f, 0.0f, 0.0f, 0.0f},
+         {-0.00295f, 0.01534f, -0.00400f, -0.02520f, 0.04128f, 0.17815f,
+          -0.34091f, 0.50551f, -0.89594f, 1.29289f, 0.26480f, 0.0f, 0.0f, 0.0f},
+         {-0.00412f, 0.01754f, 0.00691f, -0.04181f, 0.06888f, 0.14887f,
+          -0.35585f, 0.51651f, -0.77172f, 0.81801f, 0.63936f, 0.0f, 0.0f, 0.0f}}},
+    // trained on steep single-edge spectra (inks, dyed textiles)
+    {"inks",
+     {
+         0.02849f, 0.01689f, 0.00344f, -0.00473f, -0.00364f, 0.00099f,
+         0.00296f, 0.00090f, -0.00226f, -0.00403f, -0.00336f, -0.00109f,
+         0.00096f, 0.00182f, 0.00138f, -0.00023f, -0.00118f, -0.00041f,
+         0.00034f, 0.00026f, -0.00036f, -0.00076f, -0.00032f, 0.00025f,
+         0.00076f, 0.00147f, 0.00076f, -0.00163f, -0.00323f, -0.00213f,
+         0.00029f},
+     {
+         {2.59370f, -1.60864f, -0.11748f, 0.11284f, -0.02770f, -0.01175f,
+          0.02426f, -0.00547f, 0.00357f, 0.01067f, -0.04703f, 0.0f, 0.0f, 0.0f},
+         {2.22675f, -1.13995f, -0.23558f, 0.14150f, -0.02366f, -0.01040f,
+          0.02127f, -0.00511f, 0.00407f, 0.00516f, -0.02743f, 0.0f, 0.0f, 0.0f},
+         {1.49482f, -0.23823f, -0.41804f, 0.16352f, -0.01086f, -0.00575f,
+          0.01066f, -0.00234f, 0.00247f, 0.00005f, -0.00520f, 0.0f, 0.0f, 0.0f},
+         {0.48717f, 0.81186f, -0.38143f, 0.08021f, 0.01330f, 0.00411f,
+          -0.01082f, 0.00382f, -0.00293f, -0.00040f, 0.00722f, 0.0f, 0.0f, 0.0f},
+         {-0.17052f, 0.99859f, 0.33164f, -0.16776f, 0.02101f, 0.00938f,
+          -0.01943f, 0.00533f, -0.00517f, 0.00147f, 0.00483f, 0.0f, 0.0f, 0.0f},
+         {-0.18395f, 0.20810f, 1.23145f, -0.22974f, -0.04297f, -0.01208f,
+          0.03360f, -0.01281f, 0.01073f, -0.00589f, 0.00104f, 0.0f, 0.0f, 0.0f},
+         {0.05747f, -0.48554f, 1.21252f, 0.31502f, -0.16403f, -0.05104f,
+          0.13043f, -0.04490f, 0.03944f, -0.02199f, 0.00482f, 0.0f, 0.0f, 0.0f},
+         {0.15301f, -0.41254f, 0.12816f, 1.26148f, -0.20306f, -0.04800f,
+          0.14322f, -0.05205f, 0.04294f, -0.02464f, 0.00908f, 0.0f, 0.0f, 0.0f},
+         {0.08542f, 0.07820f, -1.08000f, 1.93624f, -0.01267f, 0.04170f,
+          -0.04087f, 0.00229f, -0.01182f, 0.00707f, 0.00041f, 0.0f, 0.0f, 0.0f},
+         {-0.00587f, 0.41859f, -1.54657f, 1.87660f, 0.42374f, 0.19063f,
+          -0.38687f, 0.10783f, -0.11128f, 0.06563f, -0.02187f, 0.0f, 0.0f, 0.0f},
+         {-0.03999f, 0.39225f, -1.13479f, 1.15107f, 0.95306f, 0.31262f,
+          -0.69726f, 0.19179f, -0.18911f, 0.11158f, -0.04238f, 0.0f, 0.0f, 0.0f},
+         {-0.02255f, 0.13334f, -0.29930f, 0.21262f, 1.32751f, 0.31803f,
+          -0.71652f, 0.15647f, -0.16400f, 0.09683f, -0.03933f, 0.0f, 0.0f, 0.0f},
+         {0.00700f, -0.11427f, 0.37806f, -0.44812f, 1.34762f, 0.16538f,
+          -0.29766f, -0.03487f, -0.00717f, 0.00508f, -0.00339f, 0.0f, 0.0f,
+          0.0f},
+         {0.01889f, -0.19496f, 0.56674f, -0.58899f, 0.98513f, -0.08303f,
+          0.45048f, -0.29394f, 0.20444f, -0.11624f, 0.04640f, 0.0f, 0.0f, 0.0f},
+         {0.01178f, -0.11892f, 0.33371f, -0.32498f, 0.40572f, -0.22253f,
+          1.15136f, -0.45146f, 0.31321f, -0.17188f, 0.06998f, 0.0f, 0.0f, 0.0f},
+         {0.00049f, 0.00763f, -0.03119f, 0.04180f, -0.15225f, -0.02628f,
+          1.39126f, -0.36898f, 0.18993f, -0.08785f, 0.03596f, 0.0f, 0.0f, 0.0f},
+         {-0.00782f, 0.09144f, -0.26926f, 0.26102f, -0.50047f, 0.50246f,
+          1.01335f, 0.00540f, -0.16200f, 0.11986f, -0.05063f, 0.0f, 0.0f, 0.0f},
+         {-0.01147f, 0.09653f, -0.27876f, 0.24960f, -0.55275f, 1.02798f,
+          0.23265f, 0.62424f, -0.57750f, 0.32856f, -0.13756f, 0.0f, 0.0f, 0.0f},
+         {-0.00675f, 0.04157f, -0.12235f, 0.08672f, -0.35342f, 1.14218f,
+          -0.52030f, 1.31305f, -0.80288f, 0.37305f, -0.15150f, 0.0f, 0.0f, 0.0f},
+         {0.00243f, -0.02350f, 0.05874f, -0.08300f, -0.05680f, 0.74594f,
+          -0.88599f, 1.76424f, -0.62440f, 0.15335f, -0.05175f, 0.0f, 0.0f, 0.0f},
+         {0.00910f, -0.05713f, 0.15208f, -0.15698f, 0.16271f, 0.12697f,
+          -0.77818f, 1.69548f, -0.00851f, -0.27619f, 0.13127f, 0.0f, 0.0f, 0.0f},
+         {0.00915f, -0.04901f, 0.13175f, -0.12248f, 0.21301f, -0.31505f,
+          -0.37509f, 1.07560f, 0.83358f, -0.69593f, 0.29597f, 0.0f, 0.0f, 0.0f},
+         {0.00285f, -0.01541f, 0.04433f, -0.03263f, 0.11864f, -0.38036f,
+          0.04374f, 0.20046f, 1.50942f, -0.80145f, 0.31091f, 0.0f, 0.0f, 0.0f},
+         {-0.00303f, 0.01627f, -0.04103f, 0.04641f, -0.02059f, -0.16669f,
+          0.28024f, -0.49984f, 1.67876f, -0.39663f, 0.10565f, 0.0f, 0.0f, 0.0f},
+         {-0.00633f, 0.02917f, -0.07539f, 0.07344f, -0.10265f, 0.07173f,
+          0.28675f, -0.71863f, 1.25694f, 0.43797f, -0.25452f, 0.0f, 0.0f, 0.0f},
+         {-0.00837f, 0.02311f, -0.05352f, 0.04864f, -0.09102f, 0.15777f,
+          0.14168f, -0.46684f, 0.48615f, 1.32440f, -0.56556f, 0.0f, 0.0f, 0.0f},
+         {-0.00337f, 0.00478f, -0.00816f, 0.00514f, -0.02590f, 0.09458f,
+          -0.01852f, -0.04519f, -0.19857f, 1.77833f, -0.58501f, 0.0f, 0.0f,
+          0.0f},
+         {0.00758f, -0.01272f, 0.02223f, -0.02203f, 0.02675f, -0.00217f,
+          -0.09466f, 0.21815f, -0.47660f, 1.55850f, -0.22098f, 0.0f, 0.0f, 0.0f},
+         {0.01410f, -0.01787f, 0.02425f, -0.02254f, 0.03587f, -0.04281f,
+          -0.07993f, 0.22299f, -0.37011f, 0.90436f, 0.33982f, 0.0f, 0.0f, 0.0f},
+         {0.00927f, -0.01106f, 0.01392f, -0.01252f, 0.02254f, -0.03625f,
+          -0.03925f, 0.12406f, -0.17161f, 0.32090f, 0.78541f, 0.0f, 0.0f, 0.0f},
+         {-0.00092f, -0.00084f, 0.00471f, -0.00417f, 0.00904f, -0.01947f,
+          -0.00980f, 0.04079f, -0.03483f, -0.02612f, 1.04087f, 0.0f, 0.0f, 0.0f}}},
+};
+
+constexpr int SET_COUNT = sizeof(kSets) / sizeof(kSets[0]);
+
+// Set index by name, -1 if unknown
+inline int find(const char *name) {
+  for (int i = 0; name && i < SET_COUNT; i++)
+    if (strcmp(kSets[i].name, name) == 0)
+      return i;
+  return -1;
+}
+
+inline const char *name(int set) {
+  return set >= 0 && set < SET_COUNT ? kSets[set].name : kSets[0].name;
+}
+
+// ── Fixed point ─────────────────────────────────────────────
+constexpr int32_t toQ16(float v) {
+  return static_cast<int32_t>(v * 65536.0f + (v < 0 ? -0.5f : 0.5f));
+}
+
+struct MatrixSetQ16 {
+  int32_t offset[BANDS];
+  int32_t w[BANDS][N];
+};
+
+constexpr MatrixSetQ16 makeQ16(const MatrixSet &src) {
+  MatrixSetQ16 q = {};
+  for (int b = 0; b < BANDS; b++) {
+    q.offset[b] = toQ16(src.offset[b]);
+    for (int ch = 0; ch < N; ch++)
+      q.w[b][ch] = toQ16(src.w[b][ch]);
+  }
+  return q;
+}
+
+constexpr MatrixSetQ16 kSetsQ16[SET_COUNT] = {
+    makeQ16(kSets[0]),
+    makeQ16(kSets[1]),
+    makeQ16(kSets[2]),
+};
+
+inline uint16_t toScale(int64_t reflQ16) {
+  if (reflQ16 <= 0)
+    return 0;
+  int64_t v = (reflQ16 * REFL_SCALE + (1 << 15)) >> 16;
+  return v > UINT16_MAX ? UINT16_MAX : static_cast<uint16_t>(v);
+}
+
+// calQ16: Q16 reflectance per channel (ColorEngine::Fixed::calibrate)
+inline void reconstruct(const MatrixSetQ16 &m, const int32_t *calQ16,
+                        uint16_t *out) {
+  for (int b = 0; b < BANDS; b++) {
+    int64_t acc = static_cast<int64_t>(m.offset[b]) << 16;
+    for (int ch = 0; ch < N; ch++)
+      acc += static_cast<int64_t>(m.w[b][ch]) * calQ16[ch];
+    out[b] = toScale((acc + (1 << 15)) >> 16);
+  }
+}
+
+// ── Float (reference) ───────────────────────────────────────
+inline void reconstruct(const MatrixSet &m, const float *cal,
+                        uint16_t *out) {
+  for (int b = 0; b < BANDS; b++) {
+    float acc = m.offset[b];
+    for (int ch = 0; ch < N; ch++)
+      acc += m.w[b][ch] * cal[ch];
+    out[b] = acc <= 0                   ? 0
+             : acc * REFL_SCALE >= 65535 ? UINT16_MAX
+                                         : static_cast<uint16_t>(
+                                               acc * REFL_SCALE + 0.5f);
+  }
+}
+
+} // namespace SpectralRecon
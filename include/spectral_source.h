@@ -0,0 +1,56 @@
+#pragma once
+// ============================================================
+// spectral_source.h – Where raw spectral frames come from
+//
+// Everything above this interface (auto-exposure, sequential
+// sampling, calibration, color conversion – spectral_pipeline.h)
+// is hardware independent. Implementations:
+//   - As7343Source (as7343_source.h): the sensor on I²C, woken by
+//     the INT pin
+//   - ReplaySource (replay_source.h): recorded raw-channel traces,
+//     e.g. the raw columns of /colors.csv, for host builds
+//
+// Frame model: while measuring is enabled the source completes one
+// frame (an 18-channel cycle, or one 6-channel phase in the preview
+// profile) after another. waitFrame() blocks until one is
+// available; readFrame() fetches it and re-arms.
+// ============================================================
+
+#include "spectral_types.h"
+#include <cstdint>
+
+class SpectralSource {
+public:
+  virtual ~SpectralSource() {}
+
+  virtual bool begin() = 0;
+  virtual const char *name() const = 0;
+
+  // Gain + integration; call with measuring off or between frames.
+  // force rewrites every setting (after power-up).
+  virtual void setExposure(const Exposure &e, bool force) = 0;
+
+  // Channel set per frame (SmuxProfile); call with measuring off
+  virtual void setProfile(SmuxProfile p) = 0;
+
+  // One frame of the current profile at exposure e (timeouts are
+  // derived from this)
+  virtual uint32_t cycleTimeUs(const Exposure &e) const = 0;
+
+  virtual void setLed(bool on) = 0;
+
+  // Starts / stops free-running frames. Starting discards anything
+  // pending, so the first frame waited for begins after the call.
+  virtual bool setMeasuring(bool on) = 0;
+
+  // Blocks until a frame is complete or timeoutMs elapses
+  virtual bool waitFrame(uint32_t timeoutMs) = 0;
+
+  // Reads the completed frame (NUM_CHANNELS counts, channels outside
+  // the profile 0) and re-arms
+  virtual bool readFrame(uint16_t *raw) = 0;
+
+  virtual void sleepMs(uint32_t ms) = 0;
+  virtual uint32_t nowMs() = 0;
+  virtual uint32_t nowUs() = 0; // frame timing (flicker detection)
+};
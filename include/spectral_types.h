@@ -0,0 +1,185 @@
+#pragma once
+// ============================================================
+// spectral_types.h – Measurement and calibration records
+//
+// Plain data shared by the sensor, color engine, storage and
+// connectivity layers. No hardware dependencies.
+// ============================================================
+
+#include "config.h"
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+// ── Exposure ────────────────────────────────────────────────
+// Gain + integration time a frame was taken with. Counts scale
+// linearly with sensitivity(), so frames taken at different
+// exposures can be brought to a common scale.
+struct Exposure {
+  uint8_t gainIndex; // AGAIN code: 0 = 0.5x … 12 = 2048x
+  uint8_t atime;
+  uint16_t astep;
+
+  // One SMUX phase, 2.78 µs per step
+  uint32_t integrationUs() const {
+    return (uint32_t)(atime + 1) * (astep + 1) * 278 / 100;
+  }
+
+  // Digital saturation level of the 16-bit ADC
+  uint16_t fullScale() const {
+    uint32_t fs = (uint32_t)(atime + 1) * (astep + 1);
+    return fs > 65535 ? 65535 : (uint16_t)fs;
+  }
+
+  // Relative counts per unit of light: 2 × gain × integration steps
+  uint64_t sensitivity() const {
+    return ((uint64_t)(atime + 1) * (astep + 1)) << gainIndex;
+  }
+
+  bool operator==(const Exposure &o) const {
+    return gainIndex == o.gainIndex && atime == o.atime && astep == o.astep;
+  }
+  bool operator!=(const Exposure &o) const { return !(*this == o); }
+};
+
+constexpr Exposure kDefaultExposure = {Config::Sensor::DEFAULT_GAIN,
+                                       Config::Sensor::DEFAULT_ATIME,
+                                       Config::Sensor::DEFAULT_ASTEP};
+
+// ── Acquisition Profile ─────────────────────────────────────
+// FULL:    18-channel auto-SMUX, all 14 channels, 3 SMUX phases
+//          per frame – measurements and calibration.
+// PREVIEW: 6-channel auto-SMUX, one phase per frame (3× the frame
+//          rate) – live view. Only FZ, FY, FXL, NIR, Clear and FD
+//          are read; the other channels are 0.
+enum class SmuxProfile : uint8_t { FULL, PREVIEW };
+
+constexpr int PREVIEW_CHANNELS = 6;
+constexpr uint8_t kPreviewChannels[PREVIEW_CHANNELS] = {
+    2, 5, 7, 11, 12, 13}; // raw[] index: FZ FY FXL NIR Clear FD
+constexpr int CLEAR_CHANNEL = 12; // raw[] index of Clear/VIS
+
+// ── Channel Data ────────────────────────────────────────────
+// AS7343 provides 14 spectral channels via two SMUX configurations
+// Channels: FZ, FY, FXL, NIR, 2xVIS, FD, F1..F8
+// We store all raw + calibrated values
+
+struct SpectralData {
+  // Raw ADC counts from sensor
+  uint16_t raw[Config::Sensor::NUM_CHANNELS];
+
+  // Calibrated (dark-subtracted, gain-normalized) values
+  float calibrated[Config::Sensor::NUM_CHANNELS];
+
+  // Derived color values
+  float cie_X, cie_Y, cie_Z; // CIE 1931 XYZ
+  uint8_t r, g, b;           // output space (OutputSpace), 0-255
+  bool inGamut;              // r, g, b needed no clamping / mapping
+  float L, a_star, b_star;   // CIE Lab (D65)
+  float C_star, h_ab;        // CIE LCh(ab), hue in degrees
+
+  // Reflectance at SPECTRUM_START_NM + i·SPECTRUM_STEP_NM, in
+  // SpectralRecon::REFL_SCALE units (gray-calibrated full frames)
+  uint16_t reflectance[Config::Sensor::SPECTRUM_BANDS];
+  bool hasSpectrum;
+
+  // Sampling (sequential averaging; 1 sample = single frame)
+  float stdError[Config::Sensor::NUM_CHANNELS]; // SE of raw mean, counts
+  uint16_t samples;
+
+  // Metadata
+  Exposure exposure;   // gain + integration this frame was taken with
+  SmuxProfile profile; // channel set the frame was read with
+  bool saturated;      // peak channel hit full scale
+  uint32_t timestamp;
+  bool valid;
+
+  // Convenience
+  uint32_t toRGB888() const {
+    return ((uint32_t)r << 16) | ((uint32_t)g << 8) | b;
+  }
+
+  uint16_t toRGB565() const {
+    return ((r & 0xF8) << 8) | ((g & 0xFC) << 3) | (b >> 3);
+  }
+
+  void toHexString(char *buf, size_t len) const {
+    snprintf(buf, len, "#%02X%02X%02X", r, g, b);
+  }
+};
+
+// ── Channel Statistics ──────────────────────────────────────
+// Running per-channel mean / variance of raw counts over a burst
+// of frames (Welford's update, numerically stable in float), with
+// the stopping rule for sequential sampling.
+struct ChannelStats {
+  float mean[Config::Sensor::NUM_CHANNELS];
+  float m2[Config::Sensor::NUM_CHANNELS]; // sum of squared deviations
+  uint16_t count;
+  Exposure exposure;
+  bool saturated; // any frame reached full scale
+
+  void reset() { memset(this, 0, sizeof(*this)); }
+
+  void add(const uint16_t *raw) {
+    count++;
+    float inv = 1.0f / count;
+    for (int ch = 0; ch < Config::Sensor::NUM_CHANNELS; ch++) {
+      float x = raw[ch];
+      float d = x - mean[ch];
+      mean[ch] += d * inv;
+      m2[ch] += d * (x - mean[ch]);
+    }
+  }
+
+  // Sample variance (counts²); 0 until two frames are in
+  float variance(int ch) const {
+    return count > 1 ? m2[ch] / (count - 1) : 0.0f;
+  }
+
+  // Standard error of the mean (counts)
+  float stdError(int ch) const {
+    return count > 1 ? sqrtf(variance(ch) / count) : 0.0f;
+  }
+
+  // True once every spectral channel (FD excluded) has
+  // SE <= max(seCounts, seRel × mean). Needs two frames.
+  bool converged(float seCounts, float seRel) const {
+    if (count < 2)
+      return false;
+    for (int ch = 0; ch < Config::Sensor::NUM_CHANNELS - 1; ch++) {
+      float limit = seRel * mean[ch];
+      if (limit < seCounts)
+        limit = seCounts;
+      if (variance(ch) > limit * limit * count)
+        return false;
+    }
+    return true;
+  }
+};
+
+// Stopping rule for sequential sampling
+struct SamplingTarget {
+  uint16_t minSamples;
+  uint16_t maxSamples;
+  float seCounts; // absolute standard-error floor
+  float seRel;    // relative to the channel mean
+};
+
+// ── Calibration Data ────────────────────────────────────────
+struct CalibrationData {
+  float darkRef[Config::Sensor::NUM_CHANNELS];  // Dark reference (sensor noise
+                                                // floor)
+  float grayRef[Config::Sensor::NUM_CHANNELS];  // 18% gray card reference
+  float whiteRef[Config::Sensor::NUM_CHANNELS]; // (Optional) white reference
+  bool hasDark;
+  bool hasGray;
+  bool hasWhite;
+  uint32_t calibTimestamp;
+  Exposure exposure; // all references share this exposure
+  uint8_t reconSet;  // SpectralRecon matrix set (table-wide, resolve())
+
+  // Gray card reflectance factor (18% = 0.18)
+  static constexpr float GRAY_REFLECTANCE = 0.18f;
+};
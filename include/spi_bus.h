@@ -0,0 +1,164 @@
+#pragma once
+// ============================================================
+// spi_bus.h – Scheduler for the SPI bus shared by LCD and microSD
+//
+// The ST7789 and the microSD card share SPI2 (SCLK/MOSI). Every
+// transaction on either holds a lease on the bus for its device, so
+// a frame flush and SD I/O never interleave. Each driver programs
+// its own clock when its transaction begins – LovyanGFX at
+// Config::LCD::SPI_FREQ, the SD library at the rate the card was
+// mounted with – so neither runs at the other's speed.
+//
+// Scheduling:
+//   - Frames first: while a flush waits for the bus no new SD lease
+//     is granted, so a flush waits at most for the SD transaction in
+//     progress.
+//   - Long SD work (scans, exports, compaction) calls yield()
+//     between chunks; once it has held the bus for BUS_SLICE_US and
+//     a flush is waiting, it hands the bus to that frame only and
+//     resumes right after it, ahead of any other SD lease, so no
+//     other card access lands in the middle of its work.
+//
+// Per-device occupancy (transactions, time holding and waiting for
+// the bus, longest of each) is published in a SeqLock for
+// /api/status. The lease mutex has priority inheritance, so the
+// low-priority storage task finishes its slice quickly when the UI
+// waits on it.
+// ============================================================
+
+#include "config.h"
+#include "seqlock.h"
+#include <Arduino.h>
+#include <atomic>
+#include <cstdint>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+class SpiBus {
+public:
+  enum class Device : uint8_t { LCD, SD, COUNT };
+  static constexpr int DEVICES = static_cast<int>(Device::COUNT);
+
+  struct DeviceStats {
+    uint32_t clockHz;      // as programmed by the device's driver
+    uint32_t transactions; // leases granted
+    uint32_t yields;       // slices handed to a waiting frame
+    uint32_t maxHoldUs;
+    uint32_t maxWaitUs;
+    uint64_t busyUs; // holding the bus
+    uint64_t waitUs; // waiting for it
+  };
+
+  struct Stats {
+    uint32_t sinceMs; // millis() when counting started
+    DeviceStats device[DEVICES];
+  };
+
+  static SpiBus &instance() {
+    static SpiBus inst;
+    return inst;
+  }
+
+  // Holds the bus for one device for its scope
+  class Lease {
+  public:
+    explicit Lease(Device d) : d_(d) { SpiBus::instance().acquire(d_); }
+    ~Lease() { SpiBus::instance().release(d_); }
+    Lease(const Lease &) = delete;
+    Lease &operator=(const Lease &) = delete;
+
+  private:
+    Device d_;
+  };
+
+  void acquire(Device d) { take(d, false); }
+
+  void release(Device d) {
+    DeviceStats &s = stats_.device[index(d)];
+    const uint32_t held = micros() - heldSinceUs_;
+    s.busyUs += held;
+    if (held > s.maxHoldUs)
+      s.maxHoldUs = held;
+    published_.write(stats_);
+    xSemaphoreGive(mutex_);
+  }
+
+  // Between chunks of long SD work, with the bus held for it
+  void yield(Device d) {
+    if (d != Device::SD || lcdWaiting_.load() == 0 ||
+        micros() - heldSinceUs_ < Config::SD::BUS_SLICE_US)
+      return;
+    stats_.device[index(d)].yields++;
+    sdResuming_.store(true);
+    release(d);
+    take(d, true);
+  }
+
+  // The clock a device's driver was set up with (for stats)
+  void setClock(Device d, uint32_t hz) {
+    Lease lease(d);
+    stats_.device[index(d)].clockHz = hz;
+  }
+
+  Stats stats() const {
+    Stats s;
+    published_.read(s);
+    return s;
+  }
+
+  // Share of the time since counting started that `d` held the
+  // bus, percent
+  static float occupancy(const Stats &s, Device d) {
+    const uint64_t elapsedUs =
+        static_cast<uint64_t>(millis() - s.sinceMs) * 1000;
+    return elapsedUs ? 100.0f * s.device[index(d)].busyUs / elapsedUs : 0.0f;
+  }
+
+  static const char *name(Device d) { return d == Device::LCD ? "lcd" : "sd"; }
+
+private:
+  SpiBus() {
+    stats_.sinceMs = millis();
+    published_.write(stats_);
+  }
+
+  static int index(Device d) { return static_cast<int>(d); }
+
+  // resume: the SD holder coming back from yield(), which other SD
+  // leases wait for
+  void take(Device d, bool resume) {
+    const uint32_t start = micros();
+    if (d == Device::LCD) {
+      lcdWaiting_.fetch_add(1);
+      xSemaphoreTake(mutex_, portMAX_DELAY);
+      lcdWaiting_.fetch_sub(1);
+    } else {
+      for (;;) {
+        // A waiting frame goes first, then a yielded slice
+        while (lcdWaiting_.load() > 0 || (!resume && sdResuming_.load()))
+          vTaskDelay(1);
+        xSemaphoreTake(mutex_, portMAX_DELAY);
+        if (resume || !sdResuming_.load())
+          break;
+        xSemaphoreGive(mutex_); // got in before the yielded slice
+      }
+      if (resume)
+        sdResuming_.store(false);
+    }
+
+    heldSinceUs_ = micros();
+    DeviceStats &s = stats_.device[index(d)];
+    const uint32_t waited = heldSinceUs_ - start;
+    s.transactions++;
+    s.waitUs += waited;
+    if (waited > s.maxWaitUs)
+      s.maxWaitUs = waited;
+  }
+
+  SemaphoreHandle_t mutex_ = xSemaphoreCreateMutex();
+  std::atomic<int> lcdWaiting_{0};
+  std::atomic<bool> sdResuming_{false}; // SD slice handed to a frame
+  uint32_t heldSinceUs_ = 0;
+  Stats stats_ = {};         // updated by the lease holder
+  SeqLock<Stats> published_; // copy for readers
+};
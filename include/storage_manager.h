@@ -3,37 +3,76 @@
 // storage_manager.h – microSD storage abstraction
 //
 // Data format decisions:
-//   Colors → CSV: Append-only, low memory, spreadsheet-compatible
+//   Colors → binary record log (color_log.h): fixed-size records,
+//            O(1) access by index, no parsing on load; CSV is
+//            streamed from it on demand (ColorsCsv)
 //   Calibration → JSON: Structured, infrequently written, ArduinoJson
+//                 (one entry per calibrated exposure)
+//   Measurements → CSV: a few fields, fixed-width rows so row i is
+//                  one seek away
 //
-// CSV format:
-//   timestamp,r,g,b,hex,F1,F2,FZ,F3,F4,FY,F5,FXL,F6,F7,F8,NIR
+// Deletes never rewrite a file: a color record is tombstoned in
+// place, a measurement row has its `deleted` field flipped. Dead
+// records keep their positions until compact() rewrites the file
+// without them (temp file, then rename), called when idle.
+//
+// A colors.csv from before the log is imported into it once, when
+// the log is created, and kept as COLORS_LEGACY; nothing else
+// writes either file.
+//
+// Write-behind: saves, deletes, compaction and calibration writes
+// are queued to the storage task (run()), the only writer after
+// init(). Queued appends are coalesced – up to BATCH_RECORDS per
+// file, committed at most WRITE_BEHIND_MS after the first – into
+// one seek + write per file; each saved color is announced with
+// COLOR_SAVED (data = record position), a failed batch with
+// SAVE_ERROR. Callers never wait on the card; readers take it
+// between the task's transactions.
+//
+// The card shares SPI2 with the LCD: every card access holds a
+// SpiBus lease (spi_bus.h), which keeps it off frame flushes, so it
+// can run at Config::SD::SPI_FREQ rather than a clock slow enough
+// to survive collisions.
 // ============================================================
 
+#include "color_index.h"
+#include "color_log.h"
 #include "config.h"
+#include "csv_export.h"
+#include "record_cursor.h"
+#include "events.h"
 #include "sensor_manager.h"
+#include "spi_bus.h"
 #include <Arduino.h>
 #include <ArduinoJson.h>
 #include <SD.h>
 #include <SPI.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
 #include <vector>
 
-// ── Saved Color Entry ───────────────────────────────────────
-struct SavedColor {
-  uint32_t timestamp; // epoch or millis
-  uint8_t r, g, b;
-  char hex[8]; // "#RRGGBB\0"
-  uint16_t raw[Config::Sensor::NUM_CHANNELS];
-  float calibrated[Config::Sensor::NUM_CHANNELS];
-  int index; // position in file (for deletion)
-};
+#ifdef ARDUINO
+#include <esp_system.h>
+#endif
 
 // ── Saved Measurement Entry ─────────────────────────────────
 struct SavedMeasurement {
   float value_mm;
   uint16_t value_px;
   uint32_t timestamp;
-  int index; // position in file (for deletion)
+  int index; // row in the measurements file (for deletion)
+};
+
+// ── Storage jobs (queued to the storage task) ───────────────
+enum class StorageJob : uint8_t {
+  SAVE_COLOR,         // append a color log record
+  SAVE_MEASUREMENT,   // append a measurements row
+  DELETE_COLOR,       // arg = record position
+  DELETE_MEASUREMENT, // arg = row
+  COMPACT,
+  SAVE_CALIBRATION, // write pendingCalib_
+  FLUSH,            // commit pending appends, then signal flush()
 };
 
 // ── Storage Manager ─────────────────────────────────────────
@@ -45,322 +84,1091 @@ public:
   }
 
   bool init() {
-    // Configure SPI for SD card
-    // IMPORTANT: SPI bus is shared with LCD
-    // LovyanGFX handles bus arbitration via bus_shared=true
-    SPI.begin(Config::SD::SCLK, Config::SD::MISO, Config::SD::MOSI,
-              Config::SD::CS);
-
-    if (!SD.begin(Config::SD::CS, SPI, 4000000)) {
-      Serial.println("[Storage] SD card mount failed");
-      return false;
+    // Queue first: saves posted without a card fail in post()
+    if (!jobs_) {
+      jobs_ = xQueueCreate(Config::Storage::WRITE_QUEUE, sizeof(Request));
+      sdMutex_ = xSemaphoreCreateMutex();
+      flushMutex_ = xSemaphoreCreateMutex();
+      calibMutex_ = xSemaphoreCreateMutex();
+      flushed_ = xSemaphoreCreateBinary();
+#ifdef ARDUINO
+      // Queued saves reach the card before ESP.restart()
+      esp_register_shutdown_handler(
+          [] { StorageManager::instance().flush(); });
+#endif
     }
+    if (!jobs_ || !sdMutex_ || !flushMutex_ || !calibMutex_ || !flushed_)
+      return false;
 
-    // Verify card is readable
-    uint64_t cardSize = SD.cardSize() / (1024 * 1024);
-    Serial.printf("[Storage] SD card mounted, size: %llu MB\n", cardSize);
-
-    // Create colors file with header if it doesn't exist
-    if (!SD.exists(Config::Storage::COLORS_FILE)) {
-      File f = SD.open(Config::Storage::COLORS_FILE, FILE_WRITE);
-      if (f) {
-        f.println("timestamp,r,g,b,hex,F1,F2,FZ,F3,F4,FY,F5,FXL,F6,F7,F8,NIR,"
-                  "Clear,FD");
-        f.close();
+    uint32_t hz;
+    {
+      // SPI bus shared with the LCD: SdLock holds a SpiBus lease
+      SdLock lock(sdMutex_);
+      SPI.begin(Config::SD::SCLK, Config::SD::MISO, Config::SD::MOSI,
+                Config::SD::CS);
+
+      hz = mountCard();
+      if (!hz) {
+        Serial.println("[Storage] SD card mount failed");
+        return false;
       }
-    }
 
-    // Create measurements file with header if it doesn't exist
-    if (!SD.exists(Config::Measure::DATA_FILE)) {
-      File f = SD.open(Config::Measure::DATA_FILE, FILE_WRITE);
-      if (f) {
-        f.println("timestamp,mm,px");
-        f.close();
-      }
+      // Verify card is readable
+      uint64_t cardSize = SD.cardSize() / (1024 * 1024);
+      Serial.printf("[Storage] SD card mounted at %lu MHz, size: %llu MB\n",
+                    (unsigned long)(hz / 1000000), cardSize);
+
+      openColorLog();
+      buildColorIndex();
+      openMeasurements();
     }
+    SpiBus::instance().setClock(SpiBus::Device::SD, hz);
 
     initialized_ = true;
     return true;
   }
 
-  // ── Save a color measurement ────────────────────────────
-  bool saveColor(const SpectralData &data) {
+  // ── Storage task (called from FreeRTOS task) ────────────
+  // Sole writer after init(). Appends are staged and committed
+  // together once a batch is full, WRITE_BEHIND_MS after the first
+  // of them, or before any other job runs.
+  void run() {
+    Request req;
+
+    while (true) {
+      TickType_t wait = portMAX_DELAY;
+      if (staged() > 0) {
+        uint32_t age = millis() - firstStagedMs_;
+        wait = age >= Config::Storage::WRITE_BEHIND_MS
+                   ? 0
+                   : pdMS_TO_TICKS(Config::Storage::WRITE_BEHIND_MS - age);
+      }
+      if (xQueueReceive(jobs_, &req, wait) != pdTRUE) {
+        commit(); // time budget
+        continue;
+      }
+      if (req.job == StorageJob::SAVE_COLOR ||
+          req.job == StorageJob::SAVE_MEASUREMENT) {
+        stage(req);
+        if (colorBatchCount_ == Config::Storage::BATCH_RECORDS ||
+            measureBatchCount_ == Config::Storage::BATCH_RECORDS)
+          commit(); // size budget
+      } else {
+        commit();
+        runJob(req);
+      }
+    }
+  }
+
+  // Waits until everything queued so far is on the card; false on
+  // timeout. Not from the storage task.
+  bool flush(uint32_t timeoutMs = Config::Storage::FLUSH_TIMEOUT_MS) {
     if (!initialized_)
       return false;
+    xSemaphoreTake(flushMutex_, portMAX_DELAY);
+    xSemaphoreTake(flushed_, 0); // a late signal from a timed-out flush
+    Request req = {};
+    req.job = StorageJob::FLUSH;
+    bool ok = post(req) &&
+              xSemaphoreTake(flushed_, pdMS_TO_TICKS(timeoutMs)) == pdTRUE;
+    xSemaphoreGive(flushMutex_);
+    return ok;
+  }
 
-    File f = SD.open(Config::Storage::COLORS_FILE, FILE_APPEND);
-    if (!f) {
-      Serial.println("[Storage] Failed to open colors file for append");
+  // ── Save a color measurement ────────────────────────────
+  // Queued; the record is written after the last whole one and
+  // announced with COLOR_SAVED. False if it cannot be queued.
+  bool saveColor(const SpectralData &data) {
+    if (!initialized_)
       return false;
-    }
-
-    char hex[8];
-    snprintf(hex, sizeof(hex), "#%02X%02X%02X", data.r, data.g, data.b);
-
-    // Write CSV line
-    f.printf("%lu,%d,%d,%d,%s", data.timestamp, data.r, data.g, data.b, hex);
-
-    for (int i = 0; i < Config::Sensor::NUM_CHANNELS; i++) {
-      f.printf(",%u", data.raw[i]);
-    }
-    f.println();
-    f.close();
-
-    Serial.printf("[Storage] Color saved: %s\n", hex);
-    return true;
+    Request req = {};
+    req.job = StorageJob::SAVE_COLOR;
+    ColorLog::encode(data, req.color);
+    return post(req);
   }
 
-  // ── Load all saved colors ───────────────────────────────
-  // Returns count of loaded colors, fills vector
-  int loadColors(std::vector<SavedColor> &colors) {
-    colors.clear();
-    if (!initialized_)
+  // ── Read a page of saved colors ─────────────────────────
+  // Up to maxOut colors from record `pos` on, stopping before record
+  // `end`; deleted records and those failing their CRC are skipped.
+  // index is the record position; pos ends past the last record
+  // read. Returns the count.
+  int readColors(uint32_t &pos, SavedColor *out, int maxOut,
+                 uint32_t end = UINT32_MAX) {
+    int n = 0;
+    if (!initialized_ || maxOut <= 0 || pos >= end)
       return 0;
+    SdLock lock(sdMutex_);
+    forEachColorRecord(pos, [&](uint32_t i, const ColorLog::Record &rec) {
+      if (i >= end)
+        return false;
+      pos = i + 1;
+      if (ColorLog::live(rec) && ColorLog::decode(rec, out[n])) {
+        out[n].index = i;
+        n++;
+      }
+      return n < maxOut;
+    });
+    return n;
+  }
 
+  // ── Read one saved color by record position ─────────────
+  bool readColor(uint32_t index, SavedColor &color) {
+    if (!initialized_ || index >= colorCount_)
+      return false;
+    SdLock lock(sdMutex_);
     File f = SD.open(Config::Storage::COLORS_FILE, FILE_READ);
     if (!f)
-      return 0;
+      return false;
+    ColorLog::Record rec;
+    bool ok = f.seek(ColorLog::offset(index)) &&
+              f.read(reinterpret_cast<uint8_t *>(&rec), sizeof(rec)) ==
+                  sizeof(rec) &&
+              ColorLog::live(rec) && ColorLog::decode(rec, color);
+    f.close();
+    color.index = index;
+    return ok;
+  }
 
-    // Skip header line
-    f.readStringUntil('\n');
+  // Records in the log, deleted ones included
+  uint32_t colorCount() const { return colorCount_; }
+  uint32_t liveColorCount() const { return colorCount_ - deadColors_; }
+  // Changes on every save, delete and compaction (RecordCursor)
+  uint32_t colorGeneration() const { return colorGeneration_; }
 
-    int index = 0;
-    while (f.available()) {
-      String line = f.readStringUntil('\n');
-      line.trim();
-      if (line.length() == 0)
-        continue;
-
-      SavedColor color;
-      if (parseCsvLine(line, color)) {
-        color.index = index++;
-        colors.push_back(color);
-      }
+  // ── Delete a color by index ─────────────────────────────
+  // Queued; the record is rewritten as a tombstone (COLOR_DELETED),
+  // other records keep their positions until compact()
+  bool deleteColor(int index) {
+    if (!initialized_ || index < 0 || index >= static_cast<int>(colorCount_))
+      return false;
+    Request req = {};
+    req.job = StorageJob::DELETE_COLOR;
+    req.arg = index;
+    req.layout = compactions_;
+    return post(req);
+  }
 
-      if (index >= Config::Storage::MAX_SAVED_COLORS)
-        break;
+  // ── JSON files ──────────────────────────────────────────
+  // Whole documents (calibration, connectivity settings), read and
+  // written under the card lock like every other file
+  bool loadJson(const char *path, JsonDocument &doc) {
+    if (!initialized_)
+      return false;
+    DeserializationError err;
+    {
+      SdLock lock(sdMutex_);
+      if (!SD.exists(path))
+        return false;
+      File f = SD.open(path, FILE_READ);
+      if (!f)
+        return false;
+      err = deserializeJson(doc, f);
+      f.close();
     }
-    f.close();
-
-    Serial.printf("[Storage] Loaded %d colors\n", colors.size());
-    return colors.size();
+    if (err) {
+      Serial.printf("[Storage] JSON parse error in %s: %s\n", path,
+                    err.c_str());
+      return false;
+    }
+    return true;
   }
 
-  // ── Delete a color by index ─────────────────────────────
-  // Rewrites the file excluding the specified line
-  bool deleteColor(int lineIndex) {
+  bool saveJson(const char *path, const JsonDocument &doc) {
     if (!initialized_)
       return false;
-
-    File src = SD.open(Config::Storage::COLORS_FILE, FILE_READ);
-    if (!src)
+    SdLock lock(sdMutex_);
+    File f = SD.open(path, FILE_WRITE);
+    if (!f)
       return false;
+    serializeJsonPretty(doc, f);
+    f.close();
+    return true;
+  }
 
-    // Read all lines
-    std::vector<String> lines;
-    while (src.available()) {
-      lines.push_back(src.readStringUntil('\n'));
-    }
-    src.close();
+  // ── Save calibration table (JSON) ───────────────────────
+  // {"version":2,"ledSettleMs":n,"reconSet":"generic",
+  //  "entries":[{gain,atime,astep,seq,hasDark,...,darkRef[]}]}
+  // Any task, never waits for the card: takes a copy of the table
+  // and queues the write to the storage task. Saves made before
+  // that write runs are coalesced into it, so the newest table is
+  // written. A failure, queued or not, also sends SAVE_ERROR (data
+  // 0): callers do not retry.
+  bool saveCalibration(const CalibrationTable &table) {
+    if (!initialized_)
+      return false;
+    xSemaphoreTake(calibMutex_, portMAX_DELAY);
+    pendingCalib_ = table;
+    const bool queued = calibQueued_;
+    calibQueued_ = true;
+    xSemaphoreGive(calibMutex_);
+    if (queued)
+      return true;
+
+    Request req = {};
+    req.job = StorageJob::SAVE_CALIBRATION;
+    if (post(req))
+      return true;
+    xSemaphoreTake(calibMutex_, portMAX_DELAY);
+    calibQueued_ = false;
+    xSemaphoreGive(calibMutex_);
+    EventQueue::send(EventType::SAVE_ERROR, 0);
+    return false;
+  }
 
-    // Validate index (line 0 is header, data starts at line 1)
-    int dataLine = lineIndex + 1;
-    if (dataLine < 1 || dataLine >= static_cast<int>(lines.size())) {
+  // ── Load calibration table ──────────────────────────────
+  // Files from before the table hold a single entry at top level.
+  bool loadCalibration(CalibrationTable &table) {
+    if (!initialized_)
       return false;
-    }
 
-    // Rewrite file without the deleted line
-    File dst = SD.open(Config::Storage::COLORS_FILE, FILE_WRITE);
-    if (!dst)
+    JsonDocument doc;
+    if (!loadJson(Config::Storage::CALIB_FILE, doc))
       return false;
 
-    for (int i = 0; i < static_cast<int>(lines.size()); i++) {
-      if (i == dataLine)
-        continue;
-      lines[i].trim();
-      if (lines[i].length() > 0) {
-        dst.println(lines[i]);
+    table.clear();
+    if (doc["entries"].is<JsonArray>()) {
+      // Files without "seq" keep their entries in file order
+      uint32_t seq = 0;
+      for (JsonObject obj : doc["entries"].as<JsonArray>()) {
+        seq = obj["seq"] | (seq + 1);
+        table.restore(parseCalibration(obj), seq);
       }
+    } else {
+      table.store(parseCalibration(doc.as<JsonObject>()));
     }
-    dst.close();
+    table.setLedSettleMs(doc["ledSettleMs"] | -1);
+    int reconSet = SpectralRecon::find(doc["reconSet"] | "");
+    table.setReconSet(reconSet < 0 ? 0 : static_cast<uint8_t>(reconSet));
 
-    Serial.printf("[Storage] Deleted color at index %d\n", lineIndex);
+    Serial.printf("[Storage] Calibration loaded (%d exposures)\n",
+                  table.count());
     return true;
   }
 
-  // ── Save calibration data (JSON) ────────────────────────
-  bool saveCalibration(const CalibrationData &cal) {
+  // ── Save a measurement ─────────────────────────────────
+  // Queued, timestamped now; the row is written after the last
+  // whole one. False if out of range, the file is unavailable or
+  // it cannot be queued.
+  bool saveMeasurement(float mm, uint16_t px) {
     if (!initialized_)
       return false;
-
-    JsonDocument doc;
-
-    doc["hasDark"] = cal.hasDark;
-    doc["hasGray"] = cal.hasGray;
-    doc["hasWhite"] = cal.hasWhite;
-    doc["timestamp"] = cal.calibTimestamp;
-
-    JsonArray dark = doc["darkRef"].to<JsonArray>();
-    JsonArray gray = doc["grayRef"].to<JsonArray>();
-    JsonArray white = doc["whiteRef"].to<JsonArray>();
-
-    for (int i = 0; i < Config::Sensor::NUM_CHANNELS; i++) {
-      dark.add(cal.darkRef[i]);
-      gray.add(cal.grayRef[i]);
-      white.add(cal.whiteRef[i]);
+    if (!measurementsOk_) {
+      Serial.println("[Storage] Measurements unavailable, not saved");
+      return false;
     }
 
-    File f = SD.open(Config::Storage::CALIB_FILE, FILE_WRITE);
-    if (!f)
+    Request req = {};
+    req.job = StorageJob::SAVE_MEASUREMENT;
+    char row[MEASURE_ROW_LEN + 1];
+    if (!formatMeasureRow(row, millis(), mm, px)) {
+      Serial.printf("[Storage] Measurement %.2f mm out of range\n", mm);
       return false;
+    }
+    memcpy(req.row, row, MEASURE_ROW_LEN);
+    return post(req);
+  }
 
-    serializeJsonPretty(doc, f);
-    f.close();
+  // ── Read a page of saved measurements ───────────────────
+  // As readColors: up to maxOut rows from `pos`, before `end`,
+  // deleted rows skipped
+  int readMeasurements(uint32_t &pos, SavedMeasurement *out, int maxOut,
+                       uint32_t end = UINT32_MAX) {
+    int n = 0;
+    if (!initialized_ || !measurementsOk_ || maxOut <= 0 || pos >= end)
+      return 0;
+    SdLock lock(sdMutex_);
+    forEachMeasurementRow(pos, [&](uint32_t i, const char *row) {
+      if (i >= end)
+        return false;
+      pos = i + 1;
+      if (parseMeasurementRow(row, out[n])) {
+        out[n].index = i;
+        n++;
+      }
+      return n < maxOut;
+    });
+    return n;
+  }
 
-    Serial.println("[Storage] Calibration saved");
-    return true;
+  uint32_t measurementCount() const { return measurementCount_; }
+  uint32_t liveMeasurementCount() const {
+    return measurementCount_ - deadMeasurements_;
   }
+  uint32_t measurementGeneration() const { return measurementGeneration_; }
+  // False if the file could not be created or converted at init;
+  // it is then left as found and holds no rows here
+  bool measurementsAvailable() const { return measurementsOk_; }
 
-  // ── Load calibration data ───────────────────────────────
-  bool loadCalibration(CalibrationData &cal) {
-    if (!initialized_)
+  // ── Delete a measurement by index ────────────────────────
+  // Queued; flips the row's `deleted` field in place
+  bool deleteMeasurement(int rowIndex) {
+    if (!initialized_ || !measurementsOk_ || rowIndex < 0 ||
+        rowIndex >= static_cast<int>(measurementCount_))
       return false;
+    Request req = {};
+    req.job = StorageJob::DELETE_MEASUREMENT;
+    req.arg = rowIndex;
+    req.layout = compactions_;
+    return post(req);
+  }
 
-    File f = SD.open(Config::Storage::CALIB_FILE, FILE_READ);
-    if (!f)
+  // ── Compaction ──────────────────────────────────────────
+  // Queues a rewrite of the color log and the measurements file
+  // without their dead records, each once enough of it is dead
+  // (Config::Storage::COMPACT_*). Positions change: callers drop
+  // any index they hold, and deletes queued before it is done are
+  // dropped. False if there is nothing to do or it cannot be queued.
+  bool compact() {
+    if (!needsCompaction())
       return false;
+    Request req = {};
+    req.job = StorageJob::COMPACT;
+    compactQueued_ = true; // before the task can clear it
+    if (post(req))
+      return true;
+    compactQueued_ = false;
+    return false;
+  }
 
-    JsonDocument doc;
-    DeserializationError err = deserializeJson(doc, f);
-    f.close();
+  bool needsCompaction() const {
+    return initialized_ && !compactQueued_ &&
+           (worthCompacting(deadColors_, colorCount_) ||
+            worthCompacting(deadMeasurements_, measurementCount_));
+  }
 
-    if (err) {
-      Serial.printf("[Storage] JSON parse error: %s\n", err.c_str());
-      return false;
-    }
+  bool isInitialized() const { return initialized_; }
 
-    cal.hasDark = doc["hasDark"] | false;
-    cal.hasGray = doc["hasGray"] | false;
-    cal.hasWhite = doc["hasWhite"] | false;
-    cal.calibTimestamp = doc["timestamp"] | 0;
+  // Lab index of the saved colors, for nearest / radius queries
+  const ColorIndex &colorIndex() const { return colorIndex_; }
 
-    JsonArray dark = doc["darkRef"];
-    JsonArray gray = doc["grayRef"];
-    JsonArray white = doc["whiteRef"];
+  // Live colors with Lab that the index had no room for: queries
+  // cannot return them until a compaction or reboot frees memory
+  uint32_t unindexedColors() const { return unindexedColors_; }
+
+private:
+  static constexpr int CALIB_VERSION = 2;
+
+  static CalibrationData parseCalibration(JsonObject obj) {
+    CalibrationData cal;
+    cal.hasDark = obj["hasDark"] | false;
+    cal.hasGray = obj["hasGray"] | false;
+    cal.hasWhite = obj["hasWhite"] | false;
+    cal.calibTimestamp = obj["timestamp"] | 0;
+    // Files from before auto-exposure were taken at the defaults
+    cal.exposure.gainIndex = obj["gain"] | kDefaultExposure.gainIndex;
+    cal.exposure.atime = obj["atime"] | kDefaultExposure.atime;
+    cal.exposure.astep = obj["astep"] | kDefaultExposure.astep;
+
+    JsonArray dark = obj["darkRef"];
+    JsonArray gray = obj["grayRef"];
+    JsonArray white = obj["whiteRef"];
 
     for (int i = 0; i < Config::Sensor::NUM_CHANNELS; i++) {
       cal.darkRef[i] = dark[i] | 0.0f;
       cal.grayRef[i] = gray[i] | 0.0f;
       cal.whiteRef[i] = white[i] | 0.0f;
     }
+    return cal;
+  }
 
-    Serial.println("[Storage] Calibration loaded");
-    return true;
+  StorageManager() = default;
+
+  // Mounts at the card's best clock: SPI_FREQ, else SPI_FREQ_SAFE;
+  // returns it, 0 if the card does not mount
+  static uint32_t mountCard() {
+    for (uint32_t hz : {Config::SD::SPI_FREQ, Config::SD::SPI_FREQ_SAFE}) {
+      if (SD.begin(Config::SD::CS, SPI, hz))
+        return hz;
+      SD.end();
+    }
+    return 0;
   }
 
-  // ── Save a measurement ─────────────────────────────────
-  bool saveMeasurement(float mm, uint16_t px) {
-    if (!initialized_)
-      return false;
+  // ── Record files ────────────────────────────────────────
+  static constexpr int READ_CHUNK = 8; // records per SD read
+
+  // Calls fn(index, bytes) for each whole record of `recordLen`
+  // bytes after a `headerLen`-byte header, from record `first` on,
+  // READ_CHUNK records per SD read, until fn returns false. Returns
+  // the file's record count. Holding the bus (SdLock), it yields to
+  // a waiting frame between chunks.
+  template <typename Fn>
+  static uint32_t forEachRecord(const char *path, size_t headerLen,
+                                size_t recordLen, uint32_t first, Fn fn) {
+    File f = SD.open(path, FILE_READ);
+    if (!f)
+      return 0;
+    const size_t size = f.size();
+    const uint32_t count =
+        size < headerLen
+            ? 0
+            : static_cast<uint32_t>((size - headerLen) / recordLen);
+    alignas(ColorLog::Record) uint8_t chunk[READ_CHUNK *
+                                            sizeof(ColorLog::Record)];
+    const uint32_t perChunk = sizeof(chunk) / recordLen;
+    bool more = first < count && f.seek(headerLen + first * recordLen);
+    for (uint32_t i = first; more && i < count;) {
+      uint32_t n = count - i < perChunk ? count - i : perChunk;
+      SpiBus::instance().yield(SpiBus::Device::SD);
+      if (f.read(chunk, n * recordLen) != n * recordLen)
+        break;
+      for (uint32_t j = 0; more && j < n; j++, i++)
+        more = fn(i, chunk + j * recordLen);
+    }
+    f.close();
+    return count;
+  }
 
-    File f = SD.open(Config::Measure::DATA_FILE, FILE_APPEND);
-    if (!f) {
-      Serial.println("[Storage] Failed to open measurements file for append");
+  // Copies the header and the records `keep` accepts from `path` to
+  // `temp`, then swaps the two; false if either step failed
+  template <typename Keep>
+  static bool rewriteFile(const char *path, const char *temp,
+                          size_t headerLen, size_t recordLen, Keep keep) {
+    File src = SD.open(path, FILE_READ);
+    if (!src)
+      return false;
+    uint8_t header[sizeof(ColorLog::Header)];
+    bool ok = headerLen <= sizeof(header) &&
+              src.read(header, headerLen) == headerLen;
+    src.close();
+    File dst = SD.open(temp, FILE_WRITE);
+    if (!dst)
+      return false;
+    ok = ok && dst.write(header, headerLen) == headerLen;
+    forEachRecord(path, headerLen, recordLen, 0,
+                  [&](uint32_t, const uint8_t *rec) {
+                    if (keep(rec))
+                      ok = ok && dst.write(rec, recordLen) == recordLen;
+                    return ok;
+                  });
+    dst.close();
+    if (!ok) {
+      SD.remove(temp);
       return false;
     }
+    return replaceFile(temp, path);
+  }
 
-    f.printf("%lu,%.2f,%u\n", (unsigned long)millis(), mm, px);
+  // The swap: `temp` is complete before `target` is removed, and
+  // recoverSwap() finishes a swap cut off between the two steps
+  static bool replaceFile(const char *temp, const char *target) {
+    if (!SD.exists(target) || SD.remove(target))
+      return SD.rename(temp, target);
+    SD.remove(temp);
+    return false;
+  }
+
+  // At init: a temp file next to its target is a partial copy; alone
+  // it is a finished copy whose rename did not happen
+  static void recoverSwap(const char *temp, const char *target) {
+    if (!SD.exists(temp))
+      return;
+    if (SD.exists(target)) {
+      SD.remove(temp);
+    } else {
+      SD.rename(temp, target);
+      Serial.printf("[Storage] Recovered %s from %s\n", target, temp);
+    }
+  }
+
+  static bool worthCompacting(uint32_t dead, uint32_t total) {
+    return dead >= Config::Storage::COMPACT_MIN_DEAD &&
+           dead * 100 >= total * Config::Storage::COMPACT_DEAD_PCT;
+  }
+
+  // ── Color log ───────────────────────────────────────────
+
+  // Creates the log (importing a legacy colors.csv) or checks its
+  // header; a log with a bad header is moved aside, not overwritten
+  void openColorLog() {
+    using namespace Config::Storage;
+    recoverSwap(COLORS_TEMP, COLORS_FILE);
+    if (SD.exists(COLORS_FILE)) {
+      File f = SD.open(COLORS_FILE, FILE_READ);
+      ColorLog::Header h = {};
+      bool ok = f && f.read(reinterpret_cast<uint8_t *>(&h), sizeof(h)) ==
+                         sizeof(h);
+      ok = ok && ColorLog::headerValid(h);
+      size_t size = f ? f.size() : 0;
+      if (f)
+        f.close();
+      if (ok) {
+        colorCount_ = ColorLog::count(size);
+        if (ColorLog::offset(colorCount_) != size)
+          Serial.println("[Storage] Color log has a torn record at the end");
+        return;
+      }
+      Serial.printf("[Storage] Color log header invalid, moved to %s\n",
+                    COLORS_BAD);
+      SD.remove(COLORS_BAD);
+      SD.rename(COLORS_FILE, COLORS_BAD);
+    }
+
+    colorCount_ = 0;
+    // COLORS_LEGACY marks an import already done: never import twice
+    // or overwrite the kept copy. A failed import leaves no log, so
+    // the next boot tries again.
+    if (SD.exists(COLORS_CSV) && !SD.exists(COLORS_LEGACY)) {
+      if (!importLegacyCsv())
+        Serial.println("[Storage] Color CSV import failed");
+      return;
+    }
+    File f = SD.open(COLORS_FILE, FILE_WRITE);
+    if (!f) {
+      Serial.println("[Storage] Failed to create color log");
+      return;
+    }
+    ColorLog::Header h = ColorLog::makeHeader();
+    f.write(reinterpret_cast<const uint8_t *>(&h), sizeof(h));
     f.close();
+  }
 
-    Serial.printf("[Storage] Measurement saved: %.2f mm\n", mm);
+  // One-time import of a colors.csv written before the log, built
+  // in COLORS_TEMP and swapped in as a compaction is. Its header is
+  // written last: a copy cut off by a reset has none, so if
+  // recoverSwap() takes it for a finished one, openColorLog() sets
+  // it aside and the CSV, renamed only after the swap, is imported
+  // again.
+  bool importLegacyCsv() {
+    using namespace Config::Storage;
+    File src = SD.open(COLORS_CSV, FILE_READ);
+    File dst = SD.open(COLORS_TEMP, FILE_WRITE);
+    const ColorLog::Header none = {};
+    bool ok = src && dst &&
+              dst.write(reinterpret_cast<const uint8_t *>(&none),
+                        sizeof(none)) == sizeof(none);
+    uint32_t count = 0;
+    if (ok)
+      src.readStringUntil('\n'); // header
+
+    SavedColor color;
+    ColorLog::Record rec;
+    while (ok && src.available()) {
+      String line = src.readStringUntil('\n');
+      line.trim();
+      if (line.length() == 0 || !parseCsvLine(line, color))
+        continue;
+      ColorLog::encode(color, rec);
+      ok = dst.write(reinterpret_cast<const uint8_t *>(&rec), sizeof(rec)) ==
+           sizeof(rec);
+      count++;
+    }
+    const ColorLog::Header h = ColorLog::makeHeader();
+    ok = ok && dst.seek(0) &&
+         dst.write(reinterpret_cast<const uint8_t *>(&h), sizeof(h)) ==
+             sizeof(h);
+    if (src)
+      src.close();
+    if (dst)
+      dst.close();
+    if (!ok) {
+      SD.remove(COLORS_TEMP);
+      return false;
+    }
+    if (!replaceFile(COLORS_TEMP, COLORS_FILE))
+      return false;
+    colorCount_ = count;
+    SD.rename(COLORS_CSV, COLORS_LEGACY);
+    Serial.printf("[Storage] Imported %lu colors from CSV (kept as %s)\n",
+                  (unsigned long)colorCount_, COLORS_LEGACY);
     return true;
   }
 
-  // ── Load all saved measurements ──────────────────────────
-  int loadMeasurements(std::vector<SavedMeasurement> &measurements) {
-    measurements.clear();
-    if (!initialized_)
-      return 0;
+  // Calls fn(index, record) for each record from `first` on until
+  // fn returns false; returns the log's record count
+  template <typename Fn> uint32_t forEachColorRecord(uint32_t first, Fn fn) {
+    return forEachRecord(Config::Storage::COLORS_FILE,
+                         sizeof(ColorLog::Header), sizeof(ColorLog::Record),
+                         first, [&](uint32_t i, const uint8_t *rec) {
+                           return fn(i, *reinterpret_cast<
+                                            const ColorLog::Record *>(rec));
+                         });
+  }
 
-    File f = SD.open(Config::Measure::DATA_FILE, FILE_READ);
-    if (!f)
-      return 0;
+  void compactColorLog() {
+    uint32_t start = millis();
+    uint32_t before = colorCount_;
+    bool ok = rewriteFile(Config::Storage::COLORS_FILE,
+                          Config::Storage::COLORS_TEMP,
+                          sizeof(ColorLog::Header), sizeof(ColorLog::Record),
+                          [](const uint8_t *rec) {
+                            return ColorLog::live(
+                                *reinterpret_cast<const ColorLog::Record *>(
+                                    rec));
+                          });
+    buildColorIndex();
+    if (ok)
+      Serial.printf("[Storage] Color log compacted: %lu -> %lu records in "
+                    "%lu ms\n",
+                    (unsigned long)before, (unsigned long)colorCount_,
+                    (unsigned long)(millis() - start));
+    else
+      Serial.println("[Storage] Color log compaction failed");
+  }
 
-    // Skip header line
-    f.readStringUntil('\n');
+  // ── Color index ─────────────────────────────────────────
+  // One pass over the color log; ids are record positions. Also
+  // recounts the records, dead ones included.
+  void buildColorIndex() {
+    colorIndex_.clear();
+    colorGeneration_++;
+    uint32_t start = millis();
+    deadColors_ = 0;
+    unindexedColors_ = 0;
+    colorCount_ = forEachColorRecord(0, [&](uint32_t i,
+                                            const ColorLog::Record &rec) {
+      if (!ColorLog::live(rec))
+        deadColors_++;
+      else if (!indexColor(rec, i))
+        unindexedColors_++;
+      return true;
+    });
+    Serial.printf("[Storage] Color index: %u of %lu colors (%lu dead) in "
+                  "%lu ms\n",
+                  (unsigned)colorIndex_.size(), (unsigned long)colorCount_,
+                  (unsigned long)deadColors_,
+                  (unsigned long)(millis() - start));
+    if (unindexedColors_)
+      Serial.printf("[Storage] Color index full: %lu colors not matched\n",
+                    (unsigned long)unindexedColors_);
+  }
 
-    int index = 0;
-    while (f.available()) {
-      String line = f.readStringUntil('\n');
+  // Adds record `i` to the index; false if it has Lab but no room
+  bool indexColor(const ColorLog::Record &rec, uint32_t i) {
+    if (!(rec.flags & ColorLog::HAS_LAB))
+      return true;
+    return colorIndex_.insert(ColorLog::labOf(rec), rec.rgb[0], rec.rgb[1],
+                              rec.rgb[2], i);
+  }
+
+  // ── Measurements file ───────────────────────────────────
+  //   timestamp,mm,px,deleted
+  //   1234567890,    12.34,  123,0
+  // Every row is MEASURE_ROW_LEN bytes; `deleted` is 0 or 1
+  static constexpr char MEASURE_HEADER[] = "timestamp,mm,px,deleted\n";
+  static constexpr size_t MEASURE_HEADER_LEN = sizeof(MEASURE_HEADER) - 1;
+  static constexpr size_t MEASURE_ROW_LEN = 29; // "%10lu,%9.2f,%5u,0\n"
+  static constexpr size_t MEASURE_DELETED_AT = MEASURE_ROW_LEN - 2;
+
+  static size_t measureOffset(uint32_t row) {
+    return MEASURE_HEADER_LEN + static_cast<size_t>(row) * MEASURE_ROW_LEN;
+  }
+
+  // False if a value does not fit its column
+  static bool formatMeasureRow(char *row, uint32_t timestamp, float mm,
+                               uint16_t px) {
+    int n = snprintf(row, MEASURE_ROW_LEN + 1, "%10lu,%9.2f,%5u,0\n",
+                     (unsigned long)timestamp, mm, px);
+    return n == static_cast<int>(MEASURE_ROW_LEN);
+  }
+
+  // False for deleted or malformed rows
+  static bool parseMeasurementRow(const char *row, SavedMeasurement &m) {
+    if (row[MEASURE_DELETED_AT] != '0' || row[MEASURE_ROW_LEN - 1] != '\n')
+      return false;
+    char buf[MEASURE_ROW_LEN];
+    memcpy(buf, row, MEASURE_ROW_LEN - 1);
+    buf[MEASURE_ROW_LEN - 1] = '\0';
+    char *end;
+    m.timestamp = strtoul(buf, &end, 10);
+    if (*end != ',')
+      return false;
+    m.value_mm = strtof(end + 1, &end);
+    if (*end != ',')
+      return false;
+    m.value_px = static_cast<uint16_t>(strtoul(end + 1, &end, 10));
+    return *end == ',';
+  }
+
+  template <typename Fn>
+  uint32_t forEachMeasurementRow(uint32_t first, Fn fn) {
+    return forEachRecord(Config::Measure::DATA_FILE, MEASURE_HEADER_LEN,
+                         MEASURE_ROW_LEN, first,
+                         [&](uint32_t i, const uint8_t *row) {
+                           return fn(i, reinterpret_cast<const char *>(row));
+                         });
+  }
+
+  // Creates the file, converts one from before fixed-width rows,
+  // and counts rows and dead rows. If either fails the file is left
+  // as found and measurements are unavailable: read as rows, a
+  // legacy file would be garbage.
+  void openMeasurements() {
+    using namespace Config::Measure;
+    recoverSwap(DATA_TEMP, DATA_FILE);
+    String header;
+    if (SD.exists(DATA_FILE)) {
+      File f = SD.open(DATA_FILE, FILE_READ);
+      if (f) {
+        header = f.readStringUntil('\n');
+        f.close();
+      }
+    }
+    measurementsOk_ = true;
+    if (header.length() == 0) {
+      File f = SD.open(DATA_FILE, FILE_WRITE);
+      measurementsOk_ = f && f.print(MEASURE_HEADER) == MEASURE_HEADER_LEN;
+      if (f)
+        f.close();
+    } else if (header + "\n" != MEASURE_HEADER) {
+      measurementsOk_ = convertLegacyMeasurements();
+    }
+    if (measurementsOk_) {
+      scanMeasurements();
+    } else {
+      measurementCount_ = deadMeasurements_ = 0;
+      Serial.printf("[Storage] Measurements unavailable, %s left as is\n",
+                    DATA_FILE);
+    }
+  }
+
+  // Rows of the old "timestamp,mm,px" file, one line at a time. A
+  // line that does not fit a row aborts it: nothing is dropped.
+  bool convertLegacyMeasurements() {
+    using namespace Config::Measure;
+    File src = SD.open(DATA_FILE, FILE_READ);
+    File dst = SD.open(DATA_TEMP, FILE_WRITE);
+    bool ok = src && dst && dst.print(MEASURE_HEADER) == MEASURE_HEADER_LEN;
+    uint32_t rows = 0;
+    if (ok)
+      src.readStringUntil('\n'); // header
+    while (ok && src.available()) {
+      String line = src.readStringUntil('\n');
       line.trim();
       if (line.length() == 0)
         continue;
-
-      SavedMeasurement m;
-      if (parseMeasurementLine(line, m)) {
-        m.index = index++;
-        measurements.push_back(m);
+      int c1 = line.indexOf(',');
+      int c2 = line.indexOf(',', c1 + 1);
+      char row[MEASURE_ROW_LEN + 1];
+      if (c1 < 0 || c2 < 0 ||
+          !formatMeasureRow(row, line.substring(0, c1).toInt(),
+                            line.substring(c1 + 1, c2).toFloat(),
+                            line.substring(c2 + 1).toInt())) {
+        Serial.printf("[Storage] Measurement %lu unreadable: \"%s\"\n",
+                      (unsigned long)rows, line.c_str());
+        ok = false;
+        break;
       }
+      ok = dst.write(reinterpret_cast<const uint8_t *>(row),
+                     MEASURE_ROW_LEN) == MEASURE_ROW_LEN;
+      rows++;
+    }
+    if (src)
+      src.close();
+    if (dst)
+      dst.close();
+    if (!ok) {
+      SD.remove(DATA_TEMP);
+      Serial.println("[Storage] Measurements conversion failed");
+      return false;
+    }
+    // A swap cut off after the remove is finished by recoverSwap()
+    if (!replaceFile(DATA_TEMP, DATA_FILE))
+      return false;
+    Serial.printf("[Storage] Converted %lu measurements to fixed-width "
+                  "rows\n",
+                  (unsigned long)rows);
+    return true;
+  }
 
-      if (index >= Config::Measure::MAX_SAVED_MEASUREMENTS)
-        break;
+  void scanMeasurements() {
+    measurementGeneration_++;
+    deadMeasurements_ = 0;
+    measurementCount_ =
+        forEachMeasurementRow(0, [&](uint32_t, const char *row) {
+          if (row[MEASURE_DELETED_AT] != '0')
+            deadMeasurements_++;
+          return true;
+        });
+  }
+
+  void compactMeasurements() {
+    uint32_t before = measurementCount_;
+    using namespace Config::Measure;
+    bool ok = rewriteFile(DATA_FILE, DATA_TEMP, MEASURE_HEADER_LEN,
+                          MEASURE_ROW_LEN, [](const uint8_t *row) {
+                            return row[MEASURE_DELETED_AT] == '0';
+                          });
+    scanMeasurements();
+    if (ok)
+      Serial.printf("[Storage] Measurements compacted: %lu -> %lu rows\n",
+                    (unsigned long)before, (unsigned long)measurementCount_);
+    else
+      Serial.println("[Storage] Measurements compaction failed");
+  }
+
+  // Storage task: the newest table from saveCalibration()
+  void writeCalibration() {
+    JsonDocument doc;
+    xSemaphoreTake(calibMutex_, portMAX_DELAY);
+    calibQueued_ = false; // later saves queue another write
+    calibrationJson(pendingCalib_, doc);
+    const int exposures = pendingCalib_.count();
+    xSemaphoreGive(calibMutex_);
+
+    if (!saveJson(Config::Storage::CALIB_FILE, doc)) {
+      Serial.println("[Storage] Calibration write failed");
+      EventQueue::send(EventType::SAVE_ERROR, 0);
+      return;
     }
-    f.close();
+    Serial.printf("[Storage] Calibration saved (%d exposures)\n", exposures);
+  }
 
-    Serial.printf("[Storage] Loaded %d measurements\n",
-                  (int)measurements.size());
-    return measurements.size();
+  static void calibrationJson(const CalibrationTable &table,
+                              JsonDocument &doc) {
+    doc["version"] = CALIB_VERSION;
+    if (table.ledSettleMs() >= 0)
+      doc["ledSettleMs"] = table.ledSettleMs();
+    doc["reconSet"] = SpectralRecon::name(table.reconSet());
+    JsonArray entries = doc["entries"].to<JsonArray>();
+
+    for (int e = 0; e < table.count(); e++) {
+      const CalibrationData &cal = table.entry(e);
+      JsonObject obj = entries.add<JsonObject>();
+
+      obj["gain"] = cal.exposure.gainIndex;
+      obj["atime"] = cal.exposure.atime;
+      obj["astep"] = cal.exposure.astep;
+      obj["hasDark"] = cal.hasDark;
+      obj["hasGray"] = cal.hasGray;
+      obj["hasWhite"] = cal.hasWhite;
+      obj["timestamp"] = cal.calibTimestamp;
+      obj["seq"] = table.sequence(e);
+
+      JsonArray dark = obj["darkRef"].to<JsonArray>();
+      JsonArray gray = obj["grayRef"].to<JsonArray>();
+      JsonArray white = obj["whiteRef"].to<JsonArray>();
+
+      for (int i = 0; i < Config::Sensor::NUM_CHANNELS; i++) {
+        dark.add(cal.darkRef[i]);
+        gray.add(cal.grayRef[i]);
+        white.add(cal.whiteRef[i]);
+      }
+    }
   }
 
-  // ── Delete a measurement by index ────────────────────────
-  bool deleteMeasurement(int lineIndex) {
-    if (!initialized_)
-      return false;
+  // ── Write-behind ────────────────────────────────────────
+  struct Request {
+    StorageJob job;
+    int32_t arg;
+    uint32_t layout; // deletes: compactions_ when queued
+    union {
+      ColorLog::Record color;     // SAVE_COLOR, sealed
+      char row[MEASURE_ROW_LEN]; // SAVE_MEASUREMENT
+    };
+  };
+
+  // Holds the card for one transaction (storage task vs. readers)
+  // and the SPI bus under it
+  struct SdLock {
+    explicit SdLock(SemaphoreHandle_t m) : m_(m) {
+      xSemaphoreTake(m_, portMAX_DELAY);
+      SpiBus::instance().acquire(SpiBus::Device::SD);
+    }
+    ~SdLock() {
+      SpiBus::instance().release(SpiBus::Device::SD);
+      xSemaphoreGive(m_);
+    }
+    SemaphoreHandle_t m_;
+  };
 
-    File src = SD.open(Config::Measure::DATA_FILE, FILE_READ);
-    if (!src)
+  // Any task, never blocks
+  bool post(const Request &req) {
+    if (xQueueSend(jobs_, &req, 0) != pdTRUE) {
+      Serial.println("[Storage] Write queue full");
       return false;
+    }
+    return true;
+  }
+
+  int staged() const { return colorBatchCount_ + measureBatchCount_; }
+
+  void stage(const Request &req) {
+    if (staged() == 0)
+      firstStagedMs_ = millis();
+    if (req.job == StorageJob::SAVE_COLOR)
+      colorBatch_[colorBatchCount_++] = req.color;
+    else
+      memcpy(measureBatch_[measureBatchCount_++], req.row, MEASURE_ROW_LEN);
+  }
+
+  // Staged appends, one seek + write per file
+  void commit() {
+    if (colorBatchCount_ > 0)
+      commitColors();
+    if (measureBatchCount_ > 0)
+      commitMeasurements();
+  }
 
-    std::vector<String> lines;
-    while (src.available()) {
-      lines.push_back(src.readStringUntil('\n'));
+  void commitColors() {
+    const int n = colorBatchCount_;
+    const size_t bytes = n * sizeof(ColorLog::Record);
+    colorBatchCount_ = 0;
+    bool ok;
+    {
+      SdLock lock(sdMutex_);
+      File f = SD.open(Config::Storage::COLORS_FILE, "r+");
+      ok = f && f.seek(ColorLog::offset(colorCount_)) &&
+           f.write(reinterpret_cast<const uint8_t *>(colorBatch_), bytes) ==
+               bytes;
+      if (f)
+        f.close();
+    }
+    if (!ok) {
+      // A torn batch lies past colorCount_; the next one overwrites it
+      Serial.printf("[Storage] Color log write failed, %d colors lost\n", n);
+      EventQueue::send(EventType::SAVE_ERROR, n);
+      return;
     }
-    src.close();
 
-    int dataLine = lineIndex + 1; // line 0 is header
-    if (dataLine < 1 || dataLine >= static_cast<int>(lines.size()))
-      return false;
+    for (int i = 0; i < n; i++) {
+      const ColorLog::Record &rec = colorBatch_[i];
+      if (!indexColor(rec, colorCount_)) {
+        unindexedColors_++;
+        Serial.printf("[Storage] Color index full: color %lu not matched\n",
+                      (unsigned long)colorCount_);
+      }
+      EventQueue::send(EventType::COLOR_SAVED,
+                       static_cast<int32_t>(colorCount_));
+      colorCount_++;
+    }
+    colorGeneration_++;
+    Serial.printf("[Storage] %d color(s) saved, last #%02X%02X%02X\n", n,
+                  colorBatch_[n - 1].rgb[0], colorBatch_[n - 1].rgb[1],
+                  colorBatch_[n - 1].rgb[2]);
+  }
 
-    File dst = SD.open(Config::Measure::DATA_FILE, FILE_WRITE);
-    if (!dst)
-      return false;
+  void commitMeasurements() {
+    const int n = measureBatchCount_;
+    const size_t bytes = n * MEASURE_ROW_LEN;
+    measureBatchCount_ = 0;
+    bool ok;
+    {
+      SdLock lock(sdMutex_);
+      File f = SD.open(Config::Measure::DATA_FILE, "r+");
+      ok = f && f.seek(measureOffset(measurementCount_)) &&
+           f.write(reinterpret_cast<const uint8_t *>(measureBatch_), bytes) ==
+               bytes;
+      if (f)
+        f.close();
+    }
+    if (!ok) {
+      Serial.printf("[Storage] Measurements write failed, %d rows lost\n", n);
+      EventQueue::send(EventType::SAVE_ERROR, n);
+      return;
+    }
+    measurementCount_ += n;
+    measurementGeneration_++;
+    Serial.printf("[Storage] %d measurement(s) saved\n", n);
+  }
 
-    for (int i = 0; i < static_cast<int>(lines.size()); i++) {
-      if (i == dataLine)
-        continue;
-      lines[i].trim();
-      if (lines[i].length() > 0) {
-        dst.println(lines[i]);
+  void runJob(const Request &req) {
+    switch (req.job) {
+    case StorageJob::DELETE_COLOR:
+    case StorageJob::DELETE_MEASUREMENT: {
+      // Positions from before a compaction name other records now
+      if (req.layout != compactions_) {
+        Serial.printf("[Storage] Delete of %ld dropped: file compacted\n",
+                      (long)req.arg);
+        break;
       }
+      SdLock lock(sdMutex_);
+      if (req.job == StorageJob::DELETE_COLOR) {
+        if (tombstoneColor(req.arg))
+          EventQueue::send(EventType::COLOR_DELETED, req.arg);
+      } else {
+        tombstoneMeasurement(req.arg);
+      }
+    } break;
+    case StorageJob::COMPACT: {
+      SdLock lock(sdMutex_);
+      if (worthCompacting(deadColors_, colorCount_))
+        compactColorLog();
+      if (worthCompacting(deadMeasurements_, measurementCount_))
+        compactMeasurements();
+      compactions_++;
+      compactQueued_ = false;
+    } break;
+    case StorageJob::SAVE_CALIBRATION:
+      writeCalibration();
+      break;
+    case StorageJob::FLUSH:
+      xSemaphoreGive(flushed_); // commit() already ran
+      break;
+    default:
+      break;
     }
-    dst.close();
+  }
 
-    Serial.printf("[Storage] Deleted measurement at index %d\n", lineIndex);
+  bool tombstoneColor(int index) {
+    if (index >= static_cast<int>(colorCount_))
+      return false;
+    File f = SD.open(Config::Storage::COLORS_FILE, "r+");
+    if (!f)
+      return false;
+    ColorLog::Record rec;
+    bool ok = f.seek(ColorLog::offset(index)) &&
+              f.read(reinterpret_cast<uint8_t *>(&rec), sizeof(rec)) ==
+                  sizeof(rec) &&
+              ColorLog::live(rec);
+    if (ok) {
+      ColorLog::markDeleted(rec);
+      ok = f.seek(ColorLog::offset(index)) &&
+           f.write(reinterpret_cast<const uint8_t *>(&rec), sizeof(rec)) ==
+               sizeof(rec);
+    }
+    f.close();
+    if (!ok) {
+      Serial.printf("[Storage] Failed to delete color at index %d\n", index);
+      return false;
+    }
+
+    if (!colorIndex_.remove(static_cast<uint32_t>(index)) &&
+        (rec.flags & ColorLog::HAS_LAB) && unindexedColors_)
+      unindexedColors_--;
+    deadColors_++;
+    colorGeneration_++;
+    Serial.printf("[Storage] Deleted color at index %d\n", index);
     return true;
   }
 
-  bool isInitialized() const { return initialized_; }
+  bool tombstoneMeasurement(int rowIndex) {
+    if (rowIndex >= static_cast<int>(measurementCount_))
+      return false;
+    File f = SD.open(Config::Measure::DATA_FILE, "r+");
+    if (!f)
+      return false;
+    const size_t at = measureOffset(rowIndex) + MEASURE_DELETED_AT;
+    bool ok = f.seek(at) && f.read() == '0' && f.seek(at) &&
+              f.write(static_cast<uint8_t>('1')) == 1;
+    f.close();
+    if (!ok) {
+      Serial.printf("[Storage] Failed to delete measurement at index %d\n",
+                    rowIndex);
+      return false;
+    }
 
-private:
-  StorageManager() : initialized_(false) {}
+    deadMeasurements_++;
+    measurementGeneration_++;
+    Serial.printf("[Storage] Deleted measurement at index %d\n", rowIndex);
+    return true;
+  }
 
+  // Legacy colors.csv row (import only)
   bool parseCsvLine(const String &line, SavedColor &color) {
-    // Parse: timestamp,r,g,b,hex,F1,...,FD
+    // Parse: timestamp,r,g,b,hex,F1,...,FD[,L,a,b[,R400,...,R700]]
+    constexpr int FIRST_RAW = 5;
+    constexpr int FIRST_LAB = FIRST_RAW + Config::Sensor::NUM_CHANNELS;
+    constexpr int FIRST_REFL = FIRST_LAB + 3;
+    constexpr int LAST_REFL = FIRST_REFL + Config::Sensor::SPECTRUM_BANDS - 1;
     int pos = 0;
     int field = 0;
     int start = 0;
+    color.hasLab = false;
+    color.hasSpectrum = false;
+    memset(color.reflectance, 0, sizeof(color.reflectance));
 
-    while (pos <= static_cast<int>(line.length()) && field < 18) {
+    while (pos <= static_cast<int>(line.length()) && field <= LAST_REFL) {
       if (pos == static_cast<int>(line.length()) || line[pos] == ',') {
         String val = line.substring(start, pos);
 
@@ -380,9 +1188,23 @@ private:
         case 4:
           strncpy(color.hex, val.c_str(), sizeof(color.hex) - 1);
           break;
+        case FIRST_LAB:
+          color.L = val.toFloat();
+          break;
+        case FIRST_LAB + 1:
+          color.a_star = val.toFloat();
+          break;
+        case FIRST_LAB + 2:
+          color.b_star = val.toFloat();
+          color.hasLab = true;
+          break;
         default:
-          if (field - 5 < Config::Sensor::NUM_CHANNELS) {
-            color.raw[field - 5] = val.toInt();
+          if (field < FIRST_LAB) {
+            color.raw[field - FIRST_RAW] = val.toInt();
+          } else {
+            color.reflectance[field - FIRST_REFL] = static_cast<uint16_t>(
+                val.toFloat() * SpectralRecon::REFL_SCALE + 0.5f);
+            color.hasSpectrum = field == LAST_REFL;
           }
           break;
         }
@@ -394,20 +1216,85 @@ private:
     return field >= 5; // At minimum need timestamp, RGB, hex
   }
 
-  bool parseMeasurementLine(const String &line, SavedMeasurement &m) {
-    // Parse: timestamp,mm,px
-    int c1 = line.indexOf(',');
-    if (c1 < 0)
-      return false;
-    int c2 = line.indexOf(',', c1 + 1);
-    if (c2 < 0)
-      return false;
+  bool initialized_ = false;
+  ColorIndex colorIndex_;
+  uint32_t colorCount_ = 0; // whole records in the color log
+  uint32_t deadColors_ = 0; // of those, deleted or failing their CRC
+  uint32_t unindexedColors_ = 0; // live, with Lab, not in the index
+  uint32_t measurementCount_ = 0; // rows in the measurements file
+  uint32_t deadMeasurements_ = 0;
+  uint32_t colorGeneration_ = 0;
+  uint32_t measurementGeneration_ = 0;
+  bool measurementsOk_ = false; // file created or converted at init
+
+  // Write-behind (staged batches belong to the storage task)
+  QueueHandle_t jobs_ = nullptr;
+  SemaphoreHandle_t sdMutex_ = nullptr;
+  SemaphoreHandle_t flushMutex_ = nullptr; // one flush() at a time
+  SemaphoreHandle_t flushed_ = nullptr;
+  ColorLog::Record colorBatch_[Config::Storage::BATCH_RECORDS];
+  char measureBatch_[Config::Storage::BATCH_RECORDS][MEASURE_ROW_LEN];
+  int colorBatchCount_ = 0;
+  int measureBatchCount_ = 0;
+  uint32_t firstStagedMs_ = 0;
+  uint32_t compactions_ = 0; // positions change with each
+  volatile bool compactQueued_ = false;
+  SemaphoreHandle_t calibMutex_ = nullptr;
+  CalibrationTable pendingCalib_; // SAVE_CALIBRATION writes the newest
+  bool calibQueued_ = false;      // under calibMutex_
+};
 
-    m.timestamp = line.substring(0, c1).toInt();
-    m.value_mm = line.substring(c1 + 1, c2).toFloat();
-    m.value_px = line.substring(c2 + 1).toInt();
-    return true;
+// ── RecordCursor sources (record_cursor.h) ──────────────────
+struct SavedColors {
+  using Item = SavedColor;
+  static uint32_t records() { return StorageManager::instance().colorCount(); }
+  static uint32_t live() { return StorageManager::instance().liveColorCount(); }
+  static uint32_t generation() {
+    return StorageManager::instance().colorGeneration();
+  }
+  static int read(uint32_t pos, SavedColor *out, int max, uint32_t end) {
+    return StorageManager::instance().readColors(pos, out, max, end);
+  }
+  static int next(uint32_t &pos, SavedColor *out, int max) {
+    return StorageManager::instance().readColors(pos, out, max);
   }
+  static int csvHeader(char *buf, size_t len) {
+    return ColorLog::formatCsvHeader(buf, len);
+  }
+  static int csvRow(const SavedColor &c, char *buf, size_t len) {
+    return ColorLog::formatCsv(c, buf, len);
+  }
+};
 
-  bool initialized_;
+struct SavedMeasurements {
+  using Item = SavedMeasurement;
+  static uint32_t records() {
+    return StorageManager::instance().measurementCount();
+  }
+  static uint32_t live() {
+    return StorageManager::instance().liveMeasurementCount();
+  }
+  static uint32_t generation() {
+    return StorageManager::instance().measurementGeneration();
+  }
+  static int read(uint32_t pos, SavedMeasurement *out, int max, uint32_t end) {
+    return StorageManager::instance().readMeasurements(pos, out, max, end);
+  }
+  static int next(uint32_t &pos, SavedMeasurement *out, int max) {
+    return StorageManager::instance().readMeasurements(pos, out, max);
+  }
+  static int csvHeader(char *buf, size_t len) {
+    return snprintf(buf, len, "timestamp,mm,px\n");
+  }
+  static int csvRow(const SavedMeasurement &m, char *buf, size_t len) {
+    return snprintf(buf, len, "%lu,%.2f,%u\n", (unsigned long)m.timestamp,
+                    m.value_mm, m.value_px);
+  }
 };
+
+using ColorCursor = RecordCursor<SavedColors>;
+using MeasurementCursor = RecordCursor<SavedMeasurements>;
+
+// Streamed CSV downloads (csv_export.h), deleted records left out
+using ColorsCsv = CsvExport<SavedColors, ColorLog::CSV_LINE_MAX>;
+using MeasurementsCsv = CsvExport<SavedMeasurements, 48>;
@@ -9,9 +9,9 @@
 
 #include "config.h"
 #include "display_manager.h"
+#include "palette_db.h"
 #include "sensor_manager.h"
 #include "storage_manager.h"
-#include <vector>
 
 // Connectivity status struct to avoid circular include with ConnectivityManager
 struct ConnStatus {
@@ -173,8 +173,9 @@ inline void drawCalliperMenu(DisplayManager &disp, int selectedIndex) {
 }
 
 // ── Pick Color – Live Measurement ───────────────────────────
+// liveMode: stream label (e.g. "LIVE LED"), nullptr when not streaming
 inline void drawPickColor(DisplayManager &disp, const SpectralData &data,
-                          bool measuring) {
+                          bool measuring, const char *liveMode = nullptr) {
   disp.clear();
 
   auto &c = disp.canvas();
@@ -206,6 +207,10 @@ inline void drawPickColor(DisplayManager &disp, const SpectralData &data,
     c.drawString(buf, 100, 25);
     snprintf(buf, sizeof(buf), "B: %d", data.b);
     c.drawString(buf, 100, 40);
+    if (!data.inGamut) {
+      c.setTextColor(Config::UI::COLOR_WARNING);
+      c.drawString("out of gamut", 150, 40);
+    }
 
     // HEX value
     char hex[8];
@@ -229,12 +234,26 @@ inline void drawPickColor(DisplayManager &disp, const SpectralData &data,
     c.drawString(buf, 10, 80);
   }
 
+  if (liveMode && !measuring) {
+    c.setTextSize(1);
+    c.setTextColor(Config::UI::COLOR_ACCENT);
+    c.drawString(liveMode, 10, 100);
+    c.setTextColor(0x7BEF);
+    c.drawString("Turn: LED/ambient  Press: capture", 10, 115);
+  }
+
   disp.flush();
 }
 
 // ── Pick Result – Save/Discard ──────────────────────────────
+// deltaE00: ΔE2000 to the previous pick, negative if there is none
+// match: closest reference palette color, if a palette is loaded
+// saved: closest saved color, if any
 inline void drawPickResult(DisplayManager &disp, const SpectralData &data,
-                           int selectedAction) {
+                           int selectedAction, float deltaE00 = -1.0f,
+                           const PaletteDb::Match *match = nullptr,
+                           const ColorIndex::Hit *saved = nullptr,
+                           uint32_t unindexed = 0) {
   disp.clear();
 
   auto &c = disp.canvas();
@@ -254,6 +273,49 @@ inline void drawPickResult(DisplayManager &disp, const SpectralData &data,
   snprintf(buf, sizeof(buf), "RGB(%d, %d, %d)", data.r, data.g, data.b);
   c.drawString(buf, 120, 40);
 
+  c.setTextColor(0xB596);
+  snprintf(buf, sizeof(buf), "Lab %.1f %.1f %.1f", data.L, data.a_star,
+           data.b_star);
+  c.drawString(buf, 120, 51);
+  snprintf(buf, sizeof(buf), "LCh %.1f %.1f %.0f", data.L, data.C_star,
+           data.h_ab);
+  c.drawString(buf, 120, 62);
+  if (deltaE00 >= 0.0f) {
+    snprintf(buf, sizeof(buf), "dE00 prev %.2f", deltaE00);
+    c.drawString(buf, 120, 73);
+  }
+
+  // Closest reference color, under the swatch
+  if (match) {
+    disp.drawColorSwatch(10, 86, 14, 14, match->toRGB565());
+    c.setTextColor(TFT_WHITE);
+    snprintf(buf, sizeof(buf), "%.14s", match->name);
+    c.drawString(buf, 28, 86);
+    c.setTextColor(0xB596);
+    snprintf(buf, sizeof(buf), "dE00 %.2f", match->deltaE * 0.01f);
+    c.drawString(buf, 28, 96);
+  }
+
+  // Closest saved color
+  if (saved) {
+    uint16_t rgb565 =
+        ((saved->r & 0xF8) << 8) | ((saved->g & 0xFC) << 3) | (saved->b >> 3);
+    disp.drawColorSwatch(10, 110, 14, 14, rgb565);
+    c.setTextColor(TFT_WHITE);
+    snprintf(buf, sizeof(buf), "Saved #%02X%02X%02X", saved->r, saved->g,
+             saved->b);
+    c.drawString(buf, 28, 110);
+    c.setTextColor(0xB596);
+    snprintf(buf, sizeof(buf), "dE00 %.2f", saved->deltaE * 0.01f);
+    c.drawString(buf, 28, 120);
+  }
+  // Saved colors the search could not see
+  if (unindexed) {
+    c.setTextColor(0xB596);
+    snprintf(buf, sizeof(buf), "%lu not searched", (unsigned long)unindexed);
+    c.drawString(buf, 10, 132);
+  }
+
   // Action buttons
   const char *actions[] = {"Save Color", "Discard", "Measure Again"};
   for (int i = 0; i < 3; i++) {
@@ -271,35 +333,34 @@ inline void drawPickResult(DisplayManager &disp, const SpectralData &data,
 }
 
 // ── Saved Colors List ───────────────────────────────────────
-inline void drawSavedColorsList(DisplayManager &disp,
-                                const std::vector<SavedColor> &colors,
-                                int selectedIndex, int scrollOffset) {
+// rows[0..rowCount) are list rows scrollOffset.. of `total`
+inline void drawSavedColorsList(DisplayManager &disp, const SavedColor *rows,
+                                int rowCount, int total, int selectedIndex,
+                                int scrollOffset) {
   disp.clear();
 
   auto &c = disp.canvas();
 
-  if (colors.empty()) {
+  if (total == 0) {
     c.setTextColor(0x7BEF);
     c.setTextSize(2);
     c.drawString("No colors saved", 60, 40);
     c.setTextSize(1);
     c.drawString("Go to Pick Color to start", 70, 70);
   } else {
-    int visibleItems = 6;
-    int startIdx = scrollOffset;
-    int endIdx = min(startIdx + visibleItems, (int)colors.size());
+    int visibleItems = Config::UI::LIST_ROWS;
 
-    for (int i = startIdx; i < endIdx; i++) {
-      int row = i - startIdx;
+    for (int row = 0; row < rowCount; row++) {
+      const SavedColor &color = rows[row];
       int y = row * Config::UI::MENU_ITEM_HEIGHT;
-      bool sel = (i == selectedIndex);
+      bool sel = (scrollOffset + row == selectedIndex);
 
       uint16_t bg = sel ? Config::UI::COLOR_SELECTED : Config::UI::COLOR_BG;
       c.fillRect(0, y, Config::LCD::WIDTH, Config::UI::MENU_ITEM_HEIGHT, bg);
 
       // Color swatch
-      uint16_t swatch = ((colors[i].r & 0xF8) << 8) |
-                        ((colors[i].g & 0xFC) << 3) | (colors[i].b >> 3);
+      uint16_t swatch = ((color.r & 0xF8) << 8) | ((color.g & 0xFC) << 3) |
+                        (color.b >> 3);
       c.fillRoundRect(8, y + 4, 20, 20, 3, swatch);
       c.drawRoundRect(8, y + 4, 20, 20, 3, TFT_WHITE);
 
@@ -308,17 +369,17 @@ inline void drawSavedColorsList(DisplayManager &disp,
       c.setTextSize(1);
 
       char buf[48];
-      snprintf(buf, sizeof(buf), "%s  R:%d G:%d B:%d", colors[i].hex,
-               colors[i].r, colors[i].g, colors[i].b);
+      snprintf(buf, sizeof(buf), "%s  R:%d G:%d B:%d", color.hex, color.r,
+               color.g, color.b);
       c.drawString(buf, 36, y + 8);
     }
 
     // Scroll indicator
-    if ((int)colors.size() > visibleItems) {
+    if (total > visibleItems) {
       int barHeight = Config::LCD::HEIGHT;
-      int thumbHeight = max(10, barHeight * visibleItems / (int)colors.size());
+      int thumbHeight = max(10, barHeight * visibleItems / total);
       int thumbY = (barHeight - thumbHeight) * scrollOffset /
-                   max(1, (int)colors.size() - visibleItems);
+                   max(1, total - visibleItems);
 
       c.fillRect(Config::LCD::WIDTH - 4, 0, 4, barHeight, 0x2104);
       c.fillRect(Config::LCD::WIDTH - 4, thumbY, 4, thumbHeight,
@@ -467,7 +528,7 @@ inline void drawCalibCapture(DisplayManager &disp, const char *type,
 
     c.setTextSize(1);
     c.setTextColor(TFT_WHITE);
-    c.drawString("Hold steady - averaging 10 samples", 40, 100);
+    c.drawString("Hold steady - averaging samples", 40, 100);
   } else {
     c.setTextColor(TFT_WHITE);
     c.setTextSize(1);
@@ -659,28 +720,27 @@ inline void drawMeasureResult(DisplayManager &disp, float mm, uint16_t px,
 }
 
 // ── Measurements List ───────────────────────────────────────
+// rows[0..rowCount) are list rows scrollOffset.. of `total`
 inline void drawMeasurementsList(DisplayManager &disp,
-                                 const std::vector<SavedMeasurement> &measurements,
-                                 int selectedIndex, int scrollOffset) {
+                                 const SavedMeasurement *rows, int rowCount,
+                                 int total, int selectedIndex,
+                                 int scrollOffset) {
   disp.clear();
 
   auto &c = disp.canvas();
 
-  if (measurements.empty()) {
+  if (total == 0) {
     c.setTextColor(0x7BEF);
     c.setTextSize(2);
     c.drawString("No measurements", 60, 40);
     c.setTextSize(1);
     c.drawString("Go to Measure to start", 80, 70);
   } else {
-    int visibleItems = 6;
-    int startIdx = scrollOffset;
-    int endIdx = min(startIdx + visibleItems, (int)measurements.size());
+    int visibleItems = Config::UI::LIST_ROWS;
 
-    for (int i = startIdx; i < endIdx; i++) {
-      int row = i - startIdx;
+    for (int row = 0; row < rowCount; row++) {
       int y = row * Config::UI::MENU_ITEM_HEIGHT;
-      bool sel = (i == selectedIndex);
+      bool sel = (scrollOffset + row == selectedIndex);
 
       uint16_t bg = sel ? Config::UI::COLOR_SELECTED : Config::UI::COLOR_BG;
       c.fillRect(0, y, Config::LCD::WIDTH, Config::UI::MENU_ITEM_HEIGHT, bg);
@@ -690,23 +750,22 @@ inline void drawMeasurementsList(DisplayManager &disp,
 
       char buf[48];
       // Format: value in mm + timestamp as seconds
-      unsigned long ts = measurements[i].timestamp;
+      unsigned long ts = rows[row].timestamp;
       unsigned long sec = ts / 1000;
       unsigned long h = (sec / 3600) % 24;
       unsigned long m = (sec / 60) % 60;
       unsigned long s = sec % 60;
       snprintf(buf, sizeof(buf), "%.1f mm          %02lu:%02lu:%02lu",
-               measurements[i].value_mm, h, m, s);
+               rows[row].value_mm, h, m, s);
       c.drawString(buf, 16, y + 8);
     }
 
     // Scroll indicator
-    if ((int)measurements.size() > visibleItems) {
+    if (total > visibleItems) {
       int barHeight = Config::LCD::HEIGHT;
-      int thumbHeight =
-          max(10, barHeight * visibleItems / (int)measurements.size());
+      int thumbHeight = max(10, barHeight * visibleItems / total);
       int thumbY = (barHeight - thumbHeight) * scrollOffset /
-                   max(1, (int)measurements.size() - visibleItems);
+                   max(1, total - visibleItems);
 
       c.fillRect(Config::LCD::WIDTH - 4, 0, 4, barHeight, 0x2104);
       c.fillRect(Config::LCD::WIDTH - 4, thumbY, 4, thumbHeight,
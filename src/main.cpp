@@ -4,7 +4,9 @@
 // Architecture: Arduino framework on ESP32-C6 (RISC-V)
 // Uses FreeRTOS tasks for:
 //   - UI rendering & event processing (main task)
+//   - Sensor acquisition (owns I²C, woken by the AS7343 INT pin)
 //   - Input polling (high-priority task for long-press)
+//   - Storage (write-behind: batches queued saves to the SD card)
 //   - Connectivity (WiFi/BLE, lowest priority)
 //
 // The encoder rotation is interrupt-driven (ISR).
@@ -23,6 +25,14 @@ void taskApp(void *param) {
   AppController::instance().run(); // Never returns
 }
 
+// ── FreeRTOS Task: Sensor Acquisition ───────────────────────
+// Runs queued measurement/calibration jobs; results are posted
+// back to the app task as events.
+void taskSensor(void *param) {
+  (void)param;
+  SensorManager::instance().run(); // Never returns
+}
+
 // ── FreeRTOS Task: Input Polling ────────────────────────────
 // Polls encoder pins + button at ~500 Hz for reliable edge detection.
 void taskInput(void *param) {
@@ -33,6 +43,14 @@ void taskInput(void *param) {
   }
 }
 
+// ── FreeRTOS Task: Storage ──────────────────────────────────
+// Commits queued saves in batches and runs deletes/compaction; the
+// UI never waits on the SD card.
+void taskStorage(void *param) {
+  (void)param;
+  StorageManager::instance().run(); // Never returns
+}
+
 // ── FreeRTOS Task: Connectivity ─────────────────────────────
 // Handles WiFi/BLE communication at low priority.
 void taskConnectivity(void *param) {
@@ -72,10 +90,20 @@ void setup() {
                           nullptr, Config::System::TASK_PRIORITY_UI, nullptr,
                           Config::System::CORE_UI);
 
+  xTaskCreatePinnedToCore(taskSensor, "sensor",
+                          Config::System::TASK_STACK_SENSOR, nullptr,
+                          Config::System::TASK_PRIORITY_SENSOR, nullptr,
+                          Config::System::CORE_OTHER);
+
   xTaskCreatePinnedToCore(taskInput, "input", Config::System::TASK_STACK_INPUT,
                           nullptr, Config::System::TASK_PRIORITY_INPUT, nullptr,
                           Config::System::CORE_OTHER);
 
+  xTaskCreatePinnedToCore(taskStorage, "storage",
+                          Config::System::TASK_STACK_STORAGE, nullptr,
+                          Config::System::TASK_PRIORITY_STORAGE, nullptr,
+                          Config::System::CORE_OTHER);
+
   xTaskCreatePinnedToCore(
       taskConnectivity, "conn", Config::System::TASK_STACK_CONNECTIVITY,
       nullptr, Config::System::TASK_PRIORITY_CONNECTIVITY, nullptr,
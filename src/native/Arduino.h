@@ -0,0 +1,46 @@
+#pragma once
+// ============================================================
+// Arduino.h – Minimal host stand-in for the native build
+//
+// Only what the hardware-independent headers use (config.h,
+// spectral_pipeline.h, color_engine.h …): fixed-width types,
+// millis() and Serial logging to stdout.
+// ============================================================
+
+#include <chrono>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+inline uint32_t millis() {
+  static const auto start = std::chrono::steady_clock::now();
+  return static_cast<uint32_t>(
+      std::chrono::duration_cast<std::chrono::milliseconds>(
+          std::chrono::steady_clock::now() - start)
+          .count());
+}
+
+struct HostSerial {
+  bool quiet = false; // drop log output (benchmarks)
+
+  int printf(const char *fmt, ...) __attribute__((format(printf, 2, 3))) {
+    if (quiet)
+      return 0;
+    va_list args;
+    va_start(args, fmt);
+    int n = vprintf(fmt, args);
+    va_end(args);
+    return n;
+  }
+  void print(const char *s) {
+    if (!quiet)
+      fputs(s, stdout);
+  }
+  void println(const char *s = "") {
+    if (!quiet)
+      puts(s);
+  }
+};
+
+inline HostSerial Serial;
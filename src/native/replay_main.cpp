@@ -0,0 +1,195 @@
+// ============================================================
+// replay_main.cpp – Native host replay / regression benchmark
+//
+//   pio run -e native
+//   .pio/build/native/program colors.csv [--speed 1] [--gray N]
+//                             [--reps N] [--preview] [--dump]
+//
+// Drives the device pipeline (spectral_pipeline.h) from a recorded
+// colors.csv trace (replay_source.h):
+//   1. calibration: dark (LED off) + gray from row --gray
+//   2. stream: every row as a free-running frame, auto-exposure on
+//      (--preview: 6-channel preview profile)
+//   3. measure: every row as a held target (auto-exposure +
+//      sequential sampling)
+//   4. engine: float vs fixed ColorEngine::process per frame, with
+//      the largest disagreement between the two (color and spectrum)
+// --dump prints one line per streamed frame for diffing runs.
+// x86 has an FPU, so the engine timings show relative cost only;
+// the soft-float gap on the ESP32-C6 is much wider.
+// ============================================================
+
+#include "color_engine.h"
+#include "color_lab.h"
+#include "replay_source.h"
+#include "spectral_pipeline.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double elapsedUs(Clock::time_point start) {
+  return std::chrono::duration<double, std::micro>(Clock::now() - start)
+      .count();
+}
+
+int usage() {
+  fprintf(stderr, "usage: replay <colors.csv> [--speed S] [--gray ROW] "
+                  "[--reps N] [--preview] [--dump]\n");
+  return 2;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  if (argc < 2)
+    return usage();
+  const char *path = argv[1];
+  float speed = 0; // flat out unless asked for the recorded timing
+  int grayRow = 0;
+  int reps = 200;
+  bool dump = false;
+  SmuxProfile streamProfile = SmuxProfile::FULL;
+  for (int i = 2; i < argc; i++) {
+    if (!strcmp(argv[i], "--speed") && i + 1 < argc)
+      speed = strtof(argv[++i], nullptr);
+    else if (!strcmp(argv[i], "--gray") && i + 1 < argc)
+      grayRow = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--reps") && i + 1 < argc)
+      reps = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--preview"))
+      streamProfile = SmuxProfile::PREVIEW;
+    else if (!strcmp(argv[i], "--dump"))
+      dump = true;
+    else
+      return usage();
+  }
+
+  ReplaySource source(speed);
+  size_t rows = source.load(path);
+  if (rows == 0) {
+    fprintf(stderr, "[Replay] no frames in %s\n", path);
+    return 1;
+  }
+  if (grayRow < 0 || (size_t)grayRow >= rows)
+    grayRow = 0;
+  printf("[Replay] %zu frames from %s (%s color engine)\n", rows, path,
+         Config::Color::FIXED_POINT ? "fixed-point" : "float");
+
+  SpectralPipeline pipeline(source);
+  if (!pipeline.begin())
+    return 1;
+
+  // ── 1. Calibration ────────────────────────────────────────
+  auto t0 = Clock::now();
+  source.hold(grayRow);
+  bool calOk = pipeline.captureDarkReference() &&
+               pipeline.captureGrayReference();
+  source.hold(-1);
+  if (!calOk) {
+    fprintf(stderr, "[Replay] calibration failed\n");
+    return 1;
+  }
+  printf("[Replay] calibration: %.1f ms (gray = row %d)\n",
+         elapsedUs(t0) / 1000, grayRow);
+
+  // ── 2. Stream ─────────────────────────────────────────────
+  source.rewind();
+  SpectralData data;
+  uint32_t frames = 0, exposureChanges = 0;
+  Exposure last = pipeline.exposure();
+  t0 = Clock::now();
+  while (!source.exhausted() &&
+         pipeline.streamFrame(data, true, streamProfile)) {
+    if (dump) {
+      char hex[8];
+      data.toHexString(hex, sizeof(hex));
+      printf("%u %s L %.2f a %.2f b %.2f gain %u astep %u%s\n",
+             (unsigned)frames, hex, data.L, data.a_star, data.b_star,
+             (unsigned)data.exposure.gainIndex,
+             (unsigned)data.exposure.astep, data.saturated ? " SAT" : "");
+    }
+    if (pipeline.exposure() != last)
+      exposureChanges++;
+    last = pipeline.exposure();
+    frames++;
+  }
+  pipeline.stopStream();
+  double streamUs = elapsedUs(t0);
+  printf("[Replay] stream (%s): %u frames, %u exposure changes, "
+         "%.2f us/frame\n",
+         streamProfile == SmuxProfile::PREVIEW ? "preview" : "full",
+         (unsigned)frames, (unsigned)exposureChanges,
+         frames ? streamUs / frames : 0.0);
+
+  // ── 3. Measure ────────────────────────────────────────────
+  uint32_t measured = 0, samples = 0;
+  t0 = Clock::now();
+  for (size_t i = 0; i < rows; i++) {
+    source.hold(static_cast<int>(i));
+    if (pipeline.measure(data, true)) {
+      measured++;
+      samples += data.samples;
+    }
+  }
+  source.hold(-1);
+  double measureUs = elapsedUs(t0);
+  printf("[Replay] measure: %u/%zu ok, %.2f samples avg, %.2f us/measurement\n",
+         (unsigned)measured, rows, measured ? (double)samples / measured : 0.0,
+         measured ? measureUs / measured : 0.0);
+
+  // ── 4. Float vs fixed engine ──────────────────────────────
+  const ColorEngine::Coefficients &k = pipeline.coefficients();
+  std::vector<SpectralData> in(rows);
+  for (size_t i = 0; i < rows; i++) {
+    memset(&in[i], 0, sizeof(SpectralData));
+    memcpy(in[i].raw, source.frames()[i].raw, sizeof(in[i].raw));
+    in[i].exposure = k.exposure;
+  }
+
+  int maxRgb = 0;
+  int maxDe = 0;
+  int maxRefl = 0;
+  uint32_t sink = 0;
+  for (size_t i = 0; i < rows; i++) {
+    SpectralData f = in[i], q = in[i];
+    ColorEngine::Float::process(k, f);
+    ColorEngine::Fixed::process(k, q);
+    maxRgb = std::max({maxRgb, abs(f.r - q.r), abs(f.g - q.g), abs(f.b - q.b)});
+    int de = ColorLab::deltaE2000(ColorLab::fromFloat(f.L, f.a_star, f.b_star),
+                                  ColorLab::fromFloat(q.L, q.a_star, q.b_star));
+    maxDe = std::max(maxDe, de);
+    for (int b = 0; f.hasSpectrum && b < Config::Sensor::SPECTRUM_BANDS; b++)
+      maxRefl = std::max(maxRefl, abs(f.reflectance[b] - q.reflectance[b]));
+  }
+
+  t0 = Clock::now();
+  for (int r = 0; r < reps; r++) {
+    for (size_t i = 0; i < rows; i++) {
+      SpectralData d = in[i];
+      ColorEngine::Float::process(k, d);
+      sink += d.r;
+    }
+  }
+  double floatNs = elapsedUs(t0) * 1000 / ((double)reps * rows);
+
+  t0 = Clock::now();
+  for (int r = 0; r < reps; r++) {
+    for (size_t i = 0; i < rows; i++) {
+      SpectralData d = in[i];
+      ColorEngine::Fixed::process(k, d);
+      sink += d.r;
+    }
+  }
+  double fixedNs = elapsedUs(t0) * 1000 / ((double)reps * rows);
+
+  printf("[Replay] engine: float %.0f ns/frame, fixed %.0f ns/frame, "
+         "max dRGB %d, max dE00 %.2f, max dR %.4f (%u)\n",
+         floatNs, fixedNs, maxRgb, maxDe * 0.01,
+         maxRefl / (double)SpectralRecon::REFL_SCALE, (unsigned)(sink & 1));
+  return 0;
+}
@@ -0,0 +1,288 @@
+// ============================================================
+// colorlog_bench.cpp – Host benchmark: color log vs colors.csv
+//
+//   pio run -e colorlog_bench
+//   .pio/build/colorlog_bench/program [dir]
+//
+// Writes the same synthetic colors (500 and 50,000) as a CSV file
+// in the export format and as a binary color log (color_log.h) to
+// `dir` (default /tmp), then times
+//   - load: every row into SavedColor – CSV split into per-field
+//     strings and converted as the old StorageManager::loadColors
+//     did, the log read READ_CHUNK records at a time and CRC-checked
+//   - random read: one color by position – a line scan for CSV,
+//     one seek for the log
+// Files are read through the OS cache, so the numbers show parse
+// and access cost, not SD bandwidth. On the device the CSV side is
+// slower still: Arduino String allocates on the heap for every
+// field, std::string here mostly does not.
+// ============================================================
+
+#include "color_log.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+namespace {
+
+constexpr int READ_CHUNK = 8; // as StorageManager
+constexpr int RANDOM_READS = 200;
+constexpr int REPEAT = 3; // best of
+
+using Clock = std::chrono::steady_clock;
+
+double elapsedMs(Clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(Clock::now() - start)
+      .count();
+}
+
+uint32_t lcg(uint32_t &seed) {
+  seed = seed * 1664525u + 1013904223u;
+  return seed >> 8;
+}
+
+std::vector<SavedColor> makeColors(int n) {
+  std::vector<SavedColor> colors(n);
+  uint32_t seed = 0x2468ACE1;
+  for (int i = 0; i < n; i++) {
+    SavedColor &c = colors[i];
+    c.timestamp = 1700000000u + i * 37u;
+    c.r = lcg(seed) & 0xFF;
+    c.g = lcg(seed) & 0xFF;
+    c.b = lcg(seed) & 0xFF;
+    snprintf(c.hex, sizeof(c.hex), "#%02X%02X%02X", c.r, c.g, c.b);
+    for (int ch = 0; ch < Config::Sensor::NUM_CHANNELS; ch++)
+      c.raw[ch] = lcg(seed) & 0xFFFF;
+    // Centi-unit Lab, so both files hold the same values
+    c.L = (lcg(seed) % 10000) * 0.01f;
+    c.a_star = (static_cast<int>(lcg(seed) % 20000) - 10000) * 0.01f;
+    c.b_star = (static_cast<int>(lcg(seed) % 20000) - 10000) * 0.01f;
+    c.hasLab = true;
+    c.hasSpectrum = true;
+    for (int k = 0; k < Config::Sensor::SPECTRUM_BANDS; k++)
+      c.reflectance[k] = lcg(seed) % SpectralRecon::REFL_SCALE;
+    c.index = i;
+  }
+  return colors;
+}
+
+bool writeCsv(const char *path, const std::vector<SavedColor> &colors) {
+  FILE *f = fopen(path, "w");
+  if (!f)
+    return false;
+  char line[ColorLog::CSV_LINE_MAX];
+  fwrite(line, 1, ColorLog::formatCsvHeader(line, sizeof(line)), f);
+  for (const SavedColor &c : colors)
+    fwrite(line, 1, ColorLog::formatCsv(c, line, sizeof(line)), f);
+  return fclose(f) == 0;
+}
+
+bool writeLog(const char *path, const std::vector<SavedColor> &colors) {
+  FILE *f = fopen(path, "wb");
+  if (!f)
+    return false;
+  ColorLog::Header h = ColorLog::makeHeader();
+  fwrite(&h, sizeof(h), 1, f);
+  ColorLog::Record rec;
+  for (const SavedColor &c : colors) {
+    ColorLog::encode(c, rec);
+    fwrite(&rec, sizeof(rec), 1, f);
+  }
+  return fclose(f) == 0;
+}
+
+long fileSize(const char *path) {
+  FILE *f = fopen(path, "rb");
+  if (!f)
+    return 0;
+  fseek(f, 0, SEEK_END);
+  long n = ftell(f);
+  fclose(f);
+  return n;
+}
+
+// ── CSV: line → per-field strings → numbers ─────────────────
+bool readLine(FILE *f, std::string &line) {
+  line.clear();
+  int ch;
+  while ((ch = fgetc(f)) != EOF && ch != '\n')
+    line.push_back(static_cast<char>(ch));
+  return ch != EOF || !line.empty();
+}
+
+bool parseCsvLine(const std::string &line, SavedColor &c) {
+  constexpr int FIRST_RAW = 5;
+  constexpr int FIRST_LAB = FIRST_RAW + Config::Sensor::NUM_CHANNELS;
+  constexpr int FIRST_REFL = FIRST_LAB + 3;
+  constexpr int LAST_REFL = FIRST_REFL + Config::Sensor::SPECTRUM_BANDS - 1;
+  int field = 0;
+  size_t start = 0;
+  c.hasLab = c.hasSpectrum = false;
+  for (size_t pos = 0; pos <= line.size() && field <= LAST_REFL; pos++) {
+    if (pos != line.size() && line[pos] != ',')
+      continue;
+    std::string val = line.substr(start, pos - start);
+    if (field == 0)
+      c.timestamp = strtoul(val.c_str(), nullptr, 10);
+    else if (field <= 3)
+      (&c.r)[field - 1] = atoi(val.c_str());
+    else if (field == 4)
+      snprintf(c.hex, sizeof(c.hex), "%s", val.c_str());
+    else if (field < FIRST_LAB)
+      c.raw[field - FIRST_RAW] = atoi(val.c_str());
+    else if (field < FIRST_REFL)
+      (&c.L)[field - FIRST_LAB] = atof(val.c_str());
+    else
+      c.reflectance[field - FIRST_REFL] =
+          atof(val.c_str()) * SpectralRecon::REFL_SCALE + 0.5f;
+    c.hasLab = field >= FIRST_LAB + 2;
+    c.hasSpectrum = field == LAST_REFL;
+    field++;
+    start = pos + 1;
+  }
+  return field >= 5;
+}
+
+size_t loadCsv(const char *path, std::vector<SavedColor> &colors) {
+  colors.clear();
+  FILE *f = fopen(path, "r");
+  if (!f)
+    return 0;
+  std::string line;
+  readLine(f, line); // header
+  SavedColor c;
+  while (readLine(f, line)) {
+    if (!line.empty() && parseCsvLine(line, c)) {
+      c.index = static_cast<int>(colors.size());
+      colors.push_back(c);
+    }
+  }
+  fclose(f);
+  return colors.size();
+}
+
+bool readCsvRow(FILE *f, int index, SavedColor &c) {
+  rewind(f);
+  std::string line;
+  readLine(f, line); // header
+  for (int i = 0; i < index; i++)
+    if (!readLine(f, line))
+      return false;
+  return readLine(f, line) && parseCsvLine(line, c);
+}
+
+// ── Color log ───────────────────────────────────────────────
+size_t loadLog(const char *path, std::vector<SavedColor> &colors) {
+  colors.clear();
+  FILE *f = fopen(path, "rb");
+  if (!f)
+    return 0;
+  ColorLog::Header h;
+  if (fread(&h, sizeof(h), 1, f) != 1 || !ColorLog::headerValid(h)) {
+    fclose(f);
+    return 0;
+  }
+  ColorLog::Record chunk[READ_CHUNK];
+  SavedColor c;
+  size_t n;
+  uint32_t index = 0;
+  while ((n = fread(chunk, sizeof(chunk[0]), READ_CHUNK, f)) > 0) {
+    for (size_t j = 0; j < n; j++, index++) {
+      if (ColorLog::decode(chunk[j], c)) {
+        c.index = index;
+        colors.push_back(c);
+      }
+    }
+  }
+  fclose(f);
+  return colors.size();
+}
+
+bool readLogRecord(FILE *f, uint32_t index, SavedColor &c) {
+  ColorLog::Record rec;
+  return fseek(f, ColorLog::offset(index), SEEK_SET) == 0 &&
+         fread(&rec, sizeof(rec), 1, f) == 1 && ColorLog::decode(rec, c);
+}
+
+bool sameColor(const SavedColor &a, const SavedColor &b) {
+  return a.timestamp == b.timestamp && a.r == b.r && a.g == b.g &&
+         a.b == b.b && memcmp(a.raw, b.raw, sizeof(a.raw)) == 0 &&
+         lroundf(a.L * 100) == lroundf(b.L * 100) &&
+         lroundf(a.a_star * 100) == lroundf(b.a_star * 100) &&
+         lroundf(a.b_star * 100) == lroundf(b.b_star * 100) &&
+         memcmp(a.reflectance, b.reflectance, sizeof(a.reflectance)) == 0;
+}
+
+bool run(const std::string &dir, int n) {
+  const std::string csvPath = dir + "/colorlog_bench.csv";
+  const std::string logPath = dir + "/colorlog_bench.bin";
+  const std::vector<SavedColor> colors = makeColors(n);
+  if (!writeCsv(csvPath.c_str(), colors) ||
+      !writeLog(logPath.c_str(), colors)) {
+    fprintf(stderr, "cannot write to %s\n", dir.c_str());
+    return false;
+  }
+
+  std::vector<SavedColor> fromCsv, fromLog;
+  double csvMs = 1e30, logMs = 1e30;
+  for (int r = 0; r < REPEAT; r++) {
+    Clock::time_point t = Clock::now();
+    loadCsv(csvPath.c_str(), fromCsv);
+    csvMs = std::min(csvMs, elapsedMs(t));
+    t = Clock::now();
+    loadLog(logPath.c_str(), fromLog);
+    logMs = std::min(logMs, elapsedMs(t));
+  }
+
+  int mismatches = 0;
+  if (fromCsv.size() != colors.size() || fromLog.size() != colors.size()) {
+    mismatches = n;
+  } else {
+    for (int i = 0; i < n; i++)
+      mismatches += !sameColor(fromCsv[i], colors[i]) ||
+                    !sameColor(fromLog[i], colors[i]);
+  }
+
+  // Random reads by position
+  FILE *csv = fopen(csvPath.c_str(), "r");
+  FILE *log = fopen(logPath.c_str(), "rb");
+  uint32_t seed = 7;
+  SavedColor c;
+  Clock::time_point t = Clock::now();
+  for (int i = 0; i < RANDOM_READS; i++)
+    mismatches += !readCsvRow(csv, lcg(seed) % n, c);
+  double csvReadUs = elapsedMs(t) * 1000.0 / RANDOM_READS;
+  seed = 7;
+  t = Clock::now();
+  for (int i = 0; i < RANDOM_READS; i++) {
+    uint32_t index = lcg(seed) % n;
+    mismatches += !readLogRecord(log, index, c) || !sameColor(c, colors[index]);
+  }
+  double logReadUs = elapsedMs(t) * 1000.0 / RANDOM_READS;
+  fclose(csv);
+  fclose(log);
+
+  printf("[Bench] %6d colors: CSV %7.1f KB, log %7.1f KB\n", n,
+         fileSize(csvPath.c_str()) / 1024.0, fileSize(logPath.c_str()) / 1024.0);
+  printf("[Bench]   load:        CSV %9.2f ms, log %8.2f ms (%.1fx)\n", csvMs,
+         logMs, csvMs / logMs);
+  printf("[Bench]   random read: CSV %9.1f us, log %8.2f us (%.0fx)\n",
+         csvReadUs, logReadUs, csvReadUs / logReadUs);
+  printf("[Bench]   round trip:  %d mismatches\n", mismatches);
+  remove(csvPath.c_str());
+  remove(logPath.c_str());
+  return mismatches == 0;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  const std::string dir = argc > 1 ? argv[1] : "/tmp";
+  bool ok = run(dir, 500);
+  ok = run(dir, 50000) && ok;
+  return ok ? 0 : 1;
+}
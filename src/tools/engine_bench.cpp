@@ -0,0 +1,82 @@
+// ============================================================
+// engine_bench.cpp – Host benchmark: float vs Q16 color engine
+//
+//   pio run -e engine_bench
+//   .pio/build/engine_bench/program [frames]
+//
+// Runs ColorEngine::benchmark() (color_engine.h) – the same loop
+// the firmware runs at boot with -DCOLOR_ENGINE_SELFTEST, there in
+// CPU cycles – over `frames` synthetic frames (default 20,000) with
+// dark + gray calibration, best of REPEAT, and ColorEngine::selfTest()
+// for the agreement between the two paths. Exits non-zero if the
+// self-test fails: the LUT encoder disagrees with the float one, or
+// the paths differ by more than Config::Color::SELFTEST_MAX_*.
+//
+// x86 has an FPU, so here the float path runs in hardware and the
+// timings show the integer path's own cost, not the saving: on the
+// FPU-less ESP32-C6 every float op in the float path is a soft-float
+// call. Read the device's boot log line for the cycle counts.
+// ============================================================
+
+#include "color_engine.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+namespace {
+
+constexpr int REPEAT = 5; // best of
+
+uint32_t nowNs() {
+  static const auto start = std::chrono::steady_clock::now();
+  return static_cast<uint32_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::steady_clock::now() - start)
+          .count());
+}
+
+// Dark ~1% and gray ~30% of full scale at 256x / 50 ms, as a
+// typical calibration
+ColorEngine::Coefficients calibrated() {
+  CalibrationData cal = {};
+  cal.exposure = {8, 29, 599};
+  cal.hasDark = cal.hasGray = true;
+  for (int ch = 0; ch < Config::Sensor::NUM_CHANNELS; ch++) {
+    cal.darkRef[ch] = 120.0f + 7 * ch;
+    cal.grayRef[ch] = 14000.0f + 900 * ch;
+  }
+  ColorEngine::Coefficients k;
+  ColorEngine::prepare(cal, k);
+  return k;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  const uint32_t frames = argc > 1 ? strtoul(argv[1], nullptr, 10) : 20000;
+  const ColorEngine::Coefficients k = calibrated();
+
+  uint32_t floatNs = UINT32_MAX, fixedNs = UINT32_MAX;
+  for (int r = 0; r < REPEAT; r++) {
+    ColorEngine::BenchResult b = ColorEngine::benchmark(k, nowNs, frames);
+    floatNs = std::min(floatNs, b.floatPerFrame);
+    fixedNs = std::min(fixedNs, b.fixedPerFrame);
+  }
+  ColorEngine::SelfTestResult st = ColorEngine::selfTest(k, frames);
+
+  printf("[Bench] color engine, %u frames (%s path in firmware)\n", frames,
+         Config::Color::FIXED_POINT ? "fixed" : "float");
+  printf("[Bench]   float %5u ns/frame, fixed %5u ns/frame (%.2fx, "
+         "hardware float)\n",
+         floatNs, fixedNs, fixedNs ? (double)floatNs / fixedNs : 0.0);
+  printf("[Bench]   agreement: %u encode mismatches, %u/%u frames differ, "
+         "max dRGB %d, max dE00 %.2f, max dR %.4f\n",
+         st.encodeMismatches, st.frameMismatches, st.frames, st.maxRgbDelta,
+         st.maxDeltaE00 * 0.01,
+         st.maxReflDelta / (double)SpectralRecon::REFL_SCALE);
+  printf("[Bench]   self-test %s (limits dRGB %d, dE00 %.2f)\n",
+         st.passed() ? "passed" : "FAILED", Config::Color::SELFTEST_MAX_DRGB,
+         Config::Color::SELFTEST_MAX_DE00 * 0.01);
+  return st.passed() ? 0 : 1;
+}
@@ -0,0 +1,331 @@
+// ============================================================
+// palette_build.cpp – Host tool: reference palette CSV → flash image
+//
+//   pio run -e palette_build
+//   .pio/build/palette_build/program colors.csv palette.bin
+//                                    [--title NAME] [--verify]
+//   esptool.py write_flash 0x400000 palette.bin
+//
+// Input: one color per line, header and blank lines skipped,
+// names may be "quoted" (embedded commas):
+//   name,#RRGGBB              sRGB, converted to Lab (D65)
+//   name,L,a,b                CIE Lab (D65)
+//   name,#RRGGBB,L,a,b        measured Lab + display color
+// Output: the image read by palette_db.h – records laid out as an
+// implicit balanced k-d tree (each node splits its range at the
+// median of the axis with the largest spread), then the names.
+// --verify maps the image through PaletteDb and checks that every
+// entry finds itself (or an identical-Lab twin) and that random
+// lookups match an exhaustive ΔE00 scan, and times lookups.
+// ============================================================
+
+#include "color_lab.h"
+#include "palette_db.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct Entry {
+  std::string name;
+  PaletteFormat::Record rec;
+};
+
+int usage() {
+  fprintf(stderr, "usage: palette_build <in.csv> <out.bin> [--title NAME] "
+                  "[--verify]\n");
+  return 2;
+}
+
+// ── sRGB ↔ Lab (D65) ────────────────────────────────────────
+float decodeSRGB(int v) {
+  float c = v / 255.0f;
+  return c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+}
+
+uint8_t encodeSRGB(float c) {
+  c = std::min(1.0f, std::max(0.0f, c));
+  float g = c <= 0.0031308f ? 12.92f * c : 1.055f * powf(c, 1 / 2.4f) - 0.055f;
+  return static_cast<uint8_t>(g * 255.0f + 0.5f);
+}
+
+void rgbToLab(const uint8_t *rgb, float &L, float &a, float &b) {
+  float r = decodeSRGB(rgb[0]), g = decodeSRGB(rgb[1]), bl = decodeSRGB(rgb[2]);
+  float X = 0.4124564f * r + 0.3575761f * g + 0.1804375f * bl;
+  float Y = 0.2126729f * r + 0.7151522f * g + 0.0721750f * bl;
+  float Z = 0.0193339f * r + 0.1191920f * g + 0.9503041f * bl;
+  ColorLab::fromXYZ(X, Y, Z, L, a, b);
+}
+
+void labToRgb(float L, float a, float b, uint8_t *rgb) {
+  auto finv = [](float t) {
+    return t > 6.0f / 29 ? t * t * t : 3 * (6.0f / 29) * (6.0f / 29) *
+                                           (t - 4.0f / 29);
+  };
+  float fy = (L + 16) / 116;
+  float X = 0.95047f * finv(fy + a / 500);
+  float Y = finv(fy);
+  float Z = 1.08883f * finv(fy - b / 200);
+  rgb[0] = encodeSRGB(3.2404542f * X - 1.5371385f * Y - 0.4985314f * Z);
+  rgb[1] = encodeSRGB(-0.9692660f * X + 1.8760108f * Y + 0.0415560f * Z);
+  rgb[2] = encodeSRGB(0.0556434f * X - 0.2040259f * Y + 1.0572252f * Z);
+}
+
+// ── CSV ─────────────────────────────────────────────────────
+// Splits one line into fields, honouring "quoted" fields
+std::vector<std::string> splitCsv(const char *line) {
+  std::vector<std::string> out;
+  std::string cur;
+  bool quoted = false;
+  for (const char *p = line; *p && *p != '\n' && *p != '\r'; p++) {
+    if (*p == '"') {
+      if (quoted && p[1] == '"') {
+        cur += '"';
+        p++;
+      } else {
+        quoted = !quoted;
+      }
+    } else if (*p == ',' && !quoted) {
+      out.push_back(cur);
+      cur.clear();
+    } else {
+      cur += *p;
+    }
+  }
+  out.push_back(cur);
+  return out;
+}
+
+bool parseHex(const std::string &s, uint8_t *rgb) {
+  const char *p = s.c_str();
+  if (*p == '#')
+    p++;
+  if (strlen(p) != 6 || strspn(p, "0123456789abcdefABCDEF") != 6)
+    return false;
+  unsigned long v = strtoul(p, nullptr, 16);
+  rgb[0] = (v >> 16) & 0xFF;
+  rgb[1] = (v >> 8) & 0xFF;
+  rgb[2] = v & 0xFF;
+  return true;
+}
+
+bool parseFloat(const std::string &s, float &v) {
+  char *end = nullptr;
+  v = strtof(s.c_str(), &end);
+  return end != s.c_str();
+}
+
+bool parseEntry(const std::vector<std::string> &f, Entry &e) {
+  if (f.size() < 2 || f[0].empty())
+    return false;
+  uint8_t rgb[3];
+  float L, a, b;
+  bool hasHex = parseHex(f[1], rgb);
+  size_t labAt = hasHex ? 2 : 1;
+  bool hasLab = f.size() >= labAt + 3 && parseFloat(f[labAt], L) &&
+                parseFloat(f[labAt + 1], a) && parseFloat(f[labAt + 2], b);
+  if (!hasHex && !hasLab)
+    return false; // header or malformed
+  if (!hasLab)
+    rgbToLab(rgb, L, a, b);
+  if (!hasHex)
+    labToRgb(L, a, b, rgb);
+
+  memset(&e.rec, 0, sizeof(e.rec));
+  ColorLab::LabQ q = ColorLab::fromFloat(L, a, b);
+  e.rec.lab[0] = q.L;
+  e.rec.lab[1] = q.a;
+  e.rec.lab[2] = q.b;
+  memcpy(e.rec.rgb, rgb, 3);
+  e.name = f[0];
+  return true;
+}
+
+// ── k-d tree layout ─────────────────────────────────────────
+int buildTree(std::vector<Entry> &v, size_t lo, size_t hi, int depth = 1) {
+  if (hi - lo <= 0)
+    return depth - 1;
+  int axis = 0, spread = -1;
+  for (int ax = 0; ax < 3; ax++) {
+    auto mm = std::minmax_element(
+        v.begin() + lo, v.begin() + hi, [ax](const Entry &x, const Entry &y) {
+          return x.rec.lab[ax] < y.rec.lab[ax];
+        });
+    int s = mm.second->rec.lab[ax] - mm.first->rec.lab[ax];
+    if (s > spread) {
+      spread = s;
+      axis = ax;
+    }
+  }
+  size_t mid = lo + (hi - lo) / 2;
+  std::nth_element(v.begin() + lo, v.begin() + mid, v.begin() + hi,
+                   [axis](const Entry &x, const Entry &y) {
+                     return x.rec.lab[axis] < y.rec.lab[axis];
+                   });
+  v[mid].rec.axis = static_cast<uint8_t>(axis);
+  int l = buildTree(v, lo, mid, depth + 1);
+  int r = buildTree(v, mid + 1, hi, depth + 1);
+  return std::max(std::max(l, r), depth);
+}
+
+// Brute-force reference: smallest ΔE00
+uint32_t bruteNearest(const std::vector<Entry> &v, const ColorLab::LabQ &q,
+                      uint16_t &de) {
+  uint32_t best = 0;
+  de = 0xFFFF;
+  for (size_t i = 0; i < v.size(); i++) {
+    ColorLab::LabQ p = {v[i].rec.lab[0], v[i].rec.lab[1], v[i].rec.lab[2]};
+    uint16_t d = ColorLab::deltaE2000(q, p);
+    if (d < de) {
+      de = d;
+      best = static_cast<uint32_t>(i);
+    }
+  }
+  return best;
+}
+
+int verify(const std::vector<uint8_t> &image, const std::vector<Entry> &v) {
+  PaletteDb &db = PaletteDb::instance();
+  if (!db.attach(image.data(), image.size()))
+    return 1;
+
+  int misses = 0;
+  PaletteDb::Match m;
+  for (size_t i = 0; i < v.size(); i++) {
+    ColorLab::LabQ q = {v[i].rec.lab[0], v[i].rec.lab[1], v[i].rec.lab[2]};
+    if (!db.nearest(q, m) || m.deltaE != 0)
+      misses++;
+  }
+
+  // Random queries: timing, and agreement with an exhaustive ΔE00 scan
+  std::mt19937 rng(1);
+  std::uniform_int_distribution<int> Ld(0, 10000), ab(-8000, 8000);
+  const int queries = 2000;
+  std::vector<ColorLab::LabQ> qs(queries);
+  for (auto &q : qs)
+    q = {(int16_t)Ld(rng), (int16_t)ab(rng), (int16_t)ab(rng)};
+
+  auto t0 = std::chrono::steady_clock::now();
+  uint32_t sink = 0;
+  for (auto &q : qs) {
+    db.nearest(q, m);
+    sink += m.index;
+  }
+  double us = std::chrono::duration<double, std::micro>(
+                  std::chrono::steady_clock::now() - t0)
+                  .count() /
+              queries;
+
+  int differ = 0, worse = 0;
+  for (int i = 0; i < queries; i++) {
+    uint16_t de;
+    bruteNearest(v, qs[i], de);
+    db.nearest(qs[i], m);
+    if (m.deltaE != de) {
+      differ++;
+      worse = std::max(worse, m.deltaE - de);
+    }
+  }
+  printf("[Palette] verify: %d/%zu self-lookups missed, %.2f us/lookup, "
+         "%d/%d random lookups off the exhaustive dE00 match "
+         "(worst +%.2f) (%u)\n",
+         misses, v.size(), us, differ, queries, worse * 0.01,
+         (unsigned)(sink & 1));
+  return misses || differ ? 1 : 0;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  if (argc < 3)
+    return usage();
+  const char *inPath = argv[1];
+  const char *outPath = argv[2];
+  std::string title = "palette";
+  bool doVerify = false;
+  for (int i = 3; i < argc; i++) {
+    if (!strcmp(argv[i], "--title") && i + 1 < argc)
+      title = argv[++i];
+    else if (!strcmp(argv[i], "--verify"))
+      doVerify = true;
+    else
+      return usage();
+  }
+
+  FILE *in = fopen(inPath, "r");
+  if (!in) {
+    fprintf(stderr, "[Palette] cannot open %s\n", inPath);
+    return 1;
+  }
+  std::vector<Entry> entries;
+  char line[1024];
+  int skipped = 0;
+  while (fgets(line, sizeof(line), in)) {
+    Entry e;
+    if (parseEntry(splitCsv(line), e))
+      entries.push_back(e);
+    else if (line[0] != '\n' && line[0] != '\r')
+      skipped++;
+  }
+  fclose(in);
+  if (entries.empty()) {
+    fprintf(stderr, "[Palette] no colors in %s\n", inPath);
+    return 1;
+  }
+
+  int depth = buildTree(entries, 0, entries.size());
+  if (depth + 2 > PaletteDb::MAX_DEPTH) {
+    fprintf(stderr, "[Palette] tree too deep (%d)\n", depth);
+    return 1;
+  }
+
+  // Header | records | names
+  using namespace PaletteFormat;
+  std::string names;
+  std::vector<uint8_t> image(sizeof(Header) + entries.size() * sizeof(Record));
+  for (size_t i = 0; i < entries.size(); i++) {
+    entries[i].rec.nameOffset = static_cast<uint32_t>(names.size());
+    names += entries[i].name;
+    names += '\0';
+    memcpy(&image[sizeof(Header) + i * sizeof(Record)], &entries[i].rec,
+           sizeof(Record));
+  }
+  image.insert(image.end(), names.begin(), names.end());
+
+  Header h;
+  memset(&h, 0, sizeof(h));
+  h.magic = MAGIC;
+  h.version = VERSION;
+  h.recordSize = sizeof(Record);
+  h.count = static_cast<uint32_t>(entries.size());
+  h.namesOffset = static_cast<uint32_t>(sizeof(Header) +
+                                        entries.size() * sizeof(Record));
+  h.namesSize = static_cast<uint32_t>(names.size());
+  strncpy(h.title, title.c_str(), sizeof(h.title) - 1);
+  h.crc = Crc32::update(0, image.data() + sizeof(Header),
+                        image.size() - sizeof(Header));
+  memcpy(image.data(), &h, sizeof(h));
+
+  FILE *out = fopen(outPath, "wb");
+  if (!out || fwrite(image.data(), 1, image.size(), out) != image.size()) {
+    fprintf(stderr, "[Palette] cannot write %s\n", outPath);
+    if (out)
+      fclose(out);
+    return 1;
+  }
+  fclose(out);
+  printf("[Palette] %zu colors (%d lines skipped), tree depth %d, "
+         "%zu bytes -> %s\n",
+         entries.size(), skipped, depth, image.size(), outPath);
+  if (image.size() > 0x100000)
+    printf("[Palette] WARNING: larger than the 1 MB palette partition\n");
+
+  return doVerify ? verify(image, entries) : 0;
+}
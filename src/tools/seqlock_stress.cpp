@@ -0,0 +1,134 @@
+// ============================================================
+// seqlock_stress.cpp – Host stress test: SeqLock<SpectralData>
+//
+//   pio run -e seqlock_stress
+//   .pio/build/seqlock_stress/program [writes]
+//
+// One producer publishes `writes` frames (default 2,000,000) as fast
+// as it can, as SensorManager::run() does at its frame rate; three
+// consumers read concurrently, two with read() as /api/live does,
+// one with readIfNewer() as the app loop and the WebSocket/BLE
+// pushes do. Frame n carries n in every field, so a consumer can
+// check each copy:
+//   - torn: fields from different writes in one copy
+//   - generation: read() must return the generation of the frame it
+//     copied (frame n is generation n) and never go backwards
+//   - readIfNewer(): copies only when the generation moved
+// Exits non-zero on any failure. On a multi-core host the threads
+// run in parallel, which is harsher than the single-core ESP32-C6.
+// ============================================================
+
+#include "seqlock.h"
+#include "spectral_types.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+
+namespace {
+
+constexpr int READERS = 3;
+
+using Clock = std::chrono::steady_clock;
+
+SeqLock<SpectralData> live;
+std::atomic<bool> done{false};
+
+void fill(SpectralData &d, uint32_t n) {
+  memset(&d, 0, sizeof(d));
+  for (int i = 0; i < Config::Sensor::NUM_CHANNELS; i++) {
+    d.raw[i] = static_cast<uint16_t>(n + i);
+    d.calibrated[i] = static_cast<float>(n & 0xFFFF);
+    d.stdError[i] = static_cast<float>(n & 0xFFFF);
+  }
+  for (int k = 0; k < Config::Sensor::SPECTRUM_BANDS; k++)
+    d.reflectance[k] = static_cast<uint16_t>(n - k);
+  d.r = d.g = d.b = static_cast<uint8_t>(n);
+  d.samples = static_cast<uint16_t>(n);
+  d.timestamp = n;
+  d.valid = true;
+}
+
+// True if every field agrees with the frame's timestamp
+bool consistent(const SpectralData &d) {
+  SpectralData want;
+  fill(want, d.timestamp);
+  return memcmp(&d, &want, sizeof(d)) == 0;
+}
+
+struct Result {
+  uint64_t reads = 0;
+  uint64_t skipped = 0; // readIfNewer() with nothing new
+  uint64_t torn = 0;
+  uint64_t badGeneration = 0;
+};
+
+void reader(Result &res) {
+  SpectralData d;
+  uint32_t last = 0;
+  while (!done.load(std::memory_order_relaxed)) {
+    uint32_t gen = live.read(d);
+    res.reads++;
+    res.torn += gen != 0 && !consistent(d);
+    res.badGeneration += gen < last || (gen != 0 && d.timestamp != gen);
+    last = gen;
+  }
+}
+
+void pollingReader(Result &res) {
+  SpectralData d;
+  uint32_t last = 0;
+  while (!done.load(std::memory_order_relaxed)) {
+    uint32_t before = last;
+    if (!live.readIfNewer(d, last)) {
+      res.skipped++;
+      res.badGeneration += last != before;
+      continue;
+    }
+    res.reads++;
+    res.torn += !consistent(d);
+    res.badGeneration += last <= before || d.timestamp != last;
+  }
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  const uint32_t writes = argc > 1 ? strtoul(argv[1], nullptr, 10) : 2000000;
+
+  Result res[READERS];
+  std::thread readers[READERS];
+  for (int i = 0; i < READERS; i++)
+    readers[i] = i == READERS - 1 ? std::thread(pollingReader, std::ref(res[i]))
+                                  : std::thread(reader, std::ref(res[i]));
+
+  Clock::time_point start = Clock::now();
+  SpectralData d;
+  for (uint32_t n = 1; n <= writes; n++) {
+    fill(d, n);
+    live.write(d);
+  }
+  double ms =
+      std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+  done = true;
+  for (std::thread &t : readers)
+    t.join();
+
+  bool ok = live.generation() == writes;
+  printf("[Stress] %u frames (%u B) in %.0f ms, %.0f ns/write\n", writes,
+         (unsigned)sizeof(SpectralData), ms, ms * 1e6 / writes);
+  for (int i = 0; i < READERS; i++) {
+    printf("[Stress]   %s %d: %llu reads, %llu skipped, %llu torn, "
+           "%llu bad generations\n",
+           i == READERS - 1 ? "readIfNewer" : "read       ", i,
+           (unsigned long long)res[i].reads,
+           (unsigned long long)res[i].skipped,
+           (unsigned long long)res[i].torn,
+           (unsigned long long)res[i].badGeneration);
+    ok = ok && res[i].reads > 0 && res[i].torn == 0 &&
+         res[i].badGeneration == 0;
+  }
+  printf("[Stress] %s\n", ok ? "ok" : "FAILED");
+  return ok ? 0 : 1;
+}